@@ -0,0 +1,718 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Abstract syntax tree for multi-pass compilation
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "error.h"
+#include "psa.h"
+
+#define AST_INITIAL_CAP 64
+
+/*
+ * Make room for one more item of the arena, capacity is doubled
+ */
+static bool reserve(void** items, uint32_t len, uint32_t* cap, size_t size, uint32_t needed)
+{
+    if (len + needed <= *cap)
+    {
+        return true;
+    }
+
+    uint32_t new_cap = *cap == 0 ? AST_INITIAL_CAP : *cap;
+
+    while (len + needed > new_cap)
+    {
+        if (new_cap > UINT32_MAX / 2)
+        {
+            err = E_INTERNAL;
+            return false;
+        }
+
+        new_cap *= 2;
+    }
+
+    void* tmp = realloc(*items, (size_t)new_cap * size);
+
+    if (tmp == NULL)
+    {
+        err = E_INTERNAL;
+        return false;
+    }
+
+    *items = tmp;
+    *cap = new_cap;
+
+    return true;
+}
+
+void ast_init(ast_t* ast)
+{
+    memset(ast, 0, sizeof(ast_t));
+
+    ast->first = AST_NONE;
+    ast->last = AST_NONE;
+    ast->function = AST_NONE;
+    ast->local = AST_NONE;
+}
+
+void ast_free(ast_t* ast)
+{
+    free(ast->nodes);
+    free(ast->chars);
+    free(ast->numbers);
+    free(ast->names);
+    free(ast->values);
+    free(ast->blocks);
+    free(ast->lines);
+
+    ast_init(ast);
+}
+
+uint64_t ast_size(const ast_t* ast)
+{
+    return (uint64_t)ast->nodes_cap * sizeof(ast_node_t) +
+           (uint64_t)ast->chars_cap +
+           (uint64_t)ast->numbers_cap * sizeof(double) +
+           (uint64_t)ast->names_cap * sizeof(uint32_t) +
+           (uint64_t)ast->values_cap * sizeof(uint32_t) +
+           (uint64_t)ast->blocks_cap * sizeof(ast_block_t) +
+           (uint64_t)ast->lines_cap * sizeof(uint32_t);
+}
+
+bool ast_track_lines(ast_t* ast)
+{
+    return reserve((void**)&ast->lines, ast->nodes_len, &ast->lines_cap, sizeof(uint32_t), 1);
+}
+
+void ast_set_line(ast_t* ast, uint32_t line)
+{
+    ast->line = line;
+}
+
+/********************* ARENAS **********************/
+
+static uint32_t new_node(ast_t* ast, ast_kind_t kind, data_type_t type)
+{
+    if (!reserve((void**)&ast->nodes, ast->nodes_len, &ast->nodes_cap, sizeof(ast_node_t), 1))
+    {
+        return AST_NONE;
+    }
+
+    if (ast->lines != NULL)
+    {
+        if (!reserve((void**)&ast->lines, ast->nodes_len, &ast->lines_cap, sizeof(uint32_t), 1))
+        {
+            return AST_NONE;
+        }
+
+        ast->lines[ast->nodes_len] = ast->line;
+    }
+
+    ast_node_t* node = AST_NODE(ast, ast->nodes_len);
+
+    node->kind = (uint8_t)kind;
+    node->type = (uint8_t)type;
+    node->flags = 0;
+    node->a = AST_NONE;
+    node->b = AST_NONE;
+    node->c = AST_NONE;
+    node->d = AST_NONE;
+    node->next = AST_NONE;
+
+    return ast->nodes_len++;
+}
+
+static uint32_t add_chars(ast_t* ast, const char* str)
+{
+    size_t len = strlen(str) + 1;
+
+    if (len > UINT32_MAX - ast->chars_len ||
+        !reserve((void**)&ast->chars, ast->chars_len, &ast->chars_cap, 1, (uint32_t)len))
+    {
+        err = E_INTERNAL;
+        return AST_NONE;
+    }
+
+    uint32_t offset = ast->chars_len;
+
+    memcpy(AST_CHARS(ast, offset), str, len);
+    ast->chars_len += (uint32_t)len;
+
+    return offset;
+}
+
+static uint32_t hash_name(const char* name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name != '\0'; name++)
+    {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * Double the hash table of names, it is at most half full
+ */
+static bool grow_names(ast_t* ast)
+{
+    uint32_t cap = ast->names_cap == 0 ? AST_INITIAL_CAP : ast->names_cap * 2;
+    uint32_t* names = calloc(cap, sizeof(uint32_t));
+
+    if (names == NULL)
+    {
+        err = E_INTERNAL;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ast->names_cap; i++)
+    {
+        if (ast->names[i] != 0)
+        {
+            uint32_t slot = hash_name(AST_CHARS(ast, ast->names[i] - 1)) & (cap - 1);
+
+            while (names[slot] != 0)
+            {
+                slot = (slot + 1) & (cap - 1);
+            }
+
+            names[slot] = ast->names[i];
+        }
+    }
+
+    free(ast->names);
+    ast->names = names;
+    ast->names_cap = cap;
+
+    return true;
+}
+
+/*
+ * Offset of the identifier, every name is stored once
+ */
+static uint32_t intern(ast_t* ast, const char* name)
+{
+    if ((ast->names_len + 1) * 2 > ast->names_cap && !grow_names(ast))
+    {
+        return AST_NONE;
+    }
+
+    uint32_t slot = hash_name(name) & (ast->names_cap - 1);
+
+    while (ast->names[slot] != 0)
+    {
+        if (strcmp(AST_CHARS(ast, ast->names[slot] - 1), name) == 0)
+        {
+            return ast->names[slot] - 1;
+        }
+
+        slot = (slot + 1) & (ast->names_cap - 1);
+    }
+
+    uint32_t offset = add_chars(ast, name);
+
+    if (offset != AST_NONE)
+    {
+        ast->names[slot] = offset + 1;
+        ast->names_len++;
+    }
+
+    return offset;
+}
+
+/****************** CONSTRUCTION *******************/
+
+static void push_value(ast_t* ast, uint32_t node)
+{
+    if (node == AST_NONE ||
+        !reserve((void**)&ast->values, ast->values_len, &ast->values_cap, sizeof(uint32_t), 1))
+    {
+        return;
+    }
+
+    ast->values[ast->values_len++] = node;
+}
+
+static uint32_t pop_value(ast_t* ast)
+{
+    if (ast->values_len == 0)
+    {
+        err = E_INTERNAL;
+        return AST_NONE;
+    }
+
+    return ast->values[--ast->values_len];
+}
+
+/*
+ * Chain all pending values into list, returns its first node
+ */
+static uint32_t take_values(ast_t* ast)
+{
+    uint32_t first = AST_NONE;
+
+    for (uint32_t i = ast->values_len; i > 0; i--)
+    {
+        AST_NODE(ast, ast->values[i - 1])->next = first;
+        first = ast->values[i - 1];
+    }
+
+    ast->values_len = 0;
+
+    return first;
+}
+
+static uint32_t* block_field(ast_t* ast, const ast_block_t* block)
+{
+    ast_node_t* owner = AST_NODE(ast, block->owner);
+
+    switch (block->field)
+    {
+    case 0:
+        return &owner->a;
+
+    case 1:
+        return &owner->b;
+
+    default:
+        return &owner->c;
+    }
+}
+
+/*
+ * Append statement to the innermost open list
+ */
+static void append(ast_t* ast, uint32_t node)
+{
+    if (node == AST_NONE)
+    {
+        return;
+    }
+
+    if (ast->blocks_len == 0)
+    {
+        if (ast->last == AST_NONE)
+        {
+            ast->first = node;
+        }
+        else
+        {
+            AST_NODE(ast, ast->last)->next = node;
+        }
+
+        ast->last = node;
+        return;
+    }
+
+    ast_block_t* block = &ast->blocks[ast->blocks_len - 1];
+
+    if (block->last == AST_NONE)
+    {
+        *block_field(ast, block) = node;
+    }
+    else
+    {
+        AST_NODE(ast, block->last)->next = node;
+    }
+
+    block->last = node;
+}
+
+static void open_block(ast_t* ast, uint32_t owner, uint8_t field)
+{
+    if (owner == AST_NONE ||
+        !reserve((void**)&ast->blocks, ast->blocks_len, &ast->blocks_cap, sizeof(ast_block_t), 1))
+    {
+        return;
+    }
+
+    ast->blocks[ast->blocks_len].owner = owner;
+    ast->blocks[ast->blocks_len].last = AST_NONE;
+    ast->blocks[ast->blocks_len].field = field;
+    ast->blocks_len++;
+}
+
+static uint32_t close_block(ast_t* ast)
+{
+    if (ast->blocks_len == 0)
+    {
+        err = E_INTERNAL;
+        return AST_NONE;
+    }
+
+    return ast->blocks[--ast->blocks_len].owner;
+}
+
+/*
+ * Values left since the previous statement (e.g. results of calls) are
+ * statements of their own, they are generated before the next statement
+ */
+static void flush(ast_t* ast)
+{
+    for (uint32_t i = 0; i < ast->values_len; i++)
+    {
+        AST_NODE(ast, ast->values[i])->next = AST_NONE;
+        append(ast, ast->values[i]);
+    }
+
+    ast->values_len = 0;
+}
+
+/*
+ * Append node at the end of the list starting in *first
+ */
+static void list_append(ast_t* ast, uint32_t* first, uint32_t node)
+{
+    while (*first != AST_NONE)
+    {
+        first = &AST_NODE(ast, *first)->next;
+    }
+
+    *first = node;
+}
+
+void ast_function(ast_t* ast, const char* name)
+{
+    flush(ast);
+
+    uint32_t offset = intern(ast, name);
+    uint32_t node = new_node(ast, AST_FUNCTION, NIL);
+
+    if (offset == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    append(ast, node);
+    open_block(ast, node, 2);
+
+    ast->function = node;
+}
+
+void ast_param(ast_t* ast, const char* name, data_type_t type)
+{
+    uint32_t offset = intern(ast, name);
+    uint32_t node = new_node(ast, AST_PARAM, type);
+
+    if (offset == AST_NONE || node == AST_NONE || ast->function == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    list_append(ast, &AST_NODE(ast, ast->function)->b, node);
+}
+
+void ast_return_type(ast_t* ast, data_type_t type)
+{
+    uint32_t node = new_node(ast, AST_TYPE, type);
+
+    if (node == AST_NONE || ast->function == AST_NONE)
+    {
+        return;
+    }
+
+    list_append(ast, &AST_NODE(ast, ast->function)->d, node);
+}
+
+void ast_function_end(ast_t* ast)
+{
+    flush(ast);
+    close_block(ast);
+
+    ast->function = AST_NONE;
+}
+
+void ast_local(ast_t* ast, const char* name, data_type_t type)
+{
+    flush(ast);
+
+    uint32_t offset = intern(ast, name);
+    uint32_t node = new_node(ast, AST_LOCAL, type);
+
+    if (offset == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    append(ast, node);
+
+    ast->local = node;
+}
+
+void ast_local_define(ast_t* ast)
+{
+    if (ast->local != AST_NONE)
+    {
+        AST_NODE(ast, ast->local)->flags |= AST_LOCAL_DEFINED;
+    }
+}
+
+void ast_local_init(ast_t* ast)
+{
+    if (ast->local != AST_NONE)
+    {
+        AST_NODE(ast, ast->local)->b = take_values(ast);
+    }
+}
+
+uint32_t ast_assign(ast_t* ast)
+{
+    uint32_t node = new_node(ast, AST_ASSIGN, NIL);
+
+    if (node == AST_NONE)
+    {
+        return AST_NONE;
+    }
+
+    AST_NODE(ast, node)->b = take_values(ast);
+    append(ast, node);
+
+    return node;
+}
+
+void ast_assign_target(ast_t* ast, uint32_t assign, const char* name, data_type_t type)
+{
+    uint32_t offset = intern(ast, name);
+    uint32_t node = new_node(ast, AST_VAR, type);
+
+    if (offset == AST_NONE || node == AST_NONE || assign == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    list_append(ast, &AST_NODE(ast, assign)->a, node);
+}
+
+void ast_return(ast_t* ast)
+{
+    uint32_t node = new_node(ast, AST_RETURN, NIL);
+
+    if (node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->b = take_values(ast);
+    append(ast, node);
+}
+
+void ast_if(ast_t* ast)
+{
+    uint32_t node = new_node(ast, AST_IF, NIL);
+
+    if (node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = take_values(ast);
+    append(ast, node);
+    open_block(ast, node, 1);
+}
+
+void ast_else(ast_t* ast)
+{
+    flush(ast);
+    open_block(ast, close_block(ast), 2);
+}
+
+void ast_if_end(ast_t* ast)
+{
+    flush(ast);
+    close_block(ast);
+}
+
+void ast_while(ast_t* ast)
+{
+    flush(ast);
+
+    uint32_t node = new_node(ast, AST_WHILE, NIL);
+
+    if (node == AST_NONE)
+    {
+        return;
+    }
+
+    append(ast, node);
+
+    // condition is pending until ast_while_do, body goes to b then
+    open_block(ast, node, 1);
+}
+
+void ast_while_do(ast_t* ast)
+{
+    if (ast->blocks_len == 0)
+    {
+        err = E_INTERNAL;
+        return;
+    }
+
+    AST_NODE(ast, ast->blocks[ast->blocks_len - 1].owner)->a = take_values(ast);
+}
+
+void ast_while_end(ast_t* ast)
+{
+    flush(ast);
+    close_block(ast);
+}
+
+void ast_call(ast_t* ast, const char* name, unsigned params)
+{
+    uint32_t offset = intern(ast, name);
+    uint32_t node = new_node(ast, AST_CALL, NIL);
+
+    if (offset == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    AST_NODE(ast, node)->b = take_values(ast);
+    AST_NODE(ast, node)->d = params;
+
+    push_value(ast, node);
+}
+
+void ast_statement(ast_t* ast)
+{
+    flush(ast);
+}
+
+void ast_push_var(ast_t* ast, const char* name, data_type_t type)
+{
+    uint32_t offset = intern(ast, name);
+    uint32_t node = new_node(ast, AST_VAR, type);
+
+    if (offset == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    push_value(ast, node);
+}
+
+void ast_push_int(ast_t* ast, int value)
+{
+    uint32_t node = new_node(ast, AST_INT, INT);
+
+    if (node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = (uint32_t)value;
+    push_value(ast, node);
+}
+
+void ast_push_number(ast_t* ast, double value)
+{
+    if (!reserve((void**)&ast->numbers, ast->numbers_len, &ast->numbers_cap, sizeof(double), 1))
+    {
+        return;
+    }
+
+    uint32_t node = new_node(ast, AST_NUMBER, NUMBER);
+
+    if (node == AST_NONE)
+    {
+        return;
+    }
+
+    ast->numbers[ast->numbers_len] = value;
+    AST_NODE(ast, node)->a = ast->numbers_len++;
+    push_value(ast, node);
+}
+
+void ast_push_string(ast_t* ast, const char* value)
+{
+    uint32_t offset = add_chars(ast, value);
+    uint32_t node = new_node(ast, AST_STRING, STR);
+
+    if (offset == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = offset;
+    push_value(ast, node);
+}
+
+void ast_push_nil(ast_t* ast)
+{
+    push_value(ast, new_node(ast, AST_NIL, NIL));
+}
+
+void ast_int_to_float(ast_t* ast, bool left, bool right)
+{
+    if (ast->values_len < 2)
+    {
+        err = E_INTERNAL;
+        return;
+    }
+
+    if (left)
+    {
+        AST_NODE(ast, ast->values[ast->values_len - 2])->flags |= AST_TO_NUMBER;
+    }
+
+    if (right)
+    {
+        AST_NODE(ast, ast->values[ast->values_len - 1])->flags |= AST_TO_NUMBER;
+    }
+}
+
+void ast_operation(ast_t* ast, unsigned rule, data_type_t type)
+{
+    uint32_t right = rule == NT_HASHTAG ? AST_NONE : pop_value(ast);
+    uint32_t left = pop_value(ast);
+    uint32_t node = new_node(ast, AST_OPERATION, type);
+
+    if (left == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->flags = (uint16_t)(rule & AST_RULE_MASK);
+    AST_NODE(ast, node)->a = left;
+    AST_NODE(ast, node)->b = right;
+    push_value(ast, node);
+}
+
+void ast_to_bool(ast_t* ast)
+{
+    uint32_t operand = pop_value(ast);
+    uint32_t node = new_node(ast, AST_TO_BOOL, NIL);
+
+    if (operand == AST_NONE || node == AST_NONE)
+    {
+        return;
+    }
+
+    AST_NODE(ast, node)->a = operand;
+    push_value(ast, node);
+}
+
+/****************** TRANSFORMATION *****************/
+
+uint32_t ast_new_node(ast_t* ast, ast_kind_t kind, data_type_t type)
+{
+    return new_node(ast, kind, type);
+}
+
+uint32_t ast_intern(ast_t* ast, const char* name)
+{
+    return intern(ast, name);
+}
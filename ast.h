@@ -0,0 +1,470 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Abstract syntax tree for multi-pass compilation
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_AST_H
+#define IFJ_BRATWURST2021_AST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "data_types.h"
+
+/**
+ * Index of no node (end of list, missing child).
+ */
+#define AST_NONE UINT32_MAX
+
+/**
+ * @enum Kinds of nodes. Lists (statements, arguments, ...) are chained
+ *       through the next index of their nodes.
+ */
+typedef enum ast_kind
+{
+    AST_FUNCTION,   // a name, b first PARAM, c first statement, d first TYPE of returns
+    AST_PARAM,      // a name, type
+    AST_TYPE,       // type
+    AST_LOCAL,      // a name, type, b first value of initialization, flags AST_LOCAL_DEFINED
+    AST_ASSIGN,     // a first target VAR, b first value (AST_NONE when no target is read)
+    AST_RETURN,     // b first value
+    AST_IF,         // a first value of condition, b first statement of then, c of else
+    AST_WHILE,      // a first value of condition, b first statement of body
+    AST_CALL,       // a name, b first argument in push order (last one first), d parameters passed
+    AST_VAR,        // a name, type
+    AST_INT,        // a value
+    AST_NUMBER,     // a index to numbers
+    AST_STRING,     // a offset of the literal
+    AST_NIL,
+    AST_OPERATION,  // flags rule of psa, a left (or only) operand, b right operand, type of result,
+                    // c operation with the same value (AST_REUSE)
+    AST_TO_BOOL     // a value used as condition
+} ast_kind_t;
+
+/*
+ * Flags of nodes
+ */
+#define AST_RULE_MASK       0x00ff  // psa rule of AST_OPERATION
+#define AST_LOCAL_DEFINED   0x0100  // local without value is defined (nil)
+#define AST_TO_NUMBER       0x0200  // integer operand is converted by its operation
+#define AST_INVARIANT       0x0400  // operation of loop condition is computed before the loop
+#define AST_LOCAL_COPY      0x0800  // local is moved from its value without nil (inlined parameter)
+#define AST_SAVED           0x1000  // value of operation is kept for its later uses
+#define AST_REUSE           0x2000  // operation has the kept value of the operation c
+#define AST_DEAD            0x4000  // assigned value is not read: target VAR throws it away,
+                                    // LOCAL evaluates only its calls and failing operations
+
+/**
+ * @struct Node of the tree. Names and literals are offsets to chars,
+ *         equal identifiers have equal offsets.
+ */
+typedef struct ast_node
+{
+    uint8_t kind;       /// ast_kind_t
+    uint8_t type;       /// data_type_t of the value or declared type
+    uint16_t flags;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+    uint32_t next;      /// Next node of the list or AST_NONE.
+} ast_node_t;
+
+/**
+ * @struct Open list of statements during construction.
+ */
+typedef struct ast_block
+{
+    uint32_t owner;     /// Node with the list.
+    uint32_t last;      /// Last statement or AST_NONE.
+    uint8_t field;      /// Child of the owner holding the list (0 a, 1 b, 2 c).
+} ast_block_t;
+
+/**
+ * @struct Whole program. Nodes, characters and numbers are arenas which
+ *         only grow and are released at once.
+ */
+typedef struct ast
+{
+    ast_node_t* nodes;
+    uint32_t nodes_len;
+    uint32_t nodes_cap;
+
+    char* chars;
+    uint32_t chars_len;
+    uint32_t chars_cap;
+
+    double* numbers;
+    uint32_t numbers_len;
+    uint32_t numbers_cap;
+
+    uint32_t* names;     /// Hash table of identifiers (offset + 1, 0 is free).
+    uint32_t names_len;
+    uint32_t names_cap;
+
+    uint32_t first;      /// First top level node (FUNCTION or CALL).
+    uint32_t last;       /// Last top level node.
+
+    uint32_t* lines;     /// Source line of every node, NULL unless tracked.
+    uint32_t lines_cap;
+    uint32_t line;       /// Source line of nodes added now.
+
+    /* Construction state */
+    uint32_t* values;    /// Values which are not part of any node yet.
+    uint32_t values_len;
+    uint32_t values_cap;
+
+    ast_block_t* blocks; /// Open statement lists, innermost last, none at top level.
+    uint32_t blocks_len;
+    uint32_t blocks_cap;
+
+    uint32_t function;   /// Function being built.
+    uint32_t local;      /// Last local variable.
+} ast_t;
+
+/**
+ * Node of the tree.
+ *
+ * @param ast Pointer to tree.
+ * @param index Index of node.
+ * @return Pointer to node, valid until next node is added.
+ */
+#define AST_NODE(ast, index) (&(ast)->nodes[(index)])
+
+/**
+ * Name or string literal of the tree.
+ *
+ * @param ast Pointer to tree.
+ * @param offset Offset of the string.
+ * @return Pointer to string, valid until next string is added.
+ */
+#define AST_CHARS(ast, offset) (&(ast)->chars[(offset)])
+
+/**
+ * Source line of the node.
+ *
+ * @param ast Pointer to tree.
+ * @param index Index of node.
+ * @return Line or 0 when lines are not tracked.
+ */
+#define AST_LINE(ast, index) ((ast)->lines != NULL ? (ast)->lines[(index)] : 0)
+
+/**
+ * Initialization of an empty tree, top level is the open list.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_init(ast_t* ast);
+
+/**
+ * Release all memory of the tree.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_free(ast_t* ast);
+
+/**
+ * Size of memory held by the tree in bytes.
+ *
+ * @param ast Pointer to tree.
+ * @return Capacity of all arenas.
+ */
+uint64_t ast_size(const ast_t* ast);
+
+/**
+ * Remember source line of every node added from now on (for the source map).
+ *
+ * @param ast Pointer to empty tree.
+ * @return True on success.
+ */
+bool ast_track_lines(ast_t* ast);
+
+/**
+ * Source line of the following nodes, ignored unless lines are tracked.
+ *
+ * @param ast Pointer to tree.
+ * @param line Line of the statement being parsed.
+ */
+void ast_set_line(ast_t* ast, uint32_t line);
+
+/*
+ * Construction. Parser calls these functions in the order in which the
+ * single pass compiler generates code. Expressions are built from values
+ * pushed in postfix order, statements take values which are pending since
+ * the previous statement. Errors set err to E_INTERNAL.
+ */
+
+/**
+ * Start function definition, following statements are its body.
+ *
+ * @param ast Pointer to tree.
+ * @param name Name of function.
+ */
+void ast_function(ast_t* ast, const char* name);
+
+/**
+ * Add parameter to the function being built.
+ *
+ * @param ast Pointer to tree.
+ * @param name Name of parameter.
+ * @param type Type of parameter.
+ */
+void ast_param(ast_t* ast, const char* name, data_type_t type);
+
+/**
+ * Add return type to the function being built.
+ *
+ * @param ast Pointer to tree.
+ * @param type Return type.
+ */
+void ast_return_type(ast_t* ast, data_type_t type);
+
+/**
+ * End of function body.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_function_end(ast_t* ast);
+
+/**
+ * Declaration of local variable (local id : type).
+ *
+ * @param ast Pointer to tree.
+ * @param name Name of variable.
+ * @param type Declared type.
+ */
+void ast_local(ast_t* ast, const char* name, data_type_t type);
+
+/**
+ * Last local variable is declared without value.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_local_define(ast_t* ast);
+
+/**
+ * Pending value initializes the last local variable.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_local_init(ast_t* ast);
+
+/**
+ * Assignment of pending values, targets are added by ast_assign_target.
+ *
+ * @param ast Pointer to tree.
+ * @return Index of assignment or AST_NONE.
+ */
+uint32_t ast_assign(ast_t* ast);
+
+/**
+ * Add target of assignment.
+ *
+ * @param ast Pointer to tree.
+ * @param assign Index of assignment.
+ * @param name Name of variable.
+ * @param type Type of variable.
+ */
+void ast_assign_target(ast_t* ast, uint32_t assign, const char* name, data_type_t type);
+
+/**
+ * Return of pending values.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_return(ast_t* ast);
+
+/**
+ * Pending value is condition of if, following statements are then branch.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_if(ast_t* ast);
+
+/**
+ * Following statements are else branch.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_else(ast_t* ast);
+
+/**
+ * End of if statement.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_if_end(ast_t* ast);
+
+/**
+ * Start of while statement, condition follows.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_while(ast_t* ast);
+
+/**
+ * Pending value is condition of while, following statements are body.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_while_do(ast_t* ast);
+
+/**
+ * End of while statement.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_while_end(ast_t* ast);
+
+/**
+ * Call of function with pending arguments, result is pending value.
+ *
+ * @param ast Pointer to tree.
+ * @param name Name of function.
+ * @param params Count of parameters passed to function.
+ */
+void ast_call(ast_t* ast, const char* name, unsigned params);
+
+/**
+ * Pending values (e.g. call) are statements.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_statement(ast_t* ast);
+
+/**
+ * Push variable.
+ *
+ * @param ast Pointer to tree.
+ * @param name Name of variable.
+ * @param type Type of variable.
+ */
+void ast_push_var(ast_t* ast, const char* name, data_type_t type);
+
+/**
+ * Push integer constant.
+ *
+ * @param ast Pointer to tree.
+ * @param value Value.
+ */
+void ast_push_int(ast_t* ast, int value);
+
+/**
+ * Push number constant.
+ *
+ * @param ast Pointer to tree.
+ * @param value Value.
+ */
+void ast_push_number(ast_t* ast, double value);
+
+/**
+ * Push string constant.
+ *
+ * @param ast Pointer to tree.
+ * @param value Value as written in source (with escape sequences).
+ */
+void ast_push_string(ast_t* ast, const char* value);
+
+/**
+ * Push nil.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_push_nil(ast_t* ast);
+
+/**
+ * Mark integer operands of the following operation for conversion.
+ *
+ * @param ast Pointer to tree.
+ * @param left Left operand is converted.
+ * @param right Right operand is converted.
+ */
+void ast_int_to_float(ast_t* ast, bool left, bool right);
+
+/**
+ * Replace top operands by operation.
+ *
+ * @param ast Pointer to tree.
+ * @param rule Rule of psa (NT_HASHTAG has one operand).
+ * @param type Type of result.
+ */
+void ast_operation(ast_t* ast, unsigned rule, data_type_t type);
+
+/**
+ * Top value is converted to condition.
+ *
+ * @param ast Pointer to tree.
+ */
+void ast_to_bool(ast_t* ast);
+
+/*
+ * Transformation. Optimization passes add nodes and names to the arenas,
+ * pointers to nodes and characters are not valid after these functions.
+ */
+
+/**
+ * New node which is not part of any list yet.
+ *
+ * @param ast Pointer to tree.
+ * @param kind Kind of node.
+ * @param type Type of node.
+ * @return Index of node or AST_NONE (err is set).
+ */
+uint32_t ast_new_node(ast_t* ast, ast_kind_t kind, data_type_t type);
+
+/**
+ * Offset of the identifier, equal names have equal offsets.
+ *
+ * @param ast Pointer to tree.
+ * @param name Identifier.
+ * @return Offset of the name or AST_NONE (err is set).
+ */
+uint32_t ast_intern(ast_t* ast, const char* name);
+
+/**
+ * Optimization of the tree before the code generation. Level 1 reuses
+ * values of equal operations within straight line code, computes loop
+ * invariant operations of while conditions before the loop and removes
+ * assignments and locals which are never read, level 2 also inlines calls
+ * of small functions which call no user function.
+ *
+ * @param ast Pointer to tree.
+ * @param level Optimization level (-O), 0 keeps the tree.
+ */
+void ast_optimize(ast_t* ast, unsigned level);
+
+/**
+ * @struct Options of the code generation from the tree.
+ */
+typedef struct ast_gen_options
+{
+    unsigned jobs;      /// Count of generating threads, 1 generates serially.
+    bool temps;         /// Expressions are evaluated in frame temporaries.
+} ast_gen_options_t;
+
+/**
+ * Generate IFJcode21 of the whole program through the code generator.
+ * Without temps the output is identical to the single pass compilation.
+ * With more jobs the top level functions are generated on a pool of
+ * threads and written in source order.
+ *
+ * @param ast Pointer to tree.
+ * @param options Options of the generation.
+ */
+void ast_generate(ast_t* ast, const ast_gen_options_t* options);
+
+/**
+ * Translate the program to C11 for the runtime of csrc.h (csrc_rt.c).
+ * Declared integer and number variables, parameters and results are
+ * unboxed when every value assigned to them has exactly the declared type.
+ *
+ * @param file Output of the C source.
+ * @param ast Pointer to tree.
+ * @return True on success, false otherwise (err is set).
+ */
+bool csrc_generate(FILE* file, ast_t* ast);
+
+#endif //IFJ_BRATWURST2021_AST_H
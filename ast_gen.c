@@ -0,0 +1,1284 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Code generation pass over the abstract syntax tree
+ *
+ */
+
+#include <stdlib.h>
+#include <threads.h>
+
+#include "ast.h"
+#include "code_generator.h"
+#include "stats.h"
+
+/*
+ * Count of units one thread may generate ahead of the written unit
+ */
+#define UNITS_AHEAD 16
+
+/*
+ * Expressions are evaluated in frame temporaries (--temps)
+ */
+static bool temps = false;
+
+/*
+ * Slots of temporaries of the current statement, in dry run only the
+ * count of slots needed by a function is found
+ */
+static _Thread_local int temps_top = 0;
+static _Thread_local int temps_peak = 0;
+static _Thread_local bool temps_dry = false;
+
+static void gen_values(ast_t* ast, uint32_t first);
+static void gen_stats(ast_t* ast, uint32_t first);
+
+/*
+ * ----------------------TEMPORARIES-----------------------
+ */
+
+static int temp_alloc()
+{
+    int slot = temps_top++;
+
+    if (temps_top > temps_peak)
+    {
+        temps_peak = temps_top;
+    }
+
+    return slot;
+}
+
+/*
+ * Integer operand is converted to number, constants at compile time
+ */
+static void gen_to_number(codeGen_operand_t* value, unsigned label)
+{
+    if (value->kind == OPERAND_INT)
+    {
+        value->kind = OPERAND_FLOAT;
+        value->number = value->integer;
+        return;
+    }
+
+    if (value->kind == OPERAND_NIL)
+    {
+        return;
+    }
+
+    // temporary of operation is converted in place
+    int slot = value->kind == OPERAND_TEMP ? value->slot : temp_alloc();
+
+    if (!temps_dry)
+    {
+        codeGen_temps_int_to_float(slot, value, label);
+    }
+
+    value->kind = OPERAND_TEMP;
+    value->slot = slot;
+}
+
+static codeGen_operand_t gen_operand(ast_t* ast, uint32_t index);
+
+/*
+ * Operands of operation are checked for nil and converted, their slots
+ * are released for the result
+ */
+static void gen_operation_operands(ast_t* ast, uint32_t index, codeGen_operand_t* left, codeGen_operand_t* right)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+    psa_rules_enum rule = node->flags & AST_RULE_MASK;
+    bool binary = node->b != AST_NONE;
+    int base = temps_top;
+
+    *left = gen_operand(ast, node->a);
+    *right = (codeGen_operand_t){.kind = OPERAND_NIL};
+
+    if (binary)
+    {
+        *right = gen_operand(ast, node->b);
+    }
+
+    // equality is defined for nil, operands of other operations are checked
+    if (rule != NT_EQ_NT && rule != NT_NEQ_NT)
+    {
+        if (binary && !temps_dry)
+        {
+            codeGen_temps_check_nil(right);
+        }
+
+        if (!temps_dry)
+        {
+            codeGen_temps_check_nil(left);
+        }
+
+        left->maybeNil = false;
+        right->maybeNil = false;
+    }
+
+    if (binary && (AST_NODE(ast, node->b)->flags & AST_TO_NUMBER))
+    {
+        gen_to_number(right, index * 2);
+    }
+
+    if (binary && (AST_NODE(ast, node->a)->flags & AST_TO_NUMBER))
+    {
+        gen_to_number(left, index * 2 + 1);
+    }
+
+    temps_top = base;
+}
+
+/*
+ * Intervals of temporaries of an expression tree nest, so the linear scan
+ * allocation reduces to a stack: operands are released before the result
+ * is allocated and the result reuses the first of their slots.
+ */
+static codeGen_operand_t gen_operation(ast_t* ast, uint32_t index, const codeGen_operand_t* target)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+    codeGen_operand_t left;
+    codeGen_operand_t right;
+
+    gen_operation_operands(ast, index, &left, &right);
+
+    // result of assigned expression goes right to the variable
+    codeGen_operand_t result = {.kind = OPERAND_TEMP, .maybeNil = false};
+
+    if (target != NULL)
+    {
+        result = *target;
+    }
+    else
+    {
+        result.slot = temp_alloc();
+    }
+
+    if (!temps_dry)
+    {
+        codeGen_temps_operation(node->flags & AST_RULE_MASK, &result, &left,
+                                node->b != AST_NONE ? &right : NULL);
+    }
+
+    return result;
+}
+
+/*
+ * Value kept by the optimized tree, loop invariant computed before the
+ * loop or common subexpression
+ */
+static codeGen_operand_t invariant_operand(uint32_t index)
+{
+    codeGen_operand_t value = {.kind = OPERAND_INVARIANT, .maybeNil = false, .slot = (int)index};
+
+    return value;
+}
+
+/*
+ * Operand with value of expression (anything but call)
+ */
+static codeGen_operand_t gen_operand(ast_t* ast, uint32_t index)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+    codeGen_operand_t value = {.kind = OPERAND_NIL, .maybeNil = true};
+
+    if (node->flags & AST_INVARIANT)
+    {
+        return invariant_operand(index);
+    }
+
+    if (node->flags & AST_REUSE)
+    {
+        return invariant_operand(node->c);
+    }
+
+    switch (node->kind)
+    {
+    case AST_VAR:
+        value.kind = OPERAND_VAR;
+        value.name = AST_CHARS(ast, node->a);
+        break;
+
+    case AST_INT:
+        value.kind = OPERAND_INT;
+        value.maybeNil = false;
+        value.integer = (int)node->a;
+        break;
+
+    case AST_NUMBER:
+        value.kind = OPERAND_FLOAT;
+        value.maybeNil = false;
+        value.number = ast->numbers[node->a];
+        break;
+
+    case AST_STRING:
+        value.kind = OPERAND_STRING;
+        value.maybeNil = false;
+        value.name = AST_CHARS(ast, node->a);
+        break;
+
+    case AST_OPERATION:
+        if (node->flags & AST_SAVED)
+        {
+            codeGen_operand_t saved = invariant_operand(index);
+
+            value = gen_operation(ast, index, &saved);
+            break;
+        }
+
+        value = gen_operation(ast, index, NULL);
+        break;
+
+    default:
+        break;
+    }
+
+    return value;
+}
+
+/*
+ * Single value which is not a call is evaluated to an operand
+ */
+static bool is_operand(ast_t* ast, uint32_t first)
+{
+    return temps && first != AST_NONE && AST_NODE(ast, first)->next == AST_NONE &&
+           AST_NODE(ast, first)->kind != AST_CALL;
+}
+
+/*
+ * Rule of the condition compared by the branch, see codeGen_if_start
+ */
+static psa_rules_enum condition_rule(ast_t* ast, uint32_t index)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+    psa_rules_enum rule = node->flags & AST_RULE_MASK;
+
+    if (node->kind == AST_TO_BOOL)
+    {
+        return OPERAND;
+    }
+
+    if (node->kind == AST_OPERATION && rule >= NT_EQ_NT && rule <= NT_GTN_NT)
+    {
+        return rule;
+    }
+
+    return NOT_A_RULE;
+}
+
+/*
+ * Condition is evaluated up to the operands compared by the branch
+ */
+static psa_rules_enum gen_condition_operands(ast_t* ast, uint32_t index, codeGen_operand_t* left, codeGen_operand_t* right)
+{
+    psa_rules_enum rule = condition_rule(ast, index);
+
+    *right = (codeGen_operand_t){.kind = OPERAND_NIL};
+
+    if (rule == OPERAND)
+    {
+        *left = gen_operand(ast, AST_NODE(ast, index)->a);
+    }
+    else if (rule != NOT_A_RULE)
+    {
+        gen_operation_operands(ast, index, left, right);
+    }
+    else
+    {
+        *left = gen_operand(ast, index);
+    }
+
+    return rule;
+}
+
+static void count_temps_values(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        if (AST_NODE(ast, index)->kind == AST_CALL)
+        {
+            count_temps_values(ast, AST_NODE(ast, index)->b);
+        }
+        else
+        {
+            temps_top = 0;
+            gen_operand(ast, index);
+        }
+    }
+}
+
+/*
+ * Call the function for loop invariants of the condition in the order of
+ * evaluation
+ */
+static void each_invariant(ast_t* ast, uint32_t index, void (*function)(ast_t*, uint32_t))
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    if (node->flags & AST_INVARIANT)
+    {
+        function(ast, index);
+        return;
+    }
+
+    if (node->kind == AST_OPERATION || node->kind == AST_TO_BOOL)
+    {
+        each_invariant(ast, node->a, function);
+    }
+
+    if (node->kind == AST_OPERATION && node->b != AST_NONE)
+    {
+        each_invariant(ast, node->b, function);
+    }
+}
+
+/*
+ * Loop invariant is computed right to its variable
+ */
+static void temps_invariant(ast_t* ast, uint32_t index)
+{
+    codeGen_operand_t target = invariant_operand(index);
+
+    temps_top = 0;
+    gen_operation(ast, index, &target);
+    temps_top = 0;
+}
+
+static void count_temps_condition(ast_t* ast, uint32_t first)
+{
+    codeGen_operand_t left;
+    codeGen_operand_t right;
+
+    each_invariant(ast, first, temps_invariant);
+
+    if (is_operand(ast, first))
+    {
+        temps_top = 0;
+        gen_condition_operands(ast, first, &left, &right);
+    }
+    else
+    {
+        count_temps_values(ast, first);
+    }
+}
+
+static void count_temps_stats(ast_t* ast, uint32_t first)
+{
+    // kind of the result is enough for the dry run
+    const codeGen_operand_t assigned = {.kind = OPERAND_TARGET};
+
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+
+        switch (node->kind)
+        {
+        case AST_LOCAL:
+        case AST_ASSIGN:
+            // assigned operation does not need a slot for its result
+            if (is_operand(ast, node->b) && AST_NODE(ast, node->b)->kind == AST_OPERATION &&
+                !(AST_NODE(ast, node->kind == AST_LOCAL ? index : node->a)->flags & AST_DEAD) &&
+                (node->kind == AST_LOCAL || AST_NODE(ast, node->a)->next == AST_NONE))
+            {
+                temps_top = 0;
+                gen_operation(ast, node->b, &assigned);
+                break;
+            }
+
+            count_temps_values(ast, node->b);
+            break;
+
+        case AST_RETURN:
+            count_temps_values(ast, node->b);
+            break;
+
+        case AST_IF:
+            count_temps_condition(ast, node->a);
+            count_temps_stats(ast, node->b);
+            count_temps_stats(ast, node->c);
+            break;
+
+        case AST_WHILE:
+            count_temps_condition(ast, node->a);
+            count_temps_stats(ast, node->b);
+            break;
+
+        default:
+            count_temps_values(ast, index);
+            break;
+        }
+    }
+}
+
+/*
+ * Count of slots used by statements, dry run of the allocation
+ */
+static int count_temps(ast_t* ast, uint32_t first)
+{
+    temps_dry = true;
+    temps_peak = 0;
+    count_temps_stats(ast, first);
+    temps_dry = false;
+    temps_top = 0;
+
+    return temps_peak;
+}
+
+/*
+ * ----------------------GENERATION-----------------------
+ */
+
+static void gen_value(ast_t* ast, uint32_t index);
+
+/*
+ * Operands of operation are pushed and converted
+ */
+static void gen_operands(ast_t* ast, ast_node_t* node)
+{
+    gen_value(ast, node->a);
+
+    if (node->b != AST_NONE)
+    {
+        gen_value(ast, node->b);
+
+        // right operand is on top of the stack
+        if (AST_NODE(ast, node->b)->flags & AST_TO_NUMBER)
+        {
+            generate_IntToFloat1();
+        }
+
+        if (AST_NODE(ast, node->a)->flags & AST_TO_NUMBER)
+        {
+            generate_IntToFloat2();
+        }
+    }
+}
+
+static void gen_value(ast_t* ast, uint32_t index)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    if (node->flags & (AST_INVARIANT | AST_REUSE))
+    {
+        codeGen_operand_t value = invariant_operand(node->flags & AST_REUSE ? node->c : index);
+
+        codeGen_push_operand(&value);
+        return;
+    }
+
+    switch (node->kind)
+    {
+    case AST_VAR:
+        codeGen_push_var(AST_CHARS(ast, node->a));
+        break;
+
+    case AST_INT:
+        codeGen_push_int((int)node->a);
+        break;
+
+    case AST_NUMBER:
+        codeGen_push_float(ast->numbers[node->a]);
+        break;
+
+    case AST_STRING:
+        codeGen_push_string(AST_CHARS(ast, node->a));
+        break;
+
+    case AST_NIL:
+        codeGen_push_nil();
+        break;
+
+    case AST_CALL:
+        gen_values(ast, node->b);
+        codeGen_function_call(AST_CHARS(ast, node->a), node->d);
+        break;
+
+    case AST_OPERATION:
+        if (temps)
+        {
+            int base = temps_top;
+            codeGen_operand_t value = gen_operand(ast, index);
+
+            codeGen_push_operand(&value);
+            temps_top = base;
+            break;
+        }
+
+        gen_operands(ast, node);
+        generate_operation(node->flags & AST_RULE_MASK);
+
+        // value stays on the stack for this use
+        if (node->flags & AST_SAVED)
+        {
+            codeGen_operand_t value = invariant_operand(index);
+
+            codeGen_pop_operand(&value);
+            codeGen_push_operand(&value);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void gen_values(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        gen_value(ast, index);
+    }
+}
+
+/*
+ * Condition is evaluated up to the operands compared by the branch
+ */
+static psa_rules_enum gen_condition(ast_t* ast, uint32_t first)
+{
+    psa_rules_enum rule = condition_rule(ast, first);
+
+    if (rule == OPERAND)
+    {
+        gen_value(ast, AST_NODE(ast, first)->a);
+    }
+    else if (rule != NOT_A_RULE)
+    {
+        gen_operands(ast, AST_NODE(ast, first));
+    }
+    else
+    {
+        gen_values(ast, first);
+    }
+
+    return rule;
+}
+
+/*
+ * Loop invariant is computed before the loop
+ */
+static void gen_invariant(ast_t* ast, uint32_t index)
+{
+    codeGen_operand_t value = invariant_operand(index);
+
+    if (temps)
+    {
+        temps_invariant(ast, index);
+        return;
+    }
+
+    gen_operands(ast, AST_NODE(ast, index));
+    generate_operation(AST_NODE(ast, index)->flags & AST_RULE_MASK);
+    codeGen_pop_operand(&value);
+}
+
+/*
+ * Variables of values kept in the frame of the subtree
+ */
+static void declare_kept(ast_t* ast, uint32_t index)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    if (node->flags & (AST_INVARIANT | AST_SAVED))
+    {
+        codeGen_invariant_declare((int)index);
+    }
+
+    if (node->kind == AST_CALL)
+    {
+        for (uint32_t arg = node->b; arg != AST_NONE; arg = AST_NODE(ast, arg)->next)
+        {
+            declare_kept(ast, arg);
+        }
+    }
+
+    if ((node->kind == AST_OPERATION && !(node->flags & AST_REUSE)) || node->kind == AST_TO_BOOL)
+    {
+        declare_kept(ast, node->a);
+    }
+
+    if (node->kind == AST_OPERATION && !(node->flags & AST_REUSE) && node->b != AST_NONE)
+    {
+        declare_kept(ast, node->b);
+    }
+}
+
+static void declare_kept_values(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        declare_kept(ast, index);
+    }
+}
+
+/*
+ * Variables of loop invariants and common subexpressions of the statements
+ */
+static void declare_invariants(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+
+        switch (node->kind)
+        {
+        case AST_LOCAL:
+        case AST_ASSIGN:
+        case AST_RETURN:
+            declare_kept_values(ast, node->b);
+            break;
+
+        case AST_IF:
+            declare_kept_values(ast, node->a);
+            declare_invariants(ast, node->b);
+            declare_invariants(ast, node->c);
+            break;
+
+        case AST_WHILE:
+            declare_kept_values(ast, node->a);
+            declare_invariants(ast, node->b);
+            break;
+
+        default:
+            declare_kept(ast, index);
+            break;
+        }
+    }
+}
+
+/*
+ * Targets are assigned from the last one, values are on the stack unless
+ * all of them were removed as not read
+ */
+static void gen_targets(ast_t* ast, uint32_t first, bool pushed)
+{
+    if (first == AST_NONE)
+    {
+        return;
+    }
+
+    gen_targets(ast, AST_NODE(ast, first)->next, pushed);
+
+    if (AST_NODE(ast, first)->flags & AST_DEAD)
+    {
+        codeGen_discard_var(AST_CHARS(ast, AST_NODE(ast, first)->a), pushed);
+    }
+    else
+    {
+        codeGen_assign_var(AST_CHARS(ast, AST_NODE(ast, first)->a), NOT_NIL);
+    }
+}
+
+/*
+ * Value is moved to the variable without the data stack
+ */
+static void gen_assign(ast_t* ast, uint32_t name, uint32_t value)
+{
+    // kept value is moved from its variable
+    if (AST_NODE(ast, value)->kind == AST_OPERATION &&
+        !(AST_NODE(ast, value)->flags & (AST_SAVED | AST_REUSE)))
+    {
+        codeGen_operand_t target = {.kind = OPERAND_TARGET, .name = AST_CHARS(ast, name)};
+
+        gen_operation(ast, value, &target);
+        codeGen_assign_var(AST_CHARS(ast, name), DEF);
+    }
+    else
+    {
+        codeGen_operand_t operand = gen_operand(ast, value);
+
+        codeGen_assign_operand(AST_CHARS(ast, name), &operand);
+    }
+
+    temps_top = 0;
+}
+
+/*
+ * Value assigned to the variable is not read, only a call or an operation
+ * which may fail is left (see ast_opt.c)
+ */
+static void gen_discard(ast_t* ast, uint32_t name, uint32_t value)
+{
+    if (value == AST_NONE)
+    {
+        codeGen_discard_var(AST_CHARS(ast, name), false);
+    }
+    else if (is_operand(ast, value))
+    {
+        gen_operand(ast, value);
+        codeGen_discard_var(AST_CHARS(ast, name), false);
+        temps_top = 0;
+    }
+    else
+    {
+        gen_values(ast, value);
+        codeGen_discard_var(AST_CHARS(ast, name), true);
+    }
+}
+
+static void gen_function(ast_t* ast, ast_node_t* node)
+{
+    char* name = AST_CHARS(ast, node->a);
+
+    codeGen_function_start(name);
+
+    if (temps)
+    {
+        codeGen_temps_declare(count_temps(ast, node->c));
+    }
+
+    declare_invariants(ast, node->c);
+
+    for (uint32_t index = node->b; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        codeGen_new_var(AST_CHARS(ast, AST_NODE(ast, index)->a));
+        codeGen_assign_var(AST_CHARS(ast, AST_NODE(ast, index)->a), NOT_NIL);
+    }
+
+    gen_stats(ast, node->c);
+
+    // missing return values are nil
+    for (uint32_t index = node->d; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        codeGen_push_nil();
+    }
+
+    codeGen_function_end(name);
+}
+
+static void gen_stat(ast_t* ast, uint32_t index)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    switch (node->kind)
+    {
+    case AST_FUNCTION:
+        gen_function(ast, node);
+        break;
+
+    case AST_LOCAL:
+        codeGen_new_var(AST_CHARS(ast, node->a));
+
+        // parameter of inlined call is moved from its argument
+        if (node->flags & AST_LOCAL_COPY)
+        {
+            codeGen_operand_t operand = gen_operand(ast, node->b);
+
+            codeGen_assign_operand(AST_CHARS(ast, node->a), &operand);
+            break;
+        }
+
+        codeGen_push_nil();
+        codeGen_assign_var(AST_CHARS(ast, node->a), IS_NIL);
+
+        if (node->flags & AST_LOCAL_DEFINED)
+        {
+            codeGen_assign_var(AST_CHARS(ast, node->a), DEF);
+        }
+        else if (node->flags & AST_DEAD)
+        {
+            gen_discard(ast, node->a, node->b);
+        }
+        else if (is_operand(ast, node->b))
+        {
+            gen_assign(ast, node->a, node->b);
+        }
+        else if (node->b != AST_NONE)
+        {
+            gen_values(ast, node->b);
+            codeGen_assign_var(AST_CHARS(ast, node->a), NOT_NIL);
+        }
+        break;
+
+    case AST_ASSIGN:
+        if (AST_NODE(ast, node->a)->next == AST_NONE && (AST_NODE(ast, node->a)->flags & AST_DEAD))
+        {
+            gen_discard(ast, AST_NODE(ast, node->a)->a, node->b);
+            break;
+        }
+
+        if (AST_NODE(ast, node->a)->next == AST_NONE && is_operand(ast, node->b))
+        {
+            gen_assign(ast, AST_NODE(ast, node->a)->a, node->b);
+            break;
+        }
+
+        gen_values(ast, node->b);
+        gen_targets(ast, node->a, node->b != AST_NONE);
+        break;
+
+    case AST_RETURN:
+        gen_values(ast, node->b);
+        codeGen_function_return();
+        break;
+
+    case AST_IF:
+        if (is_operand(ast, node->a))
+        {
+            codeGen_operand_t left;
+            codeGen_operand_t right;
+            psa_rules_enum rule = gen_condition_operands(ast, node->a, &left, &right);
+
+            codeGen_if_start_operand(rule, &left, &right);
+            temps_top = 0;
+        }
+        else
+        {
+            codeGen_if_start(gen_condition(ast, node->a));
+        }
+
+        // jumps and labels of the branches belong to the condition
+        gen_stats(ast, node->b);
+        codeGen_set_line(AST_LINE(ast, index));
+        codeGen_if_else();
+        gen_stats(ast, node->c);
+        codeGen_set_line(AST_LINE(ast, index));
+        codeGen_if_end();
+        break;
+
+    case AST_WHILE:
+        each_invariant(ast, node->a, gen_invariant);
+        codeGen_while_body_start();
+
+        if (is_operand(ast, node->a))
+        {
+            codeGen_operand_t left;
+            codeGen_operand_t right;
+            psa_rules_enum rule = gen_condition_operands(ast, node->a, &left, &right);
+
+            codeGen_while_start_operand(rule, &left, &right);
+            temps_top = 0;
+        }
+        else
+        {
+            codeGen_while_start(gen_condition(ast, node->a));
+        }
+
+        gen_stats(ast, node->b);
+        // jump back to the condition
+        codeGen_set_line(AST_LINE(ast, index));
+        codeGen_while_end();
+        break;
+
+    default:
+        // value is a statement (call)
+        gen_value(ast, index);
+        break;
+    }
+}
+
+static void gen_stats(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        codeGen_set_line(AST_LINE(ast, index));
+        gen_stat(ast, index);
+    }
+}
+
+/*
+ * ----------------------PARALLEL GENERATION-----------------------
+ */
+
+/*
+ * Counters at the start of a unit are known before the unit is generated,
+ * this pass counts labels in the same way as the code generator
+ */
+typedef struct gen_count
+{
+    codeGen_counters_t counters;
+    bool isWhile;
+    bool invariant;     /// Loop invariant is counted.
+} gen_count_t;
+
+static void count_values(ast_t* ast, uint32_t first, gen_count_t* count);
+static void count_stats(ast_t* ast, uint32_t first, gen_count_t* count);
+
+static void count_value(ast_t* ast, uint32_t index, gen_count_t* count)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    // loop invariants are counted before the loop, reused value is not generated
+    if (((node->flags & AST_INVARIANT) && !count->invariant) || (node->flags & AST_REUSE))
+    {
+        return;
+    }
+
+    switch (node->kind)
+    {
+    case AST_CALL:
+        count_values(ast, node->b, count);
+        break;
+
+    case AST_OPERATION:
+        count_value(ast, node->a, count);
+
+        if (node->b != AST_NONE)
+        {
+            count_value(ast, node->b, count);
+
+            // inside of while the generator increments these labels twice,
+            // temporaries mode has its own labels of conversions
+            if (!temps && (AST_NODE(ast, node->b)->flags & AST_TO_NUMBER))
+            {
+                count->counters.intToFloat1 += count->isWhile ? 2 : 1;
+            }
+
+            if (!temps && (AST_NODE(ast, node->a)->flags & AST_TO_NUMBER))
+            {
+                count->counters.intToFloat2 += count->isWhile ? 2 : 1;
+            }
+        }
+        break;
+
+    case AST_TO_BOOL:
+        count_value(ast, node->a, count);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*
+ * Loop invariants of the condition are generated before the loop
+ */
+static void count_invariants(ast_t* ast, uint32_t index, gen_count_t* count)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    if (node->flags & AST_INVARIANT)
+    {
+        count->invariant = true;
+        count_value(ast, index, count);
+        count->invariant = false;
+        return;
+    }
+
+    if (node->kind == AST_OPERATION || node->kind == AST_TO_BOOL)
+    {
+        count_invariants(ast, node->a, count);
+    }
+
+    if (node->kind == AST_OPERATION && node->b != AST_NONE)
+    {
+        count_invariants(ast, node->b, count);
+    }
+}
+
+static void count_values(ast_t* ast, uint32_t first, gen_count_t* count)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        count_value(ast, index, count);
+    }
+}
+
+static void count_stat(ast_t* ast, uint32_t index, gen_count_t* count)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    switch (node->kind)
+    {
+    case AST_FUNCTION:
+        count->counters.function++;
+        count_stats(ast, node->c, count);
+        break;
+
+    case AST_LOCAL:
+    case AST_ASSIGN:
+    case AST_RETURN:
+        count_values(ast, node->b, count);
+        break;
+
+    case AST_IF:
+        count_values(ast, node->a, count);
+        count->counters.ifCounter++;
+        count_stats(ast, node->b, count);
+        count_stats(ast, node->c, count);
+        break;
+
+    case AST_WHILE:
+    {
+        bool isWhile = count->isWhile;
+
+        count_invariants(ast, node->a, count);
+        count->counters.whileCounter++;
+        count->isWhile = true;
+        count_values(ast, node->a, count);
+        count_stats(ast, node->b, count);
+        count->isWhile = isWhile;
+        break;
+    }
+
+    default:
+        count_value(ast, index, count);
+        break;
+    }
+}
+
+static void count_stats(ast_t* ast, uint32_t first, gen_count_t* count)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        count_stat(ast, index, count);
+    }
+}
+
+/*
+ * Top level node (function or call) generated by a worker
+ */
+typedef struct gen_unit
+{
+    uint32_t node;
+    codeGen_counters_t counters;
+    char* code;
+    size_t len;
+    shadowStack_t* shade;   /// Variables left on the shadow stack.
+    error_t err;
+    bool dependent;
+    bool done;
+} gen_unit_t;
+
+typedef struct gen_pool
+{
+    ast_t* ast;
+    gen_unit_t* units;
+    uint32_t count;
+    uint32_t next;          /// Next unit for a worker.
+    uint32_t limit;         /// Units below limit may be generated.
+    mtx_t lock;
+    cnd_t done_changed;
+    cnd_t limit_changed;
+} gen_pool_t;
+
+static void gen_unit(gen_pool_t* pool, gen_unit_t* unit, shadowStack_t* shade, bool isolated)
+{
+    codeGen_unit_start(&unit->counters, shade, isolated);
+
+    if (err == E_NO_ERR)
+    {
+        gen_stat(pool->ast, unit->node);
+    }
+
+    unit->dependent = codeGen_unit_end(&unit->code, &unit->len, &unit->shade);
+    unit->err = err;
+}
+
+static int gen_worker(void* arg)
+{
+    gen_pool_t* pool = arg;
+
+    mtx_lock(&pool->lock);
+
+    while (pool->next < pool->count)
+    {
+        if (pool->next >= pool->limit)
+        {
+            cnd_wait(&pool->limit_changed, &pool->lock);
+            continue;
+        }
+
+        gen_unit_t* unit = &pool->units[pool->next++];
+
+        mtx_unlock(&pool->lock);
+        gen_unit(pool, unit, NULL, true);
+        mtx_lock(&pool->lock);
+
+        unit->done = true;
+        cnd_broadcast(&pool->done_changed);
+    }
+
+    mtx_unlock(&pool->lock);
+    codeGen_thread_end();
+
+    return 0;
+}
+
+static void free_shade(shadowStack_t* shade)
+{
+    while (shade != NULL)
+    {
+        shadowStack_t* next = shade->next;
+
+        free(shade->name);
+        free(shade->nameScale);
+        free(shade);
+        shade = next;
+    }
+}
+
+/*
+ * Units are written in source order by this thread. Unit which is not
+ * taken by any worker yet and unit which needs variables left by previous
+ * units (see codeGen_unit_start) are generated here with the shadow stack
+ * of the serial generation.
+ */
+static void write_units(gen_pool_t* pool, unsigned jobs)
+{
+    shadowStack_t* shade = NULL;
+
+    for (uint32_t i = 0; i < pool->count; i++)
+    {
+        gen_unit_t* unit = &pool->units[i];
+        bool serial = false;
+
+        mtx_lock(&pool->lock);
+
+        if (pool->next == i)
+        {
+            pool->next++;
+            serial = true;
+        }
+
+        while (!serial && !unit->done)
+        {
+            cnd_wait(&pool->done_changed, &pool->lock);
+        }
+
+        pool->limit = i + 1 + UNITS_AHEAD * jobs;
+        cnd_broadcast(&pool->limit_changed);
+        mtx_unlock(&pool->lock);
+
+        if (err == E_NO_ERR && !serial && unit->err != E_NO_ERR)
+        {
+            err = unit->err;
+        }
+
+        if (err == E_NO_ERR && (serial || unit->dependent))
+        {
+            gen_unit(pool, unit, shade, false);
+            shade = unit->shade;
+        }
+        else if (err == E_NO_ERR)
+        {
+            codeGen_emit_code(unit->code, unit->len);
+
+            if (unit->shade != NULL)
+            {
+                shadowStack_t* last = unit->shade;
+
+                while (last->next != NULL)
+                {
+                    last = last->next;
+                }
+
+                last->next = shade;
+                shade = unit->shade;
+            }
+        }
+        else
+        {
+            free_shade(unit->shade);
+        }
+
+        free(unit->code);
+    }
+
+    free_shade(shade);
+}
+
+/*
+ * Generate units on this thread and jobs - 1 workers, false if no worker
+ * was started
+ */
+static bool gen_parallel(ast_t* ast, unsigned jobs)
+{
+    gen_pool_t pool = {.ast = ast};
+    gen_count_t count = {.counters = {0, 0, -1, -1, 0}, .isWhile = false, .invariant = false};
+
+    for (uint32_t index = ast->first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        pool.count++;
+    }
+
+    pool.units = calloc(pool.count, sizeof(gen_unit_t));
+
+    if (pool.units == NULL && pool.count > 0)
+    {
+        return false;
+    }
+
+    uint32_t i = 0;
+
+    for (uint32_t index = ast->first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        pool.units[i].node = index;
+        pool.units[i].counters = count.counters;
+        count_stat(ast, index, &count);
+        i++;
+    }
+
+    pool.limit = UNITS_AHEAD * jobs;
+
+    if (mtx_init(&pool.lock, mtx_plain) != thrd_success)
+    {
+        free(pool.units);
+        return false;
+    }
+
+    if (cnd_init(&pool.done_changed) != thrd_success)
+    {
+        mtx_destroy(&pool.lock);
+        free(pool.units);
+        return false;
+    }
+
+    if (cnd_init(&pool.limit_changed) != thrd_success)
+    {
+        cnd_destroy(&pool.done_changed);
+        mtx_destroy(&pool.lock);
+        free(pool.units);
+        return false;
+    }
+
+    thrd_t* threads = malloc(sizeof(thrd_t) * (jobs - 1));
+    unsigned started = 0;
+
+    while (threads != NULL && started < jobs - 1 &&
+           thrd_create(&threads[started], gen_worker, &pool) == thrd_success)
+    {
+        started++;
+    }
+
+    if (started > 0)
+    {
+        write_units(&pool, jobs);
+
+        for (unsigned j = 0; j < started; j++)
+        {
+            thrd_join(threads[j], NULL);
+        }
+    }
+
+    free(threads);
+    cnd_destroy(&pool.limit_changed);
+    cnd_destroy(&pool.done_changed);
+    mtx_destroy(&pool.lock);
+    free(pool.units);
+
+    return started > 0;
+}
+
+void ast_generate(ast_t* ast, const ast_gen_options_t* options)
+{
+    unsigned jobs = options->jobs;
+
+    temps = options->temps;
+
+    STATS_PHASE_ENTER(STATS_PHASE_GEN);
+    STATS_ADD(ast_nodes, ast->nodes_len);
+    STATS_ADD(ast_bytes, ast_size(ast));
+
+    codeGen_init();
+    codeGen_built_in_function();
+
+    if (jobs <= 1 || !gen_parallel(ast, jobs))
+    {
+        gen_stats(ast, ast->first);
+    }
+
+    codeGen_set_line(0);
+    generate_errorOp();
+
+    STATS_PHASE_LEAVE();
+}
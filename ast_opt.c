@@ -0,0 +1,1407 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Optimization passes over the abstract syntax tree
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "error.h"
+#include "psa.h"
+
+/*
+ * ----------------------LOOP INVARIANTS-----------------------
+ */
+
+/*
+ * Variable is assigned or declared by the statements
+ */
+static bool assigned(ast_t* ast, uint32_t first, uint32_t name)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+
+        switch (node->kind)
+        {
+        case AST_LOCAL:
+            if (node->a == name)
+            {
+                return true;
+            }
+            break;
+
+        case AST_ASSIGN:
+            for (uint32_t target = node->a; target != AST_NONE; target = AST_NODE(ast, target)->next)
+            {
+                if (AST_NODE(ast, target)->a == name)
+                {
+                    return true;
+                }
+            }
+            break;
+
+        case AST_IF:
+            if (assigned(ast, node->b, name) || assigned(ast, node->c, name))
+            {
+                return true;
+            }
+            break;
+
+        case AST_WHILE:
+            if (assigned(ast, node->b, name))
+            {
+                return true;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Value does not change while the body is executed, variables are local
+ * to the function so calls do not change them
+ */
+static bool invariant(ast_t* ast, uint32_t index, uint32_t body)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    switch (node->kind)
+    {
+    case AST_INT:
+    case AST_NUMBER:
+    case AST_STRING:
+    case AST_NIL:
+        return true;
+
+    case AST_VAR:
+        return !assigned(ast, body, node->a);
+
+    case AST_OPERATION:
+        return invariant(ast, node->a, body) && (node->b == AST_NONE || invariant(ast, node->b, body));
+
+    default:
+        return false;
+    }
+}
+
+/*
+ * Operation may end the program (nil operand, division by zero)
+ */
+static bool may_fail(const ast_node_t* node)
+{
+    psa_rules_enum rule = node->flags & AST_RULE_MASK;
+
+    return node->kind == AST_OPERATION && rule != NT_EQ_NT && rule != NT_NEQ_NT;
+}
+
+/*
+ * Invariant operations of the condition are marked in the order of
+ * evaluation until an operation which may fail stays in the loop, so
+ * the error which ends the program does not change. The root of the
+ * condition is compared by the branch and stays.
+ */
+static void hoist(ast_t* ast, uint32_t index, uint32_t body, bool root, bool* failing)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    if (!root && !*failing && node->kind == AST_OPERATION && invariant(ast, index, body))
+    {
+        node->flags |= AST_INVARIANT;
+        return;
+    }
+
+    if (node->kind == AST_OPERATION || node->kind == AST_TO_BOOL)
+    {
+        hoist(ast, node->a, body, false, failing);
+    }
+
+    if (node->kind == AST_OPERATION && node->b != AST_NONE)
+    {
+        hoist(ast, node->b, body, false, failing);
+    }
+
+    if (may_fail(node))
+    {
+        *failing = true;
+    }
+}
+
+static void hoist_stats(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+        bool failing = false;
+
+        switch (node->kind)
+        {
+        case AST_IF:
+            hoist_stats(ast, node->b);
+            hoist_stats(ast, node->c);
+            break;
+
+        case AST_WHILE:
+            hoist(ast, node->a, node->b, true, &failing);
+            hoist_stats(ast, node->b);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * ----------------------COMMON SUBEXPRESSIONS-----------------------
+ */
+
+/*
+ * Count of the last operations of a block which may be reused
+ */
+#define CSE_WINDOW 64
+
+/*
+ * Operations computed in the current block (straight line code) whose
+ * operands were not assigned since
+ */
+typedef struct cse
+{
+    uint32_t available[CSE_WINDOW];
+    unsigned count;
+} cse_t;
+
+static bool same_operation(ast_t* ast, uint32_t left, uint32_t right);
+
+/*
+ * Operands have the same value, conversion by their operation included
+ */
+static bool same_value(ast_t* ast, uint32_t left, uint32_t right)
+{
+    if (left == AST_NONE || right == AST_NONE)
+    {
+        return left == right;
+    }
+
+    ast_node_t* x = AST_NODE(ast, left);
+    ast_node_t* y = AST_NODE(ast, right);
+
+    if (x->kind != y->kind || (x->flags & AST_TO_NUMBER) != (y->flags & AST_TO_NUMBER))
+    {
+        return false;
+    }
+
+    switch (x->kind)
+    {
+    case AST_VAR:
+    case AST_INT:
+        return x->a == y->a;
+
+    case AST_NUMBER:
+        return ast->numbers[x->a] == ast->numbers[y->a];
+
+    case AST_STRING:
+        return strcmp(AST_CHARS(ast, x->a), AST_CHARS(ast, y->a)) == 0;
+
+    case AST_NIL:
+        return true;
+
+    case AST_OPERATION:
+        return same_operation(ast, left, right);
+
+    default:
+        return false;
+    }
+}
+
+/*
+ * Operations compute the same value
+ */
+static bool same_operation(ast_t* ast, uint32_t left, uint32_t right)
+{
+    ast_node_t* x = AST_NODE(ast, left);
+    ast_node_t* y = AST_NODE(ast, right);
+
+    return (x->flags & AST_RULE_MASK) == (y->flags & AST_RULE_MASK) &&
+           same_value(ast, x->a, y->a) && same_value(ast, x->b, y->b);
+}
+
+static bool uses_var(ast_t* ast, uint32_t index, uint32_t name)
+{
+    if (index == AST_NONE)
+    {
+        return false;
+    }
+
+    ast_node_t* node = AST_NODE(ast, index);
+
+    switch (node->kind)
+    {
+    case AST_VAR:
+        return node->a == name;
+
+    case AST_OPERATION:
+        return uses_var(ast, node->a, name) || uses_var(ast, node->b, name);
+
+    default:
+        return false;
+    }
+}
+
+/*
+ * Variable is assigned or declared, operations using it are not available
+ */
+static void cse_kill(ast_t* ast, cse_t* cse, uint32_t name)
+{
+    unsigned kept = 0;
+
+    for (unsigned i = 0; i < cse->count; i++)
+    {
+        if (!uses_var(ast, cse->available[i], name))
+        {
+            cse->available[kept++] = cse->available[i];
+        }
+    }
+
+    cse->count = kept;
+}
+
+/*
+ * Operation equal to an available one takes its value, its operands are
+ * not evaluated then. Other operations are available after their operands
+ * in the order of evaluation. The value of the first operation is checked
+ * for nil, converted and divided by zero in the same way, so the reuse
+ * does not change errors.
+ */
+static void cse_value(ast_t* ast, cse_t* cse, uint32_t index)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    if (node->kind == AST_TO_BOOL)
+    {
+        cse_value(ast, cse, node->a);
+        return;
+    }
+
+    if (node->kind != AST_OPERATION)
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < cse->count; i++)
+    {
+        uint32_t saved = cse->available[i];
+
+        // conversion of the value is done by the operation using it
+        if (same_operation(ast, saved, index))
+        {
+            AST_NODE(ast, saved)->flags |= AST_SAVED;
+            node->flags |= AST_REUSE;
+            node->c = saved;
+            return;
+        }
+    }
+
+    cse_value(ast, cse, node->a);
+
+    if (node->b != AST_NONE)
+    {
+        cse_value(ast, cse, node->b);
+    }
+
+    if (cse->count == CSE_WINDOW)
+    {
+        memmove(cse->available, cse->available + 1, sizeof(uint32_t) * (CSE_WINDOW - 1));
+        cse->count--;
+    }
+
+    cse->available[cse->count++] = index;
+}
+
+static void cse_values(ast_t* ast, cse_t* cse, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        cse_value(ast, cse, index);
+    }
+}
+
+static void cse_stats(ast_t* ast, uint32_t first)
+{
+    cse_t cse = {.count = 0};
+
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+        psa_rules_enum rule = node->flags & AST_RULE_MASK;
+
+        switch (node->kind)
+        {
+        case AST_LOCAL:
+            cse_values(ast, &cse, node->b);
+            cse_kill(ast, &cse, node->a);
+            break;
+
+        case AST_ASSIGN:
+            cse_values(ast, &cse, node->b);
+
+            for (uint32_t target = node->a; target != AST_NONE; target = AST_NODE(ast, target)->next)
+            {
+                cse_kill(ast, &cse, AST_NODE(ast, target)->a);
+            }
+            break;
+
+        case AST_RETURN:
+        case AST_CALL:
+            cse_values(ast, &cse, node->b);
+            break;
+
+        case AST_IF:
+            // relational operation of the condition is compared by the branch
+            rule = AST_NODE(ast, node->a)->flags & AST_RULE_MASK;
+
+            if (AST_NODE(ast, node->a)->kind == AST_OPERATION && rule >= NT_EQ_NT && rule <= NT_GTN_NT)
+            {
+                cse_value(ast, &cse, AST_NODE(ast, node->a)->a);
+                cse_value(ast, &cse, AST_NODE(ast, node->a)->b);
+            }
+            else
+            {
+                cse_values(ast, &cse, node->a);
+            }
+
+            cse_stats(ast, node->b);
+            cse_stats(ast, node->c);
+            cse.count = 0;
+            break;
+
+        case AST_WHILE:
+            // condition is evaluated at the end of the body
+            cse_stats(ast, node->b);
+            cse.count = 0;
+            break;
+
+        default:
+            // value of inlined call statement
+            cse_value(ast, &cse, index);
+            break;
+        }
+    }
+}
+
+/*
+ * ----------------------INLINING-----------------------
+ */
+
+/*
+ * Count of nodes of parameters and body of inlined function
+ */
+#define INLINE_SIZE 40
+
+typedef struct inline_function
+{
+    uint32_t name;      /// Offset of the name.
+    uint32_t node;      /// FUNCTION node.
+    bool inlinable;
+} inline_function_t;
+
+typedef struct inliner
+{
+    inline_function_t* functions;   /// Sorted by name.
+    uint32_t count;
+    unsigned sites;                 /// Count of inlined calls, suffix of renamed variables.
+} inliner_t;
+
+static int compare_functions(const void* a, const void* b)
+{
+    uint32_t left = ((const inline_function_t*)a)->name;
+    uint32_t right = ((const inline_function_t*)b)->name;
+
+    return left < right ? -1 : left > right;
+}
+
+/*
+ * User function of the name, NULL for built-in function
+ */
+static inline_function_t* find_function(const inliner_t* inliner, uint32_t name)
+{
+    inline_function_t key = {.name = name};
+
+    return bsearch(&key, inliner->functions, inliner->count, sizeof(inline_function_t), compare_functions);
+}
+
+static uint32_t list_length(ast_t* ast, uint32_t first)
+{
+    uint32_t length = 0;
+
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        length++;
+    }
+
+    return length;
+}
+
+static bool measure(ast_t* ast, const inliner_t* inliner, uint32_t first, uint32_t* size);
+
+/*
+ * Nodes of the subtree are counted, false if it calls a user function or
+ * returns
+ */
+static bool measure_node(ast_t* ast, const inliner_t* inliner, uint32_t index, uint32_t* size)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    (*size)++;
+
+    switch (node->kind)
+    {
+    case AST_RETURN:
+        return false;
+
+    case AST_CALL:
+        return find_function(inliner, node->a) == NULL && measure(ast, inliner, node->b, size);
+
+    case AST_LOCAL:
+        return measure(ast, inliner, node->b, size);
+
+    case AST_IF:
+        if (!measure(ast, inliner, node->c, size))
+        {
+            return false;
+        }
+        // fall through
+
+    case AST_ASSIGN:
+    case AST_WHILE:
+    case AST_OPERATION:
+        return measure(ast, inliner, node->a, size) && measure(ast, inliner, node->b, size);
+
+    case AST_TO_BOOL:
+        return measure(ast, inliner, node->a, size);
+
+    default:
+        return true;
+    }
+}
+
+static bool measure(ast_t* ast, const inliner_t* inliner, uint32_t first, uint32_t* size)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        if (!measure_node(ast, inliner, index, size))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Small function which calls no user function (so it is not recursive),
+ * has at most one result and returns by its end or by its last statement
+ * with all results
+ */
+static bool inlinable(ast_t* ast, const inliner_t* inliner, uint32_t function)
+{
+    ast_node_t* node = AST_NODE(ast, function);
+    uint32_t results = list_length(ast, node->d);
+    uint32_t size = list_length(ast, node->b);
+
+    if (results > 1)
+    {
+        return false;
+    }
+
+    for (uint32_t index = node->c; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* stat = AST_NODE(ast, index);
+
+        if (stat->kind == AST_RETURN && stat->next == AST_NONE)
+        {
+            size++;
+
+            if (list_length(ast, stat->b) != results || !measure(ast, inliner, stat->b, &size))
+            {
+                return false;
+            }
+        }
+        else if (!measure_node(ast, inliner, index, &size))
+        {
+            return false;
+        }
+    }
+
+    return size <= INLINE_SIZE;
+}
+
+/*
+ * Variable of the inlined function is renamed by the number of the call,
+ * identifiers of the source have no '$', so the name clashes with no
+ * variable of the caller and the generator mangles it as any other local
+ */
+static uint32_t rename_var(ast_t* ast, uint32_t name, unsigned site)
+{
+    char* renamed = malloc(strlen(AST_CHARS(ast, name)) + 12);
+
+    if (renamed == NULL)
+    {
+        err = E_INTERNAL;
+        return AST_NONE;
+    }
+
+    sprintf(renamed, "%s$%u", AST_CHARS(ast, name), site);
+
+    uint32_t offset = ast_intern(ast, renamed);
+
+    free(renamed);
+
+    return offset;
+}
+
+static uint32_t clone_list(ast_t* ast, uint32_t first, unsigned site);
+
+/*
+ * Copy of the subtree with renamed variables, names of called functions
+ * and literals are shared
+ */
+static uint32_t clone(ast_t* ast, uint32_t index, unsigned site)
+{
+    ast_node_t node = *AST_NODE(ast, index);
+    uint32_t copy = ast_new_node(ast, node.kind, node.type);
+
+    if (copy == AST_NONE)
+    {
+        return AST_NONE;
+    }
+
+    switch (node.kind)
+    {
+    case AST_VAR:
+        node.a = rename_var(ast, node.a, site);
+        break;
+
+    case AST_LOCAL:
+        node.a = rename_var(ast, node.a, site);
+        node.b = clone_list(ast, node.b, site);
+        break;
+
+    case AST_IF:
+        node.c = clone_list(ast, node.c, site);
+        // fall through
+
+    case AST_ASSIGN:
+    case AST_WHILE:
+    case AST_OPERATION:
+        node.a = clone_list(ast, node.a, site);
+        node.b = clone_list(ast, node.b, site);
+        break;
+
+    case AST_RETURN:
+    case AST_CALL:
+        node.b = clone_list(ast, node.b, site);
+        break;
+
+    case AST_TO_BOOL:
+        node.a = clone_list(ast, node.a, site);
+        break;
+
+    default:
+        break;
+    }
+
+    node.flags &= ~AST_INVARIANT;
+    node.next = AST_NONE;
+    *AST_NODE(ast, copy) = node;
+
+    // inlined code keeps the lines of the function body
+    if (ast->lines != NULL)
+    {
+        ast->lines[copy] = ast->lines[index];
+    }
+
+    return copy;
+}
+
+/*
+ * Append node to the list from first to last
+ */
+static void chain(ast_t* ast, uint32_t* first, uint32_t* last, uint32_t node)
+{
+    if (*last == AST_NONE)
+    {
+        *first = node;
+    }
+    else
+    {
+        AST_NODE(ast, *last)->next = node;
+    }
+
+    *last = node;
+}
+
+static uint32_t clone_list(ast_t* ast, uint32_t first, unsigned site)
+{
+    uint32_t head = AST_NONE;
+    uint32_t last = AST_NONE;
+
+    for (uint32_t index = first; index != AST_NONE && err == E_NO_ERR; index = AST_NODE(ast, index)->next)
+    {
+        chain(ast, &head, &last, clone(ast, index, site));
+    }
+
+    return head;
+}
+
+/*
+ * Called function if the statement is a call or uses the only result
+ * of a call, which may be inlined
+ */
+static const inline_function_t* inline_site(ast_t* ast, const inliner_t* inliner, uint32_t index, uint32_t* call)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+    bool result = false;
+
+    *call = AST_NONE;
+
+    switch (node->kind)
+    {
+    case AST_CALL:
+        *call = index;
+        break;
+
+    case AST_ASSIGN:
+        if (AST_NODE(ast, node->a)->next != AST_NONE)
+        {
+            return NULL;
+        }
+        // fall through
+
+    case AST_LOCAL:
+        result = true;
+        // fall through
+
+    case AST_RETURN:
+        if (node->b != AST_NONE && AST_NODE(ast, node->b)->kind == AST_CALL && AST_NODE(ast, node->b)->next == AST_NONE)
+        {
+            *call = node->b;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (*call == AST_NONE)
+    {
+        return NULL;
+    }
+
+    const inline_function_t* function = find_function(inliner, AST_NODE(ast, *call)->a);
+
+    if (function == NULL || !function->inlinable ||
+        list_length(ast, AST_NODE(ast, *call)->b) != list_length(ast, AST_NODE(ast, function->node)->b) ||
+        (result && AST_NODE(ast, function->node)->d == AST_NONE))
+    {
+        return NULL;
+    }
+
+    return function;
+}
+
+/*
+ * Statements replacing the statement with the call. Parameters are locals
+ * moved from the arguments and the body follows. The statement itself
+ * uses the returned value, results of call statement are only evaluated
+ * when they may fail. Last of the statements keeps the next statement.
+ */
+static void expand(ast_t* ast, inliner_t* inliner, uint32_t stat, uint32_t call,
+                   const inline_function_t* function, uint32_t* first, uint32_t* last)
+{
+    unsigned site = inliner->sites++;
+    uint32_t next = AST_NODE(ast, stat)->next;
+    uint32_t args = list_length(ast, AST_NODE(ast, call)->b);
+    uint32_t param = AST_NODE(ast, function->node)->b;
+    uint32_t result = AST_NONE;
+
+    *first = AST_NONE;
+    *last = AST_NONE;
+
+    // parameters belong to the line of the call
+    ast_set_line(ast, AST_LINE(ast, stat));
+
+    // arguments are in push order, the last one first
+    for (uint32_t i = 0; i < args && err == E_NO_ERR; i++)
+    {
+        uint32_t arg = AST_NODE(ast, call)->b;
+
+        for (uint32_t j = i + 1; j < args; j++)
+        {
+            arg = AST_NODE(ast, arg)->next;
+        }
+
+        uint32_t copy = ast_new_node(ast, AST_LOCAL, AST_NODE(ast, param)->type);
+        uint32_t name = rename_var(ast, AST_NODE(ast, param)->a, site);
+
+        if (copy == AST_NONE || name == AST_NONE)
+        {
+            return;
+        }
+
+        AST_NODE(ast, copy)->flags = AST_LOCAL_COPY;
+        AST_NODE(ast, copy)->a = name;
+        AST_NODE(ast, copy)->b = arg;
+        chain(ast, first, last, copy);
+        param = AST_NODE(ast, param)->next;
+    }
+
+    for (uint32_t index = AST_NODE(ast, function->node)->c; index != AST_NONE && err == E_NO_ERR;
+         index = AST_NODE(ast, index)->next)
+    {
+        if (AST_NODE(ast, index)->kind == AST_RETURN && AST_NODE(ast, index)->next == AST_NONE)
+        {
+            result = clone_list(ast, AST_NODE(ast, index)->b, site);
+        }
+        else
+        {
+            chain(ast, first, last, clone(ast, index, site));
+        }
+    }
+
+    // function without return statement returns nil
+    if (result == AST_NONE && AST_NODE(ast, function->node)->d != AST_NONE)
+    {
+        result = ast_new_node(ast, AST_NIL, NIL);
+    }
+
+    // the arguments are moved, the ends of their list are cut
+    for (uint32_t index = *first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        if (AST_NODE(ast, index)->flags & AST_LOCAL_COPY)
+        {
+            AST_NODE(ast, AST_NODE(ast, index)->b)->next = AST_NONE;
+        }
+    }
+
+    if (err != E_NO_ERR)
+    {
+        return;
+    }
+
+    if (stat != call)
+    {
+        AST_NODE(ast, stat)->b = result;
+        chain(ast, first, last, stat);
+        return;
+    }
+
+    if (result != AST_NONE && AST_NODE(ast, result)->kind == AST_OPERATION)
+    {
+        chain(ast, first, last, result);
+    }
+
+    if (*last != AST_NONE)
+    {
+        AST_NODE(ast, *last)->next = next;
+    }
+}
+
+/*
+ * Field of the owner which holds the list (1 b, 2 c)
+ */
+static uint32_t* list_field(ast_t* ast, uint32_t owner, uint8_t field)
+{
+    return field == 1 ? &AST_NODE(ast, owner)->b : &AST_NODE(ast, owner)->c;
+}
+
+/*
+ * Calls of the statement list are replaced by the inlined bodies
+ */
+static void inline_stats(ast_t* ast, inliner_t* inliner, uint32_t owner, uint8_t field)
+{
+    uint32_t previous = AST_NONE;
+    uint32_t index = *list_field(ast, owner, field);
+
+    while (index != AST_NONE && err == E_NO_ERR)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+        uint32_t call;
+        const inline_function_t* function;
+
+        if (node->kind == AST_IF)
+        {
+            inline_stats(ast, inliner, index, 1);
+            inline_stats(ast, inliner, index, 2);
+        }
+        else if (node->kind == AST_WHILE)
+        {
+            inline_stats(ast, inliner, index, 1);
+        }
+        else if ((function = inline_site(ast, inliner, index, &call)) != NULL)
+        {
+            uint32_t next = node->next;
+            uint32_t first;
+            uint32_t last;
+
+            expand(ast, inliner, index, call, function, &first, &last);
+
+            // call statement without any code is removed
+            if (last == AST_NONE)
+            {
+                first = next;
+            }
+
+            if (previous == AST_NONE)
+            {
+                *list_field(ast, owner, field) = first;
+            }
+            else
+            {
+                AST_NODE(ast, previous)->next = first;
+            }
+
+            if (last == AST_NONE)
+            {
+                index = next;
+                continue;
+            }
+
+            index = last;
+        }
+
+        previous = index;
+        index = AST_NODE(ast, index)->next;
+    }
+}
+
+/*
+ * Calls in bodies of functions are inlined, calls of the top level stay
+ */
+static void inline_calls(ast_t* ast)
+{
+    inliner_t inliner = {.functions = NULL, .count = 0, .sites = 0};
+
+    for (uint32_t index = ast->first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        inliner.count += AST_NODE(ast, index)->kind == AST_FUNCTION;
+    }
+
+    if (inliner.count == 0)
+    {
+        return;
+    }
+
+    inliner.functions = malloc(sizeof(inline_function_t) * inliner.count);
+
+    if (inliner.functions == NULL)
+    {
+        err = E_INTERNAL;
+        return;
+    }
+
+    uint32_t i = 0;
+
+    for (uint32_t index = ast->first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        if (AST_NODE(ast, index)->kind == AST_FUNCTION)
+        {
+            inliner.functions[i].name = AST_NODE(ast, index)->a;
+            inliner.functions[i].node = index;
+            inliner.functions[i].inlinable = false;
+            i++;
+        }
+    }
+
+    qsort(inliner.functions, inliner.count, sizeof(inline_function_t), compare_functions);
+
+    // bodies are not changed yet, so every function is measured as written
+    for (i = 0; i < inliner.count; i++)
+    {
+        inliner.functions[i].inlinable = inlinable(ast, &inliner, inliner.functions[i].node);
+    }
+
+    for (i = 0; i < inliner.count && err == E_NO_ERR; i++)
+    {
+        inline_stats(ast, &inliner, inliner.functions[i].node, 2);
+    }
+
+    free(inliner.functions);
+}
+
+/*
+ * ----------------------DEAD STORES-----------------------
+ */
+
+/*
+ * Names of a function are bits of sets of variables, a name stands for
+ * all variables of the name (shadowing is handled by blocks)
+ */
+typedef struct liveness
+{
+    uint32_t* names;    /// Sorted offsets of names.
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t words;     /// Length of a set.
+    uint64_t* read;     /// Names read anywhere in the function.
+} liveness_t;
+
+static int compare_names(const void* a, const void* b)
+{
+    uint32_t left = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+
+    return left < right ? -1 : left > right;
+}
+
+static void add_name(liveness_t* lv, uint32_t name)
+{
+    if (lv->count == lv->capacity)
+    {
+        uint32_t capacity = lv->capacity == 0 ? 32 : lv->capacity * 2;
+        uint32_t* names = realloc(lv->names, sizeof(uint32_t) * capacity);
+
+        if (names == NULL)
+        {
+            err = E_INTERNAL;
+            return;
+        }
+
+        lv->names = names;
+        lv->capacity = capacity;
+    }
+
+    lv->names[lv->count++] = name;
+}
+
+static void collect_names(ast_t* ast, liveness_t* lv, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE && err == E_NO_ERR; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+
+        switch (node->kind)
+        {
+        case AST_PARAM:
+        case AST_VAR:
+            add_name(lv, node->a);
+            break;
+
+        case AST_LOCAL:
+            add_name(lv, node->a);
+            collect_names(ast, lv, node->b);
+            break;
+
+        case AST_OPERATION:
+        case AST_TO_BOOL:
+        case AST_ASSIGN:
+        case AST_WHILE:
+            // operands are single nodes, their next is AST_NONE
+            collect_names(ast, lv, node->a);
+            collect_names(ast, lv, node->b);
+            break;
+
+        case AST_IF:
+            collect_names(ast, lv, node->a);
+            collect_names(ast, lv, node->b);
+            collect_names(ast, lv, node->c);
+            break;
+
+        case AST_RETURN:
+        case AST_CALL:
+            collect_names(ast, lv, node->b);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+static uint32_t name_bit(const liveness_t* lv, uint32_t name)
+{
+    const uint32_t* found = bsearch(&name, lv->names, lv->count, sizeof(uint32_t), compare_names);
+
+    return found - lv->names;
+}
+
+static bool is_live(const liveness_t* lv, const uint64_t* set, uint32_t name)
+{
+    uint32_t bit = name_bit(lv, name);
+
+    return set[bit / 64] >> (bit % 64) & 1;
+}
+
+static void set_live(const liveness_t* lv, uint64_t* set, uint32_t name, bool live)
+{
+    uint32_t bit = name_bit(lv, name);
+
+    if (live)
+    {
+        set[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    else
+    {
+        set[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    }
+}
+
+/*
+ * Names read by the subtrees of the list (targets of assignments are not read)
+ */
+static void mark_reads(ast_t* ast, const liveness_t* lv, uint64_t* set, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+
+        switch (node->kind)
+        {
+        case AST_VAR:
+            set_live(lv, set, node->a, true);
+            break;
+
+        case AST_OPERATION:
+        case AST_TO_BOOL:
+        case AST_WHILE:
+            mark_reads(ast, lv, set, node->a);
+            mark_reads(ast, lv, set, node->b);
+            break;
+
+        case AST_IF:
+            mark_reads(ast, lv, set, node->a);
+            mark_reads(ast, lv, set, node->b);
+            mark_reads(ast, lv, set, node->c);
+            break;
+
+        case AST_LOCAL:
+        case AST_ASSIGN:
+        case AST_RETURN:
+        case AST_CALL:
+            mark_reads(ast, lv, set, node->b);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * Values can be left out, they neither call nor end the program
+ */
+static bool pure(ast_t* ast, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        ast_node_t* node = AST_NODE(ast, index);
+
+        if (node->kind == AST_CALL || may_fail(node) ||
+            (node->kind == AST_OPERATION && !(pure(ast, node->a) && pure(ast, node->b))))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint64_t* live_copy(const liveness_t* lv, const uint64_t* set)
+{
+    uint64_t* copy = malloc(sizeof(uint64_t) * lv->words);
+
+    if (copy == NULL)
+    {
+        err = E_INTERNAL;
+        return NULL;
+    }
+
+    memcpy(copy, set, sizeof(uint64_t) * lv->words);
+    return copy;
+}
+
+static void live_stats(ast_t* ast, liveness_t* lv, uint32_t owner, uint8_t field, uint64_t* live);
+
+/*
+ * Statement of the block with the variables live after it, they are
+ * changed to the variables live before it. Out are the variables live
+ * after the block, which is the state of the variable of an enclosing
+ * block before a declaration of the same name. Returns false when the
+ * statement is removed.
+ */
+static bool live_stat(ast_t* ast, liveness_t* lv, uint32_t index, uint64_t* live, const uint64_t* out)
+{
+    ast_node_t* node = AST_NODE(ast, index);
+
+    switch (node->kind)
+    {
+    case AST_LOCAL:
+    {
+        uint32_t name = node->a;
+        bool initialized = node->b != AST_NONE || (node->flags & AST_LOCAL_DEFINED);
+
+        if (!is_live(lv, lv->read, name))
+        {
+            if (pure(ast, node->b))
+            {
+                return false;
+            }
+
+            // value of never read local is thrown away, no variable is declared
+            uint32_t target = ast_new_node(ast, AST_VAR, AST_NODE(ast, index)->type);
+
+            if (target == AST_NONE)
+            {
+                return true;
+            }
+
+            node = AST_NODE(ast, index);
+            node->kind = AST_ASSIGN;
+            node->flags = 0;
+            node->a = target;
+            AST_NODE(ast, target)->a = name;
+            AST_NODE(ast, target)->flags = AST_DEAD;
+            mark_reads(ast, lv, live, node->b);
+            return true;
+        }
+
+        if (node->b != AST_NONE && !(node->flags & AST_LOCAL_COPY) && !is_live(lv, live, name))
+        {
+            node->flags |= AST_DEAD;
+
+            if (pure(ast, node->b))
+            {
+                node->b = AST_NONE;
+            }
+        }
+
+        // local without value is not read until it is assigned
+        set_live(lv, live, name, is_live(lv, out, name) || (!initialized && is_live(lv, live, name)));
+        mark_reads(ast, lv, live, node->b);
+        return true;
+    }
+
+    case AST_ASSIGN:
+    {
+        bool dead = true;
+
+        for (uint32_t target = node->a; target != AST_NONE; target = AST_NODE(ast, target)->next)
+        {
+            if (!is_live(lv, live, AST_NODE(ast, target)->a))
+            {
+                AST_NODE(ast, target)->flags |= AST_DEAD;
+            }
+            else
+            {
+                dead = false;
+            }
+        }
+
+        if (dead && pure(ast, node->b))
+        {
+            node->b = AST_NONE;
+        }
+
+        for (uint32_t target = node->a; target != AST_NONE; target = AST_NODE(ast, target)->next)
+        {
+            set_live(lv, live, AST_NODE(ast, target)->a, false);
+        }
+
+        mark_reads(ast, lv, live, node->b);
+        return true;
+    }
+
+    case AST_RETURN:
+        memset(live, 0, sizeof(uint64_t) * lv->words);
+        mark_reads(ast, lv, live, node->b);
+        return true;
+
+    case AST_IF:
+    {
+        uint64_t* other = live_copy(lv, live);
+
+        if (other == NULL)
+        {
+            return true;
+        }
+
+        live_stats(ast, lv, index, 1, live);
+        live_stats(ast, lv, index, 2, other);
+
+        for (uint32_t i = 0; i < lv->words; i++)
+        {
+            live[i] |= other[i];
+        }
+
+        free(other);
+        mark_reads(ast, lv, live, AST_NODE(ast, index)->a);
+        return true;
+    }
+
+    case AST_WHILE:
+    {
+        // everything read by the loop is live in all of its iterations
+        mark_reads(ast, lv, live, node->a);
+        mark_reads(ast, lv, live, node->b);
+
+        uint64_t* body = live_copy(lv, live);
+
+        if (body != NULL)
+        {
+            live_stats(ast, lv, index, 1, body);
+            free(body);
+        }
+
+        return true;
+    }
+
+    default:
+        mark_reads(ast, lv, live, index);
+        return true;
+    }
+}
+
+/*
+ * Statements of the list from the last one, variables declared by the
+ * list are not live at its end
+ */
+static void live_stats(ast_t* ast, liveness_t* lv, uint32_t owner, uint8_t field, uint64_t* live)
+{
+    uint32_t count = list_length(ast, *list_field(ast, owner, field));
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint32_t* stats = malloc(sizeof(uint32_t) * count);
+    uint64_t* out = live_copy(lv, live);
+
+    if (stats == NULL || out == NULL)
+    {
+        err = E_INTERNAL;
+        free(stats);
+        free(out);
+        return;
+    }
+
+    uint32_t i = 0;
+
+    for (uint32_t index = *list_field(ast, owner, field); index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        if (AST_NODE(ast, index)->kind == AST_LOCAL)
+        {
+            set_live(lv, live, AST_NODE(ast, index)->a, false);
+        }
+
+        stats[i++] = index;
+    }
+
+    uint32_t next = AST_NONE;
+
+    // removed statements are unlinked
+    for (i = count; i-- > 0 && err == E_NO_ERR;)
+    {
+        if (live_stat(ast, lv, stats[i], live, out))
+        {
+            AST_NODE(ast, stats[i])->next = next;
+            next = stats[i];
+        }
+    }
+
+    if (err == E_NO_ERR)
+    {
+        *list_field(ast, owner, field) = next;
+    }
+
+    free(stats);
+    free(out);
+}
+
+/*
+ * Stores which are overwritten or go out of scope before they are read
+ * are removed, only calls and operations which may fail are evaluated
+ * for their effects. Locals which are never read are not declared.
+ */
+static void dead_stores(ast_t* ast, uint32_t function)
+{
+    liveness_t lv = {.names = NULL, .count = 0, .capacity = 0, .words = 0, .read = NULL};
+
+    collect_names(ast, &lv, AST_NODE(ast, function)->b);
+    collect_names(ast, &lv, AST_NODE(ast, function)->c);
+
+    if (lv.count == 0 || err != E_NO_ERR)
+    {
+        free(lv.names);
+        return;
+    }
+
+    qsort(lv.names, lv.count, sizeof(uint32_t), compare_names);
+
+    uint32_t unique = 1;
+
+    for (uint32_t i = 1; i < lv.count; i++)
+    {
+        if (lv.names[i] != lv.names[unique - 1])
+        {
+            lv.names[unique++] = lv.names[i];
+        }
+    }
+
+    lv.count = unique;
+    lv.words = (lv.count + 63) / 64;
+    lv.read = calloc(lv.words, sizeof(uint64_t));
+
+    uint64_t* live = calloc(lv.words, sizeof(uint64_t));
+
+    if (lv.read == NULL || live == NULL)
+    {
+        err = E_INTERNAL;
+    }
+    else
+    {
+        mark_reads(ast, &lv, lv.read, AST_NODE(ast, function)->c);
+        live_stats(ast, &lv, function, 2, live);
+    }
+
+    free(live);
+    free(lv.read);
+    free(lv.names);
+}
+
+/*
+ * ----------------------PASSES-----------------------
+ */
+
+void ast_optimize(ast_t* ast, unsigned level)
+{
+    if (level == 0)
+    {
+        return;
+    }
+
+    if (level >= 2)
+    {
+        inline_calls(ast);
+    }
+
+    for (uint32_t index = ast->first; index != AST_NONE; index = AST_NODE(ast, index)->next)
+    {
+        if (AST_NODE(ast, index)->kind == AST_FUNCTION && err == E_NO_ERR)
+        {
+            // kept values of reused operations must not be removed
+            dead_stores(ast, index);
+            cse_stats(ast, AST_NODE(ast, index)->c);
+            hoist_stats(ast, AST_NODE(ast, index)->c);
+        }
+    }
+}
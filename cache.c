@@ -0,0 +1,381 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   On-disk cache of compilation results
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define COMPILER_VERSION "IFJ21 compiler 1.0 (" __DATE__ " " __TIME__ ")"
+
+#define ENTRY_MAGIC "IFJ21CC\n"
+#define ENTRY_SUFFIX ".ifjc"
+#define ENTRY_NAME_LEN 21          // 16 hex digits and suffix
+#define TMP_PREFIX "tmp."
+#define TMP_MAX_AGE (60 * 60)      // abandoned temporary files are removed
+#define COPY_BUFFER_SIZE 4096
+
+/**
+ * @struct Header of the cache entry, followed by version, options,
+ *         source and output.
+ */
+typedef struct entry_header
+{
+    char magic[8];
+    uint64_t version_len;
+    uint64_t options_len;
+    uint64_t source_len;
+    uint64_t output_len;
+    int64_t exit_code;
+} entry_header_t;
+
+/**
+ * @struct Entry found during eviction.
+ */
+typedef struct entry_info
+{
+    char name[ENTRY_NAME_LEN + 1];
+    uint64_t size;
+    time_t mtime;
+} entry_info_t;
+
+static uint64_t hash_update(uint64_t hash, const char* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211u;
+    }
+
+    return hash;
+}
+
+void cache_init(cache_t* cache, const char* dir, uint64_t max_size, const char* options,
+                const char* source, size_t source_len)
+{
+    uint64_t hash = 14695981039346656037u;
+
+    // '\0' separates the parts of the key
+    hash = hash_update(hash, COMPILER_VERSION, sizeof(COMPILER_VERSION));
+    hash = hash_update(hash, options, strlen(options) + 1);
+    hash = hash_update(hash, source, source_len);
+
+    cache->dir = dir;
+    cache->max_size = max_size;
+    cache->options = options;
+    cache->source = source;
+    cache->source_len = source_len;
+    cache->hash = hash;
+}
+
+static char* entry_path(const cache_t* cache, const char* name)
+{
+    size_t len = strlen(cache->dir) + strlen(name) + 2;
+    char* path = malloc(len);
+
+    if (path)
+    {
+        snprintf(path, len, "%s/%s", cache->dir, name);
+    }
+
+    return path;
+}
+
+static char* entry_file(const cache_t* cache)
+{
+    char name[ENTRY_NAME_LEN + 1];
+
+    snprintf(name, sizeof(name), "%016llx" ENTRY_SUFFIX, (unsigned long long)cache->hash);
+
+    return entry_path(cache, name);
+}
+
+/*
+ * Compare next len bytes of the file with data
+ */
+static bool file_equals(FILE* file, const char* data, size_t len)
+{
+    char buffer[COPY_BUFFER_SIZE];
+
+    while (len > 0)
+    {
+        size_t chunk = len < sizeof(buffer) ? len : sizeof(buffer);
+
+        if (fread(buffer, 1, chunk, file) != chunk || memcmp(buffer, data, chunk) != 0)
+        {
+            return false;
+        }
+
+        data += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+static bool file_copy(FILE* from, FILE* to, uint64_t len)
+{
+    char buffer[COPY_BUFFER_SIZE];
+
+    while (len > 0)
+    {
+        size_t chunk = len < sizeof(buffer) ? (size_t)len : sizeof(buffer);
+
+        if (fread(buffer, 1, chunk, from) != chunk || fwrite(buffer, 1, chunk, to) != chunk)
+        {
+            return false;
+        }
+
+        len -= chunk;
+    }
+
+    return true;
+}
+
+bool cache_lookup(cache_t* cache, FILE* out, int* exit_code)
+{
+    entry_header_t header;
+    struct stat info;
+    bool hit = false;
+    char* path = entry_file(cache);
+
+    if (!path)
+    {
+        return false;
+    }
+
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+    {
+        free(path);
+        return false;
+    }
+
+    // entry must be complete before anything is written to out
+    if (fstat(fileno(file), &info) == 0 &&
+        fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, ENTRY_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version_len == sizeof(COMPILER_VERSION) &&
+        header.options_len == strlen(cache->options) + 1 &&
+        header.source_len == cache->source_len &&
+        (uint64_t)info.st_size == sizeof(header) + header.version_len + header.options_len +
+                                  header.source_len + header.output_len &&
+        file_equals(file, COMPILER_VERSION, sizeof(COMPILER_VERSION)) &&
+        file_equals(file, cache->options, strlen(cache->options) + 1) &&
+        file_equals(file, cache->source, cache->source_len))
+    {
+        hit = file_copy(file, out, header.output_len);
+        *exit_code = (int)header.exit_code;
+    }
+
+    fclose(file);
+
+    // hit makes the entry the most recently used one
+    if (hit)
+    {
+        utimensat(AT_FDCWD, path, NULL, 0);
+    }
+
+    free(path);
+
+    return hit;
+}
+
+static bool is_entry_name(const char* name)
+{
+    if (strlen(name) != ENTRY_NAME_LEN || strcmp(name + 16, ENTRY_SUFFIX) != 0)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        if (!strchr("0123456789abcdef", name[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int compare_age(const void* a, const void* b)
+{
+    const entry_info_t* x = a;
+    const entry_info_t* y = b;
+
+    if (x->mtime != y->mtime)
+    {
+        return x->mtime < y->mtime ? -1 : 1;
+    }
+
+    return strcmp(x->name, y->name);
+}
+
+/*
+ * Remove least recently used entries until the cache fits its size bound.
+ * Entries removed by other compilers in the meantime are simply skipped.
+ */
+static void cache_evict(cache_t* cache)
+{
+    DIR* dir = opendir(cache->dir);
+    entry_info_t* entries = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+    struct dirent* item;
+
+    if (!dir)
+    {
+        return;
+    }
+
+    while ((item = readdir(dir)) != NULL)
+    {
+        struct stat info;
+        bool entry = is_entry_name(item->d_name);
+        bool tmp = strncmp(item->d_name, TMP_PREFIX, strlen(TMP_PREFIX)) == 0;
+        char* path;
+
+        if ((!entry && !tmp) || !(path = entry_path(cache, item->d_name)))
+        {
+            continue;
+        }
+
+        if (stat(path, &info) != 0)
+        {
+            free(path);
+            continue;
+        }
+
+        if (tmp)
+        {
+            if (now - info.st_mtime > TMP_MAX_AGE)
+            {
+                unlink(path);
+            }
+
+            free(path);
+            continue;
+        }
+
+        free(path);
+
+        if (len == cap)
+        {
+            size_t new_cap = cap == 0 ? 64 : cap * 2;
+            entry_info_t* tmp_entries = realloc(entries, new_cap * sizeof(entry_info_t));
+
+            if (!tmp_entries)
+            {
+                break;
+            }
+
+            entries = tmp_entries;
+            cap = new_cap;
+        }
+
+        strcpy(entries[len].name, item->d_name);
+        entries[len].size = (uint64_t)info.st_size;
+        entries[len].mtime = info.st_mtime;
+        total += entries[len].size;
+        len++;
+    }
+
+    closedir(dir);
+
+    if (total > cache->max_size)
+    {
+        qsort(entries, len, sizeof(entry_info_t), compare_age);
+
+        for (size_t i = 0; i < len && total > cache->max_size; i++)
+        {
+            char* path = entry_path(cache, entries[i].name);
+
+            if (path)
+            {
+                unlink(path);
+                free(path);
+            }
+
+            total -= entries[i].size;
+        }
+    }
+
+    free(entries);
+}
+
+void cache_store(cache_t* cache, FILE* output, int exit_code)
+{
+    entry_header_t header;
+    char* tmp_path = entry_path(cache, TMP_PREFIX "XXXXXX");
+    char* path = entry_file(cache);
+    FILE* file = NULL;
+    long output_len;
+    int fd;
+
+    if (!tmp_path || !path)
+    {
+        free(tmp_path);
+        free(path);
+        return;
+    }
+
+    mkdir(cache->dir, 0777);
+
+    if (fseek(output, 0, SEEK_END) != 0 || (output_len = ftell(output)) < 0 ||
+        (fd = mkstemp(tmp_path)) < 0)
+    {
+        free(tmp_path);
+        free(path);
+        return;
+    }
+
+    if (!(file = fdopen(fd, "wb")))
+    {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        free(path);
+        return;
+    }
+
+    memcpy(header.magic, ENTRY_MAGIC, sizeof(header.magic));
+    header.version_len = sizeof(COMPILER_VERSION);
+    header.options_len = strlen(cache->options) + 1;
+    header.source_len = cache->source_len;
+    header.output_len = (uint64_t)output_len;
+    header.exit_code = exit_code;
+
+    rewind(output);
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(COMPILER_VERSION, 1, sizeof(COMPILER_VERSION), file) == sizeof(COMPILER_VERSION) &&
+              fwrite(cache->options, 1, header.options_len, file) == header.options_len &&
+              fwrite(cache->source, 1, cache->source_len, file) == cache->source_len &&
+              file_copy(output, file, header.output_len);
+
+    // rename is atomic, readers see either no entry or the whole entry
+    if (fclose(file) != 0 || !ok || rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(path);
+
+    cache_evict(cache);
+}
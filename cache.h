@@ -0,0 +1,68 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   On-disk cache of compilation results
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_CACHE_H
+#define IFJ_BRATWURST2021_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CACHE_DEFAULT_SIZE_MB 64
+
+/**
+ * @struct Cache configuration and key of the current compilation.
+ *         Key is made of compiler version and options affecting the output.
+ */
+typedef struct cache
+{
+    const char* dir;       /// Cache directory, created if missing.
+    uint64_t max_size;     /// Size bound of all entries in bytes.
+    const char* options;   /// Options which change the generated code.
+    const char* source;    /// Whole source program.
+    size_t source_len;
+    uint64_t hash;         /// Hash of version, options and source.
+} cache_t;
+
+/**
+ * Initialization of the cache for one compilation.
+ *
+ * @param cache Pointer to cache.
+ * @param dir Cache directory.
+ * @param max_size Size bound in bytes.
+ * @param options Options which change the generated code.
+ * @param source Source program.
+ * @param source_len Length of the source.
+ */
+void cache_init(cache_t* cache, const char* dir, uint64_t max_size, const char* options,
+                const char* source, size_t source_len);
+
+/**
+ * Find result of the same compilation. Entry is verified against the
+ * version, options and whole source, so hash collisions are harmless.
+ *
+ * @param cache Pointer to cache.
+ * @param out Stream for stored output (written only on hit).
+ * @param exit_code Stored exit code of the compiler.
+ * @return True on hit.
+ */
+bool cache_lookup(cache_t* cache, FILE* out, int* exit_code);
+
+/**
+ * Store result of the compilation and evict least recently used entries
+ * above the size bound. Entry is written to a temporary file and renamed,
+ * so concurrent compilers never see partial entries. Failures are ignored,
+ * cache is only an optimization.
+ *
+ * @param cache Pointer to cache.
+ * @param output Stream with the whole output of the compiler.
+ * @param exit_code Exit code of the compiler.
+ */
+void cache_store(cache_t* cache, FILE* output, int exit_code);
+
+#endif //IFJ_BRATWURST2021_CACHE_H
@@ -10,18 +10,169 @@
  */
 
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <limits.h>
 
 
 #include "code_generator.h"
-
-#define DEF 2
+#include "emitter.h"
+#include "stats.h"
 
 /*
  * ----------------------USEFUL FUNCTIONS-----------------------
  */
 
+/*
+ * Stream for generated code, NULL means stdout
+ */
+static FILE* output = NULL;
+
+/*
+ * Target is ic21vm with extended instructions of built-in functions
+ */
+static bool extended = false;
+
+/*
+ * Source map of the generated code, NULL when disabled. Every entry
+ * "<generated line> <source line>" starts a run of generated lines which
+ * belong to one source line, 0 is code of no statement (built-in functions).
+ */
+static FILE* sourceMap = NULL;
+static _Thread_local unsigned sourceLine = 0;
+static unsigned mapLine = 1;            // generated line being written
+static unsigned mapSource = UINT_MAX;   // source line of the last entry
+static bool mapLineStart = true;
+static char* mapCode = NULL;           // formatted code being counted
+static size_t mapCap = 0;
+
+/*
+ * Code of the isolated unit, it is written to the output by the main thread
+ */
+static _Thread_local bool isolated = false;
+static _Thread_local bool dependent = false;
+static _Thread_local char* unitCode = NULL;
+static _Thread_local size_t unitLen = 0;
+static _Thread_local size_t unitCap = 0;
+
+static void unit_vprintf(const char* format, va_list args){
+    va_list copy;
+
+    va_copy(copy, args);
+    int written = vsnprintf(unitCode == NULL ? NULL : unitCode + unitLen, unitCap - unitLen, format, copy);
+    va_end(copy);
+
+    if(written < 0){
+        err = E_INTERNAL;
+        return;
+    }
+
+    if((size_t)written >= unitCap - unitLen){
+        size_t cap = unitCap == 0 ? 4096 : unitCap * 2;
+        while(cap <= unitLen + written){
+            cap *= 2;
+        }
+        char* tmp = realloc(unitCode, cap);
+        if(tmp == NULL){
+            err = E_INTERNAL;
+            return;
+        }
+        unitCode = tmp;
+        unitCap = cap;
+        vsnprintf(unitCode + unitLen, unitCap - unitLen, format, args);
+    }
+
+    unitLen += written;
+}
+
+/*
+ * Count lines of the code and add an entry of the source map when a line
+ * of other source line starts
+ */
+static void map_lines(const char* format, va_list args){
+    va_list copy;
+
+    va_copy(copy, args);
+    int len = vsnprintf(mapCode, mapCap, format, copy);
+    va_end(copy);
+
+    if(len < 0){
+        err = E_INTERNAL;
+        return;
+    }
+
+    if((size_t)len >= mapCap){
+        size_t cap = mapCap == 0 ? 4096 : mapCap * 2;
+        while(cap <= (size_t)len){
+            cap *= 2;
+        }
+        char* tmp = realloc(mapCode, cap);
+        if(tmp == NULL){
+            err = E_INTERNAL;
+            return;
+        }
+        mapCode = tmp;
+        mapCap = cap;
+        va_copy(copy, args);
+        vsnprintf(mapCode, mapCap, format, copy);
+        va_end(copy);
+    }
+
+    for(const char* code = mapCode; code < mapCode + len;){
+        if(mapLineStart && sourceLine != mapSource){
+            fprintf(sourceMap, "%u %u\n", mapLine, sourceLine);
+            mapSource = sourceLine;
+        }
+        const char* newline = memchr(code, '\n', mapCode + len - code);
+        if(newline == NULL){
+            mapLineStart = false;
+            break;
+        }
+        mapLine++;
+        mapLineStart = true;
+        code = newline + 1;
+    }
+}
+
+/*
+ * All generated code goes through this function
+ */
+static void vemit(const char* format, va_list args){
+    int written;
+
+    // statistics are counted when the main thread writes the unit
+    if(isolated){
+        unit_vprintf(format, args);
+        return;
+    }
+
+    if(sourceMap != NULL){
+        map_lines(format, args);
+    }
+
+    STATS_PHASE_ENTER(STATS_PHASE_EMIT);
+
+    if(emitter_running()){
+        written = emitter_vprintf(format, args);
+    }else{
+        written = vfprintf(output ? output : stdout, format, args);
+    }
+
+    STATS_PHASE_LEAVE();
+
+    if(written > 0){
+        STATS_ADD(emitted_bytes, written);
+    }
+}
+
+static void emit(const char* format, ...){
+    va_list args;
+
+    va_start(args, format);
+    vemit(format, args);
+    va_end(args);
+}
+
 int numPlaces (int n) {    
     int r = 1;
     if (n < 0) n = (n == INT_MIN) ? INT_MAX: -n;
@@ -32,115 +183,106 @@ int numPlaces (int n) {
     return r;
 }
 
-char* convert_string(char* str_toconvert){
-    if (str_toconvert == NULL)
-    {
-        return NULL;
+/*
+ * Scratch buffer for encoded string literals, reused by all literals
+ */
+static _Thread_local char* literal = NULL;
+static _Thread_local size_t literal_cap = 0;
+
+/*
+ * Text of operands in the temporaries mode, one buffer for each operand
+ * of an instruction
+ */
+#define OPERAND_BUFFERS 3
+
+static _Thread_local char* operandText[OPERAND_BUFFERS];
+static _Thread_local size_t operandCap[OPERAND_BUFFERS];
+
+static void free_buffers(){
+    free(literal);
+    literal = NULL;
+    literal_cap = 0;
+    for(int i = 0; i < OPERAND_BUFFERS; i++){
+        free(operandText[i]);
+        operandText[i] = NULL;
+        operandCap[i] = 0;
     }
-    
-    char* string = str_toconvert;
+}
 
-    if (string[0] == '\0')
-    {
-        return "";
-    }
-    
-    string_ptr_t string_res = string_init();
-
-    while(*string != '\0'){          
-        if(*string == 92){                        
-            string_append_character(string_res, '\\');
-            
-            if (!isdigit(*(string+1)))
-            {
-                string++;
-
-                switch (*string)
-                {
-                case 'a':                    
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '7');
-                    break;
-
-                case 'b':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '8');
-                    break;
-                
-                case 'f':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '1');
-                    string_append_character(string_res, '2');
-                    break;
-                
-                case 'n':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '1');
-                    string_append_character(string_res, '0');
-                    break;
-
-                case 'r':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '1');
-                    string_append_character(string_res, '3');
-                    break;
-
-                case 't':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '9');
-                    break;
-
-                case 'v':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '1');
-                    string_append_character(string_res, '1');
-                    break;
-
-                case '\\':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '9');
-                    string_append_character(string_res, '2');
-                    break;
-
-                case '"':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '3');
-                    string_append_character(string_res, '4');
-                    break;
-
-                case '\'':
-                    string_append_character(string_res, '0');
-                    string_append_character(string_res, '3');
-                    string_append_character(string_res, '9');
-                    break;                
-
-                default:
-                    break;
-                }                                       
-            }                               
-        }else if(*string == 35){
-            string_append_character(string_res, '\\');
-            string_append_character(string_res, '0');
-            string_append_character(string_res, '3');
-            string_append_character(string_res, '5');
-        }else if(*string <= 32){
-            string_append_character(string_res, '\\');
-            string_append_character(string_res, '0');
-            string_append_character(string_res, ((*string / 10) + 48));
-            string_append_character(string_res, ((*string % 10) + 48));
+#define LITERAL_PREFIX "PUSHS string@"
+#define LITERAL_PREFIX_LEN (sizeof(LITERAL_PREFIX) - 1)
+
+/*
+ * Decimal codes of escape sequences kept by the scanner (\n -> \010 ...),
+ * unknown sequences are dropped
+ */
+static const char* escape_code(char c){
+    switch(c){
+        case 'a':  return "007";
+        case 'b':  return "008";
+        case 'f':  return "012";
+        case 'n':  return "010";
+        case 'r':  return "013";
+        case 't':  return "009";
+        case 'v':  return "011";
+        case '\\': return "092";
+        case '"':  return "034";
+        case '\'': return "039";
+        default:   return "";
+    }
+}
+
+/*
+ * Characters copied to string@ as they are
+ */
+static int is_plain(char c){
+    return c > 32 && c != '#' && c != '\\';
+}
+
+/*
+ * Encode string literal to the string@ form in one pass, dst must have
+ * room for 4 * strlen(src) characters. Returns end of the written data.
+ */
+static char* encode_string(const char* src, char* dst){
+    while(*src != '\0'){
+        const char* run = src;
+
+        // runs of plain characters are copied at once
+        while(is_plain(*src)){
+            src++;
+        }
+
+        memcpy(dst, run, src - run);
+        dst += src - run;
+
+        if(*src == '\0'){
+            break;
+        }
+
+        *dst++ = '\\';
+
+        if(*src == '\\'){
+            // \ddd stays as it is, digits are plain characters
+            if(!isdigit((unsigned char)src[1]) && src[1] != '\0'){
+                const char* code = escape_code(*++src);
+                size_t len = strlen(code);
+
+                memcpy(dst, code, len);
+                dst += len;
+            }
+        }else if(*src == '#'){
+            memcpy(dst, "035", 3);
+            dst += 3;
         }else{
-            string_append_character(string_res, *string);
+            *dst++ = '0';
+            *dst++ = (*src / 10) + 48;
+            *dst++ = (*src % 10) + 48;
         }
 
-        string++;
+        src++;
     }
 
-    string_append_character(string_res, '\0');
-
-    return string_res->string;
+    return dst;
 }
 
 shadowStack_t* shStackPush(shadowStack_t* shade, char* name, int scale, int function){
@@ -157,7 +299,7 @@ shadowStack_t* shStackPush(shadowStack_t* shade, char* name, int scale, int func
     strcpy(newNode->name, name);
     newNode->scale = scale;
     newNode->inicialized = 0;
-    newNode->nameScale = malloc(strlen(name) + numPlaces(scale) + 1);
+    newNode->nameScale = malloc(function + strlen(name) + numPlaces(scale) + 2);
     if(newNode->nameScale == NULL){
         err = E_INTERNAL;
         return NULL;
@@ -220,205 +362,205 @@ shadowStack_t* shStackDelByScale(shadowStack_t* shade, int scale){
  */
 
 void codeGen_write(){
-    printf("#----FUN-write----\n");
-    printf("JUMP write$end\n");
-    printf("LABEL write\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("DEFVAR TF@cnt_of_parameter\n");
-    printf("DEFVAR TF@to_print\n");
-    printf("DEFVAR TF@cnt\n");
-    printf("POPS TF@cnt_of_parameter\n");
-    printf("MOVE TF@cnt int@0\n");
-    printf("LABEL _print_while_start\n");
-    printf("LT GF@expr TF@cnt TF@cnt_of_parameter\n");
-    printf("JUMPIFNEQ _print_while_end GF@expr bool@true\n");
-    printf("POPS TF@to_print\n");
-    printf("JUMPIFNEQ exprint TF@to_print nil@nil \n");
-    printf("PUSHS string@nil\n");
-    printf("POPS TF@to_print\n");
-    printf("LABEL exprint\n");
-    printf("WRITE TF@to_print\n");
-    printf("ADD TF@cnt TF@cnt int@1\n");
-    printf("JUMP _print_while_start\n");
-    printf("LABEL _print_while_end\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL write$end\n");
+    emit("#----FUN-write----\n");
+    emit("JUMP write$end\n");
+    emit("LABEL write\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("DEFVAR TF@cnt_of_parameter\n");
+    emit("DEFVAR TF@to_print\n");
+    emit("DEFVAR TF@cnt\n");
+    emit("POPS TF@cnt_of_parameter\n");
+    emit("MOVE TF@cnt int@0\n");
+    emit("LABEL _print_while_start\n");
+    emit("LT GF@expr TF@cnt TF@cnt_of_parameter\n");
+    emit("JUMPIFNEQ _print_while_end GF@expr bool@true\n");
+    emit("POPS TF@to_print\n");
+    emit("JUMPIFNEQ exprint TF@to_print nil@nil \n");
+    emit("PUSHS string@nil\n");
+    emit("POPS TF@to_print\n");
+    emit("LABEL exprint\n");
+    emit("WRITE TF@to_print\n");
+    emit("ADD TF@cnt TF@cnt int@1\n");
+    emit("JUMP _print_while_start\n");
+    emit("LABEL _print_while_end\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL write$end\n");
 }
 
 void codeGen_reads(){
-    printf("#----FUN-reads----\n");
-    printf("JUMP reads$end\n");
-    printf("LABEL reads\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("POPS GF@trash\n");
-    printf("DEFVAR TF@out\n");
-    printf("READ TF@out string\n");
-    printf("PUSHS TF@out\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL reads$end\n");
+    emit("#----FUN-reads----\n");
+    emit("JUMP reads$end\n");
+    emit("LABEL reads\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("POPS GF@trash\n");
+    emit("DEFVAR TF@out\n");
+    emit("READ TF@out string\n");
+    emit("PUSHS TF@out\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL reads$end\n");
 }
 
 void codeGen_readi(){
-    printf("#----FUN-readi----\n");
-    printf("JUMP readi$end\n");
-    printf("LABEL readi\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("POPS GF@trash\n");
-    printf("DEFVAR TF@out\n");
-    printf("READ TF@out int\n");
-    printf("PUSHS TF@out\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL readi$end\n");
+    emit("#----FUN-readi----\n");
+    emit("JUMP readi$end\n");
+    emit("LABEL readi\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("POPS GF@trash\n");
+    emit("DEFVAR TF@out\n");
+    emit("READ TF@out int\n");
+    emit("PUSHS TF@out\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL readi$end\n");
 }
 
 void codeGen_readn(){
-    printf("#----FUN-readn----\n");
-    printf("JUMP readn$end\n");
-    printf("LABEL readn\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("POPS GF@trash\n");
-    printf("DEFVAR TF@out\n");
-    printf("READ TF@out float\n");
-    printf("PUSHS TF@out\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL readn$end\n");
+    emit("#----FUN-readn----\n");
+    emit("JUMP readn$end\n");
+    emit("LABEL readn\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("POPS GF@trash\n");
+    emit("DEFVAR TF@out\n");
+    emit("READ TF@out float\n");
+    emit("PUSHS TF@out\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL readn$end\n");
 }
 
 void codeGen_tointeger(){
-    printf("#----FUN-tointeger----\n");
-    printf("JUMP tointeger$end\n");
-    printf("LABEL tointeger\n");
-    printf("POPS GF@trash\n");
-    printf("FLOAT2INTS\n");
-    printf("RETURN\n");
-    printf("LABEL tointeger$end\n");
+    emit("#----FUN-tointeger----\n");
+    emit("JUMP tointeger$end\n");
+    emit("LABEL tointeger\n");
+    emit("POPS GF@trash\n");
+    emit("FLOAT2INTS\n");
+    emit("RETURN\n");
+    emit("LABEL tointeger$end\n");
 }
 
 void codeGen_substr(){
-    printf("#----FUN-substr----\n");
-    printf("JUMP substr$end\n");
-    printf("LABEL substr\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("POPS GF@trash\n");
-    printf("DEFVAR TF@ret_str\n");
-    printf("MOVE TF@ret_str string@\n");
-    printf("DEFVAR TF@s\n");
-    printf("POPS TF@s\n");
-    printf("DEFVAR TF@i\n");
-    printf("POPS TF@i\n");
-    printf("SUB TF@i TF@i int@1\n");
-    printf("DEFVAR TF@n\n");
-    printf("POPS TF@n\n");
-    printf("DEFVAR TF@char\n");
-    printf("MOVE TF@char string@\n");
-    printf("DEFVAR TF@str_len\n");
-    printf("DEFVAR TF@l_limit\n");
-    printf("DEFVAR TF@r_limit\n");
-    printf("STRLEN TF@str_len TF@s\n");
-    printf("LT TF@l_limit TF@i int@0\n");
-    printf("NOT TF@l_limit TF@l_limit\n");
-    printf("GT TF@r_limit TF@i TF@str_len\n");
-    printf("NOT TF@r_limit TF@r_limit\n");
-    printf("AND TF@l_limit TF@l_limit TF@r_limit\n");
-    printf("LT TF@r_limit TF@n int@0\n");
-    printf("NOT TF@r_limit TF@r_limit\n");
-    printf("AND TF@l_limit TF@l_limit TF@r_limit\n");
-    printf("JUMPIFNEQ _sub_end TF@l_limit bool@true\n");
-    printf("DEFVAR TF@cnt_of_loaded\n");
-    printf("MOVE TF@cnt_of_loaded TF@i\n");
-    printf("LABEL _sub_while\n");
-    printf("LT TF@l_limit TF@i TF@str_len\n");
-    printf("LT TF@r_limit TF@cnt_of_loaded TF@n\n");
-    printf("AND TF@l_limit TF@l_limit TF@r_limit\n");
-    printf("JUMPIFNEQ _sub_end TF@l_limit bool@true\n");
-    printf("GETCHAR TF@char TF@s TF@i\n");
-    printf("CONCAT TF@ret_str TF@ret_str TF@char\n");
-    printf("ADD TF@cnt_of_loaded TF@cnt_of_loaded int@1\n");
-    printf("ADD TF@i TF@i int@1\n");
-    printf("JUMP _sub_while\n");
-    printf("LABEL _sub_end\n");
-    printf("PUSHS TF@ret_str\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL substr$end\n");
+    emit("#----FUN-substr----\n");
+    emit("JUMP substr$end\n");
+    emit("LABEL substr\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("POPS GF@trash\n");
+    emit("DEFVAR TF@ret_str\n");
+    emit("MOVE TF@ret_str string@\n");
+    emit("DEFVAR TF@s\n");
+    emit("POPS TF@s\n");
+    emit("DEFVAR TF@i\n");
+    emit("POPS TF@i\n");
+    emit("SUB TF@i TF@i int@1\n");
+    emit("DEFVAR TF@n\n");
+    emit("POPS TF@n\n");
+    emit("DEFVAR TF@char\n");
+    emit("MOVE TF@char string@\n");
+    emit("DEFVAR TF@str_len\n");
+    emit("DEFVAR TF@l_limit\n");
+    emit("DEFVAR TF@r_limit\n");
+    emit("STRLEN TF@str_len TF@s\n");
+    emit("LT TF@l_limit TF@i int@0\n");
+    emit("NOT TF@l_limit TF@l_limit\n");
+    emit("GT TF@r_limit TF@i TF@str_len\n");
+    emit("NOT TF@r_limit TF@r_limit\n");
+    emit("AND TF@l_limit TF@l_limit TF@r_limit\n");
+    emit("LT TF@r_limit TF@n int@0\n");
+    emit("NOT TF@r_limit TF@r_limit\n");
+    emit("AND TF@l_limit TF@l_limit TF@r_limit\n");
+    emit("JUMPIFNEQ _sub_end TF@l_limit bool@true\n");
+    emit("DEFVAR TF@cnt_of_loaded\n");
+    emit("MOVE TF@cnt_of_loaded TF@i\n");
+    emit("LABEL _sub_while\n");
+    emit("LT TF@l_limit TF@i TF@str_len\n");
+    emit("LT TF@r_limit TF@cnt_of_loaded TF@n\n");
+    emit("AND TF@l_limit TF@l_limit TF@r_limit\n");
+    emit("JUMPIFNEQ _sub_end TF@l_limit bool@true\n");
+    emit("GETCHAR TF@char TF@s TF@i\n");
+    emit("CONCAT TF@ret_str TF@ret_str TF@char\n");
+    emit("ADD TF@cnt_of_loaded TF@cnt_of_loaded int@1\n");
+    emit("ADD TF@i TF@i int@1\n");
+    emit("JUMP _sub_while\n");
+    emit("LABEL _sub_end\n");
+    emit("PUSHS TF@ret_str\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL substr$end\n");
 }
 
 void codeGen_ord(){
-    printf("#----FUN-ord----\n");
-    printf("JUMP ord$end\n");
-    printf("LABEL ord\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("POPS GF@trash\n");
-    printf("DEFVAR TF@ascii\n");
-    printf("DEFVAR TF@err\n");
-    printf("MOVE TF@ascii string@\n");
-    printf("MOVE TF@err int@1\n");
-    printf("DEFVAR TF@l_limit\n");
-    printf("DEFVAR TF@r_limit\n");
-    printf("DEFVAR TF@string\n");
-    printf("DEFVAR TF@i\n");
-    printf("POPS TF@string\n");
-    printf("POPS TF@i\n");
-    printf("DEFVAR TF@str_len\n");
-    printf("MOVE TF@str_len int@0\n");
-    printf("STRLEN TF@str_len TF@string\n");
-    printf("SUB TF@str_len TF@str_len int@1\n");
-    printf("LT TF@l_limit TF@i int@0\n");
-    printf("NOT TF@l_limit TF@l_limit\n");
-    printf("GT TF@r_limit TF@i TF@str_len\n");
-    printf("NOT TF@r_limit TF@r_limit\n");
-    printf("AND TF@l_limit TF@l_limit TF@r_limit\n");
-    printf("JUMPIFNEQ _ord_end TF@l_limit bool@true\n");
-    printf("MOVE TF@err int@0\n");
-    printf("STRI2INT TF@ascii TF@string TF@i\n");
-    printf("LABEL _ord_end\n");
-    printf("PUSHS TF@ascii\n");
-    printf("PUSHS TF@err\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL ord$end\n");
+    emit("#----FUN-ord----\n");
+    emit("JUMP ord$end\n");
+    emit("LABEL ord\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("POPS GF@trash\n");
+    emit("DEFVAR TF@ascii\n");
+    emit("DEFVAR TF@err\n");
+    emit("MOVE TF@ascii string@\n");
+    emit("MOVE TF@err int@1\n");
+    emit("DEFVAR TF@l_limit\n");
+    emit("DEFVAR TF@r_limit\n");
+    emit("DEFVAR TF@string\n");
+    emit("DEFVAR TF@i\n");
+    emit("POPS TF@string\n");
+    emit("POPS TF@i\n");
+    emit("DEFVAR TF@str_len\n");
+    emit("MOVE TF@str_len int@0\n");
+    emit("STRLEN TF@str_len TF@string\n");
+    emit("SUB TF@str_len TF@str_len int@1\n");
+    emit("LT TF@l_limit TF@i int@0\n");
+    emit("NOT TF@l_limit TF@l_limit\n");
+    emit("GT TF@r_limit TF@i TF@str_len\n");
+    emit("NOT TF@r_limit TF@r_limit\n");
+    emit("AND TF@l_limit TF@l_limit TF@r_limit\n");
+    emit("JUMPIFNEQ _ord_end TF@l_limit bool@true\n");
+    emit("MOVE TF@err int@0\n");
+    emit("STRI2INT TF@ascii TF@string TF@i\n");
+    emit("LABEL _ord_end\n");
+    emit("PUSHS TF@ascii\n");
+    emit("PUSHS TF@err\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL ord$end\n");
 
 }
 
 void codeGen_chr(){
-    printf("#----FUN-chr----\n");
-    printf("JUMP chr$end\n");
-    printf("LABEL chr\n");
-    printf("PUSHFRAME\n");
-    printf("CREATEFRAME\n");
-    printf("POPS GF@trash\n");
-    printf("DEFVAR TF@ret_str\n");
-    printf("MOVE TF@ret_str string@\n");
-    printf("DEFVAR TF@err\n");
-    printf("MOVE TF@err int@1\n");
-    printf("DEFVAR TF@l_limit\n");
-    printf("DEFVAR TF@r_limit\n");
-    printf("DEFVAR TF@i\n");
-    printf("POPS TF@i\n");
-    printf("LT TF@l_limit TF@i int@0\n");
-    printf("NOT TF@l_limit TF@l_limit\n");
-    printf("GT TF@r_limit TF@i int@255\n");
-    printf("NOT TF@r_limit TF@r_limit\n");
-    printf("AND TF@l_limit TF@l_limit TF@r_limit\n");
-    printf("JUMPIFNEQ _chr_end TF@l_limit bool@true\n");
-    printf("MOVE TF@err int@0\n");
-    printf("INT2CHAR TF@ret_str TF@i\n");
-    printf("LABEL _chr_end\n");
-    printf("PUSHS TF@ret_str\n");
-    printf("PUSHS TF@err\n");
-    printf("POPFRAME\n");
-    printf("RETURN\n");
-    printf("LABEL chr$end\n");
+    emit("#----FUN-chr----\n");
+    emit("JUMP chr$end\n");
+    emit("LABEL chr\n");
+    emit("PUSHFRAME\n");
+    emit("CREATEFRAME\n");
+    emit("POPS GF@trash\n");
+    emit("DEFVAR TF@ret_str\n");
+    emit("MOVE TF@ret_str string@\n");
+    emit("DEFVAR TF@err\n");
+    emit("MOVE TF@err int@1\n");
+    emit("DEFVAR TF@l_limit\n");
+    emit("DEFVAR TF@r_limit\n");
+    emit("DEFVAR TF@i\n");
+    emit("POPS TF@i\n");
+    emit("LT TF@l_limit TF@i int@0\n");
+    emit("NOT TF@l_limit TF@l_limit\n");
+    emit("GT TF@r_limit TF@i int@255\n");
+    emit("NOT TF@r_limit TF@r_limit\n");
+    emit("AND TF@l_limit TF@l_limit TF@r_limit\n");
+    emit("JUMPIFNEQ _chr_end TF@l_limit bool@true\n");
+    emit("MOVE TF@err int@0\n");
+    emit("INT2CHAR TF@ret_str TF@i\n");
+    emit("LABEL _chr_end\n");
+    emit("PUSHS TF@ret_str\n");
+    emit("PUSHS TF@err\n");
+    emit("POPFRAME\n");
+    emit("RETURN\n");
+    emit("LABEL chr$end\n");
 }
 
 
@@ -426,20 +568,125 @@ void codeGen_chr(){
  * ----------------------GENERATOR START-----------------------
  */
 
-static int ifCounter = 0;
-static int whileCounter = 0;
-static int stackTop = -1;
-static int stackSize = TABLE_SIZE;
-static int* stack;
-static int intToFloat1 = -1;
-static int intToFloat2 = -1;
-static int scale = -1;
-static int function = 0;
-static int isWhile = 0;
-static int isNil = 0;
-static int toBool = -1;
-DLList* list = NULL;
-shadowStack_t* shStack = NULL;
+/*
+ * Condition of a loop in the list, from its label to the branch
+ */
+typedef struct loopCondition{
+    DLLElementPtr first;
+    DLLElementPtr last;
+} loopCondition_t;
+
+/*
+ * State of the generator, every thread generating units has its own,
+ * isWhile is the depth of loops
+ */
+static _Thread_local int ifCounter = 0;
+static _Thread_local int whileCounter = 0;
+static _Thread_local int stackTop = -1;
+static _Thread_local int stackSize = TABLE_SIZE;
+static _Thread_local int* stack;
+static _Thread_local int intToFloat1 = -1;
+static _Thread_local int intToFloat2 = -1;
+static _Thread_local int scale = -1;
+static _Thread_local int function = 0;
+static _Thread_local int isWhile = 0;
+static _Thread_local int isNil = 0;
+static _Thread_local DLList* list = NULL;
+static _Thread_local loopCondition_t* loops = NULL;
+static _Thread_local int loopsSize = 0;
+static _Thread_local shadowStack_t* shStack = NULL;
+
+/*
+ * Collect the instruction of the loop with its source line
+ */
+static void list_insert(char* str, unsigned size){
+    DLL_InsertLast(list, str, size);
+    if(list->lastElement != NULL){
+        list->lastElement->line = sourceLine;
+    }
+}
+
+/*
+ * Instruction of the current code, inside of while it is collected in the list
+ */
+static void instruction(const char* format, ...){
+    va_list args;
+
+    if(isWhile == 0){
+        va_start(args, format);
+        vemit(format, args);
+        va_end(args);
+        return;
+    }
+
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if(len < 0){
+        err = E_INTERNAL;
+        return;
+    }
+    char* str = (char*)malloc(len + 1);
+    if(str == NULL){
+        err = E_INTERNAL;
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(str, len + 1, format, args);
+    va_end(args);
+    list_insert(str, len + 1);
+    free(str);
+}
+
+/*
+ * Enter the scale of if or while with its label number
+ */
+static void scope_push(int label){
+    stackTop++;
+    scale++;
+    if(stackTop >= stackSize){
+        stackSize += stackSize;
+        stack = realloc(stack, sizeof(int) * stackSize);
+    }
+    stack[stackTop] = label;
+}
+
+/*
+ * Leave the scale, isolated unit depends on previous units when the
+ * variables of previous units would be deleted too
+ */
+static void shStackLeaveScale(int leftScale){
+    shStack = shStackDelByScale(shStack, leftScale);
+    if(isolated && shStack == NULL && leftScale != 0){
+        dependent = true;
+    }
+}
+
+void codeGen_set_output(FILE* file){
+    output = file;
+}
+
+void codeGen_set_extended(bool enable){
+    extended = enable;
+}
+
+void codeGen_set_source_map(FILE* file){
+    sourceMap = file;
+    mapLine = 1;
+    mapSource = UINT_MAX;
+    mapLineStart = true;
+    sourceLine = 0;
+
+    if(file == NULL){
+        free(mapCode);
+        mapCode = NULL;
+        mapCap = 0;
+    }
+}
+
+void codeGen_set_line(unsigned line){
+    sourceLine = line;
+}
 
 void codeGen_init(){
     stack = malloc(sizeof(int) * stackSize);
@@ -454,17 +701,21 @@ void codeGen_init(){
     }
     DLL_Init(list);
     shStack = NULL;
-    printf(".IFJcode21\n");
-    printf("DEFVAR GF@expr\n");
-    printf("DEFVAR GF@tmp1\n");
-    printf("DEFVAR GF@tmp2\n");
-    printf("DEFVAR GF@tmp3\n");
-    printf("DEFVAR GF@tmp4\n");
-    printf("DEFVAR GF@trash\n");
-    printf("CREATEFRAME\n");
+    emit(".IFJcode21\n");
+    emit("DEFVAR GF@expr\n");
+    emit("DEFVAR GF@tmp1\n");
+    emit("DEFVAR GF@tmp2\n");
+    emit("DEFVAR GF@tmp3\n");
+    emit("DEFVAR GF@tmp4\n");
+    emit("DEFVAR GF@trash\n");
+    emit("CREATEFRAME\n");
 }
 
 void codeGen_built_in_function(){
+    // calls are replaced by instructions, see codeGen_function_call
+    if(extended){
+        return;
+    }
     codeGen_write();
     codeGen_reads();
     codeGen_readi();
@@ -481,42 +732,58 @@ void codeGen_built_in_function(){
 
 void codeGen_push_var(char* name){
     shadowStack_t* current = shStackNameScaleByNameInitialized(shStack, name);
+    if(current == NULL && isolated){
+        dependent = true;
+        return;
+    }
     if(current == NULL){
         err = E_INTERNAL;
         return;
     }
 
     if(isWhile == 0){
-        printf("PUSHS TF@%s\n", current->nameScale);
+        emit("PUSHS TF@%s\n", current->nameScale);
     }else{
         char* str = (char*)malloc(12 + strlen(current->nameScale) + 1);
         sprintf(str, "PUSHS TF@%s\n", current->nameScale);
-        DLL_InsertLast(list, str, 12 + strlen(current->nameScale) + 1);
+        list_insert(str, 12 + strlen(current->nameScale) + 1);
         free(str);
         str = NULL;
     }
 }
 
 void codeGen_push_string(char* value){
+    size_t needed = LITERAL_PREFIX_LEN + 4 * strlen(value) + 2;
+
+    if(needed > literal_cap){
+        char* tmp = realloc(literal, needed);
+        if(tmp == NULL){
+            err = E_INTERNAL;
+            return;
+        }
+        literal = tmp;
+        literal_cap = needed;
+    }
+
+    memcpy(literal, LITERAL_PREFIX, LITERAL_PREFIX_LEN);
+    char* end = encode_string(value, literal + LITERAL_PREFIX_LEN);
+    *end++ = '\n';
+    *end = '\0';
+
     if(isWhile == 0){
-        printf("PUSHS string@%s\n", convert_string(value));
+        emit("%s", literal);
     }else{
-        char* str = (char*)malloc(15 + strlen(convert_string(value)) + 1);
-        sprintf(str, "PUSHS string@%s\n", convert_string(value));
-        DLL_InsertLast(list, str, 15 + strlen(convert_string(value)) + 1);
-        free(str);
-        str = NULL;
+        list_insert(literal, end - literal + 1);
     }
-
 }
 
 void codeGen_push_int(int value){
     if(isWhile == 0){
-        printf("PUSHS int@%d\n", value);
+        emit("PUSHS int@%d\n", value);
     }else{
         char* str = (char*)malloc(INST_LEN + numPlaces(value) + 1);
         sprintf(str, "PUSHS int@%d\n", value);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(value) + 1);
+        list_insert(str, INST_LEN + numPlaces(value) + 1);
         free(str);
         str = NULL;
     }
@@ -525,11 +792,11 @@ void codeGen_push_int(int value){
 
 void codeGen_push_float(double value){
     if(isWhile == 0){
-        printf("PUSHS float@%a\n", value);
+        emit("PUSHS float@%a\n", value);
     }else{
         char* str = (char*)malloc(INST_LEN + 30 + 1);
         sprintf(str, "PUSHS float@%a\n", value);
-        DLL_InsertLast(list, str, INST_LEN + 30 + 1);
+        list_insert(str, INST_LEN + 30 + 1);
         free(str);
         str = NULL;
     }
@@ -539,11 +806,11 @@ void codeGen_push_float(double value){
 void codeGen_push_nil(){
     isNil = 1;
     if(isWhile == 0){
-        printf("PUSHS nil@nil\n");
+        emit("PUSHS nil@nil\n");
     }else{
         char* str = (char*)malloc(INST_LEN + 1);
         sprintf(str, "PUSHS nil@nil\n");
-        DLL_InsertLast(list, str, INST_LEN + 1);
+        list_insert(str, INST_LEN + 1);
         free(str);
         str = NULL;
     }
@@ -557,11 +824,15 @@ void codeGen_new_var(char* name){
         return;
     }
         
-    printf("DEFVAR TF@%s\n", shStack->nameScale);
+    emit("DEFVAR TF@%s\n", shStack->nameScale);
 }
 
 void codeGen_assign_var(char* name, unsigned nil){
     shadowStack_t* current = shStackNameScaleByName(shStack, name);
+    if(current == NULL && isolated){
+        dependent = true;
+        return;
+    }
     if (nil == DEF)
     {
         current->inicialized = 1;        
@@ -576,60 +847,99 @@ void codeGen_assign_var(char* name, unsigned nil){
             current->inicialized = 1;
         }
         if(isWhile == 0){
-            printf("POPS TF@%s\n", current->nameScale);
+            emit("POPS TF@%s\n", current->nameScale);
         }else{
             char* str = (char*)malloc(INST_LEN + strlen(current->nameScale) + 1);
             sprintf(str, "POPS TF@%s\n", current->nameScale);
-            DLL_InsertLast(list, str, INST_LEN + strlen(current->nameScale) + 1);
+            list_insert(str, INST_LEN + strlen(current->nameScale) + 1);
             free(str);
             str = NULL;
         }
     }        
 }
 
+/*
+ * Assigned value is not read, the variable is only marked as initialized
+ * and the value on the stack (if pushed) is thrown away. Removed unused
+ * local is not found.
+ */
+void codeGen_discard_var(char* name, bool pushed){
+    shadowStack_t* current = shStackNameScaleByName(shStack, name);
+
+    if(current != NULL){
+        current->inicialized = 1;
+    }
+    if(pushed){
+        instruction("POPS GF@trash\n");
+    }
+}
+
 /*
  * ----------------------IF-----------------------
  */
 
-void codeGen_if_start(){
-    stackTop++;
-    scale++;
-    if(stackTop >= stackSize){
-        stackSize += stackSize;
-        stack = realloc(stack, sizeof(int) * stackSize);
+/*
+ * Jump to the label when the condition has the value. Relational
+ * condition is compared by the branch itself, its operands are on the
+ * stack.
+ */
+static void branch(psa_rules_enum condition, const char* label, bool value){
+    // a <= b is not a > b, a >= b is not a < b
+    bool direct = condition == NT_LTN_NT || condition == NT_GTN_NT;
+
+    switch (condition){
+        case OPERAND:
+            // nil is false, any other value is true
+            instruction("POPS GF@expr\n");
+            instruction("%s %s GF@expr nil@nil\n", value ? "JUMPIFNEQ" : "JUMPIFEQ", label);
+            break;
+        case NT_EQ_NT:
+            instruction("%s %s\n", value ? "JUMPIFEQS" : "JUMPIFNEQS", label);
+            break;
+        case NT_NEQ_NT:
+            instruction("%s %s\n", value ? "JUMPIFNEQS" : "JUMPIFEQS", label);
+            break;
+        case NT_LEQ_NT:
+        case NT_GEQ_NT:
+        case NT_LTN_NT:
+        case NT_GTN_NT:
+            instruction("POPS GF@tmp1\n");
+            instruction("POPS GF@tmp2\n");
+            instruction("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n");
+            instruction("JUMPIFEQ ERR8 GF@tmp2 nil@nil\n");
+            instruction("%s GF@expr GF@tmp2 GF@tmp1\n",
+                        condition == NT_LTN_NT || condition == NT_GEQ_NT ? "LT" : "GT");
+            instruction("%s %s GF@expr bool@true\n", direct == value ? "JUMPIFEQ" : "JUMPIFNEQ", label);
+            break;
+        default:
+            instruction("POPS GF@expr\n");
+            instruction("%s %s GF@expr bool@true\n", value ? "JUMPIFEQ" : "JUMPIFNEQ", label);
+            break;
     }
-    stack[stackTop] = ifCounter;
+}
+
+void codeGen_if_start(psa_rules_enum condition){
+    char label[INST_LEN];
+
+    scope_push(ifCounter);
     ifCounter++;
-    if(isWhile == 0){
-        printf("POPS GF@expr\n");
-        printf("JUMPIFNEQ if$%d$else GF@expr bool@true\n", stack[stackTop]);
-    }else{
-        char* str = (char*)malloc(INST_LEN + 1);
-        sprintf(str, "POPS GF@expr\n");
-        DLL_InsertLast(list, str, INST_LEN + 1);
-        free(str);
-        str = NULL;
-        char* str2 = (char*)malloc(INST_LEN + numPlaces(stack[stackTop]) + 1);
-        sprintf(str2, "JUMPIFNEQ if$%d$else GF@expr bool@true\n", stack[stackTop]);
-        DLL_InsertLast(list, str2, INST_LEN + numPlaces(stack[stackTop]) + 1);
-        free(str2);
-        str2 = NULL;
-    }
+    snprintf(label, INST_LEN, "if$%d$else", stack[stackTop]);
+    branch(condition, label, false);
 }
 
 void codeGen_if_else(){
     if(isWhile == 0) {
-        printf("JUMP if$%d$end\n", stack[stackTop]);
-        printf("LABEL if$%d$else\n", stack[stackTop]);
+        emit("JUMP if$%d$end\n", stack[stackTop]);
+        emit("LABEL if$%d$else\n", stack[stackTop]);
     }else{
         char* str = (char*)malloc(INST_LEN + numPlaces(stack[stackTop]) + 1);
         sprintf(str, "JUMP if$%d$end\n", stack[stackTop]);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(stack[stackTop]) + 1);
+        list_insert(str, INST_LEN + numPlaces(stack[stackTop]) + 1);
         free(str);
         str = NULL;
         char* str2 = (char*)malloc(INST_LEN + numPlaces(stack[stackTop]) + 1);
         sprintf(str2, "LABEL if$%d$else\n", stack[stackTop]);
-        DLL_InsertLast(list, str2, INST_LEN + numPlaces(stack[stackTop]) + 1);
+        list_insert(str2, INST_LEN + numPlaces(stack[stackTop]) + 1);
         free(str2);
         str2 = NULL;
     }
@@ -637,15 +947,15 @@ void codeGen_if_else(){
 
 void codeGen_if_end(){
     if(isWhile == 0){
-        printf("LABEL if$%d$end\n", stack[stackTop]);
+        emit("LABEL if$%d$end\n", stack[stackTop]);
     }else{
         char* str = (char*)malloc(INST_LEN + numPlaces(stack[stackTop]) + 1);
         sprintf(str, "LABEL if$%d$end\n", stack[stackTop]);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(stack[stackTop]) + 1);
+        list_insert(str, INST_LEN + numPlaces(stack[stackTop]) + 1);
         free(str);
         str = NULL;
     }
-    shStack = shStackDelByScale(shStack, scale);
+    shStackLeaveScale(scale);
     stackTop--;
     scale--;
 }
@@ -654,43 +964,67 @@ void codeGen_if_end(){
  * ----------------------WHILE-----------------------
  */
 
-void codeGen_while_body_start(){
-    stackTop++;
-    scale++;
-    isWhile = 1;
-    if(stackTop >= stackSize){
-        stackSize += stackSize;
-        stack = realloc(stack, sizeof(int) * stackSize);
+/*
+ * Loops are inverted, the condition is tested after the body:
+ *
+ *     JUMP while$N$cond
+ *     LABEL while$N$start
+ *     body
+ *     LABEL while$N$cond
+ *     condition, jump to while$N$start when true
+ *
+ * The condition is generated before the body, its part of the list is
+ * moved after the body at the end of the loop.
+ */
+static void loops_reserve(int depth){
+    if(depth >= loopsSize){
+        int size = loopsSize == 0 ? TABLE_SIZE : loopsSize * 2;
+        loopCondition_t* resized = realloc(loops, sizeof(loopCondition_t) * size);
+        if(resized == NULL){
+            err = E_INTERNAL;
+            return;
+        }
+        loops = resized;
+        loopsSize = size;
     }
-    stack[stackTop] = whileCounter;
-    whileCounter++;
-    char* str = (char*)malloc(INST_LEN + numPlaces(stack[stackTop]) + 1);
-    sprintf(str, "LABEL while$%d$start\n", stack[stackTop]);    
-    DLL_InsertLast(list, str, INST_LEN + numPlaces(stack[stackTop]) + 1);
-    free(str);
-    str = NULL;
 }
 
-void codeGen_while_start(){
-    if(isWhile == 0) {
-        printf("POPS GF@expr\n");
-        printf("JUMPIFNEQ while$%d$end GF@expr bool@true\n", stack[stackTop]);
-    }else{
-        DLL_InsertLast(list, "POPS GF@expr\n", 14);
-        char* str2 = (char*)malloc(INST_LEN + numPlaces(stack[stackTop]) + 1);
-        sprintf(str2, "JUMPIFNEQ while$%d$end GF@expr bool@true\n", stack[stackTop]);
-        DLL_InsertLast(list, str2, INST_LEN + numPlaces(stack[stackTop]) + 1);
-        free(str2);
-        str2 = NULL;
+void codeGen_while_body_start(){
+    scope_push(whileCounter);
+    whileCounter++;
+    loops_reserve(isWhile);
+    if(err == E_INTERNAL){
+        return;
     }
+    isWhile++;
+    instruction("JUMP while$%d$cond\n", stack[stackTop]);
+    instruction("LABEL while$%d$cond\n", stack[stackTop]);
+    loops[isWhile - 1].first = list->lastElement;
+}
+
+void codeGen_while_start(psa_rules_enum condition){
+    char label[INST_LEN];
+
+    snprintf(label, INST_LEN, "while$%d$start", stack[stackTop]);
+    branch(condition, label, true);
+    loops[isWhile - 1].last = list->lastElement;
+    instruction("LABEL %s\n", label);
 }
 
 void codeGen_while_end(){
-    DLL_PrintAll(list);
-    DLL_Dispose(list);
-    printf("JUMP while$%d$start\n", stack[stackTop]);
-    printf("LABEL while$%d$end\n", stack[stackTop]);
-    isWhile = 0;
+    DLL_MoveLast(list, loops[isWhile - 1].first, loops[isWhile - 1].last);
+    isWhile--;
+
+    // instructions of the outermost loop are written after its variables
+    if(isWhile == 0){
+        unsigned line = sourceLine;
+        for(DLLElementPtr elem = list->firstElement; elem != NULL; elem = elem->nextElement){
+            sourceLine = elem->line;
+            emit("%s", elem->data);
+        }
+        sourceLine = line;
+        DLL_Dispose(list);
+    }
     stackTop--;
     scale--;
 }
@@ -703,39 +1037,69 @@ void codeGen_while_end(){
 void codeGen_function_start(char* name){
     scale++;
     function++;
-    printf("#----FUN-%s----\n", name);
-    printf("JUMP %s$end\nLABEL %s\nPUSHFRAME\nCREATEFRAME\n", name, name);
-    printf("POPS GF@trash\n");
+    emit("#----FUN-%s----\n", name);
+    emit("JUMP %s$end\nLABEL %s\nPUSHFRAME\nCREATEFRAME\n", name, name);
+    emit("POPS GF@trash\n");
 }
 
 void codeGen_function_return(){
     if(isWhile == 0){
-        printf("POPFRAME\nRETURN\n");
+        emit("POPFRAME\nRETURN\n");
     }else{
-        DLL_InsertLast(list, "POPFRAME\nRETURN\n", 17);
+        list_insert("POPFRAME\nRETURN\n", 17);
     }
 }
 
 void codeGen_function_end(char* name){
-    printf("POPFRAME\nRETURN\nLABEL %s$end\n", name);
+    emit("POPFRAME\nRETURN\nLABEL %s$end\n", name);
 
-    shStack = shStackDelByScale(shStack, scale);
+    shStackLeaveScale(scale);
     scale--;
 }
 
+/*
+ * Extended instruction of built-in function, arguments are on the stack
+ * without their count
+ */
+static bool builtin_instruction(const char* name, unsigned parameters){
+    if(strcmp(name, "write") == 0){
+        instruction("WRITEN int@%u\n", parameters);
+    }else if(strcmp(name, "reads") == 0){
+        instruction("READS string\n");
+    }else if(strcmp(name, "readi") == 0){
+        instruction("READS int\n");
+    }else if(strcmp(name, "readn") == 0){
+        instruction("READS float\n");
+    }else if(strcmp(name, "tointeger") == 0){
+        instruction("FLOAT2INTS\n");
+    }else if(strcmp(name, "substr") == 0){
+        instruction("SUBSTRS\n");
+    }else if(strcmp(name, "ord") == 0){
+        instruction("ORDS\n");
+    }else if(strcmp(name, "chr") == 0){
+        instruction("CHRS\n");
+    }else{
+        return false;
+    }
+    return true;
+}
+
 void codeGen_function_call(char* name, unsigned parameters){
+    if(extended && builtin_instruction(name, parameters)){
+        return;
+    }
     if(isWhile == 0){
-        printf("PUSHS int@%i\n", parameters);
-        printf("CALL %s\n", name);
+        emit("PUSHS int@%i\n", parameters);
+        emit("CALL %s\n", name);
     }else{
         char* str = (char*)malloc(INST_LEN + numPlaces(parameters) + 1);
         sprintf(str, "PUSHS int@%i\n", parameters);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(parameters) + 1);
+        list_insert(str, INST_LEN + numPlaces(parameters) + 1);
         free(str);
         str = NULL;
         char* str2 = (char*)malloc(INST_LEN + strlen(name) + 1);
         sprintf(str2, "CALL %s\n", name);
-        DLL_InsertLast(list, str2, INST_LEN + strlen(name) + 1);
+        list_insert(str2, INST_LEN + strlen(name) + 1);
         free(str2);
         str2 = NULL;
     }
@@ -747,23 +1111,23 @@ void codeGen_function_call(char* name, unsigned parameters){
 
 void generate_IntToFloat1(){
     if(isWhile == 0){
-        printf("POPS GF@tmp1\n");
-        printf("JUMPIFEQ nope%d GF@tmp1 nil@nil\n",++intToFloat1);
-        printf("PUSHS GF@tmp1\n");
-        printf("INT2FLOATS\n");
-        printf("LABEL nope%d\n",intToFloat1);
+        emit("POPS GF@tmp1\n");
+        emit("JUMPIFEQ nope%d GF@tmp1 nil@nil\n",++intToFloat1);
+        emit("PUSHS GF@tmp1\n");
+        emit("INT2FLOATS\n");
+        emit("LABEL nope%d\n",intToFloat1);
     }else{
-        DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
+        list_insert("POPS GF@tmp1\n", 14);
         char* str = (char*)malloc(INST_LEN + numPlaces(++intToFloat1) + 1);
         sprintf(str, "JUMPIFEQ nope%d GF@tmp1 nil@nil\n", intToFloat1);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(++intToFloat1) + 1);
+        list_insert(str, INST_LEN + numPlaces(++intToFloat1) + 1);
         free(str);
         str = NULL;
-        DLL_InsertLast(list, "PUSHS GF@tmp1\n", 15);
-        DLL_InsertLast(list, "INT2FLOATS\n", 12);
+        list_insert("PUSHS GF@tmp1\n", 15);
+        list_insert("INT2FLOATS\n", 12);
         char* str2 = (char*)malloc(INST_LEN + numPlaces(intToFloat1) + 1);
         sprintf(str2, "LABEL nope%d\n", intToFloat1);
-        DLL_InsertLast(list, str2, INST_LEN + numPlaces(intToFloat1) + 1);
+        list_insert(str2, INST_LEN + numPlaces(intToFloat1) + 1);
         free(str2);
         str2 = NULL;
     }
@@ -771,73 +1135,77 @@ void generate_IntToFloat1(){
 
 void generate_IntToFloat2(){
     if(isWhile == 0){
-        printf("POPS GF@tmp3\n");
-        printf("POPS GF@tmp2\n");
-        printf("JUMPIFEQ no%d GF@tmp2 nil@nil\n",++intToFloat2);
-        printf("INT2FLOAT GF@tmp2 GF@tmp2\n");
-        printf("LABEL no%d\n",intToFloat2);
-        printf("PUSHS GF@tmp2\n");
-        printf("PUSHS GF@tmp3\n");
+        emit("POPS GF@tmp3\n");
+        emit("POPS GF@tmp2\n");
+        emit("JUMPIFEQ no%d GF@tmp2 nil@nil\n",++intToFloat2);
+        emit("INT2FLOAT GF@tmp2 GF@tmp2\n");
+        emit("LABEL no%d\n",intToFloat2);
+        emit("PUSHS GF@tmp2\n");
+        emit("PUSHS GF@tmp3\n");
     }else{
-        DLL_InsertLast(list, "POPS GF@tmp3\n", 14);
-        DLL_InsertLast(list, "POPS GF@tmp2\n", 14);
+        list_insert("POPS GF@tmp3\n", 14);
+        list_insert("POPS GF@tmp2\n", 14);
         char* str = (char*)malloc(INST_LEN + numPlaces(++intToFloat2) + 1);
         sprintf(str, "JUMPIFEQ no%d GF@tmp2 nil@nil\n", intToFloat2);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(++intToFloat2) + 1);
+        list_insert(str, INST_LEN + numPlaces(++intToFloat2) + 1);
         free(str);
         str = NULL;
-        DLL_InsertLast(list, "INT2FLOAT GF@tmp2 GF@tmp2\n", 27);
+        list_insert("INT2FLOAT GF@tmp2 GF@tmp2\n", 27);
         char* str2 = (char*)malloc(INST_LEN + numPlaces(intToFloat2) + 1);
         sprintf(str2, "LABEL no%d\n", intToFloat2);
-        DLL_InsertLast(list, str2, INST_LEN + numPlaces(intToFloat2) + 1);
+        list_insert(str2, INST_LEN + numPlaces(intToFloat2) + 1);
         free(str2);
         str2 = NULL;
-        DLL_InsertLast(list, "PUSHS GF@tmp2\n", 15);
-        DLL_InsertLast(list, "PUSHS GF@tmp3\n", 15);
+        list_insert("PUSHS GF@tmp2\n", 15);
+        list_insert("PUSHS GF@tmp3\n", 15);
     }
 }
 
 void generate_checkifNIL2ops(){
     if(isWhile == 0){
-        printf("POPS GF@tmp1\n");
-        printf("POPS GF@tmp2\n");
-        printf("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n");
-        printf("JUMPIFEQ ERR8 GF@tmp2 nil@nil\n");
-        printf("PUSHS GF@tmp2\n");
-        printf("PUSHS GF@tmp1\n");
+        emit("POPS GF@tmp1\n");
+        emit("POPS GF@tmp2\n");
+        emit("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n");
+        emit("JUMPIFEQ ERR8 GF@tmp2 nil@nil\n");
+        emit("PUSHS GF@tmp2\n");
+        emit("PUSHS GF@tmp1\n");
     }else{
-        DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-        DLL_InsertLast(list, "POPS GF@tmp2\n", 14);
-        DLL_InsertLast(list, "JUMPIFEQ ERR8 GF@tmp1 nil@nil\n", 31);
-        DLL_InsertLast(list, "JUMPIFEQ ERR8 GF@tmp2 nil@nil\n", 31);
-        DLL_InsertLast(list, "PUSHS GF@tmp2\n", 15);
-        DLL_InsertLast(list, "PUSHS GF@tmp1\n", 15);
+        list_insert("POPS GF@tmp1\n", 14);
+        list_insert("POPS GF@tmp2\n", 14);
+        list_insert("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n", 31);
+        list_insert("JUMPIFEQ ERR8 GF@tmp2 nil@nil\n", 31);
+        list_insert("PUSHS GF@tmp2\n", 15);
+        list_insert("PUSHS GF@tmp1\n", 15);
     }
 }
 void generate_checkifNIL1op(){
     if(isWhile == 0){
-        printf("POPS GF@tmp1\n");
-        printf("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n");
-        printf("PUSHS GF@tmp1\n");
+        emit("POPS GF@tmp1\n");
+        emit("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n");
+        emit("PUSHS GF@tmp1\n");
     }else{
-        DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-        DLL_InsertLast(list, "JUMPIFEQ ERR8 GF@tmp1 nil@nil\n", 31);
-        DLL_InsertLast(list, "PUSHS GF@tmp1\n", 15);
+        list_insert("POPS GF@tmp1\n", 14);
+        list_insert("JUMPIFEQ ERR8 GF@tmp1 nil@nil\n", 31);
+        list_insert("PUSHS GF@tmp1\n", 15);
     }
 }
 
 void generate_errorOp(){
-    printf("JUMP errorOp_End\n");
-    printf("LABEL ERR9\n");
-    printf("EXIT int@9\n");
-    printf("JUMP errorOp_End\n");
-    printf("LABEL ERR8\n");
-    printf("EXIT int@8\n");
-    printf("LABEL errorOp_End\n");
+    emit("JUMP errorOp_End\n");
+    emit("LABEL ERR9\n");
+    emit("EXIT int@9\n");
+    emit("JUMP errorOp_End\n");
+    emit("LABEL ERR8\n");
+    emit("EXIT int@8\n");
+    emit("LABEL errorOp_End\n");
     free(list);
     list = NULL;
     free(stack);
     stack = NULL;
+    free(loops);
+    loops = NULL;
+    loopsSize = 0;
+    free_buffers();
 }
 
 void generate_operation(psa_rules_enum operation){
@@ -846,44 +1214,44 @@ void generate_operation(psa_rules_enum operation){
             // rule E -> E + E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("ADDS\n");
+                emit("ADDS\n");
             }else{
-                DLL_InsertLast(list, "ADDS\n", 6);
+                list_insert("ADDS\n", 6);
             }
             break;
         case NT_MINUS_NT:
             // rule E -> E - E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("SUBS\n");
+                emit("SUBS\n");
             }else{
-                DLL_InsertLast(list, "SUBS\n", 6);
+                list_insert("SUBS\n", 6);
             }
             break;
         case NT_MUL_NT:
             // rule E -> E * E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("MULS\n");
+                emit("MULS\n");
             }else{
-                DLL_InsertLast(list, "MULS\n", 6);
+                list_insert("MULS\n", 6);
             }
             break;
         case NT_DIV_NT:
             // rule E -> E / E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("POPS GF@tmp1\n");
-                printf("POPS GF@tmp2\n");
-                printf("JUMPIFEQ ERR9 GF@tmp1 float@0x0p+0\n");
-                printf("DIV GF@tmp1 GF@tmp2 GF@tmp1\n");
-                printf("PUSHS GF@tmp1\n");
+                emit("POPS GF@tmp1\n");
+                emit("POPS GF@tmp2\n");
+                emit("JUMPIFEQ ERR9 GF@tmp1 float@0x0p+0\n");
+                emit("DIV GF@tmp1 GF@tmp2 GF@tmp1\n");
+                emit("PUSHS GF@tmp1\n");
             }else{
-                DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-                DLL_InsertLast(list, "POPS GF@tmp2\n", 14);
-                DLL_InsertLast(list, "JUMPIFEQ ERR9 GF@tmp1 float@0x0p+0\n", 36);
-                DLL_InsertLast(list, "DIV GF@tmp1 GF@tmp2 GF@tmp1\n", 29);
-                DLL_InsertLast(list, "PUSHS GF@tmp1\n", 15);
+                list_insert("POPS GF@tmp1\n", 14);
+                list_insert("POPS GF@tmp2\n", 14);
+                list_insert("JUMPIFEQ ERR9 GF@tmp1 float@0x0p+0\n", 36);
+                list_insert("DIV GF@tmp1 GF@tmp2 GF@tmp1\n", 29);
+                list_insert("PUSHS GF@tmp1\n", 15);
             }
 
             break;
@@ -891,135 +1259,423 @@ void generate_operation(psa_rules_enum operation){
             // rule E -> E // E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("POPS GF@tmp1\n");
-                printf("POPS GF@tmp2\n");
-                printf("JUMPIFNEQ ERR9 GF@tmp1 int@0\n");
-                printf("IDIV GF@tmp1 GF@tmp2 GF@tmp1\n");
-                printf("PUSHS GF@tmp1\n");
+                emit("POPS GF@tmp1\n");
+                emit("POPS GF@tmp2\n");
+                emit("JUMPIFEQ ERR9 GF@tmp1 int@0\n");
+                emit("IDIV GF@tmp1 GF@tmp2 GF@tmp1\n");
+                emit("PUSHS GF@tmp1\n");
             }else{
-                DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-                DLL_InsertLast(list, "POPS GF@tmp2\n", 14);
-                DLL_InsertLast(list, "JUMPIFNEQ ERR9 GF@tmp1 int@0\n", 30);
-                DLL_InsertLast(list, "IDIV GF@tmp1 GF@tmp2 GF@tmp1\n", 30);
-                DLL_InsertLast(list, "PUSHS GF@tmp1\n", 15);
+                list_insert("POPS GF@tmp1\n", 14);
+                list_insert("POPS GF@tmp2\n", 14);
+                list_insert("JUMPIFEQ ERR9 GF@tmp1 int@0\n", 29);
+                list_insert("IDIV GF@tmp1 GF@tmp2 GF@tmp1\n", 30);
+                list_insert("PUSHS GF@tmp1\n", 15);
             }
             break;
         case NT_CONCAT_NT:
             // rule E -> E .. E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("POPS GF@tmp1\n");
-                printf("POPS GF@tmp2\n");
-                printf("CONCAT GF@tmp1 GF@tmp2 GF@tmp1\n");
-                printf("PUSHS GF@tmp1\n");
+                emit("POPS GF@tmp1\n");
+                emit("POPS GF@tmp2\n");
+                emit("CONCAT GF@tmp1 GF@tmp2 GF@tmp1\n");
+                emit("PUSHS GF@tmp1\n");
             }else{
-                DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-                DLL_InsertLast(list, "POPS GF@tmp2\n", 14);
-                DLL_InsertLast(list, "CONCAT GF@tmp1 GF@tmp2 GF@tmp1\n", 32);
-                DLL_InsertLast(list, "PUSHS GF@tmp1\n", 15);
+                list_insert("POPS GF@tmp1\n", 14);
+                list_insert("POPS GF@tmp2\n", 14);
+                list_insert("CONCAT GF@tmp1 GF@tmp2 GF@tmp1\n", 32);
+                list_insert("PUSHS GF@tmp1\n", 15);
             }
             break;
         case NT_EQ_NT:
             // rule E -> E == E
             if(isWhile == 0){
-                printf("EQS\n");
+                emit("EQS\n");
             }else{
-                DLL_InsertLast(list, "EQS\n", 5);
+                list_insert("EQS\n", 5);
             }
             break;
         case NT_NEQ_NT:
             // rule E -> E ~= E
             if(isWhile == 0){
-                printf("EQS\nNOTS\n");
+                emit("EQS\nNOTS\n");
             }else{
-                DLL_InsertLast(list, "EQS\nNOTS\n", 10);
+                list_insert("EQS\nNOTS\n", 10);
             }
             break;
         case NT_LEQ_NT:
             // rule E -> E <= E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("GTS\nNOTS\n");
+                emit("GTS\nNOTS\n");
             }else{
-                DLL_InsertLast(list, "GTS\nNOTS\n", 10);
+                list_insert("GTS\nNOTS\n", 10);
             }
             break;
         case NT_GEQ_NT:
             // rule E -> E >= E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("LTS\nNOTS\n");
+                emit("LTS\nNOTS\n");
             }else{
-                DLL_InsertLast(list, "LTS\nNOTS\n", 10);
+                list_insert("LTS\nNOTS\n", 10);
             }
             break;
         case NT_LTN_NT:
             // rule E -> E < E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("LTS\n");
+                emit("LTS\n");
             }else{
-                DLL_InsertLast(list, "LTS\n", 5);
+                list_insert("LTS\n", 5);
             }
             break;
         case NT_GTN_NT:
             // rule E -> E > E
             generate_checkifNIL2ops();
             if(isWhile == 0){
-                printf("GTS\n");
+                emit("GTS\n");
             }else{
-                DLL_InsertLast(list, "GTS\n", 5);
+                list_insert("GTS\n", 5);
             }
             break;
         case NT_HASHTAG:
             // rule E -> #E
             generate_checkifNIL1op();
             if(isWhile == 0){
-                printf("POPS GF@tmp1\n");
-                printf("STRLEN GF@tmp4 GF@tmp1\n");
-                printf("PUSHS GF@tmp4\n");
+                emit("POPS GF@tmp1\n");
+                emit("STRLEN GF@tmp4 GF@tmp1\n");
+                emit("PUSHS GF@tmp4\n");
             }else{
-                DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-                DLL_InsertLast(list, "STRLEN GF@tmp4 GF@tmp1\n", 24);
-                DLL_InsertLast(list, "PUSHS GF@tmp4\n", 15);
+                list_insert("POPS GF@tmp1\n", 14);
+                list_insert("STRLEN GF@tmp4 GF@tmp1\n", 24);
+                list_insert("PUSHS GF@tmp4\n", 15);
             }
             break;
         default:break;
     }
 }
 
-void generate_toBool() {
-    if(isWhile == 0){
-        printf("POPS GF@tmp1\n");
-        printf("JUMPIFEQ toBoolTru%d GF@tmp1 nil@nil\n",++toBool);
-        printf("PUSHS bool@true\n");
-        printf("JUMP toBoolFalse%d\n",toBool);
-        printf("LABEL toBoolTru%d\n",toBool);
-        printf("PUSHS bool@false\n");
-        printf("LABEL toBoolFalse%d\n",toBool);
+/*
+ * ----------------------UNITS-----------------------
+ */
+
+void codeGen_unit_start(const codeGen_counters_t* counters, shadowStack_t* shade, bool isolatedUnit){
+    if(stack == NULL){
+        stackSize = TABLE_SIZE;
+        stack = malloc(sizeof(int) * stackSize);
+        if(stack == NULL){
+            err = E_INTERNAL;
+            return;
+        }
+    }
+    if(list == NULL){
+        list = malloc(sizeof(DLList));
+        if(list == NULL){
+            err = E_INTERNAL;
+            return;
+        }
+        DLL_Init(list);
+    }
+    ifCounter = counters->ifCounter;
+    whileCounter = counters->whileCounter;
+    intToFloat1 = counters->intToFloat1;
+    intToFloat2 = counters->intToFloat2;
+    function = counters->function;
+    stackTop = -1;
+    scale = -1;
+    isWhile = 0;
+    shStack = shade;
+    isolated = isolatedUnit;
+    dependent = false;
+    unitLen = 0;
+}
+
+bool codeGen_unit_end(char** code, size_t* len, shadowStack_t** shade){
+    bool result = dependent;
+
+    // code of dependent unit is not valid, it is generated again
+    if(dependent){
+        while(shStack != NULL){
+            shStack = shStackDelByScale(shStack, shStack->scale);
+        }
+        *code = NULL;
+        *len = 0;
+    }else if(isolated){
+        *code = unitCode;
+        *len = unitLen;
+        unitCode = NULL;
+        unitCap = 0;
     }else{
-        DLL_InsertLast(list, "POPS GF@tmp1\n", 14);
-        char* str = (char*)malloc(INST_LEN + numPlaces(++toBool) + 1);
-        sprintf(str, "JUMPIFEQ toBoolTru%d GF@tmp1 nil@nil\n", toBool);
-        DLL_InsertLast(list, str, INST_LEN + numPlaces(toBool) + 1);
-        free(str);
-        str = NULL;
-        DLL_InsertLast(list, "PUSHS bool@true\n", 17);
-        char* str2 = (char*)malloc(INST_LEN + numPlaces(toBool) + 1);
-        sprintf(str2, "JUMP toBoolFalse%d\n", toBool);
-        DLL_InsertLast(list, str2, INST_LEN + numPlaces(toBool) + 1);
-        free(str2);
-        str2 = NULL;        
-        char* str3 = (char*)malloc(INST_LEN + numPlaces(toBool) + 1);
-        sprintf(str3, "LABEL toBoolTru%d\n", toBool);        
-        DLL_InsertLast(list, str3, INST_LEN + numPlaces(toBool) + 1);
-        free(str3);
-        str3 = NULL;
-        DLL_InsertLast(list, "PUSHS bool@false\n", 18);
-        char* str4 = (char*)malloc(INST_LEN + numPlaces(toBool) + 1);
-        sprintf(str4, "LABEL toBoolFalse%d\n", toBool);
-        DLL_InsertLast(list, str4, INST_LEN + numPlaces(toBool) + 1);
-        free(str4);
-        str4 = NULL;
+        *code = NULL;
+        *len = 0;
+    }
+    unitLen = 0;
+    *shade = shStack;
+    shStack = NULL;
+    isolated = false;
+    dependent = false;
+
+    return result;
+}
+
+void codeGen_emit_code(const char* code, size_t len){
+    if(len > 0){
+        emit("%.*s", (int)len, code);
+    }
+}
+
+void codeGen_thread_end(){
+    free(list);
+    list = NULL;
+    free(stack);
+    stack = NULL;
+    free(loops);
+    loops = NULL;
+    loopsSize = 0;
+    free_buffers();
+    free(unitCode);
+    unitCode = NULL;
+    unitCap = 0;
+    unitLen = 0;
+}
+
+/*
+ * ----------------------TEMPORARIES-----------------------
+ */
+
+static const char* operand(const codeGen_operand_t* value, int buffer){
+    shadowStack_t* current = NULL;
+    size_t needed;
+
+    switch(value->kind){
+        case OPERAND_VAR:
+        case OPERAND_TARGET:
+            if(value->kind == OPERAND_VAR){
+                current = shStackNameScaleByNameInitialized(shStack, value->name);
+            }else{
+                current = shStackNameScaleByName(shStack, value->name);
+            }
+            if(current == NULL){
+                if(isolated){
+                    dependent = true;
+                }else{
+                    err = E_INTERNAL;
+                }
+                return "nil@nil";
+            }
+            needed = 4 + strlen(current->nameScale);
+            break;
+        case OPERAND_TEMP:
+            needed = 6 + numPlaces(value->slot);
+            break;
+        case OPERAND_INVARIANT:
+            needed = 8 + numPlaces(value->slot);
+            break;
+        case OPERAND_INT:
+            needed = 5 + numPlaces(value->integer);
+            break;
+        case OPERAND_FLOAT:
+            needed = 7 + 30;
+            break;
+        case OPERAND_STRING:
+            needed = 8 + 4 * strlen(value->name);
+            break;
+        default:
+            return "nil@nil";
     }
+
+    if(needed > operandCap[buffer]){
+        char* tmp = realloc(operandText[buffer], needed);
+        if(tmp == NULL){
+            err = E_INTERNAL;
+            return "nil@nil";
+        }
+        operandText[buffer] = tmp;
+        operandCap[buffer] = needed;
+    }
+
+    char* text = operandText[buffer];
+
+    switch(value->kind){
+        case OPERAND_VAR:
+        case OPERAND_TARGET:
+            sprintf(text, "TF@%s", current->nameScale);
+            break;
+        case OPERAND_TEMP:
+            sprintf(text, "TF@$t%d", value->slot);
+            break;
+        case OPERAND_INVARIANT:
+            sprintf(text, "TF@$inv%d", value->slot);
+            break;
+        case OPERAND_INT:
+            sprintf(text, "int@%d", value->integer);
+            break;
+        case OPERAND_FLOAT:
+            sprintf(text, "float@%a", value->number);
+            break;
+        default:
+            memcpy(text, "string@", 7);
+            *encode_string(value->name, text + 7) = '\0';
+            break;
+    }
+
+    return text;
+}
+
+void codeGen_temps_declare(int count){
+    for(int i = 0; i < count; i++){
+        emit("DEFVAR TF@$t%d\n", i);
+    }
+}
+
+void codeGen_temps_check_nil(const codeGen_operand_t* value){
+    if(value->maybeNil){
+        instruction("JUMPIFEQ ERR8 %s nil@nil\n", operand(value, 0));
+    }
+}
+
+void codeGen_temps_int_to_float(int slot, const codeGen_operand_t* value, unsigned label){
+    const char* text = operand(value, 0);
+
+    // nil is not converted
+    if(value->maybeNil){
+        instruction("MOVE TF@$t%d %s\n", slot, text);
+        instruction("JUMPIFEQ $conv%u %s nil@nil\n", label, text);
+        instruction("INT2FLOAT TF@$t%d %s\n", slot, text);
+        instruction("LABEL $conv%u\n", label);
+    }else{
+        instruction("INT2FLOAT TF@$t%d %s\n", slot, text);
+    }
+}
+
+void codeGen_temps_operation(psa_rules_enum operation, const codeGen_operand_t* result, const codeGen_operand_t* left, const codeGen_operand_t* right){
+    const char* l = operand(left, 0);
+    const char* r = right != NULL ? operand(right, 1) : NULL;
+    const char* t = operand(result, 2);
+
+    switch (operation){
+        case NT_PLUS_NT:
+            instruction("ADD %s %s %s\n", t, l, r);
+            break;
+        case NT_MINUS_NT:
+            instruction("SUB %s %s %s\n", t, l, r);
+            break;
+        case NT_MUL_NT:
+            instruction("MUL %s %s %s\n", t, l, r);
+            break;
+        case NT_DIV_NT:
+            instruction("JUMPIFEQ ERR9 %s float@0x0p+0\n", r);
+            instruction("DIV %s %s %s\n", t, l, r);
+            break;
+        case NT_IDIV_NT:
+            instruction("JUMPIFEQ ERR9 %s int@0\n", r);
+            instruction("IDIV %s %s %s\n", t, l, r);
+            break;
+        case NT_CONCAT_NT:
+            instruction("CONCAT %s %s %s\n", t, l, r);
+            break;
+        case NT_EQ_NT:
+            instruction("EQ %s %s %s\n", t, l, r);
+            break;
+        case NT_NEQ_NT:
+            instruction("EQ %s %s %s\n", t, l, r);
+            instruction("NOT %s %s\n", t, t);
+            break;
+        case NT_LEQ_NT:
+            instruction("GT %s %s %s\n", t, l, r);
+            instruction("NOT %s %s\n", t, t);
+            break;
+        case NT_GEQ_NT:
+            instruction("LT %s %s %s\n", t, l, r);
+            instruction("NOT %s %s\n", t, t);
+            break;
+        case NT_LTN_NT:
+            instruction("LT %s %s %s\n", t, l, r);
+            break;
+        case NT_GTN_NT:
+            instruction("GT %s %s %s\n", t, l, r);
+            break;
+        case NT_HASHTAG:
+            instruction("STRLEN %s %s\n", t, l);
+            break;
+        default:break;
+    }
+}
+
+void codeGen_push_operand(const codeGen_operand_t* value){
+    instruction("PUSHS %s\n", operand(value, 0));
+}
+
+void codeGen_pop_operand(const codeGen_operand_t* value){
+    instruction("POPS %s\n", operand(value, 0));
+}
+
+void codeGen_assign_operand(char* name, const codeGen_operand_t* value){
+    // value is read before the variable is initialized (local a = a)
+    const char* text = operand(value, 0);
+    shadowStack_t* current = shStackNameScaleByName(shStack, name);
+    if(current == NULL && isolated){
+        dependent = true;
+        return;
+    }
+    if(current == NULL){
+        err = E_INTERNAL;
+        return;
+    }
+    current->inicialized = 1;
+    instruction("MOVE TF@%s %s\n", current->nameScale, text);
+}
+
+/*
+ * Jump to the label when the condition has the value, see branch
+ */
+static void branch_operands(psa_rules_enum condition, const char* label, bool value, const codeGen_operand_t* left, const codeGen_operand_t* right){
+    const char* l = operand(left, 0);
+    bool direct = condition == NT_LTN_NT || condition == NT_GTN_NT;
+
+    switch (condition){
+        case OPERAND:
+            instruction("%s %s %s nil@nil\n", value ? "JUMPIFNEQ" : "JUMPIFEQ", label, l);
+            break;
+        case NT_EQ_NT:
+            instruction("%s %s %s %s\n", value ? "JUMPIFEQ" : "JUMPIFNEQ", label, l, operand(right, 1));
+            break;
+        case NT_NEQ_NT:
+            instruction("%s %s %s %s\n", value ? "JUMPIFNEQ" : "JUMPIFEQ", label, l, operand(right, 1));
+            break;
+        case NT_LEQ_NT:
+        case NT_GEQ_NT:
+        case NT_LTN_NT:
+        case NT_GTN_NT:
+            instruction("%s GF@expr %s %s\n",
+                        condition == NT_LTN_NT || condition == NT_GEQ_NT ? "LT" : "GT", l, operand(right, 1));
+            instruction("%s %s GF@expr bool@true\n", direct == value ? "JUMPIFEQ" : "JUMPIFNEQ", label);
+            break;
+        default:
+            instruction("%s %s %s bool@true\n", value ? "JUMPIFEQ" : "JUMPIFNEQ", label, l);
+            break;
+    }
+}
+
+void codeGen_if_start_operand(psa_rules_enum condition, const codeGen_operand_t* left, const codeGen_operand_t* right){
+    char label[INST_LEN];
+
+    scope_push(ifCounter);
+    ifCounter++;
+    snprintf(label, INST_LEN, "if$%d$else", stack[stackTop]);
+    branch_operands(condition, label, false, left, right);
+}
+
+void codeGen_while_start_operand(psa_rules_enum condition, const codeGen_operand_t* left, const codeGen_operand_t* right){
+    char label[INST_LEN];
+
+    snprintf(label, INST_LEN, "while$%d$start", stack[stackTop]);
+    branch_operands(condition, label, true, left, right);
+    loops[isWhile - 1].last = list->lastElement;
+    instruction("LABEL %s\n", label);
+}
+
+void codeGen_invariant_declare(int slot){
+    emit("DEFVAR TF@$inv%d\n", slot);
 }
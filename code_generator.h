@@ -10,6 +10,7 @@
 #ifndef IFJ_BRATWURST2021_CODE_GENERATOR_H
 #define IFJ_BRATWURST2021_CODE_GENERATOR_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include "scanner.h"
@@ -22,6 +23,13 @@
 #define TABLE_SIZE 10
 #define INST_LEN 100
 
+/*
+ * State of the value assigned by codeGen_assign_var
+ */
+#define NOT_NIL 0
+#define IS_NIL 1
+#define DEF 2
+
 typedef struct shadowStack{
     char* nameScale;
     int scale;
@@ -30,10 +38,36 @@ typedef struct shadowStack{
     struct shadowStack* next;
 } shadowStack_t;
 
+/*
+ * Counters of labels and the function count at the start of a unit
+ * (function or call at top level). Units with known counters can be
+ * generated on other threads, see ast_gen.c.
+ */
+typedef struct codeGen_counters{
+    int ifCounter;
+    int whileCounter;
+    int intToFloat1;
+    int intToFloat2;
+    int function;
+} codeGen_counters_t;
+
 void generate_errorOp();
 void generate_operation(psa_rules_enum operation);
 void generate_IntToFloat1();
 void generate_IntToFloat2();
+void codeGen_set_output(FILE* file);
+/*
+ * Built-in functions are extended instructions of ic21vm instead of
+ * IFJcode21 functions (the code runs only on ic21vm)
+ */
+void codeGen_set_extended(bool enable);
+/*
+ * Source map of the generated code is written to the file (NULL disables
+ * it), generated lines belong to the source line set before them. Code
+ * of isolated units is not mapped.
+ */
+void codeGen_set_source_map(FILE* file);
+void codeGen_set_line(unsigned line);
 void codeGen_init();
 void codeGen_built_in_function();
 void codeGen_main_start();
@@ -45,16 +79,79 @@ void codeGen_push_float(double value);
 void codeGen_push_nil();
 void codeGen_new_var(char* name);
 void codeGen_assign_var(char* name, unsigned nil);
-void codeGen_if_start();
+void codeGen_discard_var(char* name, bool pushed);
+/*
+ * Condition of if and while is the psa rule of its root. Relational rule
+ * is compared by the branch with both operands on the stack, OPERAND is
+ * a value which is false when nil, other rules leave a bool on the stack.
+ */
+void codeGen_if_start(psa_rules_enum condition);
 void codeGen_if_else();
 void codeGen_if_end();
 void codeGen_while_body_start();
-void codeGen_while_start();
+void codeGen_while_start(psa_rules_enum condition);
 void codeGen_while_end();
 void codeGen_function_start(char* name);
 void codeGen_function_return();
 void codeGen_function_end(char* name);
 void codeGen_function_call(char* name, unsigned parameters);
-void generate_toBool();
+
+/*
+ * Operand of three-address instructions in the temporaries mode. Results
+ * of operations are kept in frame variables TF@$t<slot> of the function
+ * instead of the data stack.
+ */
+typedef enum codeGen_operand_kind{
+    OPERAND_VAR,        // variable, name
+    OPERAND_TARGET,     // variable assigned by the instruction, name
+    OPERAND_TEMP,       // temporary, slot
+    OPERAND_INVARIANT,  // value kept in the frame (loop invariant, common subexpression), slot
+    OPERAND_INT,        // integer constant, integer
+    OPERAND_FLOAT,      // number constant, number
+    OPERAND_STRING,     // string constant as in source, name
+    OPERAND_NIL
+} codeGen_operand_kind_t;
+
+typedef struct codeGen_operand{
+    codeGen_operand_kind_t kind;
+    bool maybeNil;      // value has to be checked for nil
+    int slot;
+    int integer;
+    double number;
+    char* name;
+} codeGen_operand_t;
+
+/*
+ * Generation of units. Every thread has its own generator state.
+ * Isolated unit collects its code in memory and does not see variables
+ * left on the shadow stack by previous units; when it would need them it
+ * is dependent and has to be generated again with the real shadow stack.
+ */
+void codeGen_unit_start(const codeGen_counters_t* counters, shadowStack_t* shade, bool isolated);
+bool codeGen_unit_end(char** code, size_t* len, shadowStack_t** shade);
+void codeGen_emit_code(const char* code, size_t len);
+void codeGen_thread_end();
+
+/*
+ * Temporaries mode (--temps), used by the code generation from the tree.
+ * Operations with nil checks are done on values checked before, label is
+ * an unique number of the operation for conditional conversion.
+ */
+void codeGen_temps_declare(int count);
+void codeGen_temps_operation(psa_rules_enum operation, const codeGen_operand_t* result, const codeGen_operand_t* left, const codeGen_operand_t* right);
+void codeGen_temps_check_nil(const codeGen_operand_t* value);
+void codeGen_temps_int_to_float(int slot, const codeGen_operand_t* value, unsigned label);
+void codeGen_push_operand(const codeGen_operand_t* value);
+void codeGen_pop_operand(const codeGen_operand_t* value);
+void codeGen_assign_operand(char* name, const codeGen_operand_t* value);
+void codeGen_if_start_operand(psa_rules_enum condition, const codeGen_operand_t* left, const codeGen_operand_t* right);
+void codeGen_while_start_operand(psa_rules_enum condition, const codeGen_operand_t* left, const codeGen_operand_t* right);
+
+/*
+ * Values kept by the optimized tree (loop invariants computed before the
+ * loop, common subexpressions) are in variables TF@$inv<slot> of the
+ * function, in both modes of expressions.
+ */
+void codeGen_invariant_declare(int slot);
 
 #endif //IFJ_BRATWURST2021_CODE_GENERATOR_H
@@ -0,0 +1,227 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   C source backend - tagged values and operations of the runtime
+ *          included by the generated C programs
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_CSRC_H
+#define IFJ_BRATWURST2021_CSRC_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Program is translated to C11 (compiler --csrc) and compiled with the
+ * runtime (csrc_rt.c). Variables, parameters and results which are
+ * declared integer or number and provably hold a value of exactly that
+ * type are plain int64_t and double, every other value is tagged. Run time
+ * errors have the exit codes of the generated IFJcode21 run by ic21vm.
+ */
+
+#define CSRC_E_NIL     8    // nil operand
+#define CSRC_E_ZERO    9    // division by zero
+#define CSRC_E_TYPE    53   // wrong operand types
+#define CSRC_E_STRING  58   // wrong string operation
+#define CSRC_E_INTERNAL 99
+
+/**
+ * Strings of constants have a count of references which never drops to
+ * zero.
+ */
+#define CSRC_STATIC_REFS ((size_t)1 << (sizeof(size_t) * 8 - 2))
+
+/**
+ * @enum Types of tagged values.
+ */
+typedef enum csrc_type
+{
+    CSRC_NIL,
+    CSRC_INT,
+    CSRC_FLOAT,
+    CSRC_BOOL,
+    CSRC_STRING
+} csrc_type_t;
+
+/**
+ * @enum Operations of the runtime on tagged values.
+ */
+typedef enum csrc_op
+{
+    CSRC_ADD,
+    CSRC_SUB,
+    CSRC_MUL,
+    CSRC_EQ,
+    CSRC_NEQ,
+    CSRC_LT,
+    CSRC_GT,
+    CSRC_LEQ,
+    CSRC_GEQ
+} csrc_op_t;
+
+/**
+ * @struct Immutable byte string shared by values, may contain '\0'.
+ */
+typedef struct csrc_string
+{
+    size_t refs;
+    size_t len;
+    char data[];
+} csrc_string_t;
+
+/**
+ * @struct Tagged value, a variable owns one reference of its string.
+ */
+typedef struct csrc_value
+{
+    csrc_type_t type;
+    union
+    {
+        int64_t i;
+        double f;
+        bool b;
+        csrc_string_t* s;
+    };
+} csrc_value_t;
+
+#define CSRC_NIL_VALUE ((csrc_value_t){.type = CSRC_NIL})
+
+/* Generated program, called by main of the runtime */
+void csrc_run(void);
+
+/*
+ * Runtime (csrc_rt.c)
+ */
+_Noreturn void csrc_fail(int code);
+csrc_value_t csrc_constant(const char* data, size_t len);
+csrc_value_t csrc_to_number(csrc_value_t a);
+csrc_value_t csrc_arith(csrc_op_t op, csrc_value_t a, csrc_value_t b);
+double csrc_div(csrc_value_t a, csrc_value_t b);
+int64_t csrc_idiv(csrc_value_t a, csrc_value_t b);
+bool csrc_compare(csrc_op_t op, csrc_value_t a, csrc_value_t b);
+bool csrc_condition(csrc_value_t a);
+csrc_value_t csrc_concat(csrc_value_t a, csrc_value_t b);
+int64_t csrc_strlen(csrc_value_t a);
+
+/*
+ * Built-in functions, results in the order in which IFJcode21 pushes them
+ */
+void csrc_write(csrc_value_t a);
+void csrc_write_int(int64_t i);
+void csrc_write_float(double f);
+csrc_value_t csrc_read(csrc_type_t type);
+int64_t csrc_tointeger(csrc_value_t f);
+csrc_value_t csrc_substr(csrc_value_t s, csrc_value_t i, csrc_value_t j);
+void csrc_ord(csrc_value_t s, csrc_value_t i, csrc_value_t* ascii, int64_t* error);
+void csrc_chr(csrc_value_t i, csrc_value_t* str, int64_t* error);
+
+/*
+ * Tagged values
+ */
+static inline csrc_value_t csrc_int(int64_t i)
+{
+    return (csrc_value_t){.type = CSRC_INT, .i = i};
+}
+
+static inline csrc_value_t csrc_float(double f)
+{
+    return (csrc_value_t){.type = CSRC_FLOAT, .f = f};
+}
+
+static inline csrc_value_t csrc_bool(bool b)
+{
+    return (csrc_value_t){.type = CSRC_BOOL, .b = b};
+}
+
+static inline void csrc_retain(csrc_value_t a)
+{
+    if (a.type == CSRC_STRING)
+    {
+        a.s->refs++;
+    }
+}
+
+static inline void csrc_release(csrc_value_t a)
+{
+    if (a.type == CSRC_STRING && --a.s->refs == 0)
+    {
+        free(a.s);
+    }
+}
+
+/*
+ * Variable takes a reference of the value, its old value is released
+ */
+static inline void csrc_assign(csrc_value_t* dst, csrc_value_t src)
+{
+    csrc_retain(src);
+    csrc_release(*dst);
+    *dst = src;
+}
+
+/*
+ * Condition of the value itself, nil is false and anything else is true
+ */
+static inline bool csrc_truthy(csrc_value_t a)
+{
+    return a.type != CSRC_NIL;
+}
+
+/*
+ * Unboxed arithmetic, integers wrap around as in the interpreter
+ */
+static inline int64_t csrc_add_i(int64_t a, int64_t b)
+{
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+}
+
+static inline int64_t csrc_sub_i(int64_t a, int64_t b)
+{
+    return (int64_t)((uint64_t)a - (uint64_t)b);
+}
+
+static inline int64_t csrc_mul_i(int64_t a, int64_t b)
+{
+    return (int64_t)((uint64_t)a * (uint64_t)b);
+}
+
+/*
+ * Integer division rounds towards negative infinity
+ */
+static inline int64_t csrc_idiv_i(int64_t a, int64_t b)
+{
+    if (b == 0)
+    {
+        csrc_fail(CSRC_E_ZERO);
+    }
+
+    if (b == -1)
+    {
+        return (int64_t)(0 - (uint64_t)a);
+    }
+
+    int64_t q = a / b;
+
+    if (a % b != 0 && ((a < 0) != (b < 0)))
+    {
+        q--;
+    }
+
+    return q;
+}
+
+static inline double csrc_div_f(double a, double b)
+{
+    if (b == 0.0)
+    {
+        csrc_fail(CSRC_E_ZERO);
+    }
+
+    return a / b;
+}
+
+#endif //IFJ_BRATWURST2021_CSRC_H
@@ -0,0 +1,2006 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   C source backend - translation of the abstract syntax tree to
+ *          C11 for the runtime of csrc.h
+ *
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "error.h"
+#include "psa.h"
+#include "stats.h"
+
+#define INITIAL_CAP 32
+
+/*
+ * Characters of an operand in C, names of variables are shortened
+ */
+#define OPERAND_TEXT 96
+#define NAME_TEXT 32
+
+/*
+ * C types of values. A variable, parameter or result declared integer or
+ * number is unboxed when all its assigned values are exactly of that type
+ * and never nil, any other value is tagged. Conditions are C booleans.
+ */
+typedef enum kind
+{
+    K_VALUE,    // csrc_value_t
+    K_INT,      // int64_t
+    K_FLOAT,    // double
+    K_BOOL      // bool
+} kind_t;
+
+typedef enum form
+{
+    F_VAR,      // variable, index is its LOCAL or PARAM
+    F_TEMP,     // temporary of the statement
+    F_INT,
+    F_FLOAT,
+    F_CONST,    // string constant, index to constants
+    F_NIL
+} form_t;
+
+/**
+ * @struct Value computed by the statement.
+ */
+typedef struct operand
+{
+    kind_t kind;
+    form_t form;
+    uint32_t index;
+    int64_t integer;
+    double number;
+} operand_t;
+
+typedef enum builtin
+{
+    B_NONE,
+    B_WRITE,
+    B_READS,
+    B_READI,
+    B_READN,
+    B_TOINTEGER,
+    B_SUBSTR,
+    B_ORD,
+    B_CHR
+} builtin_t;
+
+/**
+ * @struct Built-in function, its results are pushed in this order by the
+ *         IFJcode21 code of the function.
+ */
+typedef struct builtin_def
+{
+    const char* name;
+    builtin_t builtin;
+    uint32_t results;
+    kind_t kinds[2];
+} builtin_def_t;
+
+static const builtin_def_t builtins[] = {
+    {"write", B_WRITE, 0, {K_VALUE, K_VALUE}},
+    {"reads", B_READS, 1, {K_VALUE, K_VALUE}},
+    {"readi", B_READI, 1, {K_VALUE, K_VALUE}},
+    {"readn", B_READN, 1, {K_VALUE, K_VALUE}},
+    {"tointeger", B_TOINTEGER, 1, {K_INT, K_VALUE}},
+    {"substr", B_SUBSTR, 1, {K_VALUE, K_VALUE}},
+    {"ord", B_ORD, 2, {K_VALUE, K_INT}},
+    {"chr", B_CHR, 2, {K_VALUE, K_INT}},
+};
+
+/**
+ * @struct Function of the program found by its name.
+ */
+typedef struct function_ref
+{
+    uint32_t name;
+    uint32_t node;
+} function_ref_t;
+
+typedef struct csrc_gen
+{
+    ast_t* ast;
+    FILE* file;
+
+    uint32_t* link;         /// VAR: its LOCAL or PARAM, STRING: constant, CALL: FUNCTION.
+    bool* unboxed;          /// LOCAL, PARAM and TYPE of result is int64_t or double.
+    bool changed;           /// Analysis demoted a declaration.
+
+    function_ref_t* functions;  /// Sorted by name.
+    uint32_t functions_len;
+    uint32_t functions_cap;
+
+    uint32_t* scope;        /// Visible declarations, innermost last.
+    uint32_t scope_len;
+    uint32_t scope_cap;
+    uint32_t scope_base;    /// First declaration of the function.
+
+    uint32_t* constants;    /// Offsets of string literals.
+    uint32_t constants_len;
+    uint32_t constants_cap;
+
+    operand_t* slots;       /// Values of the statement, results of calls flattened.
+    uint32_t slots_len;
+    uint32_t slots_cap;
+
+    uint32_t* owned;        /// Temporaries released at the end of the statement.
+    uint32_t owned_len;
+    uint32_t owned_cap;
+
+    uint32_t function;      /// Function being generated, AST_NONE at top level.
+    uint32_t temps;         /// Temporaries of the function.
+    bool jumps;             /// Function has a return jumping to its end.
+    unsigned depth;         /// Indentation.
+} csrc_gen_t;
+
+/*
+ * ----------------------HELPERS-----------------------
+ */
+
+/*
+ * Make room for one more item, capacity is doubled
+ */
+static bool reserve(void** items, uint32_t len, uint32_t* cap, size_t size)
+{
+    if (len < *cap)
+    {
+        return true;
+    }
+
+    uint32_t new_cap = *cap == 0 ? INITIAL_CAP : *cap * 2;
+    void* tmp = realloc(*items, (size_t)new_cap * size);
+
+    if (tmp == NULL)
+    {
+        err = E_INTERNAL;
+        return false;
+    }
+
+    *items = tmp;
+    *cap = new_cap;
+
+    return true;
+}
+
+static void push_index(uint32_t** items, uint32_t* len, uint32_t* cap, uint32_t value)
+{
+    if (reserve((void**)items, *len, cap, sizeof(uint32_t)))
+    {
+        (*items)[(*len)++] = value;
+    }
+}
+
+static void push_slot(csrc_gen_t* gen, operand_t value)
+{
+    if (reserve((void**)&gen->slots, gen->slots_len, &gen->slots_cap, sizeof(operand_t)))
+    {
+        gen->slots[gen->slots_len++] = value;
+    }
+}
+
+static ast_node_t* node_at(csrc_gen_t* gen, uint32_t index)
+{
+    return AST_NODE(gen->ast, index);
+}
+
+static uint32_t list_length(csrc_gen_t* gen, uint32_t first)
+{
+    uint32_t len = 0;
+
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        len++;
+    }
+
+    return len;
+}
+
+static uint32_t list_at(csrc_gen_t* gen, uint32_t first, uint32_t position)
+{
+    uint32_t index = first;
+
+    while (index != AST_NONE && position-- > 0)
+    {
+        index = node_at(gen, index)->next;
+    }
+
+    return index;
+}
+
+static int compare_functions(const void* a, const void* b)
+{
+    uint32_t left = ((const function_ref_t*)a)->name;
+    uint32_t right = ((const function_ref_t*)b)->name;
+
+    return (left > right) - (left < right);
+}
+
+static uint32_t find_function(csrc_gen_t* gen, uint32_t name)
+{
+    function_ref_t key = {.name = name};
+    function_ref_t* found = bsearch(&key, gen->functions, gen->functions_len, sizeof(function_ref_t), compare_functions);
+
+    return found != NULL ? found->node : AST_NONE;
+}
+
+static const builtin_def_t* find_builtin(csrc_gen_t* gen, uint32_t call)
+{
+    const char* name = AST_CHARS(gen->ast, node_at(gen, call)->a);
+
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    {
+        if (strcmp(builtins[i].name, name) == 0)
+        {
+            return &builtins[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * ----------------------SCOPES-----------------------
+ */
+
+static uint32_t lookup(csrc_gen_t* gen, uint32_t name)
+{
+    for (uint32_t i = gen->scope_len; i > gen->scope_base; i--)
+    {
+        if (node_at(gen, gen->scope[i - 1])->a == name)
+        {
+            return gen->scope[i - 1];
+        }
+    }
+
+    err = E_INTERNAL;
+
+    return AST_NONE;
+}
+
+static void declare(csrc_gen_t* gen, uint32_t decl)
+{
+    push_index(&gen->scope, &gen->scope_len, &gen->scope_cap, decl);
+}
+
+static void resolve_values(csrc_gen_t* gen, uint32_t first);
+
+static void resolve_value(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t* node = node_at(gen, index);
+
+    switch (node->kind)
+    {
+    case AST_VAR:
+        gen->link[index] = lookup(gen, node->a);
+        break;
+
+    case AST_STRING:
+        gen->link[index] = gen->constants_len;
+        push_index(&gen->constants, &gen->constants_len, &gen->constants_cap, node->a);
+        break;
+
+    case AST_CALL:
+        gen->link[index] = find_function(gen, node->a);
+        resolve_values(gen, node->b);
+        break;
+
+    case AST_OPERATION:
+        resolve_value(gen, node->a);
+
+        if (node->b != AST_NONE)
+        {
+            resolve_value(gen, node->b);
+        }
+        break;
+
+    case AST_TO_BOOL:
+        resolve_value(gen, node->a);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void resolve_values(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        resolve_value(gen, index);
+    }
+}
+
+/*
+ * Variables are bound to their declarations, value of local sees the
+ * variables declared before it
+ */
+static void resolve_stats(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE && err == E_NO_ERR; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+        uint32_t base = gen->scope_len;
+
+        switch (node->kind)
+        {
+        case AST_FUNCTION:
+            gen->scope_base = base;
+
+            for (uint32_t param = node->b; param != AST_NONE; param = node_at(gen, param)->next)
+            {
+                declare(gen, param);
+            }
+
+            resolve_stats(gen, node->c);
+            gen->scope_len = base;
+            gen->scope_base = 0;
+            break;
+
+        case AST_LOCAL:
+            resolve_values(gen, node->b);
+            declare(gen, index);
+            break;
+
+        case AST_ASSIGN:
+            resolve_values(gen, node->b);
+
+            // target throwing its value away may be a removed local
+            for (uint32_t target = node->a; target != AST_NONE; target = node_at(gen, target)->next)
+            {
+                if (!(node_at(gen, target)->flags & AST_DEAD))
+                {
+                    resolve_value(gen, target);
+                }
+            }
+            break;
+
+        case AST_RETURN:
+            resolve_values(gen, node->b);
+            break;
+
+        case AST_IF:
+            resolve_values(gen, node->a);
+            resolve_stats(gen, node->b);
+            gen->scope_len = base;
+            resolve_stats(gen, node->c);
+            gen->scope_len = base;
+            break;
+
+        case AST_WHILE:
+            resolve_values(gen, node->a);
+            resolve_stats(gen, node->b);
+            gen->scope_len = base;
+            break;
+
+        default:
+            resolve_value(gen, index);
+            break;
+        }
+    }
+}
+
+/*
+ * ----------------------UNBOXING-----------------------
+ */
+
+/*
+ * C type of the declared integer or number
+ */
+static kind_t declared_kind(csrc_gen_t* gen, uint32_t decl)
+{
+    return node_at(gen, decl)->type == INT ? K_INT : K_FLOAT;
+}
+
+static kind_t decl_kind(csrc_gen_t* gen, uint32_t decl)
+{
+    return gen->unboxed[decl] ? declared_kind(gen, decl) : K_VALUE;
+}
+
+/*
+ * Integer operand converted by its operation becomes a number
+ */
+static kind_t converted(csrc_gen_t* gen, uint32_t index, kind_t kind)
+{
+    return kind == K_INT && (node_at(gen, index)->flags & AST_TO_NUMBER) ? K_FLOAT : kind;
+}
+
+/*
+ * C type of the value, the generation produces exactly this type
+ */
+static kind_t value_kind(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t* node = node_at(gen, index);
+
+    switch (node->kind)
+    {
+    case AST_VAR:
+        return decl_kind(gen, gen->link[index]);
+
+    case AST_INT:
+        return K_INT;
+
+    case AST_NUMBER:
+        return K_FLOAT;
+
+    case AST_TO_BOOL:
+        return K_BOOL;
+
+    case AST_OPERATION:
+        break;
+
+    default:
+        return K_VALUE;
+    }
+
+    psa_rules_enum rule = node->flags & AST_RULE_MASK;
+
+    switch (rule)
+    {
+    case NT_PLUS_NT:
+    case NT_MINUS_NT:
+    case NT_MUL_NT:
+    {
+        kind_t left = converted(gen, node->a, value_kind(gen, node->a));
+        kind_t right = converted(gen, node->b, value_kind(gen, node->b));
+
+        return left == right && (left == K_INT || left == K_FLOAT) ? left : K_VALUE;
+    }
+
+    case NT_DIV_NT:
+        return K_FLOAT;
+
+    case NT_IDIV_NT:
+    case NT_HASHTAG:
+        return K_INT;
+
+    case NT_CONCAT_NT:
+        return K_VALUE;
+
+    case LBR_NT_RBR:
+        return value_kind(gen, node->a);
+
+    default:
+        return K_BOOL;
+    }
+}
+
+/*
+ * C type of the result of the call
+ */
+static kind_t result_kind(csrc_gen_t* gen, uint32_t call, uint32_t result)
+{
+    uint32_t function = gen->link[call];
+
+    if (function == AST_NONE)
+    {
+        const builtin_def_t* builtin = find_builtin(gen, call);
+
+        return builtin != NULL && result < builtin->results ? builtin->kinds[result] : K_VALUE;
+    }
+
+    return decl_kind(gen, list_at(gen, node_at(gen, function)->d, result));
+}
+
+static uint32_t call_results(csrc_gen_t* gen, uint32_t call)
+{
+    uint32_t function = gen->link[call];
+
+    if (function == AST_NONE)
+    {
+        const builtin_def_t* builtin = find_builtin(gen, call);
+
+        return builtin != NULL ? builtin->results : 0;
+    }
+
+    return list_length(gen, node_at(gen, function)->d);
+}
+
+static void demote(csrc_gen_t* gen, uint32_t decl)
+{
+    if (gen->unboxed[decl])
+    {
+        gen->unboxed[decl] = false;
+        gen->changed = true;
+    }
+}
+
+/*
+ * Assigned value keeps the declaration unboxed only with its exact type
+ */
+static void require(csrc_gen_t* gen, uint32_t decl, kind_t kind)
+{
+    if (gen->unboxed[decl] && kind != declared_kind(gen, decl))
+    {
+        demote(gen, decl);
+    }
+}
+
+/*
+ * Values are pushed in order, a call pushes all its results. Kind of the
+ * value with the position from the end of the pushed values (0 is the
+ * top), false when there is no such value.
+ */
+static bool slot_kind(csrc_gen_t* gen, uint32_t first, uint32_t from_top, kind_t* kind)
+{
+    uint32_t count = 0;
+
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        count += node_at(gen, index)->kind == AST_CALL ? call_results(gen, index) : 1;
+    }
+
+    if (from_top >= count)
+    {
+        return false;
+    }
+
+    uint32_t position = count - 1 - from_top;
+
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        uint32_t len = node_at(gen, index)->kind == AST_CALL ? call_results(gen, index) : 1;
+
+        if (position < len)
+        {
+            *kind = node_at(gen, index)->kind == AST_CALL ? result_kind(gen, index, position) : value_kind(gen, index);
+            return true;
+        }
+
+        position -= len;
+    }
+
+    return false;
+}
+
+static void require_slot(csrc_gen_t* gen, uint32_t decl, uint32_t first, uint32_t from_top)
+{
+    kind_t kind;
+
+    if (!slot_kind(gen, first, from_top, &kind))
+    {
+        demote(gen, decl);
+        return;
+    }
+
+    require(gen, decl, kind);
+}
+
+/*
+ * Parameters of called user functions are assigned from the arguments,
+ * which are in push order (the last one first)
+ */
+static void analyze_values(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+
+        if (node->kind != AST_CALL || gen->link[index] == AST_NONE)
+        {
+            continue;
+        }
+
+        uint32_t args = list_length(gen, node->b);
+        uint32_t param = node_at(gen, gen->link[index])->b;
+
+        for (uint32_t i = 0; param != AST_NONE; i++, param = node_at(gen, param)->next)
+        {
+            if (i >= args)
+            {
+                demote(gen, param);
+                continue;
+            }
+
+            require(gen, param, value_kind(gen, list_at(gen, node->b, args - 1 - i)));
+        }
+    }
+}
+
+static void analyze_stats(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+
+        switch (node->kind)
+        {
+        case AST_FUNCTION:
+            gen->function = index;
+            analyze_stats(gen, node->c);
+            gen->function = AST_NONE;
+            break;
+
+        case AST_LOCAL:
+            analyze_values(gen, node->b);
+
+            // value of removed local is never read
+            if (!(node->flags & (AST_DEAD | AST_LOCAL_DEFINED)))
+            {
+                require_slot(gen, index, node->b, 0);
+            }
+            break;
+
+        case AST_ASSIGN:
+        {
+            uint32_t targets = list_length(gen, node->a);
+            uint32_t target = node->a;
+
+            analyze_values(gen, node->b);
+
+            // targets are assigned from the last one
+            for (uint32_t i = 0; i < targets; i++, target = node_at(gen, target)->next)
+            {
+                if (!(node_at(gen, target)->flags & AST_DEAD))
+                {
+                    require_slot(gen, gen->link[target], node->b, targets - 1 - i);
+                }
+            }
+            break;
+        }
+
+        case AST_RETURN:
+        {
+            analyze_values(gen, node->b);
+
+            if (gen->function == AST_NONE)
+            {
+                break;
+            }
+
+            uint32_t results = list_length(gen, node_at(gen, gen->function)->d);
+            uint32_t values = 0;
+            uint32_t type = node_at(gen, gen->function)->d;
+            kind_t kind;
+
+            for (uint32_t value = node->b; value != AST_NONE; value = node_at(gen, value)->next)
+            {
+                values += node_at(gen, value)->kind == AST_CALL ? call_results(gen, value) : 1;
+            }
+
+            // results are taken by position, missing ones are nil
+            for (uint32_t i = 0; i < results; i++, type = node_at(gen, type)->next)
+            {
+                if (i >= values || !slot_kind(gen, node->b, values - 1 - i, &kind))
+                {
+                    demote(gen, type);
+                    continue;
+                }
+
+                require(gen, type, kind);
+            }
+            break;
+        }
+
+        case AST_IF:
+            analyze_values(gen, node->a);
+            analyze_stats(gen, node->b);
+            analyze_stats(gen, node->c);
+            break;
+
+        case AST_WHILE:
+            analyze_values(gen, node->a);
+            analyze_stats(gen, node->b);
+            break;
+
+        default:
+            analyze_values(gen, index);
+            break;
+        }
+    }
+}
+
+/*
+ * Every path of the statements ends by return
+ */
+static bool returns(csrc_gen_t* gen, uint32_t first)
+{
+    uint32_t last = AST_NONE;
+
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        last = index;
+    }
+
+    if (last == AST_NONE)
+    {
+        return false;
+    }
+
+    ast_node_t* node = node_at(gen, last);
+
+    return node->kind == AST_RETURN ||
+           (node->kind == AST_IF && returns(gen, node->b) && returns(gen, node->c));
+}
+
+static bool unboxable(data_type_t type)
+{
+    return type == INT || type == NUMBER;
+}
+
+static void mark_candidates(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+
+        switch (node->kind)
+        {
+        case AST_FUNCTION:
+        {
+            // result of a function which may end without return is nil
+            bool ends = returns(gen, node->c);
+
+            for (uint32_t param = node->b; param != AST_NONE; param = node_at(gen, param)->next)
+            {
+                gen->unboxed[param] = unboxable(node_at(gen, param)->type);
+            }
+
+            for (uint32_t type = node->d; type != AST_NONE; type = node_at(gen, type)->next)
+            {
+                gen->unboxed[type] = ends && unboxable(node_at(gen, type)->type);
+            }
+
+            mark_candidates(gen, node->c);
+            break;
+        }
+
+        case AST_LOCAL:
+            gen->unboxed[index] = unboxable(node->type) && !(node->flags & AST_LOCAL_DEFINED);
+            break;
+
+        case AST_IF:
+            mark_candidates(gen, node->b);
+            mark_candidates(gen, node->c);
+            break;
+
+        case AST_WHILE:
+            mark_candidates(gen, node->b);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * All candidates are unboxed at first, declarations with a value of other
+ * type are demoted until nothing changes
+ */
+static void analyze(csrc_gen_t* gen)
+{
+    mark_candidates(gen, gen->ast->first);
+
+    do
+    {
+        gen->changed = false;
+        gen->function = AST_NONE;
+        analyze_stats(gen, gen->ast->first);
+    } while (gen->changed);
+}
+
+/*
+ * ----------------------OUTPUT-----------------------
+ */
+
+static void emit(csrc_gen_t* gen, const char* format, ...)
+{
+    va_list args;
+
+    fprintf(gen->file, "%*s", (int)gen->depth * 4, "");
+    va_start(args, format);
+    vfprintf(gen->file, format, args);
+    va_end(args);
+    fputc('\n', gen->file);
+}
+
+static void open_block(csrc_gen_t* gen)
+{
+    emit(gen, "{");
+    gen->depth++;
+}
+
+static void close_block(csrc_gen_t* gen)
+{
+    gen->depth--;
+    emit(gen, "}");
+}
+
+static const char* c_type(kind_t kind)
+{
+    switch (kind)
+    {
+    case K_INT:
+        return "int64_t";
+    case K_FLOAT:
+        return "double";
+    case K_BOOL:
+        return "bool";
+    default:
+        return "csrc_value_t";
+    }
+}
+
+/*
+ * Variable is named by its declaration, '$' of inlined variables is not
+ * a character of C identifiers
+ */
+static char* var_name(csrc_gen_t* gen, uint32_t decl, char* buffer)
+{
+    const char* name = AST_CHARS(gen->ast, node_at(gen, decl)->a);
+    int len = sprintf(buffer, "v%" PRIu32 "_", decl);
+
+    for (int i = 0; name[i] != '\0' && i < NAME_TEXT; i++)
+    {
+        buffer[len++] = name[i] == '$' ? '_' : name[i];
+    }
+
+    buffer[len] = '\0';
+
+    return buffer;
+}
+
+static char* number_text(double number, char* buffer)
+{
+    if (isinf(number))
+    {
+        strcpy(buffer, number < 0 ? "(-HUGE_VAL)" : "HUGE_VAL");
+    }
+    else
+    {
+        sprintf(buffer, "%a", number);
+    }
+
+    return buffer;
+}
+
+/*
+ * Operand in C, boxed operand is a tagged value
+ */
+static const char* text(csrc_gen_t* gen, const operand_t* operand, bool boxed, char* buffer)
+{
+    char value[OPERAND_TEXT];
+
+    switch (operand->form)
+    {
+    case F_VAR:
+        var_name(gen, operand->index, value);
+        break;
+    case F_TEMP:
+        sprintf(value, "t%" PRIu32, operand->index);
+        break;
+    case F_INT:
+        sprintf(value, "INT64_C(%" PRId64 ")", operand->integer);
+        break;
+    case F_FLOAT:
+        number_text(operand->number, value);
+        break;
+    case F_CONST:
+        sprintf(value, "k[%" PRIu32 "]", operand->index);
+        break;
+    default:
+        strcpy(value, "CSRC_NIL_VALUE");
+        break;
+    }
+
+    if (!boxed || operand->kind == K_VALUE)
+    {
+        strcpy(buffer, value);
+        return buffer;
+    }
+
+    switch (operand->kind)
+    {
+    case K_INT:
+        sprintf(buffer, "csrc_int(%s)", value);
+        break;
+    case K_FLOAT:
+        sprintf(buffer, "csrc_float(%s)", value);
+        break;
+    default:
+        sprintf(buffer, "csrc_bool(%s)", value);
+        break;
+    }
+
+    return buffer;
+}
+
+static operand_t new_temp(csrc_gen_t* gen, kind_t kind)
+{
+    operand_t temp = {.kind = kind, .form = F_TEMP, .index = gen->temps++};
+
+    return temp;
+}
+
+/*
+ * Temporary holds a reference of a string until the end of the statement
+ */
+static void own(csrc_gen_t* gen, const operand_t* temp)
+{
+    push_index(&gen->owned, &gen->owned_len, &gen->owned_cap, temp->index);
+}
+
+static void release_owned(csrc_gen_t* gen)
+{
+    for (uint32_t i = 0; i < gen->owned_len; i++)
+    {
+        emit(gen, "csrc_release(t%" PRIu32 ");", gen->owned[i]);
+    }
+
+    gen->owned_len = 0;
+}
+
+/*
+ * Value of the string literal as written in the source, escape sequences
+ * are decoded as the code generator does (\ddd is a decimal code)
+ */
+static size_t decode_string(const char* src, char* dst)
+{
+    size_t len = 0;
+
+    while (*src != '\0')
+    {
+        if (*src != '\\' || src[1] == '\0')
+        {
+            dst[len++] = *src++;
+            continue;
+        }
+
+        src++;
+
+        if (isdigit((unsigned char)src[0]) && isdigit((unsigned char)src[1]) && isdigit((unsigned char)src[2]))
+        {
+            dst[len++] = (char)((src[0] - '0') * 100 + (src[1] - '0') * 10 + (src[2] - '0'));
+            src += 3;
+            continue;
+        }
+
+        switch (*src)
+        {
+        case 'a':
+            dst[len++] = '\a';
+            break;
+        case 'b':
+            dst[len++] = '\b';
+            break;
+        case 'f':
+            dst[len++] = '\f';
+            break;
+        case 'n':
+            dst[len++] = '\n';
+            break;
+        case 'r':
+            dst[len++] = '\r';
+            break;
+        case 't':
+            dst[len++] = '\t';
+            break;
+        case 'v':
+            dst[len++] = '\v';
+            break;
+        case '\\':
+        case '"':
+        case '\'':
+            dst[len++] = *src;
+            break;
+        default:
+            break;
+        }
+
+        src++;
+    }
+
+    return len;
+}
+
+/*
+ * Constant is written as C string literal, other than printable
+ * characters are octal escapes
+ */
+static void emit_constant(csrc_gen_t* gen, uint32_t constant)
+{
+    const char* src = AST_CHARS(gen->ast, gen->constants[constant]);
+    char* data = malloc(strlen(src) + 1);
+
+    if (data == NULL)
+    {
+        err = E_INTERNAL;
+        return;
+    }
+
+    size_t len = decode_string(src, data);
+
+    fprintf(gen->file, "%*sk[%" PRIu32 "] = csrc_constant(\"", (int)gen->depth * 4, "", constant);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)data[i];
+
+        if (c == '"' || c == '\\' || c == '?')
+        {
+            fprintf(gen->file, "\\%c", c);
+        }
+        else if (c < 32 || c > 126)
+        {
+            fprintf(gen->file, "\\%03o", c);
+        }
+        else
+        {
+            fputc(c, gen->file);
+        }
+    }
+
+    fprintf(gen->file, "\", %zu);\n", len);
+    free(data);
+}
+
+/*
+ * ----------------------EXPRESSIONS-----------------------
+ */
+
+static operand_t gen_value(csrc_gen_t* gen, uint32_t index);
+
+/*
+ * Integer operand of operation is converted to number, nil is left for
+ * the check of the operation
+ */
+static operand_t to_number(csrc_gen_t* gen, operand_t value)
+{
+    char a[OPERAND_TEXT];
+
+    if (value.kind == K_INT && value.form == F_INT)
+    {
+        value.kind = K_FLOAT;
+        value.form = F_FLOAT;
+        value.number = (double)value.integer;
+        return value;
+    }
+
+    if (value.kind == K_INT)
+    {
+        operand_t temp = new_temp(gen, K_FLOAT);
+
+        emit(gen, "double t%" PRIu32 " = (double)%s;", temp.index, text(gen, &value, false, a));
+        return temp;
+    }
+
+    if (value.kind == K_VALUE)
+    {
+        operand_t temp = new_temp(gen, K_VALUE);
+
+        emit(gen, "csrc_value_t t%" PRIu32 " = csrc_to_number(%s);", temp.index, text(gen, &value, false, a));
+        return temp;
+    }
+
+    return value;
+}
+
+static const char* runtime_op(psa_rules_enum rule)
+{
+    switch (rule)
+    {
+    case NT_PLUS_NT:
+        return "CSRC_ADD";
+    case NT_MINUS_NT:
+        return "CSRC_SUB";
+    case NT_MUL_NT:
+        return "CSRC_MUL";
+    case NT_EQ_NT:
+        return "CSRC_EQ";
+    case NT_NEQ_NT:
+        return "CSRC_NEQ";
+    case NT_LEQ_NT:
+        return "CSRC_LEQ";
+    case NT_GEQ_NT:
+        return "CSRC_GEQ";
+    case NT_LTN_NT:
+        return "CSRC_LT";
+    default:
+        return "CSRC_GT";
+    }
+}
+
+/*
+ * Relation of unboxed operands, a <= b is not a > b, a >= b is not a < b
+ */
+static const char* relation_format(psa_rules_enum rule)
+{
+    switch (rule)
+    {
+    case NT_EQ_NT:
+        return "bool t%" PRIu32 " = %s == %s;";
+    case NT_NEQ_NT:
+        return "bool t%" PRIu32 " = !(%s == %s);";
+    case NT_LEQ_NT:
+        return "bool t%" PRIu32 " = !(%s > %s);";
+    case NT_GEQ_NT:
+        return "bool t%" PRIu32 " = !(%s < %s);";
+    case NT_LTN_NT:
+        return "bool t%" PRIu32 " = %s < %s;";
+    default:
+        return "bool t%" PRIu32 " = %s > %s;";
+    }
+}
+
+/*
+ * Operands are evaluated from the left, the right one is converted first
+ * and both are checked by the operation (as in IFJcode21). Unboxed
+ * operands of the same type are computed inline, others by the runtime.
+ */
+static operand_t gen_operation(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t node = *node_at(gen, index);
+    psa_rules_enum rule = node.flags & AST_RULE_MASK;
+    operand_t left = gen_value(gen, node.a);
+    operand_t right = {.kind = K_VALUE, .form = F_NIL};
+    char a[OPERAND_TEXT];
+    char b[OPERAND_TEXT];
+
+    if (rule == LBR_NT_RBR)
+    {
+        return left;
+    }
+
+    if (node.b != AST_NONE)
+    {
+        right = gen_value(gen, node.b);
+
+        if (node_at(gen, node.b)->flags & AST_TO_NUMBER)
+        {
+            right = to_number(gen, right);
+        }
+
+        if (node_at(gen, node.a)->flags & AST_TO_NUMBER)
+        {
+            left = to_number(gen, left);
+        }
+    }
+
+    bool same = left.kind == right.kind && (left.kind == K_INT || left.kind == K_FLOAT);
+    operand_t result = new_temp(gen, value_kind(gen, index));
+    uint32_t t = result.index;
+
+    switch (rule)
+    {
+    case NT_PLUS_NT:
+    case NT_MINUS_NT:
+    case NT_MUL_NT:
+        if (same && left.kind == K_INT)
+        {
+            emit(gen, "int64_t t%" PRIu32 " = csrc_%s_i(%s, %s);", t,
+                 rule == NT_PLUS_NT ? "add" : (rule == NT_MINUS_NT ? "sub" : "mul"),
+                 text(gen, &left, false, a), text(gen, &right, false, b));
+        }
+        else if (same)
+        {
+            emit(gen, "double t%" PRIu32 " = %s %c %s;", t, text(gen, &left, false, a),
+                 rule == NT_PLUS_NT ? '+' : (rule == NT_MINUS_NT ? '-' : '*'), text(gen, &right, false, b));
+        }
+        else
+        {
+            emit(gen, "csrc_value_t t%" PRIu32 " = csrc_arith(%s, %s, %s);", t, runtime_op(rule),
+                 text(gen, &left, true, a), text(gen, &right, true, b));
+        }
+        break;
+
+    case NT_DIV_NT:
+        emit(gen, same && left.kind == K_FLOAT ? "double t%" PRIu32 " = csrc_div_f(%s, %s);" :
+                                                 "double t%" PRIu32 " = csrc_div(%s, %s);",
+             t, text(gen, &left, !same, a), text(gen, &right, !same, b));
+        break;
+
+    case NT_IDIV_NT:
+        emit(gen, same && left.kind == K_INT ? "int64_t t%" PRIu32 " = csrc_idiv_i(%s, %s);" :
+                                               "int64_t t%" PRIu32 " = csrc_idiv(%s, %s);",
+             t, text(gen, &left, !same, a), text(gen, &right, !same, b));
+        break;
+
+    case NT_CONCAT_NT:
+        emit(gen, "csrc_value_t t%" PRIu32 " = csrc_concat(%s, %s);", t,
+             text(gen, &left, true, a), text(gen, &right, true, b));
+        own(gen, &result);
+        break;
+
+    case NT_HASHTAG:
+        emit(gen, "int64_t t%" PRIu32 " = csrc_strlen(%s);", t, text(gen, &left, true, a));
+        break;
+
+    default:
+        if (same)
+        {
+            emit(gen, relation_format(rule), t, text(gen, &left, false, a), text(gen, &right, false, b));
+        }
+        else
+        {
+            emit(gen, "bool t%" PRIu32 " = csrc_compare(%s, %s, %s);", t, runtime_op(rule),
+                 text(gen, &left, true, a), text(gen, &right, true, b));
+        }
+        break;
+    }
+
+    return result;
+}
+
+/*
+ * Value which is not a call
+ */
+static operand_t gen_value(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t* node = node_at(gen, index);
+    operand_t value = {.kind = K_VALUE, .form = F_NIL};
+
+    switch (node->kind)
+    {
+    case AST_VAR:
+        value.kind = decl_kind(gen, gen->link[index]);
+        value.form = F_VAR;
+        value.index = gen->link[index];
+        break;
+
+    case AST_INT:
+        value.kind = K_INT;
+        value.form = F_INT;
+        value.integer = (int)node->a;
+        break;
+
+    case AST_NUMBER:
+        value.kind = K_FLOAT;
+        value.form = F_FLOAT;
+        value.number = gen->ast->numbers[node->a];
+        break;
+
+    case AST_STRING:
+        value.form = F_CONST;
+        value.index = gen->link[index];
+        break;
+
+    case AST_OPERATION:
+        value = gen_operation(gen, index);
+        break;
+
+    case AST_CALL:
+        // a call is never an operand of expression
+        err = E_INTERNAL;
+        break;
+
+    default:
+        break;
+    }
+
+    return value;
+}
+
+/*
+ * Argument of the parameter (arguments are in push order), nil when it
+ * is missing
+ */
+static operand_t gen_arg(csrc_gen_t* gen, uint32_t call, uint32_t param)
+{
+    uint32_t args = list_length(gen, node_at(gen, call)->b);
+    operand_t nil = {.kind = K_VALUE, .form = F_NIL};
+
+    if (param >= args)
+    {
+        return nil;
+    }
+
+    return gen_value(gen, list_at(gen, node_at(gen, call)->b, args - 1 - param));
+}
+
+static void gen_write(csrc_gen_t* gen, uint32_t call)
+{
+    uint32_t args = list_length(gen, node_at(gen, call)->b);
+    char a[OPERAND_TEXT];
+
+    // arguments are printed from the first one
+    for (uint32_t i = 0; i < args; i++)
+    {
+        operand_t value = gen_arg(gen, call, i);
+
+        if (value.kind == K_INT)
+        {
+            emit(gen, "csrc_write_int(%s);", text(gen, &value, false, a));
+        }
+        else if (value.kind == K_FLOAT)
+        {
+            emit(gen, "csrc_write_float(%s);", text(gen, &value, false, a));
+        }
+        else
+        {
+            emit(gen, "csrc_write(%s);", text(gen, &value, true, a));
+        }
+    }
+}
+
+static void gen_builtin(csrc_gen_t* gen, uint32_t call, const builtin_def_t* builtin)
+{
+    operand_t first = new_temp(gen, builtin->kinds[0]);
+    char a[OPERAND_TEXT];
+    char b[OPERAND_TEXT];
+    char c[OPERAND_TEXT];
+    operand_t arg0 = gen_arg(gen, call, 0);
+    operand_t arg1 = gen_arg(gen, call, 1);
+    operand_t arg2 = gen_arg(gen, call, 2);
+    uint32_t t = first.index;
+
+    switch (builtin->builtin)
+    {
+    case B_READS:
+    case B_READI:
+    case B_READN:
+        emit(gen, "csrc_value_t t%" PRIu32 " = csrc_read(%s);", t,
+             builtin->builtin == B_READS ? "CSRC_STRING" : (builtin->builtin == B_READI ? "CSRC_INT" : "CSRC_FLOAT"));
+        break;
+
+    case B_TOINTEGER:
+        emit(gen, "int64_t t%" PRIu32 " = csrc_tointeger(%s);", t, text(gen, &arg0, true, a));
+        break;
+
+    case B_SUBSTR:
+        emit(gen, "csrc_value_t t%" PRIu32 " = csrc_substr(%s, %s, %s);", t,
+             text(gen, &arg0, true, a), text(gen, &arg1, true, b), text(gen, &arg2, true, c));
+        break;
+
+    default:
+    {
+        operand_t second = new_temp(gen, K_INT);
+
+        emit(gen, "csrc_value_t t%" PRIu32 ";", t);
+        emit(gen, "int64_t t%" PRIu32 ";", second.index);
+
+        if (builtin->builtin == B_ORD)
+        {
+            emit(gen, "csrc_ord(%s, %s, &t%" PRIu32 ", &t%" PRIu32 ");", text(gen, &arg0, true, a),
+                 text(gen, &arg1, true, b), t, second.index);
+        }
+        else
+        {
+            emit(gen, "csrc_chr(%s, &t%" PRIu32 ", &t%" PRIu32 ");", text(gen, &arg0, true, a), t, second.index);
+        }
+
+        push_slot(gen, first);
+        push_slot(gen, second);
+        own(gen, &first);
+        return;
+    }
+    }
+
+    push_slot(gen, first);
+
+    if (first.kind == K_VALUE)
+    {
+        own(gen, &first);
+    }
+}
+
+/*
+ * Call of user function, results are temporaries passed to the function
+ */
+static void gen_user_call(csrc_gen_t* gen, uint32_t call)
+{
+    ast_node_t* function = node_at(gen, gen->link[call]);
+    uint32_t first = gen->temps;
+    uint32_t i = 0;
+    char a[OPERAND_TEXT];
+
+    fprintf(gen->file, "%*s", (int)gen->depth * 4, "");
+
+    for (uint32_t type = function->d; type != AST_NONE; type = node_at(gen, type)->next)
+    {
+        operand_t result = new_temp(gen, decl_kind(gen, type));
+
+        fprintf(gen->file, "%s t%" PRIu32 "; ", c_type(result.kind), result.index);
+        push_slot(gen, result);
+
+        if (result.kind == K_VALUE)
+        {
+            own(gen, &result);
+        }
+    }
+
+    fprintf(gen->file, "f_%s(", AST_CHARS(gen->ast, function->a));
+
+    for (uint32_t param = function->b; param != AST_NONE; param = node_at(gen, param)->next, i++)
+    {
+        operand_t arg = gen_arg(gen, call, i);
+
+        fprintf(gen->file, "%s%s", i > 0 ? ", " : "", text(gen, &arg, !gen->unboxed[param], a));
+    }
+
+    for (uint32_t t = first; t < gen->temps; t++, i++)
+    {
+        fprintf(gen->file, "%s&t%" PRIu32, i > 0 ? ", " : "", t);
+    }
+
+    fprintf(gen->file, ");\n");
+}
+
+/*
+ * Results of the call are added to the values of the statement
+ */
+static void gen_call(csrc_gen_t* gen, uint32_t call)
+{
+    const builtin_def_t* builtin;
+
+    if (gen->link[call] != AST_NONE)
+    {
+        gen_user_call(gen, call);
+    }
+    else if ((builtin = find_builtin(gen, call)) == NULL)
+    {
+        err = E_INTERNAL;
+    }
+    else if (builtin->builtin == B_WRITE)
+    {
+        gen_write(gen, call);
+    }
+    else
+    {
+        gen_builtin(gen, call, builtin);
+    }
+}
+
+/*
+ * Values are computed in order to the slots, a call adds all its results
+ */
+static void gen_values(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        if (node_at(gen, index)->kind == AST_CALL)
+        {
+            gen_call(gen, index);
+        }
+        else
+        {
+            push_slot(gen, gen_value(gen, index));
+        }
+    }
+}
+
+/*
+ * Variable values are copied before any target is assigned
+ */
+static void snapshot_slots(csrc_gen_t* gen, uint32_t base)
+{
+    char a[OPERAND_TEXT];
+
+    for (uint32_t i = base; i < gen->slots_len; i++)
+    {
+        operand_t* slot = &gen->slots[i];
+
+        if (slot->form != F_VAR)
+        {
+            continue;
+        }
+
+        operand_t temp = new_temp(gen, slot->kind);
+
+        emit(gen, "%s t%" PRIu32 " = %s;", c_type(temp.kind), temp.index, text(gen, slot, false, a));
+
+        if (temp.kind == K_VALUE)
+        {
+            emit(gen, "csrc_retain(t%" PRIu32 ");", temp.index);
+            own(gen, &temp);
+        }
+
+        *slot = temp;
+    }
+}
+
+/*
+ * Value is stored to the variable, missing value is nil
+ */
+static void store(csrc_gen_t* gen, uint32_t decl, const operand_t* value)
+{
+    char name[OPERAND_TEXT];
+    char a[OPERAND_TEXT];
+
+    var_name(gen, decl, name);
+
+    if (!gen->unboxed[decl])
+    {
+        emit(gen, "csrc_assign(&%s, %s);", name, value != NULL ? text(gen, value, true, a) : "CSRC_NIL_VALUE");
+        return;
+    }
+
+    if (value == NULL || value->kind != declared_kind(gen, decl))
+    {
+        err = E_INTERNAL;
+        return;
+    }
+
+    emit(gen, "%s = %s;", name, text(gen, value, false, a));
+}
+
+/*
+ * Value of the slot with the position from the top, NULL if missing
+ */
+static const operand_t* slot_from_top(csrc_gen_t* gen, uint32_t base, uint32_t from_top)
+{
+    return from_top < gen->slots_len - base ? &gen->slots[gen->slots_len - 1 - from_top] : NULL;
+}
+
+/*
+ * Condition as C boolean
+ */
+static operand_t gen_condition(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t node = *node_at(gen, index);
+    char a[OPERAND_TEXT];
+
+    if (node.kind == AST_TO_BOOL)
+    {
+        operand_t value = gen_value(gen, node.a);
+        operand_t result = new_temp(gen, K_BOOL);
+
+        // unboxed value is never nil
+        if (value.kind == K_VALUE)
+        {
+            emit(gen, "bool t%" PRIu32 " = csrc_truthy(%s);", result.index, text(gen, &value, false, a));
+        }
+        else
+        {
+            emit(gen, "bool t%" PRIu32 " = true;", result.index);
+        }
+
+        return result;
+    }
+
+    operand_t value = gen_value(gen, index);
+
+    if (value.kind == K_BOOL)
+    {
+        return value;
+    }
+
+    operand_t result = new_temp(gen, K_BOOL);
+
+    emit(gen, "bool t%" PRIu32 " = csrc_condition(%s);", result.index, text(gen, &value, true, a));
+
+    return result;
+}
+
+/*
+ * ----------------------STATEMENTS-----------------------
+ */
+
+static void gen_stats(csrc_gen_t* gen, uint32_t first);
+
+static void gen_local(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t node = *node_at(gen, index);
+    uint32_t base = gen->slots_len;
+
+    gen_values(gen, node.b);
+
+    // value of removed local is only evaluated, the variable stays nil
+    if (node.flags & (AST_DEAD | AST_LOCAL_DEFINED))
+    {
+        if (!gen->unboxed[index])
+        {
+            store(gen, index, NULL);
+        }
+    }
+    else
+    {
+        store(gen, index, slot_from_top(gen, base, 0));
+    }
+
+    gen->slots_len = base;
+}
+
+static void gen_assign(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t node = *node_at(gen, index);
+    uint32_t base = gen->slots_len;
+    uint32_t targets = list_length(gen, node.a);
+
+    gen_values(gen, node.b);
+
+    if (targets > 1)
+    {
+        snapshot_slots(gen, base);
+    }
+
+    // targets are assigned from the last one
+    for (uint32_t i = targets; i > 0; i--)
+    {
+        uint32_t target = list_at(gen, node.a, i - 1);
+
+        if (!(node_at(gen, target)->flags & AST_DEAD))
+        {
+            store(gen, gen->link[target], slot_from_top(gen, base, targets - i));
+        }
+    }
+
+    gen->slots_len = base;
+}
+
+static void gen_return(csrc_gen_t* gen, uint32_t index)
+{
+    uint32_t base = gen->slots_len;
+    uint32_t values;
+    uint32_t i = 0;
+    char a[OPERAND_TEXT];
+
+    gen_values(gen, node_at(gen, index)->b);
+    values = gen->slots_len - base;
+
+    if (gen->function != AST_NONE)
+    {
+        // results are taken by position, missing ones are nil
+        for (uint32_t type = node_at(gen, gen->function)->d; type != AST_NONE; type = node_at(gen, type)->next, i++)
+        {
+            const operand_t* value = i < values ? &gen->slots[base + i] : NULL;
+
+            if (gen->unboxed[type])
+            {
+                emit(gen, "*r%" PRIu32 " = %s;", i, text(gen, value, false, a));
+            }
+            else
+            {
+                emit(gen, "*r%" PRIu32 " = %s;", i, value != NULL ? text(gen, value, true, a) : "CSRC_NIL_VALUE");
+                emit(gen, "csrc_retain(*r%" PRIu32 ");", i);
+            }
+        }
+    }
+
+    gen->slots_len = base;
+    release_owned(gen);
+    emit(gen, "goto end;");
+    gen->jumps = true;
+}
+
+static void gen_stat(csrc_gen_t* gen, uint32_t index)
+{
+    ast_node_t node = *node_at(gen, index);
+    uint32_t base = gen->slots_len;
+
+    switch (node.kind)
+    {
+    case AST_LOCAL:
+        gen_local(gen, index);
+        break;
+
+    case AST_ASSIGN:
+        gen_assign(gen, index);
+        break;
+
+    case AST_RETURN:
+        gen_return(gen, index);
+        return;
+
+    case AST_FUNCTION:
+        // definitions are generated before the top level
+        return;
+
+    case AST_IF:
+    {
+        operand_t condition = gen_condition(gen, node.a);
+
+        release_owned(gen);
+        emit(gen, "if (t%" PRIu32 ")", condition.index);
+        open_block(gen);
+        gen_stats(gen, node.b);
+        close_block(gen);
+
+        if (node.c != AST_NONE)
+        {
+            emit(gen, "else");
+            open_block(gen);
+            gen_stats(gen, node.c);
+            close_block(gen);
+        }
+        return;
+    }
+
+    case AST_WHILE:
+    {
+        emit(gen, "for (;;)");
+        open_block(gen);
+
+        operand_t condition = gen_condition(gen, node.a);
+
+        release_owned(gen);
+        emit(gen, "if (!t%" PRIu32 ")", condition.index);
+        open_block(gen);
+        emit(gen, "break;");
+        close_block(gen);
+        gen_stats(gen, node.b);
+        close_block(gen);
+        return;
+    }
+
+    case AST_CALL:
+        // results of call statement are thrown away
+        gen_call(gen, index);
+        gen->slots_len = base;
+        break;
+
+    default:
+        // value of inlined call, evaluated only when it may fail
+        gen_value(gen, index);
+        break;
+    }
+
+    release_owned(gen);
+}
+
+static void gen_stats(csrc_gen_t* gen, uint32_t first)
+{
+    for (uint32_t index = first; index != AST_NONE && err == E_NO_ERR; index = node_at(gen, index)->next)
+    {
+        gen_stat(gen, index);
+    }
+}
+
+/*
+ * ----------------------FUNCTIONS-----------------------
+ */
+
+/*
+ * Locals of the body are declared at the start of the function, tagged
+ * ones are nil until their declaration
+ */
+static void declare_locals(csrc_gen_t* gen, uint32_t first)
+{
+    char name[OPERAND_TEXT];
+
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+
+        switch (node->kind)
+        {
+        case AST_LOCAL:
+            emit(gen, "%s %s = %s;", c_type(decl_kind(gen, index)), var_name(gen, index, name),
+                 !gen->unboxed[index] ? "CSRC_NIL_VALUE" : (declared_kind(gen, index) == K_INT ? "0" : "0.0"));
+            break;
+
+        case AST_IF:
+            declare_locals(gen, node->b);
+            declare_locals(gen, node->c);
+            break;
+
+        case AST_WHILE:
+            declare_locals(gen, node->b);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+static void release_locals(csrc_gen_t* gen, uint32_t first)
+{
+    char name[OPERAND_TEXT];
+
+    for (uint32_t index = first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+
+        switch (node->kind)
+        {
+        case AST_LOCAL:
+            if (!gen->unboxed[index])
+            {
+                emit(gen, "csrc_release(%s);", var_name(gen, index, name));
+            }
+            break;
+
+        case AST_IF:
+            release_locals(gen, node->b);
+            release_locals(gen, node->c);
+            break;
+
+        case AST_WHILE:
+            release_locals(gen, node->b);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * Parameters are passed by value, results through out-parameters
+ */
+static void gen_signature(csrc_gen_t* gen, ast_node_t* function)
+{
+    char name[OPERAND_TEXT];
+    uint32_t i = 0;
+
+    fprintf(gen->file, "static void f_%s(", AST_CHARS(gen->ast, function->a));
+
+    for (uint32_t param = function->b; param != AST_NONE; param = node_at(gen, param)->next, i++)
+    {
+        fprintf(gen->file, "%s%s %s", i > 0 ? ", " : "", c_type(decl_kind(gen, param)), var_name(gen, param, name));
+    }
+
+    uint32_t result = 0;
+
+    for (uint32_t type = function->d; type != AST_NONE; type = node_at(gen, type)->next, i++, result++)
+    {
+        fprintf(gen->file, "%s%s* r%" PRIu32, i > 0 ? ", " : "", c_type(decl_kind(gen, type)), result);
+    }
+
+    fprintf(gen->file, "%s)", i == 0 ? "void" : "");
+}
+
+/*
+ * Body of function or of the top level, every return jumps to the end
+ * where the tagged variables are released
+ */
+static void gen_body(csrc_gen_t* gen, uint32_t function, uint32_t first)
+{
+    char name[OPERAND_TEXT];
+
+    gen->function = function;
+    gen->temps = 0;
+    gen->jumps = false;
+    open_block(gen);
+    declare_locals(gen, first);
+
+    for (uint32_t i = 0; function == AST_NONE && i < gen->constants_len; i++)
+    {
+        emit_constant(gen, i);
+    }
+
+    if (function != AST_NONE)
+    {
+        for (uint32_t param = node_at(gen, function)->b; param != AST_NONE; param = node_at(gen, param)->next)
+        {
+            if (!gen->unboxed[param])
+            {
+                emit(gen, "csrc_retain(%s);", var_name(gen, param, name));
+            }
+        }
+    }
+
+    gen_stats(gen, first);
+
+    // missing results are nil
+    if (function != AST_NONE && !returns(gen, first))
+    {
+        uint32_t result = 0;
+
+        for (uint32_t type = node_at(gen, function)->d; type != AST_NONE; type = node_at(gen, type)->next)
+        {
+            emit(gen, "*r%" PRIu32 " = CSRC_NIL_VALUE;", result++);
+        }
+    }
+
+    if (gen->jumps)
+    {
+        gen->depth--;
+        emit(gen, "end:");
+        gen->depth++;
+        emit(gen, ";");
+    }
+
+    release_locals(gen, first);
+
+    if (function != AST_NONE)
+    {
+        for (uint32_t param = node_at(gen, function)->b; param != AST_NONE; param = node_at(gen, param)->next)
+        {
+            if (!gen->unboxed[param])
+            {
+                emit(gen, "csrc_release(%s);", var_name(gen, param, name));
+            }
+        }
+    }
+
+    close_block(gen);
+    gen->function = AST_NONE;
+}
+
+/*
+ * Constants are created before the statements of the top level
+ */
+static void gen_program(csrc_gen_t* gen)
+{
+    fprintf(gen->file, "#include \"csrc.h\"\n");
+
+    if (gen->constants_len > 0)
+    {
+        fprintf(gen->file, "\nstatic csrc_value_t k[%" PRIu32 "];\n", gen->constants_len);
+    }
+
+    fputc('\n', gen->file);
+
+    for (uint32_t index = gen->ast->first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        if (node_at(gen, index)->kind == AST_FUNCTION)
+        {
+            gen_signature(gen, node_at(gen, index));
+            fprintf(gen->file, ";\n");
+        }
+    }
+
+    for (uint32_t index = gen->ast->first; index != AST_NONE && err == E_NO_ERR; index = node_at(gen, index)->next)
+    {
+        ast_node_t* node = node_at(gen, index);
+
+        if (node->kind == AST_FUNCTION)
+        {
+            fputc('\n', gen->file);
+            gen_signature(gen, node);
+            fputc('\n', gen->file);
+            gen_body(gen, index, node->c);
+        }
+    }
+
+    fprintf(gen->file, "\nvoid csrc_run(void)\n");
+    gen_body(gen, AST_NONE, gen->ast->first);
+}
+
+static void collect_functions(csrc_gen_t* gen)
+{
+    for (uint32_t index = gen->ast->first; index != AST_NONE; index = node_at(gen, index)->next)
+    {
+        if (node_at(gen, index)->kind == AST_FUNCTION &&
+            reserve((void**)&gen->functions, gen->functions_len, &gen->functions_cap, sizeof(function_ref_t)))
+        {
+            gen->functions[gen->functions_len].name = node_at(gen, index)->a;
+            gen->functions[gen->functions_len++].node = index;
+        }
+    }
+
+    qsort(gen->functions, gen->functions_len, sizeof(function_ref_t), compare_functions);
+}
+
+bool csrc_generate(FILE* file, ast_t* ast)
+{
+    STATS_PHASE_ENTER(STATS_PHASE_GEN);
+
+    csrc_gen_t gen = {.ast = ast, .file = file, .function = AST_NONE};
+
+    gen.link = malloc(sizeof(uint32_t) * (ast->nodes_len + 1));
+    gen.unboxed = calloc(ast->nodes_len + 1, sizeof(bool));
+
+    if (gen.link == NULL || gen.unboxed == NULL)
+    {
+        err = E_INTERNAL;
+    }
+
+    if (err == E_NO_ERR)
+    {
+        collect_functions(&gen);
+    }
+
+    if (err == E_NO_ERR)
+    {
+        resolve_stats(&gen, ast->first);
+    }
+
+    if (err == E_NO_ERR)
+    {
+        analyze(&gen);
+        gen_program(&gen);
+    }
+
+    free(gen.link);
+    free(gen.unboxed);
+    free(gen.functions);
+    free(gen.scope);
+    free(gen.constants);
+    free(gen.slots);
+    free(gen.owned);
+
+    STATS_PHASE_LEAVE();
+
+    return err == E_NO_ERR && !ferror(file);
+}
@@ -0,0 +1,569 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   C source backend - runtime library compiled with the generated
+ *          C program (strings, operations on tagged values, built-in
+ *          functions)
+ *
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "csrc.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define LINE_INIT_SIZE 64
+
+/*
+ * ----------------------ERRORS-----------------------
+ */
+
+/*
+ * Run time error ends the program, errors of the interpreter are reported
+ * as by ic21vm, nil and zero operands end it silently as EXIT does
+ */
+_Noreturn void csrc_fail(int code)
+{
+    fflush(stdout);
+
+    switch (code)
+    {
+        case CSRC_E_TYPE:
+            fprintf(stderr, "Error: Wrong operand type!\n");
+            break;
+        case CSRC_E_STRING:
+            fprintf(stderr, "Error: Wrong string operation!\n");
+            break;
+        case CSRC_E_INTERNAL:
+            fprintf(stderr, "Error: Out of memory!\n");
+            break;
+        default:
+            break;
+    }
+
+    exit(code);
+}
+
+/*
+ * ----------------------VALUES-----------------------
+ */
+
+static csrc_string_t* string_new(size_t len)
+{
+    csrc_string_t* string = malloc(sizeof(csrc_string_t) + len + 1);
+
+    if (!string)
+    {
+        csrc_fail(CSRC_E_INTERNAL);
+    }
+
+    string->refs = 1;
+    string->len = len;
+    string->data[len] = '\0';
+
+    return string;
+}
+
+static csrc_value_t make_string(const char* data, size_t len)
+{
+    csrc_value_t value = {.type = CSRC_STRING, .s = string_new(len)};
+
+    memcpy(value.s->data, data, len);
+
+    return value;
+}
+
+csrc_value_t csrc_constant(const char* data, size_t len)
+{
+    csrc_value_t value = make_string(data, len);
+
+    value.s->refs = CSRC_STATIC_REFS;
+
+    return value;
+}
+
+/*
+ * ----------------------OPERATIONS-----------------------
+ */
+
+/*
+ * Operands of operations other than equality are checked for nil first
+ */
+static void check_nil(csrc_value_t a, csrc_value_t b)
+{
+    if (a.type == CSRC_NIL || b.type == CSRC_NIL)
+    {
+        csrc_fail(CSRC_E_NIL);
+    }
+}
+
+/*
+ * Integer operand converted for its operation, nil is left for the check
+ * of the operation
+ */
+csrc_value_t csrc_to_number(csrc_value_t a)
+{
+    if (a.type == CSRC_INT)
+    {
+        return csrc_float((double)a.i);
+    }
+
+    if (a.type != CSRC_NIL)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    return a;
+}
+
+csrc_value_t csrc_arith(csrc_op_t op, csrc_value_t a, csrc_value_t b)
+{
+    check_nil(a, b);
+
+    if (a.type == CSRC_INT && b.type == CSRC_INT)
+    {
+        switch (op)
+        {
+            case CSRC_ADD:
+                return csrc_int(csrc_add_i(a.i, b.i));
+            case CSRC_SUB:
+                return csrc_int(csrc_sub_i(a.i, b.i));
+            default:
+                return csrc_int(csrc_mul_i(a.i, b.i));
+        }
+    }
+
+    if (a.type != CSRC_FLOAT || b.type != CSRC_FLOAT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    switch (op)
+    {
+        case CSRC_ADD:
+            return csrc_float(a.f + b.f);
+        case CSRC_SUB:
+            return csrc_float(a.f - b.f);
+        default:
+            return csrc_float(a.f * b.f);
+    }
+}
+
+/*
+ * Divisor is compared with zero of its type before the division
+ */
+double csrc_div(csrc_value_t a, csrc_value_t b)
+{
+    check_nil(a, b);
+
+    if (b.type != CSRC_FLOAT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    if (b.f == 0.0)
+    {
+        csrc_fail(CSRC_E_ZERO);
+    }
+
+    if (a.type != CSRC_FLOAT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    return a.f / b.f;
+}
+
+int64_t csrc_idiv(csrc_value_t a, csrc_value_t b)
+{
+    check_nil(a, b);
+
+    if (b.type != CSRC_INT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    if (b.i == 0)
+    {
+        csrc_fail(CSRC_E_ZERO);
+    }
+
+    if (a.type != CSRC_INT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    return csrc_idiv_i(a.i, b.i);
+}
+
+/*
+ * Relational operation, equality is defined for nil. a <= b is not a > b,
+ * a >= b is not a < b.
+ */
+bool csrc_compare(csrc_op_t op, csrc_value_t a, csrc_value_t b)
+{
+    bool eq = op == CSRC_EQ || op == CSRC_NEQ;
+    int cmp = 0;
+
+    if (eq && (a.type == CSRC_NIL || b.type == CSRC_NIL))
+    {
+        return (a.type == b.type) == (op == CSRC_EQ);
+    }
+
+    if (!eq)
+    {
+        check_nil(a, b);
+    }
+
+    if (a.type != b.type)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    switch (a.type)
+    {
+        case CSRC_INT:
+            cmp = (a.i > b.i) - (a.i < b.i);
+            break;
+        case CSRC_FLOAT:
+            if (eq)
+            {
+                return (a.f == b.f) == (op == CSRC_EQ);
+            }
+
+            cmp = (a.f > b.f) - (a.f < b.f);
+            break;
+        case CSRC_BOOL:
+            cmp = (int)a.b - (int)b.b;
+            break;
+        default:
+            cmp = memcmp(a.s->data, b.s->data, a.s->len < b.s->len ? a.s->len : b.s->len);
+
+            if (cmp == 0)
+            {
+                cmp = (a.s->len > b.s->len) - (a.s->len < b.s->len);
+            }
+            break;
+    }
+
+    switch (op)
+    {
+        case CSRC_EQ:
+            return cmp == 0;
+        case CSRC_NEQ:
+            return cmp != 0;
+        case CSRC_LT:
+            return cmp < 0;
+        case CSRC_GT:
+            return cmp > 0;
+        case CSRC_LEQ:
+            return !(cmp > 0);
+        default:
+            return !(cmp < 0);
+    }
+}
+
+/*
+ * Condition which is neither relation nor converted value is compared
+ * with true
+ */
+bool csrc_condition(csrc_value_t a)
+{
+    if (a.type == CSRC_NIL)
+    {
+        return false;
+    }
+
+    if (a.type != CSRC_BOOL)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    return a.b;
+}
+
+csrc_value_t csrc_concat(csrc_value_t a, csrc_value_t b)
+{
+    check_nil(a, b);
+
+    if (a.type != CSRC_STRING || b.type != CSRC_STRING)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    csrc_value_t value = {.type = CSRC_STRING, .s = string_new(a.s->len + b.s->len)};
+
+    memcpy(value.s->data, a.s->data, a.s->len);
+    memcpy(value.s->data + a.s->len, b.s->data, b.s->len);
+
+    return value;
+}
+
+int64_t csrc_strlen(csrc_value_t a)
+{
+    if (a.type == CSRC_NIL)
+    {
+        csrc_fail(CSRC_E_NIL);
+    }
+
+    if (a.type != CSRC_STRING)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    return (int64_t)a.s->len;
+}
+
+/*
+ * ----------------------INPUT AND OUTPUT-----------------------
+ */
+
+void csrc_write_int(int64_t i)
+{
+    printf("%" PRId64, i);
+}
+
+/*
+ * Integral floats are written as integers (like ic21int and ic21vm)
+ */
+void csrc_write_float(double f)
+{
+    if (f != f)
+    {
+        printf("%a", f);
+    }
+    else if (f < -9223372036854775808.0 || f >= 9223372036854775808.0)
+    {
+        printf("%" PRId64, INT64_MIN);
+    }
+    else if ((double)(int64_t)f == f)
+    {
+        printf("%" PRId64, (int64_t)f);
+    }
+    else
+    {
+        printf("%a", f);
+    }
+}
+
+void csrc_write(csrc_value_t a)
+{
+    switch (a.type)
+    {
+        case CSRC_INT:
+            csrc_write_int(a.i);
+            break;
+        case CSRC_FLOAT:
+            csrc_write_float(a.f);
+            break;
+        case CSRC_BOOL:
+            fputs(a.b ? "true" : "false", stdout);
+            break;
+        case CSRC_STRING:
+            fwrite(a.s->data, 1, a.s->len, stdout);
+            break;
+        default:
+            fputs("nil", stdout);
+            break;
+    }
+}
+
+/*
+ * Read one line without the line terminator, false on end of input
+ */
+static bool read_line(csrc_value_t* line)
+{
+    size_t cap = LINE_INIT_SIZE;
+    size_t len = 0;
+    char* data = malloc(cap);
+    int c;
+
+    if (!data)
+    {
+        csrc_fail(CSRC_E_INTERNAL);
+    }
+
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (len + 1 == cap)
+        {
+            char* tmp = realloc(data, cap * 2);
+
+            if (!tmp)
+            {
+                free(data);
+                csrc_fail(CSRC_E_INTERNAL);
+            }
+
+            data = tmp;
+            cap *= 2;
+        }
+
+        data[len++] = (char)c;
+    }
+
+    if (c == EOF && len == 0)
+    {
+        free(data);
+        return false;
+    }
+
+    data[len] = '\0';
+    *line = make_string(data, len);
+    free(data);
+
+    return true;
+}
+
+static bool only_spaces(const char* str)
+{
+    while (isspace((unsigned char)*str))
+    {
+        str++;
+    }
+
+    return *str == '\0';
+}
+
+/*
+ * READ of reads, readi and readn, nil on wrong or missing input
+ */
+csrc_value_t csrc_read(csrc_type_t type)
+{
+    csrc_value_t line;
+    csrc_value_t res = CSRC_NIL_VALUE;
+    char* end;
+
+    if (!read_line(&line))
+    {
+        return res;
+    }
+
+    switch (type)
+    {
+        case CSRC_INT:
+            res.i = strtoll(line.s->data, &end, 0);
+
+            if (end != line.s->data && only_spaces(end))
+            {
+                res.type = CSRC_INT;
+            }
+            break;
+
+        case CSRC_FLOAT:
+            res.f = strtod(line.s->data, &end);
+
+            if (end != line.s->data && only_spaces(end))
+            {
+                res.type = CSRC_FLOAT;
+            }
+            break;
+
+        default:
+            return line;
+    }
+
+    csrc_release(line);
+
+    return res;
+}
+
+/*
+ * ----------------------BUILT-IN FUNCTIONS-----------------------
+ */
+
+int64_t csrc_tointeger(csrc_value_t f)
+{
+    if (f.type != CSRC_FLOAT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    // out of range conversion behaves as on x86-64 (like ic21int)
+    return (f.f >= -9223372036854775808.0 && f.f < 9223372036854775808.0) ? (int64_t)f.f : INT64_MIN;
+}
+
+/*
+ * Characters i to j of s (from 1), empty string out of the bounds
+ */
+csrc_value_t csrc_substr(csrc_value_t s, csrc_value_t i, csrc_value_t j)
+{
+    if (i.type != CSRC_INT || s.type != CSRC_STRING || j.type != CSRC_INT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    int64_t from = csrc_sub_i(i.i, 1);
+    int64_t len = (int64_t)s.s->len;
+
+    if (from < 0 || from > len || j.i < 0)
+    {
+        return make_string("", 0);
+    }
+
+    int64_t to = j.i < len ? j.i : len;
+
+    return make_string(s.s->data + from, to > from ? (size_t)(to - from) : 0);
+}
+
+/*
+ * Code of the character at index i (from 0) and error flag, empty string
+ * with error 1 out of the bounds
+ */
+void csrc_ord(csrc_value_t s, csrc_value_t i, csrc_value_t* ascii, int64_t* error)
+{
+    if (s.type != CSRC_STRING || i.type != CSRC_INT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    if (i.i < 0 || i.i > (int64_t)s.s->len - 1)
+    {
+        *ascii = make_string("", 0);
+        *error = 1;
+        return;
+    }
+
+    *ascii = csrc_int((unsigned char)s.s->data[i.i]);
+    *error = 0;
+}
+
+/*
+ * Character of the code and error flag, empty string with error 1 out of
+ * the 0-255 range
+ */
+void csrc_chr(csrc_value_t i, csrc_value_t* str, int64_t* error)
+{
+    if (i.type != CSRC_INT)
+    {
+        csrc_fail(CSRC_E_TYPE);
+    }
+
+    if (i.i < 0 || i.i > 255)
+    {
+        *str = make_string("", 0);
+        *error = 1;
+        return;
+    }
+
+    char c = (char)i.i;
+
+    *str = make_string(&c, 1);
+    *error = 0;
+}
+
+int main(void)
+{
+    static char output_buffer[OUTPUT_BUFFER_SIZE];
+
+    setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    csrc_run();
+
+    fflush(stdout);
+
+    return 0;
+}
@@ -47,6 +47,7 @@ void DLL_InsertLast( DLList *list, char *data , unsigned size) {
             err = E_INTERNAL;
             return;
         }
+        tmp->line = 0;
         tmp->nextElement = NULL;
         tmp->previousElement = list->lastElement;
         if (list->firstElement == NULL){
@@ -60,6 +61,27 @@ void DLL_InsertLast( DLList *list, char *data , unsigned size) {
     }
 }
 
+void DLL_MoveLast( DLList *list, DLLElementPtr first, DLLElementPtr last ) {
+
+    if (last == list->lastElement){
+        return;
+    }
+
+    // unlink elements from first to last
+    if (first->previousElement == NULL){
+        list->firstElement = last->nextElement;
+    } else {
+        first->previousElement->nextElement = last->nextElement;
+    }
+    last->nextElement->previousElement = first->previousElement;
+
+    // and link them after the last element
+    first->previousElement = list->lastElement;
+    list->lastElement->nextElement = first;
+    last->nextElement = NULL;
+    list->lastElement = last;
+}
+
 
 void DLL_PrintAll( DLList *list ){
 
@@ -13,6 +13,8 @@
 typedef struct DLLElement {
     /** Useful data */
     char* data;
+    /** Source line of the data (source map of the code generator) */
+    unsigned line;
     /** Pointer to the previous list element */
     struct DLLElement *previousElement;
     /** Pointer to the next list element */
@@ -35,4 +37,7 @@ void DLL_PrintAll( DLList * );
 
 void DLL_InsertLast( DLList *, char *, unsigned size);
 
+/** Move elements from first to last (inclusive) to the end of the list */
+void DLL_MoveLast( DLList *, DLLElementPtr first, DLLElementPtr last );
+
 #endif //IFJ_BRATWURST2021_DLL_H
@@ -0,0 +1,254 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Background writer of the generated code
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "emitter.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define CHUNK_COUNT 8        // bounds memory of code waiting for output
+
+/**
+ * @struct Queue of chunk indexes.
+ */
+typedef struct chunk_queue
+{
+    int items[CHUNK_COUNT];
+    int first;
+    int len;
+} chunk_queue_t;
+
+static char* chunks[CHUNK_COUNT];
+static size_t chunk_len[CHUNK_COUNT];
+
+static chunk_queue_t full;     // chunks waiting for the writer
+static chunk_queue_t empty;    // chunks free for the generator
+static int current = -1;       // chunk filled by the generator
+
+static mtx_t lock;
+static cnd_t full_changed;
+static cnd_t empty_changed;
+static bool done;
+
+static FILE* output = NULL;
+static thrd_t thread;
+static bool running = false;
+
+static void queue_push (chunk_queue_t* queue, int chunk)
+{
+    queue->items[(queue->first + queue->len++) % CHUNK_COUNT] = chunk;
+}
+
+static int queue_pop (chunk_queue_t* queue)
+{
+    int chunk = queue->items[queue->first];
+
+    queue->first = (queue->first + 1) % CHUNK_COUNT;
+    queue->len--;
+
+    return chunk;
+}
+
+static int writer_thread (void* arg)
+{
+    (void)arg;
+
+    mtx_lock(&lock);
+
+    for (;;)
+    {
+        while (full.len == 0 && !done)
+        {
+            cnd_wait(&full_changed, &lock);
+        }
+
+        if (full.len == 0)
+        {
+            break;
+        }
+
+        int chunk = queue_pop(&full);
+
+        // output may block for a long time, generator keeps going
+        mtx_unlock(&lock);
+        fwrite(chunks[chunk], 1, chunk_len[chunk], output);
+        mtx_lock(&lock);
+
+        queue_push(&empty, chunk);
+        cnd_signal(&empty_changed);
+    }
+
+    mtx_unlock(&lock);
+
+    return 0;
+}
+
+/*
+ * Pass the current chunk to the writer and take an empty one
+ */
+static void next_chunk ()
+{
+    mtx_lock(&lock);
+
+    queue_push(&full, current);
+    cnd_signal(&full_changed);
+
+    while (empty.len == 0)
+    {
+        cnd_wait(&empty_changed, &lock);
+    }
+
+    current = queue_pop(&empty);
+    chunk_len[current] = 0;
+
+    mtx_unlock(&lock);
+}
+
+static void free_chunks ()
+{
+    for (int i = 0; i < CHUNK_COUNT; i++)
+    {
+        free(chunks[i]);
+        chunks[i] = NULL;
+    }
+}
+
+bool emitter_start (FILE* file)
+{
+    for (int i = 0; i < CHUNK_COUNT; i++)
+    {
+        if (!(chunks[i] = malloc(CHUNK_SIZE)))
+        {
+            free_chunks();
+            return false;
+        }
+    }
+
+    full = (chunk_queue_t){ .first = 0, .len = 0 };
+    empty = (chunk_queue_t){ .first = 0, .len = 0 };
+
+    for (int i = 1; i < CHUNK_COUNT; i++)
+    {
+        queue_push(&empty, i);
+    }
+
+    current = 0;
+    chunk_len[current] = 0;
+    output = file;
+    done = false;
+
+    if (mtx_init(&lock, mtx_plain) != thrd_success)
+    {
+        free_chunks();
+        return false;
+    }
+
+    if (cnd_init(&full_changed) != thrd_success || cnd_init(&empty_changed) != thrd_success ||
+        thrd_create(&thread, writer_thread, NULL) != thrd_success)
+    {
+        mtx_destroy(&lock);
+        free_chunks();
+        return false;
+    }
+
+    running = true;
+
+    return true;
+}
+
+bool emitter_running ()
+{
+    return running;
+}
+
+/*
+ * Copy data which do not fit one chunk
+ */
+static void emitter_write (const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t space = CHUNK_SIZE - chunk_len[current];
+        size_t part = len < space ? len : space;
+
+        memcpy(chunks[current] + chunk_len[current], data, part);
+        chunk_len[current] += part;
+        data += part;
+        len -= part;
+
+        if (chunk_len[current] == CHUNK_SIZE)
+        {
+            next_chunk();
+        }
+    }
+}
+
+int emitter_vprintf (const char* format, va_list args)
+{
+    size_t space = CHUNK_SIZE - chunk_len[current];
+    va_list copy;
+
+    va_copy(copy, args);
+    int len = vsnprintf(chunks[current] + chunk_len[current], space, format, copy);
+    va_end(copy);
+
+    if (len < 0)
+    {
+        return len;
+    }
+
+    if ((size_t)len < space)
+    {
+        chunk_len[current] += len;
+        return len;
+    }
+
+    // instruction does not fit the rest of the chunk
+    char* data = malloc((size_t)len + 1);
+
+    if (!data)
+    {
+        return -1;
+    }
+
+    vsnprintf(data, (size_t)len + 1, format, args);
+    emitter_write(data, len);
+    free(data);
+
+    return len;
+}
+
+void emitter_stop ()
+{
+    if (!running)
+    {
+        return;
+    }
+
+    mtx_lock(&lock);
+
+    if (chunk_len[current] > 0)
+    {
+        queue_push(&full, current);
+    }
+
+    done = true;
+    cnd_signal(&full_changed);
+    mtx_unlock(&lock);
+
+    thrd_join(thread, NULL);
+    fflush(output);
+
+    cnd_destroy(&full_changed);
+    cnd_destroy(&empty_changed);
+    mtx_destroy(&lock);
+    free_chunks();
+
+    running = false;
+}
@@ -0,0 +1,46 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Background writer of the generated code
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_EMITTER_H
+#define IFJ_BRATWURST2021_EMITTER_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Start the writer thread. Generated code is collected in chunks which
+ * the thread writes to the stream, the count of chunks is bounded.
+ *
+ * @param file Output stream.
+ * @return True if the thread was started.
+ */
+bool emitter_start (FILE* file);
+
+/**
+ * Check whether the writer thread runs.
+ *
+ * @return True if code goes through the writer thread.
+ */
+bool emitter_running ();
+
+/**
+ * Format code into the current chunk, waits for a free chunk when all
+ * of them are queued for writing.
+ *
+ * @param format Format string as for printf.
+ * @param args Arguments.
+ * @return Count of characters, negative on error.
+ */
+int emitter_vprintf (const char* format, va_list args);
+
+/**
+ * Write the rest of the code, stop the thread and flush the stream.
+ */
+void emitter_stop ();
+
+#endif //IFJ_BRATWURST2021_EMITTER_H
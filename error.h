@@ -24,6 +24,7 @@ typedef enum error {
     E_INTERNAL   = 99
 } error_t;
 
-extern error_t err;
+// every thread has its own error, see lex_thread.c
+extern _Thread_local error_t err;
 
 #endif //IFJ_BRATWURST2021_ERROR_H
@@ -0,0 +1,141 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Scanner running on its own thread
+ *
+ */
+
+#include <stdatomic.h>
+#include <threads.h>
+
+#include "lex_thread.h"
+#include "error.h"
+
+#define RING_SIZE 1024    // power of two
+#define SPIN_LIMIT 256    // busy waits before giving up the CPU
+
+/**
+ * @struct Result of one get_next_token call.
+ */
+typedef struct ring_entry
+{
+    token_t* token;
+    error_t err;          /// err after the call (err is thread local).
+    bool last;            /// Scanner reached the end, no more calls follow.
+} ring_entry_t;
+
+static ring_entry_t ring[RING_SIZE];
+static atomic_size_t head;    // next entry written by the scanner
+static atomic_size_t tail;    // next entry read by the parser
+static atomic_bool stop;
+
+static thrd_t thread;
+static bool running = false;
+static bool finished = false;
+
+/*
+ * Wait step of both sides, short waits stay on the CPU
+ */
+static void ring_wait (unsigned* spins)
+{
+    if (++*spins >= SPIN_LIMIT)
+    {
+        thrd_yield();
+    }
+}
+
+/*
+ * Scanner thread. Lexical errors do not stop it, the parser may ask for
+ * more tokens and gets the same ones as from the synchronous scanner.
+ */
+static int scanner_thread (void* arg)
+{
+    (void)arg;
+
+    for (;;)
+    {
+        token_t* token = get_next_token();
+        bool last = err == E_INTERNAL || source_exhausted();
+        size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+        unsigned spins = 0;
+
+        while (pos - atomic_load_explicit(&tail, memory_order_acquire) == RING_SIZE)
+        {
+            if (atomic_load_explicit(&stop, memory_order_relaxed))
+            {
+                delete_token(token);
+                return 0;
+            }
+
+            ring_wait(&spins);
+        }
+
+        ring[pos % RING_SIZE] = (ring_entry_t){ token, err, last };
+        atomic_store_explicit(&head, pos + 1, memory_order_release);
+
+        if (last)
+        {
+            return 0;
+        }
+    }
+}
+
+bool lex_thread_start ()
+{
+    atomic_store(&head, 0);
+    atomic_store(&tail, 0);
+    atomic_store(&stop, false);
+    finished = false;
+
+    running = thrd_create(&thread, scanner_thread, NULL) == thrd_success;
+
+    return running;
+}
+
+void lex_thread_stop ()
+{
+    if (!running)
+    {
+        return;
+    }
+
+    atomic_store(&stop, true);
+    thrd_join(thread, NULL);
+    running = false;
+
+    for (size_t pos = atomic_load(&tail); pos != atomic_load(&head); pos++)
+    {
+        delete_token(ring[pos % RING_SIZE].token);
+    }
+}
+
+token_t* lex_get_token ()
+{
+    if (!running)
+    {
+        return get_next_token();
+    }
+
+    // synchronous scanner at the end gives no more tokens
+    if (finished)
+    {
+        err = E_NO_ERR;
+        return NULL;
+    }
+
+    size_t pos = atomic_load_explicit(&tail, memory_order_relaxed);
+    unsigned spins = 0;
+
+    while (atomic_load_explicit(&head, memory_order_acquire) == pos)
+    {
+        ring_wait(&spins);
+    }
+
+    ring_entry_t entry = ring[pos % RING_SIZE];
+    atomic_store_explicit(&tail, pos + 1, memory_order_release);
+
+    finished = entry.last;
+    err = entry.err;
+
+    return entry.token;
+}
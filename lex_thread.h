@@ -0,0 +1,36 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Scanner running on its own thread
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_LEX_THREAD_H
+#define IFJ_BRATWURST2021_LEX_THREAD_H
+
+#include <stdbool.h>
+
+#include "scanner.h"
+
+/**
+ * Start the scanner thread. Tokens are passed to the parser through
+ * a bounded single-producer/single-consumer ring.
+ *
+ * @return True if the thread was started.
+ */
+bool lex_thread_start ();
+
+/**
+ * Stop the scanner thread and release tokens the parser did not take.
+ */
+void lex_thread_stop ();
+
+/**
+ * Next token for the parser. Token and err are the same as get_next_token
+ * would give at this position, with or without the scanner thread.
+ *
+ * @return Token or NULL (end of input or error in err).
+ */
+token_t* lex_get_token ();
+
+#endif //IFJ_BRATWURST2021_LEX_THREAD_H
@@ -7,12 +7,473 @@
  * 
  */
 
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "parser.h"
+#include "ast.h"
 #include "error.h"
+#include "stats.h"
+#include "scanner.h"
+#include "code_generator.h"
+#include "cache.h"
+#include "lex_thread.h"
+#include "emitter.h"
+#include "vm.h"
+#include "native.h"
+
+#define CACHE_DIR_ENV "IFJ21_CACHE_DIR"
+#define READ_CHUNK 4096
+#define MAX_JOBS 256
+#define MAX_OPT 2
+
+/**
+ * @struct Command line options of the compilation.
+ */
+typedef struct options
+{
+    bool binary;          /// Binary object instead of IFJcode21.
+    bool native;          /// x86-64 assembly instead of IFJcode21.
+    bool csrc;            /// C11 source instead of IFJcode21 (through the tree).
+    bool lex_thread;      /// Scanner runs on its own thread.
+    bool async_output;    /// Output is written by its own thread.
+    bool ast;             /// Tree is built first, code is generated from it.
+    unsigned jobs;        /// Threads generating functions from the tree.
+    bool temps;           /// Expressions are evaluated in frame temporaries.
+    unsigned opt;         /// Optimization level of the tree.
+    bool vm_ext;          /// Built-in functions are extended instructions of ic21vm.
+    const char* source_map;  /// File of the source map or NULL.
+} options_t;
+
+/*
+ * Convert generated IFJcode21 to the binary object format
+ */
+static void write_object(FILE* code, FILE* out) {
+    vm_program_t program;
+
+    vm_program_init(&program);
+    rewind(code);
+
+    if (vm_load(code, &program) != VM_OK || !vm_object_write(out, &program))
+    {
+        err = E_INTERNAL;
+    }
+
+    vm_program_free(&program);
+}
+
+/*
+ * Lower generated IFJcode21 to x86-64 assembly
+ */
+static void write_native(FILE* code, FILE* out) {
+    vm_program_t program;
+
+    vm_program_init(&program);
+    rewind(code);
+
+    if (vm_load(code, &program) != VM_OK || !native_generate(out, &program))
+    {
+        err = E_INTERNAL;
+    }
+
+    vm_program_free(&program);
+}
+
+/*
+ * Read whole stream into memory
+ */
+static char* read_source(FILE* file, size_t* len) {
+    size_t cap = READ_CHUNK;
+    char* source = malloc(cap);
+
+    *len = 0;
+
+    for (size_t n; source && (n = fread(source + *len, 1, cap - *len, file)) > 0;)
+    {
+        *len += n;
+
+        if (*len == cap)
+        {
+            char* tmp = realloc(source, cap * 2);
+
+            if (!tmp)
+            {
+                free(source);
+                return NULL;
+            }
+
+            source = tmp;
+            cap *= 2;
+        }
+    }
+
+    return source;
+}
+
+static void copy_stream(FILE* from, FILE* to) {
+    char buffer[READ_CHUNK];
+    size_t n;
+
+    rewind(from);
+
+    while ((n = fread(buffer, 1, sizeof(buffer), from)) > 0)
+    {
+        fwrite(buffer, 1, n, to);
+    }
+}
+
+/*
+ * Multi-pass compilation, nothing is generated when parsing fails
+ */
+static void compile_ast(const options_t* options, FILE* out) {
+    ast_gen_options_t gen = { .jobs = options->jobs, .temps = options->temps };
+    ast_t ast;
+
+    ast_init(&ast);
+
+    if (options->source_map && !ast_track_lines(&ast))
+    {
+        err = E_INTERNAL;
+    }
+    else if (parser_build_ast(&ast) == PARSE_NO_ERR && err == E_NO_ERR)
+    {
+        ast_optimize(&ast, options->opt);
+
+        if (err == E_NO_ERR && options->csrc)
+        {
+            if (!csrc_generate(out, &ast))
+            {
+                err = E_INTERNAL;
+            }
+        }
+        else if (err == E_NO_ERR)
+        {
+            ast_generate(&ast, &gen);
+        }
+    }
+
+    ast_free(&ast);
+}
+
+/*
+ * Run the compiler, generated code (or object) is written to out
+ */
+static void compile(const options_t* options, FILE* out) {
+    FILE* code = NULL;
+    FILE* map = NULL;
+    bool collect = options->binary || options->native;
+
+    // map refers to lines of IFJcode21, they are kept in the binary object
+    if (options->source_map)
+    {
+        map = fopen(options->source_map, "w");
+
+        if (!map)
+        {
+            err = E_INTERNAL;
+            return;
+        }
+    }
+
+    // binary object and assembly are made from IFJcode21 collected in temporary file
+    if (collect)
+    {
+        code = tmpfile();
+
+        if (!code)
+        {
+            if (map)
+            {
+                fclose(map);
+            }
+
+            err = E_INTERNAL;
+            return;
+        }
+    }
+
+    codeGen_set_output(collect ? code : out);
+    codeGen_set_source_map(map);
+
+    // assembly is lowered from the IFJcode21 known to its runtime
+    codeGen_set_extended(options->vm_ext && !options->native && !options->csrc);
+
+    stats_start();
+
+    if ((options->lex_thread && !lex_thread_start()) ||
+        (options->async_output && !emitter_start(collect ? code : out)))
+    {
+        err = E_INTERNAL;
+    }
+    else if (options->ast)
+    {
+        compile_ast(options, out);
+    }
+    else
+    {
+        parser();
+    }
+
+    lex_thread_stop();
+    emitter_stop();
+    stats_stop();
+
+    if (map)
+    {
+        codeGen_set_source_map(NULL);
+
+        if (fclose(map) != 0 && err == E_NO_ERR)
+        {
+            err = E_INTERNAL;
+        }
+    }
+
+    if (collect)
+    {
+        if (err == E_NO_ERR && options->native)
+        {
+            write_native(code, out);
+        }
+        else if (err == E_NO_ERR)
+        {
+            write_object(code, out);
+        }
+
+        fclose(code);
+    }
+}
+
+/*
+ * Compilation through the cache, returns exit code of the compiler
+ */
+static int compile_cached(const options_t* options, const char* dir, uint64_t max_size) {
+    cache_t cache;
+    size_t len;
+    int exit_code;
+    char* source = read_source(stdin, &len);
+
+    if (!source)
+    {
+        return E_INTERNAL;
+    }
+
+    // options which change the output are part of the key
+    char key[48];
+    char opt[16] = "";
+
+    if (options->opt > 0)
+    {
+        snprintf(opt, sizeof(opt), " -O%u", options->opt);
+    }
+
+    snprintf(key, sizeof(key), "%s%s%s%s%s",
+             options->csrc ? "--csrc" : (options->native ? "--native" : (options->binary ? "--binary" : "")),
+             options->ast ? (options->binary || options->native || options->csrc ? " --ast" : "--ast") : "",
+             options->temps ? " --temps" : "",
+             opt,
+             options->vm_ext && !options->native && !options->csrc ? " --vm-ext" : "");
+
+    cache_init(&cache, dir, max_size, key, source, len);
+
+    if (cache_lookup(&cache, stdout, &exit_code))
+    {
+        free(source);
+        return exit_code;
+    }
+
+    FILE* result = tmpfile();
+
+    if (!result)
+    {
+        free(source);
+        return E_INTERNAL;
+    }
+
+    set_source_buffer(source, len);
+
+    compile(options, result);
+    exit_code = err;
+
+    copy_stream(result, stdout);
+    fflush(stdout);
+
+    // internal errors (e.g. out of memory) are not worth remembering
+    if (exit_code != E_INTERNAL)
+    {
+        cache_store(&cache, result, exit_code);
+    }
+
+    set_source_buffer(NULL, 0);
+    fclose(result);
+    free(source);
+
+    return exit_code;
+}
+
+int main(int argc, char* argv[]) {    
+    bool print_stats = false;
+    options_t options = { .binary = false, .native = false, .csrc = false, .lex_thread = false, .async_output = false, .ast = false, .jobs = 1, .temps = false, .opt = 0, .vm_ext = false, .source_map = NULL };
+    const char* cache_dir = getenv(CACHE_DIR_ENV);
+    uint64_t cache_size = CACHE_DEFAULT_SIZE_MB;
+    stats_format_t stats_format = STATS_TEXT;
+    int exit_code;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0)
+        {
+            print_stats = true;
+            stats_format = STATS_TEXT;
+        }
+        else if (strcmp(argv[i], "--stats=json") == 0)
+        {
+            print_stats = true;
+            stats_format = STATS_JSON;
+        }
+        else if (strcmp(argv[i], "--binary") == 0)
+        {
+            options.binary = true;
+            options.native = false;
+            options.csrc = false;
+        }
+        else if (strcmp(argv[i], "--native") == 0)
+        {
+            options.native = true;
+            options.binary = false;
+            options.csrc = false;
+        }
+        else if (strcmp(argv[i], "--csrc") == 0)
+        {
+            // C source is translated from the tree
+            options.csrc = true;
+            options.ast = true;
+            options.binary = false;
+            options.native = false;
+        }
+        else if (strcmp(argv[i], "--lex-thread") == 0)
+        {
+            options.lex_thread = true;
+        }
+        else if (strcmp(argv[i], "--async-output") == 0)
+        {
+            options.async_output = true;
+        }
+        else if (strcmp(argv[i], "--ast") == 0)
+        {
+            options.ast = true;
+        }
+        else if (strcmp(argv[i], "--temps") == 0)
+        {
+            // temporaries are allocated on the tree
+            options.temps = true;
+            options.ast = true;
+        }
+        else if (strcmp(argv[i], "--vm-ext") == 0)
+        {
+            options.vm_ext = true;
+        }
+        else if (strncmp(argv[i], "--source-map=", 13) == 0 && argv[i][13] != '\0')
+        {
+            options.source_map = argv[i] + 13;
+        }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0 && argv[i][7] != '\0')
+        {
+            char* end;
+            unsigned long jobs = strtoul(argv[i] + 7, &end, 10);
+
+            if (*end != '\0' || jobs == 0 || jobs > MAX_JOBS)
+            {
+                fprintf(stderr, "%s: invalid count of jobs '%s'\n", argv[0], argv[i] + 7);
+                return E_INTERNAL;
+            }
+
+            // functions are generated in parallel from the tree
+            options.jobs = (unsigned)jobs;
+            options.ast = options.ast || jobs > 1;
+        }
+        else if (strncmp(argv[i], "-O", 2) == 0)
+        {
+            char* end;
+            unsigned long level = argv[i][2] == '\0' ? 1 : strtoul(argv[i] + 2, &end, 10);
+
+            if ((argv[i][2] != '\0' && *end != '\0') || level > MAX_OPT)
+            {
+                fprintf(stderr, "%s: invalid optimization level '%s'\n", argv[0], argv[i] + 2);
+                return E_INTERNAL;
+            }
+
+            // optimizations work on the tree
+            options.opt = (unsigned)level;
+            options.ast = options.ast || level > 0;
+        }
+        else if (strncmp(argv[i], "--cache=", 8) == 0 && argv[i][8] != '\0')
+        {
+            cache_dir = argv[i] + 8;
+        }
+        else if (strcmp(argv[i], "--no-cache") == 0)
+        {
+            cache_dir = NULL;
+        }
+        else if (strncmp(argv[i], "--cache-size=", 13) == 0 && argv[i][13] != '\0')
+        {
+            char* end;
+
+            cache_size = strtoull(argv[i] + 13, &end, 10);
+
+            // the size in bytes has to fit as well
+            if (*end != '\0' || cache_size > UINT64_MAX / (1024 * 1024))
+            {
+                fprintf(stderr, "%s: invalid cache size '%s'\n", argv[0], argv[i] + 13);
+                return E_INTERNAL;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--stats[=text|json]] [--binary] [--native] [--csrc] [--lex-thread] [--async-output] [--ast] [--jobs=N] [--temps] [-O[N]] [--vm-ext] [--source-map=FILE] [--cache=DIR] [--cache-size=MB] [--no-cache] < program.tl\n", argv[0]);
+            return E_INTERNAL;
+        }
+    }
+
+    // native code and C source have no lines of IFJcode21 to map
+    if (options.source_map && (options.native || options.csrc))
+    {
+        fprintf(stderr, "%s: --source-map cannot be used with --native or --csrc\n", argv[0]);
+        return E_INTERNAL;
+    }
+
+    // code of isolated units is not mapped, map is not cached
+    if (options.source_map)
+    {
+        options.jobs = 1;
+        cache_dir = NULL;
+    }
+
+    // statistics measure the compilation, a cache hit compiles nothing
+    if (print_stats)
+    {
+        cache_dir = NULL;
+    }
+
+    if (cache_dir && cache_dir[0] != '\0')
+    {
+        exit_code = compile_cached(&options, cache_dir, cache_size * 1024 * 1024);
+    }
+    else
+    {
+        compile(&options, stdout);
+        exit_code = err;
 
+        // frees the source read by the scanner
+        set_source_buffer(NULL, 0);
+    }
 
-int main() {    
-    parser();
+    if (print_stats)
+    {
+        fflush(stdout);
+        stats_print(stderr, stats_format);
+    }
     
-    return err;
-}
\ No newline at end of file
+    return exit_code;
+}
@@ -0,0 +1,91 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Native x86-64 backend - layout of the runtime shared by the
+ *          generated assembly and the runtime library
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_NATIVE_H
+#define IFJ_BRATWURST2021_NATIVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+/*
+ * Every instruction of the loaded IFJcode21 program is lowered to x86-64
+ * code (GNU as, Intel syntax). Integer and float arithmetic, comparisons,
+ * moves and the data stack run inline, other instructions call the runtime
+ * (native_rt.c) which has the semantics and exit codes of ic21vm.
+ *
+ * Registers of the generated code (callee saved, kept across the runtime):
+ *   rbx  temporary frame (NULL when there is none)
+ *   r12  top of the data stack (first free value)
+ *   r13  top of the call stack (first free return address)
+ *   rbp, r14, r15  addresses of operands of the current instruction
+ */
+
+/**
+ * Strings are shared by values, constants of the program have a count of
+ * references which never drops to zero.
+ */
+#define NATIVE_STATIC_REFS ((uint64_t)1 << 62)
+
+/**
+ * @struct Byte string, may contain '\0'.
+ */
+typedef struct native_string
+{
+    uint64_t refs;
+    uint64_t len;
+    char data[];
+} native_string_t;
+
+/**
+ * @struct Runtime value, type is vm_type_t. Booleans are 0 or 1 in i.
+ */
+typedef struct native_value
+{
+    uint32_t type;
+    uint32_t unused;
+    union
+    {
+        int64_t i;
+        double f;
+        native_string_t* s;
+    };
+} native_value_t;
+
+/**
+ * @struct Local or temporary frame, variables in definition order.
+ */
+typedef struct native_frame
+{
+    uint32_t* names;
+    native_value_t* vals;
+    uint32_t len;
+    uint32_t cap;
+    struct native_frame* next;
+} native_frame_t;
+
+/* State of the runtime used by the generated code */
+extern native_frame_t* native_lf;
+extern native_value_t* native_stack_base;
+extern native_value_t* native_stack_end;
+extern void** native_calls_base;
+extern void** native_calls_end;
+
+/**
+ * Write the program as x86-64 assembly, entry point is ic21_run called by
+ * main of the runtime.
+ *
+ * @param file Output stream.
+ * @param program Loaded program.
+ * @return True on success.
+ */
+bool native_generate(FILE* file, const vm_program_t* program);
+
+#endif //IFJ_BRATWURST2021_NATIVE_H
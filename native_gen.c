@@ -0,0 +1,1071 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Native x86-64 backend - lowering of the loaded IFJcode21 program
+ *          to assembly for the system assembler
+ *
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "native.h"
+
+/*
+ * Registers with addresses of operands, they survive calls of the runtime
+ */
+#define REG_DST "r15"
+#define REG_A   "rbp"
+#define REG_B   "r14"
+
+#define VALUE_SIZE ((unsigned)sizeof(native_value_t))
+#define PAYLOAD ((unsigned)offsetof(native_value_t, i))
+
+typedef struct native_gen
+{
+    FILE* file;
+    const vm_program_t* program;
+    const vm_instr_t* ins;  /// Instruction being lowered.
+    uint32_t index;         /// Its index.
+    uint32_t labels;        /// Count of local labels.
+    bool cold;              /// Code goes to the cold subsection.
+} native_gen_t;
+
+static void emit(native_gen_t* gen, const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(gen->file, format, args);
+    va_end(args);
+    fputc('\n', gen->file);
+}
+
+static uint32_t new_label(native_gen_t* gen)
+{
+    return gen->labels++;
+}
+
+/*
+ * Code which is rarely executed (calls of the runtime) is kept away from
+ * the inlined code in the second subsection, errors in the third one
+ */
+static void cold(native_gen_t* gen, uint32_t label)
+{
+    gen->cold = true;
+    emit(gen, "\t.subsection 1");
+    emit(gen, ".Ln%u:", label);
+}
+
+static void hot(native_gen_t* gen)
+{
+    gen->cold = false;
+    emit(gen, "\t.subsection 0");
+}
+
+/*
+ * Jump to a stub which ends the program with the error of the interpreter
+ */
+static void fail_if(native_gen_t* gen, const char* jump, int code)
+{
+    uint32_t label = new_label(gen);
+
+    emit(gen, "\t%s .Ln%u", jump, label);
+    emit(gen, "\t.subsection 2");
+    emit(gen, ".Ln%u:", label);
+    emit(gen, "\tmov edi, %d", code);
+    emit(gen, "\tmov esi, %u", gen->ins->line);
+    emit(gen, "\tcall native_fail");
+    emit(gen, "\t.subsection %d", gen->cold ? 1 : 0);
+}
+
+/*
+ * Label of the instruction, missing label fails when it is jumped to
+ */
+static void jump_to(native_gen_t* gen, const char* jump, const vm_operand_t* label)
+{
+    if (label->index == VM_NO_TARGET)
+    {
+        fail_if(gen, jump, VM_E_SEMANTIC);
+        return;
+    }
+
+    emit(gen, "\t%s .Li%u", jump, label->index);
+}
+
+static void frame_to_rdi(native_gen_t* gen, const vm_operand_t* operand)
+{
+    if (operand->kind == VM_OPND_LF)
+    {
+        emit(gen, "\tmov rdi, qword ptr [rip + native_lf]");
+    }
+    else
+    {
+        emit(gen, "\tmov rdi, rbx");
+    }
+}
+
+/*
+ * Address of the variable to the register. Variable of a frame is found at
+ * the slot where its name was defined last time, other slots are searched
+ * by the runtime.
+ */
+static void gen_var(native_gen_t* gen, const vm_operand_t* operand, const char* reg)
+{
+    if (operand->kind == VM_OPND_GF)
+    {
+        emit(gen, "\tcmp byte ptr [rip + ic21_defined + %u], 0", operand->index);
+        fail_if(gen, "je", VM_E_VAR);
+        emit(gen, "\tlea %s, [rip + ic21_globals + %u]", reg, operand->index * VALUE_SIZE);
+        return;
+    }
+
+    uint32_t search = new_label(gen);
+    uint32_t found = new_label(gen);
+
+    frame_to_rdi(gen, operand);
+    emit(gen, "\ttest rdi, rdi");
+    fail_if(gen, "jz", VM_E_FRAME);
+    emit(gen, "\tmov ecx, dword ptr [rip + ic21_hints + %u]", operand->index * 4);
+    emit(gen, "\tcmp ecx, dword ptr [rdi + %u]", (unsigned)offsetof(native_frame_t, len));
+    emit(gen, "\tjae .Ln%u", search);
+    emit(gen, "\tmov rax, qword ptr [rdi + %u]", (unsigned)offsetof(native_frame_t, names));
+    emit(gen, "\tcmp dword ptr [rax + rcx*4], %u", operand->index);
+    emit(gen, "\tjne .Ln%u", search);
+    emit(gen, "\tshl rcx, 4");
+    emit(gen, "\tadd rcx, qword ptr [rdi + %u]", (unsigned)offsetof(native_frame_t, vals));
+    emit(gen, "\tmov %s, rcx", reg);
+    emit(gen, ".Ln%u:", found);
+
+    cold(gen, search);
+    emit(gen, "\tmov esi, %u", operand->index);
+    emit(gen, "\tlea rdx, [rip + ic21_hints + %u]", operand->index * 4);
+    emit(gen, "\tmov ecx, %u", gen->ins->line);
+    emit(gen, "\tcall native_find");
+    emit(gen, "\tmov %s, rax", reg);
+    emit(gen, "\tjmp .Ln%u", found);
+    hot(gen);
+}
+
+/*
+ * Address of the value of the symbol, variable must have a value
+ */
+static void gen_symb(native_gen_t* gen, const vm_operand_t* operand, const char* reg)
+{
+    if (operand->kind == VM_OPND_CONST)
+    {
+        emit(gen, "\tlea %s, [rip + .Lk%u]", reg, operand->index);
+        return;
+    }
+
+    gen_var(gen, operand, reg);
+    emit(gen, "\tcmp dword ptr [%s], %d", reg, VM_T_UNDEF);
+    fail_if(gen, "je", VM_E_VALUE);
+}
+
+/*
+ * Type of the symbol known during the compilation or VM_T_UNDEF
+ */
+static vm_type_t known_type(native_gen_t* gen, const vm_operand_t* operand)
+{
+    return operand->kind == VM_OPND_CONST ? gen->program->consts[operand->index].type : VM_T_UNDEF;
+}
+
+/*
+ * At least count values are on the data stack
+ */
+static void gen_depth(native_gen_t* gen, unsigned count)
+{
+    emit(gen, "\tmov rax, r12");
+    emit(gen, "\tsub rax, qword ptr [rip + native_stack_base]");
+    emit(gen, "\tcmp rax, %u", count * VALUE_SIZE);
+    fail_if(gen, "jb", VM_E_VALUE);
+}
+
+/*
+ * Instruction which is not inlined, its operands are in the registers
+ */
+static void call_op(native_gen_t* gen)
+{
+    emit(gen, "\tmov edi, %d", gen->ins->opcode);
+    emit(gen, "\tmov rsi, " REG_DST);
+    emit(gen, "\tmov rdx, " REG_A);
+    emit(gen, "\tmov rcx, " REG_B);
+    emit(gen, "\tmov r8d, %u", gen->ins->line);
+    emit(gen, "\tcall native_op");
+}
+
+/*
+ * Stack instruction which is not inlined
+ */
+static void call_stack_op(native_gen_t* gen)
+{
+    emit(gen, "\tmov edi, %d", gen->ins->opcode);
+    emit(gen, "\tmov rsi, r12");
+    emit(gen, "\tmov edx, %u", gen->ins->line);
+    emit(gen, "\tcall native_stack_op");
+    emit(gen, "\tmov r12, rax");
+}
+
+/*
+ * Operation of two integers (rax op rcx to rax) or floats (xmm0 op xmm1
+ * to xmm0), false if the operation has no inlined form for the type
+ */
+static bool gen_arith(native_gen_t* gen, vm_type_t type)
+{
+    int opcode = gen->ins->opcode;
+
+    if (type == VM_T_INT)
+    {
+        switch (opcode)
+        {
+            case VM_ADD:
+            case VM_ADDS:
+                emit(gen, "\tadd rax, rcx");
+                return true;
+            case VM_SUB:
+            case VM_SUBS:
+                emit(gen, "\tsub rax, rcx");
+                return true;
+            case VM_MUL:
+            case VM_MULS:
+                emit(gen, "\timul rax, rcx");
+                return true;
+            case VM_IDIV:
+            case VM_IDIVS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    switch (opcode)
+    {
+        case VM_ADD:
+        case VM_ADDS:
+            emit(gen, "\taddsd xmm0, xmm1");
+            return true;
+        case VM_SUB:
+        case VM_SUBS:
+            emit(gen, "\tsubsd xmm0, xmm1");
+            return true;
+        case VM_MUL:
+        case VM_MULS:
+            emit(gen, "\tmulsd xmm0, xmm1");
+            return true;
+        case VM_DIV:
+        case VM_DIVS:
+            emit(gen, "\tdivsd xmm0, xmm1");
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Integer division rounded towards negative infinity (rax // rcx to rax),
+ * zero and -1 divisors are left to the runtime
+ */
+static void gen_idiv(native_gen_t* gen, uint32_t slow)
+{
+    uint32_t done = new_label(gen);
+
+    emit(gen, "\ttest rcx, rcx");
+    emit(gen, "\tje .Ln%u", slow);
+    emit(gen, "\tcmp rcx, -1");
+    emit(gen, "\tje .Ln%u", slow);
+    emit(gen, "\tcqo");
+    emit(gen, "\tidiv rcx");
+    emit(gen, "\ttest rdx, rdx");
+    emit(gen, "\tje .Ln%u", done);
+    emit(gen, "\txor rdx, rcx");
+    emit(gen, "\tjns .Ln%u", done);
+    emit(gen, "\tdec rax");
+    emit(gen, ".Ln%u:", done);
+}
+
+/*
+ * Inlined arithmetic on values at addresses a and b, result is written by
+ * store_int or store_float, other types jump to slow
+ */
+static void gen_arith_values(native_gen_t* gen, const char* a, const char* b, uint32_t slow,
+                             void (*store)(native_gen_t*, vm_type_t), uint32_t done)
+{
+    int opcode = gen->ins->opcode;
+    bool integers = opcode != VM_DIV && opcode != VM_DIVS;
+    bool floats = opcode != VM_IDIV && opcode != VM_IDIVS;
+    uint32_t floating = new_label(gen);
+
+    emit(gen, "\tmov eax, dword ptr [%s]", a);
+    emit(gen, "\tmov edx, dword ptr [%s]", b);
+
+    if (integers)
+    {
+        emit(gen, "\tcmp eax, %d", VM_T_INT);
+        emit(gen, "\tjne .Ln%u", floats ? floating : slow);
+        emit(gen, "\tcmp edx, %d", VM_T_INT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tmov rax, qword ptr [%s + %u]", a, PAYLOAD);
+        emit(gen, "\tmov rcx, qword ptr [%s + %u]", b, PAYLOAD);
+
+        if (opcode == VM_IDIV || opcode == VM_IDIVS)
+        {
+            gen_idiv(gen, slow);
+        }
+        else
+        {
+            gen_arith(gen, VM_T_INT);
+        }
+
+        store(gen, VM_T_INT);
+        emit(gen, "\tjmp .Ln%u", done);
+    }
+
+    if (floats)
+    {
+        emit(gen, ".Ln%u:", floating);
+        emit(gen, "\tcmp eax, %d", VM_T_FLOAT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tcmp edx, %d", VM_T_FLOAT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tmovsd xmm0, qword ptr [%s + %u]", a, PAYLOAD);
+        emit(gen, "\tmovsd xmm1, qword ptr [%s + %u]", b, PAYLOAD);
+
+        // division by zero is reported by the runtime
+        if (opcode == VM_DIV || opcode == VM_DIVS)
+        {
+            emit(gen, "\txorpd xmm2, xmm2");
+            emit(gen, "\tucomisd xmm1, xmm2");
+            emit(gen, "\tje .Ln%u", slow);
+        }
+
+        gen_arith(gen, VM_T_FLOAT);
+        store(gen, VM_T_FLOAT);
+        emit(gen, "\tjmp .Ln%u", done);
+    }
+}
+
+static void store_dst(native_gen_t* gen, vm_type_t type)
+{
+    emit(gen, "\tmov qword ptr [" REG_DST "], %d", type);
+
+    if (type == VM_T_INT || type == VM_T_BOOL)
+    {
+        emit(gen, "\tmov qword ptr [" REG_DST " + %u], rax", PAYLOAD);
+    }
+    else
+    {
+        emit(gen, "\tmovsd qword ptr [" REG_DST " + %u], xmm0", PAYLOAD);
+    }
+}
+
+/*
+ * Result replaces the first of two values on the stack
+ */
+static void store_stack(native_gen_t* gen, vm_type_t type)
+{
+    emit(gen, "\tmov qword ptr [r12 - %u], %d", 2 * VALUE_SIZE, type);
+
+    if (type == VM_T_INT || type == VM_T_BOOL)
+    {
+        emit(gen, "\tmov qword ptr [r12 - %u], rax", 2 * VALUE_SIZE - PAYLOAD);
+    }
+    else
+    {
+        emit(gen, "\tmovsd qword ptr [r12 - %u], xmm0", 2 * VALUE_SIZE - PAYLOAD);
+    }
+
+    emit(gen, "\tsub r12, %u", VALUE_SIZE);
+}
+
+/*
+ * Condition code of the comparison of integers
+ */
+static const char* condition(int opcode)
+{
+    switch (opcode)
+    {
+        case VM_LT:
+        case VM_LTS:
+            return "l";
+        case VM_GT:
+        case VM_GTS:
+            return "g";
+        default:
+            return "e";
+    }
+}
+
+/*
+ * ADD ... IDIV, LT, GT, EQ with integer and float operands inlined
+ */
+static void gen_binary(native_gen_t* gen)
+{
+    const vm_instr_t* ins = gen->ins;
+    uint32_t slow = new_label(gen);
+    uint32_t done = new_label(gen);
+    bool relational = ins->opcode == VM_LT || ins->opcode == VM_GT || ins->opcode == VM_EQ;
+
+    gen_var(gen, &ins->op[0], REG_DST);
+    gen_symb(gen, &ins->op[1], REG_A);
+    gen_symb(gen, &ins->op[2], REG_B);
+
+    // string in the destination is released by the runtime
+    emit(gen, "\tcmp dword ptr [" REG_DST "], %d", VM_T_STRING);
+    emit(gen, "\tje .Ln%u", slow);
+
+    if (relational)
+    {
+        emit(gen, "\tcmp dword ptr [" REG_A "], %d", VM_T_INT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tcmp dword ptr [" REG_B "], %d", VM_T_INT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tmov rcx, qword ptr [" REG_A " + %u]", PAYLOAD);
+        emit(gen, "\txor eax, eax");
+        emit(gen, "\tcmp rcx, qword ptr [" REG_B " + %u]", PAYLOAD);
+        emit(gen, "\tset%s al", condition(ins->opcode));
+        store_dst(gen, VM_T_BOOL);
+    }
+    else
+    {
+        gen_arith_values(gen, REG_A, REG_B, slow, store_dst, done);
+    }
+
+    emit(gen, ".Ln%u:", done);
+
+    cold(gen, slow);
+    call_op(gen);
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+/*
+ * ADDS ... IDIVS, LTS, GTS, EQS with integer and float operands inlined
+ */
+static void gen_binary_stack(native_gen_t* gen)
+{
+    int opcode = gen->ins->opcode;
+    uint32_t slow = new_label(gen);
+    uint32_t done = new_label(gen);
+
+    gen_depth(gen, 2);
+
+    if (opcode == VM_LTS || opcode == VM_GTS || opcode == VM_EQS)
+    {
+        emit(gen, "\tcmp dword ptr [r12 - %u], %d", 2 * VALUE_SIZE, VM_T_INT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tcmp dword ptr [r12 - %u], %d", VALUE_SIZE, VM_T_INT);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tmov rcx, qword ptr [r12 - %u]", 2 * VALUE_SIZE - PAYLOAD);
+        emit(gen, "\txor eax, eax");
+        emit(gen, "\tcmp rcx, qword ptr [r12 - %u]", VALUE_SIZE - PAYLOAD);
+        emit(gen, "\tset%s al", condition(opcode));
+        store_stack(gen, VM_T_BOOL);
+    }
+    else
+    {
+        emit(gen, "\tlea rsi, [r12 - %u]", 2 * VALUE_SIZE);
+        emit(gen, "\tlea rdi, [r12 - %u]", VALUE_SIZE);
+        gen_arith_values(gen, "rsi", "rdi", slow, store_stack, done);
+    }
+
+    emit(gen, ".Ln%u:", done);
+
+    cold(gen, slow);
+    call_stack_op(gen);
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+/*
+ * JUMPIFEQ, JUMPIFNEQ inlined for nil, integers and booleans, comparison
+ * with a constant is specialized
+ */
+static void gen_jump(native_gen_t* gen)
+{
+    const vm_instr_t* ins = gen->ins;
+    const char* jump = ins->opcode == VM_JUMPIFEQ ? "je" : "jne";
+    vm_type_t type = known_type(gen, &ins->op[2]);
+    uint32_t slow = new_label(gen);
+    uint32_t done = new_label(gen);
+
+    gen_symb(gen, &ins->op[1], REG_A);
+    gen_symb(gen, &ins->op[2], REG_B);
+
+    emit(gen, "\tmov eax, dword ptr [" REG_A "]");
+
+    if (type == VM_T_NIL)
+    {
+        // equal to nil only when the value is nil
+        emit(gen, "\tcmp eax, %d", VM_T_NIL);
+        jump_to(gen, jump, &ins->op[0]);
+    }
+    else if (type == VM_T_INT || type == VM_T_BOOL)
+    {
+        uint32_t nil = new_label(gen);
+
+        emit(gen, "\tcmp eax, %d", type);
+        emit(gen, "\tjne .Ln%u", nil);
+        emit(gen, "\tmov rcx, qword ptr [" REG_A " + %u]", PAYLOAD);
+        emit(gen, "\tcmp rcx, qword ptr [" REG_B " + %u]", PAYLOAD);
+        jump_to(gen, jump, &ins->op[0]);
+        emit(gen, "\tjmp .Ln%u", done);
+
+        // nil differs from the constant, other types are wrong
+        emit(gen, ".Ln%u:", nil);
+        emit(gen, "\tcmp eax, %d", VM_T_NIL);
+        emit(gen, "\tjne .Ln%u", slow);
+
+        if (ins->opcode == VM_JUMPIFNEQ)
+        {
+            jump_to(gen, "jmp", &ins->op[0]);
+        }
+    }
+    else
+    {
+        uint32_t nil = new_label(gen);
+        uint32_t same = new_label(gen);
+
+        emit(gen, "\tmov edx, dword ptr [" REG_B "]");
+        emit(gen, "\tcmp eax, %d", VM_T_NIL);
+        emit(gen, "\tje .Ln%u", nil);
+        emit(gen, "\tcmp edx, %d", VM_T_NIL);
+        emit(gen, "\tje .Ln%u", nil);
+        emit(gen, "\tcmp eax, edx");
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, "\tcmp eax, %d", VM_T_INT);
+        emit(gen, "\tje .Ln%u", same);
+        emit(gen, "\tcmp eax, %d", VM_T_BOOL);
+        emit(gen, "\tjne .Ln%u", slow);
+        emit(gen, ".Ln%u:", same);
+        emit(gen, "\tmov rcx, qword ptr [" REG_A " + %u]", PAYLOAD);
+        emit(gen, "\tcmp rcx, qword ptr [" REG_B " + %u]", PAYLOAD);
+        jump_to(gen, jump, &ins->op[0]);
+        emit(gen, "\tjmp .Ln%u", done);
+
+        // nil is equal only to nil
+        emit(gen, ".Ln%u:", nil);
+        emit(gen, "\tcmp eax, edx");
+        jump_to(gen, jump, &ins->op[0]);
+    }
+
+    emit(gen, ".Ln%u:", done);
+
+    cold(gen, slow);
+    emit(gen, "\tmov edi, %d", ins->opcode);
+    emit(gen, "\tmov rsi, " REG_A);
+    emit(gen, "\tmov rdx, " REG_B);
+    emit(gen, "\tmov ecx, %u", ins->line);
+    emit(gen, "\tcall native_jump");
+    emit(gen, "\ttest al, al");
+    jump_to(gen, "jnz", &ins->op[0]);
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+/*
+ * JUMPIFEQS, JUMPIFNEQS inlined for integers
+ */
+static void gen_jump_stack(native_gen_t* gen)
+{
+    const vm_instr_t* ins = gen->ins;
+    const char* jump = ins->opcode == VM_JUMPIFEQS ? "je" : "jne";
+    uint32_t slow = new_label(gen);
+    uint32_t done = new_label(gen);
+
+    gen_depth(gen, 2);
+    emit(gen, "\tcmp dword ptr [r12 - %u], %d", 2 * VALUE_SIZE, VM_T_INT);
+    emit(gen, "\tjne .Ln%u", slow);
+    emit(gen, "\tcmp dword ptr [r12 - %u], %d", VALUE_SIZE, VM_T_INT);
+    emit(gen, "\tjne .Ln%u", slow);
+    emit(gen, "\tmov rcx, qword ptr [r12 - %u]", 2 * VALUE_SIZE - PAYLOAD);
+    emit(gen, "\tsub r12, %u", 2 * VALUE_SIZE);
+    emit(gen, "\tcmp rcx, qword ptr [r12 + %u]", VALUE_SIZE + PAYLOAD);
+    jump_to(gen, jump, &ins->op[0]);
+    emit(gen, ".Ln%u:", done);
+
+    cold(gen, slow);
+    emit(gen, "\tmov edi, %d", ins->opcode);
+    emit(gen, "\tmov rsi, r12");
+    emit(gen, "\tmov edx, %u", ins->line);
+    emit(gen, "\tcall native_jump_stack");
+    emit(gen, "\tsub r12, %u", 2 * VALUE_SIZE);
+    emit(gen, "\ttest al, al");
+    jump_to(gen, "jnz", &ins->op[0]);
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+static void gen_move(native_gen_t* gen)
+{
+    const vm_instr_t* ins = gen->ins;
+    uint32_t slow = new_label(gen);
+    uint32_t done = new_label(gen);
+
+    gen_var(gen, &ins->op[0], REG_DST);
+    gen_symb(gen, &ins->op[1], REG_A);
+
+    // strings are shared by the runtime
+    emit(gen, "\tcmp dword ptr [" REG_DST "], %d", VM_T_STRING);
+    emit(gen, "\tje .Ln%u", slow);
+
+    if (known_type(gen, &ins->op[1]) != VM_T_STRING)
+    {
+        if (ins->op[1].kind != VM_OPND_CONST)
+        {
+            emit(gen, "\tcmp dword ptr [" REG_A "], %d", VM_T_STRING);
+            emit(gen, "\tje .Ln%u", slow);
+        }
+
+        emit(gen, "\tmovdqu xmm0, xmmword ptr [" REG_A "]");
+        emit(gen, "\tmovdqu xmmword ptr [" REG_DST "], xmm0");
+    }
+    else
+    {
+        emit(gen, "\tjmp .Ln%u", slow);
+    }
+
+    emit(gen, ".Ln%u:", done);
+
+    cold(gen, slow);
+    emit(gen, "\tmov rdi, " REG_DST);
+    emit(gen, "\tmov rsi, " REG_A);
+    emit(gen, "\tcall native_move");
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+static void gen_pushs(native_gen_t* gen)
+{
+    const vm_operand_t* operand = &gen->ins->op[0];
+    uint32_t grow = new_label(gen);
+    uint32_t room = new_label(gen);
+
+    gen_symb(gen, operand, REG_A);
+    emit(gen, "\tcmp r12, qword ptr [rip + native_stack_end]");
+    emit(gen, "\tjae .Ln%u", grow);
+    emit(gen, ".Ln%u:", room);
+
+    // constant strings are never released
+    if (operand->kind != VM_OPND_CONST)
+    {
+        uint32_t shared = new_label(gen);
+
+        emit(gen, "\tcmp dword ptr [" REG_A "], %d", VM_T_STRING);
+        emit(gen, "\tjne .Ln%u", shared);
+        emit(gen, "\tmov rax, qword ptr [" REG_A " + %u]", PAYLOAD);
+        emit(gen, "\tinc qword ptr [rax]");
+        emit(gen, ".Ln%u:", shared);
+    }
+
+    emit(gen, "\tmovdqu xmm0, xmmword ptr [" REG_A "]");
+    emit(gen, "\tmovdqu xmmword ptr [r12], xmm0");
+    emit(gen, "\tadd r12, %u", VALUE_SIZE);
+
+    cold(gen, grow);
+    emit(gen, "\tmov rdi, r12");
+    emit(gen, "\tcall native_stack_grow");
+    emit(gen, "\tmov r12, rax");
+    emit(gen, "\tjmp .Ln%u", room);
+    hot(gen);
+}
+
+static void gen_pops(native_gen_t* gen)
+{
+    uint32_t release = new_label(gen);
+    uint32_t done = new_label(gen);
+
+    gen_var(gen, &gen->ins->op[0], REG_DST);
+    emit(gen, "\tcmp r12, qword ptr [rip + native_stack_base]");
+    fail_if(gen, "je", VM_E_VALUE);
+    emit(gen, "\tcmp dword ptr [" REG_DST "], %d", VM_T_STRING);
+    emit(gen, "\tje .Ln%u", release);
+    emit(gen, ".Ln%u:", done);
+    emit(gen, "\tsub r12, %u", VALUE_SIZE);
+    emit(gen, "\tmovdqu xmm0, xmmword ptr [r12]");
+    emit(gen, "\tmovdqu xmmword ptr [" REG_DST "], xmm0");
+
+    cold(gen, release);
+    emit(gen, "\tmov rdi, qword ptr [" REG_DST " + %u]", PAYLOAD);
+    emit(gen, "\tcall native_release");
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+static void gen_int2floats(native_gen_t* gen)
+{
+    uint32_t slow = new_label(gen);
+    uint32_t done = new_label(gen);
+
+    gen_depth(gen, 1);
+    emit(gen, "\tcmp dword ptr [r12 - %u], %d", VALUE_SIZE, VM_T_INT);
+    emit(gen, "\tjne .Ln%u", slow);
+    emit(gen, "\tcvtsi2sd xmm0, qword ptr [r12 - %u]", VALUE_SIZE - PAYLOAD);
+    emit(gen, "\tmovsd qword ptr [r12 - %u], xmm0", VALUE_SIZE - PAYLOAD);
+    emit(gen, "\tmov dword ptr [r12 - %u], %d", VALUE_SIZE, VM_T_FLOAT);
+    emit(gen, ".Ln%u:", done);
+
+    cold(gen, slow);
+    call_stack_op(gen);
+    emit(gen, "\tjmp .Ln%u", done);
+    hot(gen);
+}
+
+/*
+ * Instruction executed by the runtime, operands are fetched in the order
+ * of the interpreter
+ */
+static void gen_runtime_op(native_gen_t* gen)
+{
+    const vm_instr_t* ins = gen->ins;
+    const char* signature = vm_opcode_operands(ins->opcode);
+    const char* regs[] = {REG_DST, REG_A, REG_B};
+
+    emit(gen, "\txor " REG_B ", " REG_B);
+
+    for (int i = 0; signature[i] != '\0'; i++)
+    {
+        if (signature[i] == 'v' || (ins->opcode == VM_TYPE && ins->op[i].kind != VM_OPND_CONST))
+        {
+            gen_var(gen, &ins->op[i], regs[i]);
+
+            // value is changed in place
+            if (ins->opcode == VM_SETCHAR)
+            {
+                emit(gen, "\tcmp dword ptr [" REG_DST "], %d", VM_T_UNDEF);
+                fail_if(gen, "je", VM_E_VALUE);
+            }
+        }
+        else
+        {
+            gen_symb(gen, &ins->op[i], regs[i]);
+        }
+    }
+
+    call_op(gen);
+}
+
+static void gen_defvar(native_gen_t* gen)
+{
+    const vm_operand_t* operand = &gen->ins->op[0];
+
+    if (operand->kind == VM_OPND_GF)
+    {
+        emit(gen, "\tcmp byte ptr [rip + ic21_defined + %u], 0", operand->index);
+        fail_if(gen, "jne", VM_E_SEMANTIC);
+        emit(gen, "\tmov byte ptr [rip + ic21_defined + %u], 1", operand->index);
+        emit(gen, "\tmov dword ptr [rip + ic21_globals + %u], %d", operand->index * VALUE_SIZE, VM_T_UNDEF);
+        return;
+    }
+
+    frame_to_rdi(gen, operand);
+    emit(gen, "\tmov esi, %u", operand->index);
+    emit(gen, "\tlea rdx, [rip + ic21_hints + %u]", operand->index * 4);
+    emit(gen, "\tmov ecx, %u", gen->ins->line);
+    emit(gen, "\tcall native_defvar");
+}
+
+static void gen_call(native_gen_t* gen)
+{
+    uint32_t grow = new_label(gen);
+    uint32_t room = new_label(gen);
+
+    emit(gen, "\tcmp r13, qword ptr [rip + native_calls_end]");
+    emit(gen, "\tjae .Ln%u", grow);
+    emit(gen, ".Ln%u:", room);
+    emit(gen, "\tlea rax, [rip + .Li%u]", gen->index + 1);
+    emit(gen, "\tmov qword ptr [r13], rax");
+    emit(gen, "\tadd r13, 8");
+    jump_to(gen, "jmp", &gen->ins->op[0]);
+
+    cold(gen, grow);
+    emit(gen, "\tmov rdi, r13");
+    emit(gen, "\tcall native_calls_grow");
+    emit(gen, "\tmov r13, rax");
+    emit(gen, "\tjmp .Ln%u", room);
+    hot(gen);
+}
+
+static void gen_instruction(native_gen_t* gen)
+{
+    const vm_instr_t* ins = gen->ins;
+
+    switch (ins->opcode)
+    {
+        case VM_MOVE:
+            gen_move(gen);
+            break;
+
+        case VM_CREATEFRAME:
+            emit(gen, "\tmov rdi, rbx");
+            emit(gen, "\tcall native_createframe");
+            emit(gen, "\tmov rbx, rax");
+            break;
+
+        case VM_PUSHFRAME:
+            emit(gen, "\ttest rbx, rbx");
+            fail_if(gen, "jz", VM_E_FRAME);
+            emit(gen, "\tmov rax, qword ptr [rip + native_lf]");
+            emit(gen, "\tmov qword ptr [rbx + %u], rax", (unsigned)offsetof(native_frame_t, next));
+            emit(gen, "\tmov qword ptr [rip + native_lf], rbx");
+            emit(gen, "\txor ebx, ebx");
+            break;
+
+        case VM_POPFRAME:
+            emit(gen, "\tcmp qword ptr [rip + native_lf], 0");
+            fail_if(gen, "je", VM_E_FRAME);
+            emit(gen, "\tmov rdi, rbx");
+            emit(gen, "\tcall native_frame_release");
+            emit(gen, "\tmov rbx, qword ptr [rip + native_lf]");
+            emit(gen, "\tmov rax, qword ptr [rbx + %u]", (unsigned)offsetof(native_frame_t, next));
+            emit(gen, "\tmov qword ptr [rip + native_lf], rax");
+            emit(gen, "\tmov qword ptr [rbx + %u], 0", (unsigned)offsetof(native_frame_t, next));
+            break;
+
+        case VM_DEFVAR:
+            gen_defvar(gen);
+            break;
+
+        case VM_CALL:
+            gen_call(gen);
+            break;
+
+        case VM_RETURN:
+            emit(gen, "\tcmp r13, qword ptr [rip + native_calls_base]");
+            fail_if(gen, "je", VM_E_VALUE);
+            emit(gen, "\tsub r13, 8");
+            emit(gen, "\tjmp qword ptr [r13]");
+            break;
+
+        case VM_PUSHS:
+            gen_pushs(gen);
+            break;
+
+        case VM_POPS:
+            gen_pops(gen);
+            break;
+
+        case VM_CLEARS:
+            emit(gen, "\tmov rdi, r12");
+            emit(gen, "\tcall native_clears");
+            emit(gen, "\tmov r12, rax");
+            break;
+
+        case VM_ADD:
+        case VM_SUB:
+        case VM_MUL:
+        case VM_DIV:
+        case VM_IDIV:
+        case VM_LT:
+        case VM_GT:
+        case VM_EQ:
+            gen_binary(gen);
+            break;
+
+        case VM_ADDS:
+        case VM_SUBS:
+        case VM_MULS:
+        case VM_DIVS:
+        case VM_IDIVS:
+        case VM_LTS:
+        case VM_GTS:
+        case VM_EQS:
+            gen_binary_stack(gen);
+            break;
+
+        case VM_INT2FLOATS:
+            gen_int2floats(gen);
+            break;
+
+        case VM_ANDS:
+        case VM_ORS:
+        case VM_NOTS:
+        case VM_FLOAT2INTS:
+        case VM_INT2CHARS:
+        case VM_STRI2INTS:
+            call_stack_op(gen);
+            break;
+
+        case VM_READ:
+            gen_var(gen, &ins->op[0], REG_DST);
+            emit(gen, "\tmov rdi, " REG_DST);
+            emit(gen, "\tmov esi, %u", ins->op[1].index);
+            emit(gen, "\tmov edx, %u", ins->line);
+            emit(gen, "\tcall native_read");
+            break;
+
+        case VM_WRITE:
+        case VM_DPRINT:
+            gen_symb(gen, &ins->op[0], REG_A);
+            emit(gen, "\tmov rdi, " REG_A);
+            emit(gen, "\tcall %s", ins->opcode == VM_WRITE ? "native_print" : "native_dprint");
+            break;
+
+        case VM_JUMP:
+            jump_to(gen, "jmp", &ins->op[0]);
+            break;
+
+        case VM_JUMPIFEQ:
+        case VM_JUMPIFNEQ:
+            gen_jump(gen);
+            break;
+
+        case VM_JUMPIFEQS:
+        case VM_JUMPIFNEQS:
+            gen_jump_stack(gen);
+            break;
+
+        case VM_EXIT:
+            gen_symb(gen, &ins->op[0], REG_A);
+            emit(gen, "\tmov rdi, " REG_A);
+            emit(gen, "\tmov esi, %u", ins->line);
+            emit(gen, "\tcall native_exit");
+            break;
+
+        case VM_BREAK:
+            emit(gen, "\tmov edi, %u", ins->line);
+            emit(gen, "\tmov rsi, r12");
+            emit(gen, "\tmov rdx, r13");
+            emit(gen, "\tmov rcx, rbx");
+            emit(gen, "\tcall native_break");
+            break;
+
+        default:
+            gen_runtime_op(gen);
+            break;
+    }
+}
+
+/*
+ * Constants are values in the read only data, strings are writable as
+ * their count of references changes
+ */
+static void gen_consts(native_gen_t* gen)
+{
+    const vm_program_t* program = gen->program;
+
+    emit(gen, "\t.data");
+    emit(gen, "\t.balign 8");
+
+    for (uint32_t i = 0; i < program->consts_len; i++)
+    {
+        const vm_value_t* value = &program->consts[i];
+
+        if (value->type != VM_T_STRING)
+        {
+            continue;
+        }
+
+        emit(gen, ".Ls%u:", i);
+        emit(gen, "\t.quad %llu, %zu", (unsigned long long)NATIVE_STATIC_REFS, value->s.len);
+        fputs("\t.byte ", gen->file);
+
+        for (size_t c = 0; c < value->s.len; c++)
+        {
+            fprintf(gen->file, "%u,", (unsigned char)value->s.data[c]);
+        }
+
+        emit(gen, "0");
+        emit(gen, "\t.balign 8");
+    }
+
+    emit(gen, "\t.section .data.rel.ro");
+    emit(gen, "\t.balign 16");
+
+    for (uint32_t i = 0; i < program->consts_len; i++)
+    {
+        const vm_value_t* value = &program->consts[i];
+
+        emit(gen, ".Lk%u:", i);
+        emit(gen, "\t.long %d, 0", value->type);
+
+        switch (value->type)
+        {
+            case VM_T_INT:
+                emit(gen, "\t.quad %lld", (long long)value->i);
+                break;
+
+            case VM_T_FLOAT:
+            {
+                uint64_t bits;
+
+                memcpy(&bits, &value->f, sizeof(bits));
+                emit(gen, "\t.quad %llu", (unsigned long long)bits);
+                break;
+            }
+
+            case VM_T_BOOL:
+                emit(gen, "\t.quad %d", value->b ? 1 : 0);
+                break;
+
+            case VM_T_STRING:
+                emit(gen, "\t.quad .Ls%u", i);
+                break;
+
+            default:
+                emit(gen, "\t.quad 0");
+                break;
+        }
+    }
+}
+
+bool native_generate(FILE* file, const vm_program_t* program)
+{
+    native_gen_t gen = {.file = file, .program = program, .ins = NULL, .index = 0, .labels = 0, .cold = false};
+    uint32_t names = program->names_len == 0 ? 1 : program->names_len;
+
+    emit(&gen, "\t.intel_syntax noprefix");
+    emit(&gen, "\t.text");
+    emit(&gen, "\t.globl ic21_run");
+    emit(&gen, "\t.type ic21_run, @function");
+    emit(&gen, "ic21_run:");
+
+    // registers of the runtime are saved, stack stays aligned for calls
+    emit(&gen, "\tpush rbx");
+    emit(&gen, "\tpush rbp");
+    emit(&gen, "\tpush r12");
+    emit(&gen, "\tpush r13");
+    emit(&gen, "\tpush r14");
+    emit(&gen, "\tpush r15");
+    emit(&gen, "\tsub rsp, 8");
+    emit(&gen, "\txor ebx, ebx");
+    emit(&gen, "\tmov r12, qword ptr [rip + native_stack_base]");
+    emit(&gen, "\tmov r13, qword ptr [rip + native_calls_base]");
+
+    for (gen.index = 0; gen.index < program->code_len; gen.index++)
+    {
+        gen.ins = &program->code[gen.index];
+
+        emit(&gen, ".Li%u:\t# %u: %s", gen.index, gen.ins->line, vm_opcode_name(gen.ins->opcode));
+        gen_instruction(&gen);
+    }
+
+    emit(&gen, ".Li%u:", program->code_len);
+    emit(&gen, "\tmov rdi, rbx");
+    emit(&gen, "\tcall native_frame_release");
+    emit(&gen, "\txor eax, eax");
+    emit(&gen, "\tadd rsp, 8");
+    emit(&gen, "\tpop r15");
+    emit(&gen, "\tpop r14");
+    emit(&gen, "\tpop r13");
+    emit(&gen, "\tpop r12");
+    emit(&gen, "\tpop rbp");
+    emit(&gen, "\tpop rbx");
+    emit(&gen, "\tret");
+    emit(&gen, "\t.size ic21_run, .-ic21_run");
+
+    gen_consts(&gen);
+
+    emit(&gen, "\t.bss");
+    emit(&gen, "\t.balign 16");
+    emit(&gen, "ic21_globals:");
+    emit(&gen, "\t.zero %u", names * VALUE_SIZE);
+    emit(&gen, "ic21_hints:");
+    emit(&gen, "\t.zero %u", names * 4);
+    emit(&gen, "ic21_defined:");
+    emit(&gen, "\t.zero %u", names);
+    emit(&gen, "\t.section .note.GNU-stack,\"\",@progbits");
+
+    return !ferror(file);
+}
@@ -0,0 +1,957 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Native x86-64 backend - runtime library linked to the generated
+ *          assembly (frames, strings, nil handling, input and output)
+ *
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define STACK_INIT_SIZE 64
+#define FRAME_INIT_SIZE 8
+#define LINE_INIT_SIZE 64
+
+native_frame_t* native_lf = NULL;
+native_value_t* native_stack_base = NULL;
+native_value_t* native_stack_end = NULL;
+void** native_calls_base = NULL;
+void** native_calls_end = NULL;
+
+static native_frame_t* free_frames = NULL;
+
+/* Generated program */
+extern int ic21_run(void);
+
+static const char* type_names[] = {
+    "",
+    "nil",
+    "int",
+    "float",
+    "bool",
+    "string"
+};
+
+/*
+ * ----------------------ERRORS-----------------------
+ */
+
+static const char* error_message(int code)
+{
+    switch (code)
+    {
+        case VM_E_SEMANTIC:
+            return "Label does not exist or variable already exists!";
+        case VM_E_TYPE:
+            return "Wrong operand type!";
+        case VM_E_VAR:
+            return "Variable is not defined!";
+        case VM_E_FRAME:
+            return "Frame does not exist!";
+        case VM_E_VALUE:
+            return "Missing value!";
+        case VM_E_OPERAND:
+            return "Wrong operand value!";
+        case VM_E_STRING:
+            return "Wrong string operation!";
+        default:
+            return "Out of memory!";
+    }
+}
+
+/*
+ * Runtime error ends the program with the exit code of the interpreter
+ */
+_Noreturn void native_fail(int code, uint32_t line)
+{
+    fflush(stdout);
+    fprintf(stderr, "Error at line %" PRIu32 ": %s\n", line, error_message(code));
+    exit(code);
+}
+
+/*
+ * ----------------------VALUES-----------------------
+ */
+
+static native_string_t* string_new(const char* data, size_t len)
+{
+    native_string_t* string = malloc(sizeof(native_string_t) + len + 1);
+
+    if (!string)
+    {
+        native_fail(VM_E_INTERNAL, 0);
+    }
+
+    string->refs = 1;
+    string->len = len;
+    memcpy(string->data, data, len);
+    string->data[len] = '\0';
+
+    return string;
+}
+
+void native_release(native_string_t* string)
+{
+    if (--string->refs == 0)
+    {
+        free(string);
+    }
+}
+
+static void value_free(native_value_t* value)
+{
+    if (value->type == VM_T_STRING)
+    {
+        native_release(value->s);
+    }
+
+    value->type = VM_T_UNDEF;
+}
+
+/*
+ * Result is stored to the variable, its old value is released
+ */
+static void store(native_value_t* dst, native_value_t res)
+{
+    value_free(dst);
+    *dst = res;
+}
+
+static native_value_t make_int(int64_t i)
+{
+    native_value_t value = {.type = VM_T_INT, .i = i};
+
+    return value;
+}
+
+static native_value_t make_float(double f)
+{
+    native_value_t value = {.type = VM_T_FLOAT, .f = f};
+
+    return value;
+}
+
+static native_value_t make_bool(bool b)
+{
+    native_value_t value = {.type = VM_T_BOOL, .i = b};
+
+    return value;
+}
+
+static native_value_t make_string(native_string_t* s)
+{
+    native_value_t value = {.type = VM_T_STRING, .s = s};
+
+    return value;
+}
+
+/*
+ * MOVE with a string on any side, strings are shared
+ */
+void native_move(native_value_t* dst, const native_value_t* src)
+{
+    if (dst == src)
+    {
+        return;
+    }
+
+    if (src->type == VM_T_STRING)
+    {
+        src->s->refs++;
+    }
+
+    store(dst, *src);
+}
+
+/*
+ * ----------------------FRAMES AND STACKS-----------------------
+ */
+
+void native_frame_release(native_frame_t* frame)
+{
+    if (!frame)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < frame->len; i++)
+    {
+        value_free(&frame->vals[i]);
+    }
+
+    frame->len = 0;
+    frame->next = free_frames;
+    free_frames = frame;
+}
+
+/*
+ * New temporary frame, the old one is released
+ */
+native_frame_t* native_createframe(native_frame_t* tf)
+{
+    native_frame_t* frame;
+
+    native_frame_release(tf);
+
+    frame = free_frames;
+
+    if (frame)
+    {
+        free_frames = frame->next;
+        frame->next = NULL;
+        return frame;
+    }
+
+    frame = calloc(1, sizeof(native_frame_t));
+
+    if (!frame)
+    {
+        native_fail(VM_E_INTERNAL, 0);
+    }
+
+    return frame;
+}
+
+/*
+ * Variable of the frame which is not at the slot of its hint
+ */
+native_value_t* native_find(native_frame_t* frame, uint32_t name, uint32_t* hint, uint32_t line)
+{
+    for (uint32_t i = frame->len; i-- > 0;)
+    {
+        if (frame->names[i] == name)
+        {
+            *hint = i;
+            return &frame->vals[i];
+        }
+    }
+
+    native_fail(VM_E_VAR, line);
+}
+
+void native_defvar(native_frame_t* frame, uint32_t name, uint32_t* hint, uint32_t line)
+{
+    if (!frame)
+    {
+        native_fail(VM_E_FRAME, line);
+    }
+
+    for (uint32_t i = 0; i < frame->len; i++)
+    {
+        if (frame->names[i] == name)
+        {
+            native_fail(VM_E_SEMANTIC, line);
+        }
+    }
+
+    if (frame->len == frame->cap)
+    {
+        uint32_t cap = frame->cap == 0 ? FRAME_INIT_SIZE : frame->cap * 2;
+        uint32_t* names = realloc(frame->names, cap * sizeof(uint32_t));
+        native_value_t* vals = names ? realloc(frame->vals, cap * sizeof(native_value_t)) : NULL;
+
+        if (!vals)
+        {
+            native_fail(VM_E_INTERNAL, line);
+        }
+
+        frame->names = names;
+        frame->vals = vals;
+        frame->cap = cap;
+    }
+
+    *hint = frame->len;
+    frame->names[frame->len] = name;
+    frame->vals[frame->len++].type = VM_T_UNDEF;
+}
+
+/*
+ * Data stack is full, returns the new top
+ */
+native_value_t* native_stack_grow(native_value_t* top)
+{
+    size_t len = top - native_stack_base;
+    size_t cap = (native_stack_end - native_stack_base) * 2;
+    native_value_t* stack = realloc(native_stack_base, cap * sizeof(native_value_t));
+
+    if (!stack)
+    {
+        native_fail(VM_E_INTERNAL, 0);
+    }
+
+    native_stack_base = stack;
+    native_stack_end = stack + cap;
+
+    return stack + len;
+}
+
+void** native_calls_grow(void** top)
+{
+    size_t len = top - native_calls_base;
+    size_t cap = (native_calls_end - native_calls_base) * 2;
+    void** calls = realloc(native_calls_base, cap * sizeof(void*));
+
+    if (!calls)
+    {
+        native_fail(VM_E_INTERNAL, 0);
+    }
+
+    native_calls_base = calls;
+    native_calls_end = calls + cap;
+
+    return calls + len;
+}
+
+native_value_t* native_clears(native_value_t* top)
+{
+    while (top > native_stack_base)
+    {
+        value_free(--top);
+    }
+
+    return top;
+}
+
+/*
+ * ----------------------OPERATIONS-----------------------
+ */
+
+/*
+ * Integer division rounds towards negative infinity
+ */
+static int64_t int_div(int64_t a, int64_t b)
+{
+    if (b == -1)
+    {
+        return (int64_t)(0 - (uint64_t)a);
+    }
+
+    int64_t q = a / b;
+
+    if (a % b != 0 && ((a < 0) != (b < 0)))
+    {
+        q--;
+    }
+
+    return q;
+}
+
+static native_value_t arith(int opcode, const native_value_t* a, const native_value_t* b, uint32_t line)
+{
+    if (a->type == VM_T_INT && b->type == VM_T_INT && opcode != VM_DIV && opcode != VM_DIVS)
+    {
+        uint64_t x = (uint64_t)a->i;
+        uint64_t y = (uint64_t)b->i;
+
+        switch (opcode)
+        {
+            case VM_ADD:
+            case VM_ADDS:
+                return make_int((int64_t)(x + y));
+            case VM_SUB:
+            case VM_SUBS:
+                return make_int((int64_t)(x - y));
+            case VM_MUL:
+            case VM_MULS:
+                return make_int((int64_t)(x * y));
+            default:
+                if (b->i == 0)
+                {
+                    native_fail(VM_E_OPERAND, line);
+                }
+
+                return make_int(int_div(a->i, b->i));
+        }
+    }
+
+    if (a->type == VM_T_FLOAT && b->type == VM_T_FLOAT && opcode != VM_IDIV && opcode != VM_IDIVS)
+    {
+        switch (opcode)
+        {
+            case VM_ADD:
+            case VM_ADDS:
+                return make_float(a->f + b->f);
+            case VM_SUB:
+            case VM_SUBS:
+                return make_float(a->f - b->f);
+            case VM_MUL:
+            case VM_MULS:
+                return make_float(a->f * b->f);
+            default:
+                if (b->f == 0.0)
+                {
+                    native_fail(VM_E_OPERAND, line);
+                }
+
+                return make_float(a->f / b->f);
+        }
+    }
+
+    native_fail(VM_E_TYPE, line);
+}
+
+static bool compare(int opcode, const native_value_t* a, const native_value_t* b, uint32_t line)
+{
+    bool eq = opcode == VM_EQ || opcode == VM_EQS || opcode == VM_JUMPIFEQ || opcode == VM_JUMPIFNEQ ||
+              opcode == VM_JUMPIFEQS || opcode == VM_JUMPIFNEQS;
+    int cmp = 0;
+
+    if (eq && (a->type == VM_T_NIL || b->type == VM_T_NIL))
+    {
+        return a->type == b->type;
+    }
+
+    if (a->type != b->type || a->type == VM_T_NIL)
+    {
+        native_fail(VM_E_TYPE, line);
+    }
+
+    switch (a->type)
+    {
+        case VM_T_INT:
+        case VM_T_BOOL:
+            cmp = (a->i > b->i) - (a->i < b->i);
+            break;
+        case VM_T_FLOAT:
+            if (eq)
+            {
+                return a->f == b->f;
+            }
+
+            cmp = (a->f > b->f) - (a->f < b->f);
+            break;
+        default:
+            cmp = memcmp(a->s->data, b->s->data, a->s->len < b->s->len ? a->s->len : b->s->len);
+
+            if (cmp == 0)
+            {
+                cmp = (a->s->len > b->s->len) - (a->s->len < b->s->len);
+            }
+            break;
+    }
+
+    switch (opcode)
+    {
+        case VM_LT:
+        case VM_LTS:
+            return cmp < 0;
+        case VM_GT:
+        case VM_GTS:
+            return cmp > 0;
+        default:
+            return cmp == 0;
+    }
+}
+
+static native_value_t logic(int opcode, const native_value_t* a, const native_value_t* b, uint32_t line)
+{
+    if (a->type != VM_T_BOOL || (b && b->type != VM_T_BOOL))
+    {
+        native_fail(VM_E_TYPE, line);
+    }
+
+    switch (opcode)
+    {
+        case VM_AND:
+        case VM_ANDS:
+            return make_bool(a->i && b->i);
+        case VM_OR:
+        case VM_ORS:
+            return make_bool(a->i || b->i);
+        default:
+            return make_bool(!a->i);
+    }
+}
+
+/*
+ * Type conversions, b is used only by STRI2INT
+ */
+static native_value_t convert(int opcode, const native_value_t* a, const native_value_t* b, uint32_t line)
+{
+    switch (opcode)
+    {
+        case VM_INT2FLOAT:
+        case VM_INT2FLOATS:
+            if (a->type == VM_T_INT)
+            {
+                return make_float((double)a->i);
+            }
+            break;
+
+        case VM_FLOAT2INT:
+        case VM_FLOAT2INTS:
+            if (a->type == VM_T_FLOAT)
+            {
+                // out of range conversion behaves as on x86-64 (like ic21int)
+                return make_int((a->f >= -9223372036854775808.0 && a->f < 9223372036854775808.0) ?
+                                (int64_t)a->f : INT64_MIN);
+            }
+            break;
+
+        case VM_INT2CHAR:
+        case VM_INT2CHARS:
+            if (a->type == VM_T_INT)
+            {
+                if (a->i < 0 || a->i > 255)
+                {
+                    native_fail(VM_E_STRING, line);
+                }
+
+                char c = (char)a->i;
+
+                return make_string(string_new(&c, 1));
+            }
+            break;
+
+        default:
+            if (a->type == VM_T_STRING && b->type == VM_T_INT)
+            {
+                if (b->i < 0 || (uint64_t)b->i >= a->s->len)
+                {
+                    native_fail(VM_E_STRING, line);
+                }
+
+                return make_int((unsigned char)a->s->data[b->i]);
+            }
+            break;
+    }
+
+    native_fail(VM_E_TYPE, line);
+}
+
+/*
+ * Instruction with the result in dst which is not inlined or whose
+ * operands are not handled by the inlined code
+ */
+void native_op(int opcode, native_value_t* dst, const native_value_t* a, const native_value_t* b, uint32_t line)
+{
+    native_value_t res;
+
+    switch (opcode)
+    {
+        case VM_ADD:
+        case VM_SUB:
+        case VM_MUL:
+        case VM_DIV:
+        case VM_IDIV:
+            res = arith(opcode, a, b, line);
+            break;
+
+        case VM_LT:
+        case VM_GT:
+        case VM_EQ:
+            res = make_bool(compare(opcode, a, b, line));
+            break;
+
+        case VM_AND:
+        case VM_OR:
+            res = logic(opcode, a, b, line);
+            break;
+
+        case VM_NOT:
+            res = logic(opcode, a, NULL, line);
+            break;
+
+        case VM_INT2FLOAT:
+        case VM_FLOAT2INT:
+        case VM_INT2CHAR:
+        case VM_STRI2INT:
+            res = convert(opcode, a, b, line);
+            break;
+
+        case VM_CONCAT:
+        {
+            if (a->type != VM_T_STRING || b->type != VM_T_STRING)
+            {
+                native_fail(VM_E_TYPE, line);
+            }
+
+            native_string_t* s = malloc(sizeof(native_string_t) + a->s->len + b->s->len + 1);
+
+            if (!s)
+            {
+                native_fail(VM_E_INTERNAL, line);
+            }
+
+            s->refs = 1;
+            s->len = a->s->len + b->s->len;
+            memcpy(s->data, a->s->data, a->s->len);
+            memcpy(s->data + a->s->len, b->s->data, b->s->len);
+            s->data[s->len] = '\0';
+            res = make_string(s);
+            break;
+        }
+
+        case VM_STRLEN:
+            if (a->type != VM_T_STRING)
+            {
+                native_fail(VM_E_TYPE, line);
+            }
+
+            res = make_int((int64_t)a->s->len);
+            break;
+
+        case VM_GETCHAR:
+            if (a->type != VM_T_STRING || b->type != VM_T_INT)
+            {
+                native_fail(VM_E_TYPE, line);
+            }
+
+            if (b->i < 0 || (uint64_t)b->i >= a->s->len)
+            {
+                native_fail(VM_E_STRING, line);
+            }
+
+            res = make_string(string_new(&a->s->data[b->i], 1));
+            break;
+
+        case VM_SETCHAR:
+            if (dst->type == VM_T_UNDEF)
+            {
+                native_fail(VM_E_VALUE, line);
+            }
+
+            if (dst->type != VM_T_STRING || a->type != VM_T_INT || b->type != VM_T_STRING)
+            {
+                native_fail(VM_E_TYPE, line);
+            }
+
+            if (a->i < 0 || (uint64_t)a->i >= dst->s->len || b->s->len == 0)
+            {
+                native_fail(VM_E_STRING, line);
+            }
+
+            // shared string is copied before the change
+            if (dst->s->refs > 1)
+            {
+                native_string_t* copy = string_new(dst->s->data, dst->s->len);
+
+                native_release(dst->s);
+                dst->s = copy;
+            }
+
+            dst->s->data[a->i] = b->s->data[0];
+            return;
+
+        default:
+            res = make_string(string_new(type_names[a->type], strlen(type_names[a->type])));
+            break;
+    }
+
+    store(dst, res);
+}
+
+/*
+ * Stack instruction which is not inlined, returns the new top
+ */
+native_value_t* native_stack_op(int opcode, native_value_t* top, uint32_t line)
+{
+    bool unary = opcode == VM_NOTS || opcode == VM_INT2FLOATS || opcode == VM_FLOAT2INTS || opcode == VM_INT2CHARS;
+    native_value_t* a = top - (unary ? 1 : 2);
+    native_value_t* b = top - 1;
+    native_value_t res;
+
+    if (a < native_stack_base)
+    {
+        native_fail(VM_E_VALUE, line);
+    }
+
+    switch (opcode)
+    {
+        case VM_ADDS:
+        case VM_SUBS:
+        case VM_MULS:
+        case VM_DIVS:
+        case VM_IDIVS:
+            res = arith(opcode, a, b, line);
+            break;
+
+        case VM_LTS:
+        case VM_GTS:
+        case VM_EQS:
+            res = make_bool(compare(opcode, a, b, line));
+            break;
+
+        case VM_ANDS:
+        case VM_ORS:
+            res = logic(opcode, a, b, line);
+            break;
+
+        case VM_NOTS:
+            res = logic(opcode, a, NULL, line);
+            break;
+
+        default:
+            res = convert(opcode, a, b, line);
+            break;
+    }
+
+    value_free(a);
+
+    if (!unary)
+    {
+        value_free(b);
+    }
+
+    *a = res;
+
+    return a + 1;
+}
+
+/*
+ * Conditional jump on variables and constants, true when it jumps
+ */
+bool native_jump(int opcode, const native_value_t* a, const native_value_t* b, uint32_t line)
+{
+    return compare(opcode, a, b, line) == (opcode == VM_JUMPIFEQ);
+}
+
+/*
+ * Conditional jump on the top of the stack, both values are popped by
+ * the caller
+ */
+bool native_jump_stack(int opcode, native_value_t* top, uint32_t line)
+{
+    if (top - 2 < native_stack_base)
+    {
+        native_fail(VM_E_VALUE, line);
+    }
+
+    bool cond = compare(opcode, top - 2, top - 1, line);
+
+    value_free(top - 2);
+    value_free(top - 1);
+
+    return cond == (opcode == VM_JUMPIFEQS);
+}
+
+/*
+ * ----------------------INPUT AND OUTPUT-----------------------
+ */
+
+static void write_value(FILE* out, const native_value_t* value)
+{
+    switch (value->type)
+    {
+        case VM_T_INT:
+            fprintf(out, "%" PRId64, value->i);
+            break;
+
+        case VM_T_FLOAT:
+        {
+            double f = value->f;
+
+            // integral floats are written as integers (like ic21int)
+            if (f != f)
+            {
+                fprintf(out, "%a", f);
+            }
+            else if (f < -9223372036854775808.0 || f >= 9223372036854775808.0)
+            {
+                fprintf(out, "%" PRId64, INT64_MIN);
+            }
+            else if ((double)(int64_t)f == f)
+            {
+                fprintf(out, "%" PRId64, (int64_t)f);
+            }
+            else
+            {
+                fprintf(out, "%a", f);
+            }
+            break;
+        }
+
+        case VM_T_BOOL:
+            fputs(value->i ? "true" : "false", out);
+            break;
+
+        case VM_T_STRING:
+            fwrite(value->s->data, 1, value->s->len, out);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void native_print(const native_value_t* value)
+{
+    write_value(stdout, value);
+}
+
+void native_dprint(const native_value_t* value)
+{
+    write_value(stderr, value);
+}
+
+void native_break(uint32_t line, const native_value_t* top, void** calls, const native_frame_t* tf)
+{
+    fprintf(stderr, "Current line: %" PRIu32 "\n", line);
+    fprintf(stderr, "Data stack size: %zu\n", (size_t)(top - native_stack_base));
+    fprintf(stderr, "Call stack size: %zu\n", (size_t)(calls - native_calls_base));
+    fprintf(stderr, "Temporary frame: %s\n", tf ? "defined" : "undefined");
+    fprintf(stderr, "Local frame: %s\n", native_lf ? "defined" : "undefined");
+}
+
+/*
+ * Read one line without the line terminator, NULL on end of input
+ */
+static native_string_t* read_line(void)
+{
+    size_t cap = LINE_INIT_SIZE;
+    size_t len = 0;
+    native_string_t* line = malloc(sizeof(native_string_t) + cap);
+    int c;
+
+    if (!line)
+    {
+        native_fail(VM_E_INTERNAL, 0);
+    }
+
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (len + 1 == cap)
+        {
+            native_string_t* tmp = realloc(line, sizeof(native_string_t) + cap * 2);
+
+            if (!tmp)
+            {
+                native_fail(VM_E_INTERNAL, 0);
+            }
+
+            line = tmp;
+            cap *= 2;
+        }
+
+        line->data[len++] = (char)c;
+    }
+
+    if (c == EOF && len == 0)
+    {
+        free(line);
+        return NULL;
+    }
+
+    line->refs = 1;
+    line->len = len;
+    line->data[len] = '\0';
+
+    return line;
+}
+
+static bool only_spaces(const char* str)
+{
+    while (isspace((unsigned char)*str))
+    {
+        str++;
+    }
+
+    return *str == '\0';
+}
+
+/*
+ * READ instruction, nil is stored on wrong or missing input
+ */
+void native_read(native_value_t* dst, int type, uint32_t line)
+{
+    native_value_t res = {.type = VM_T_NIL};
+    native_string_t* input;
+    char* end;
+
+    if (type == VM_T_NIL)
+    {
+        native_fail(VM_E_TYPE, line);
+    }
+
+    fflush(stdout);
+
+    if (!(input = read_line()))
+    {
+        store(dst, res);
+        return;
+    }
+
+    switch (type)
+    {
+        case VM_T_INT:
+            res.i = strtoll(input->data, &end, 0);
+
+            if (end != input->data && only_spaces(end))
+            {
+                res.type = VM_T_INT;
+            }
+            break;
+
+        case VM_T_FLOAT:
+            res.f = strtod(input->data, &end);
+
+            if (end != input->data && only_spaces(end))
+            {
+                res.type = VM_T_FLOAT;
+            }
+            break;
+
+        case VM_T_BOOL:
+            if (input->len > 0)
+            {
+                res = make_bool(input->len == 4 && tolower((unsigned char)input->data[0]) == 't' &&
+                                tolower((unsigned char)input->data[1]) == 'r' &&
+                                tolower((unsigned char)input->data[2]) == 'u' &&
+                                tolower((unsigned char)input->data[3]) == 'e');
+            }
+            break;
+
+        default:
+            store(dst, make_string(input));
+            return;
+    }
+
+    free(input);
+    store(dst, res);
+}
+
+_Noreturn void native_exit(const native_value_t* value, uint32_t line)
+{
+    if (value->type != VM_T_INT)
+    {
+        native_fail(VM_E_TYPE, line);
+    }
+
+    if (value->i < 0 || value->i > 49)
+    {
+        native_fail(VM_E_OPERAND, line);
+    }
+
+    exit((int)value->i);
+}
+
+int main(void)
+{
+    static char output_buffer[OUTPUT_BUFFER_SIZE];
+
+    setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    native_stack_base = malloc(STACK_INIT_SIZE * sizeof(native_value_t));
+    native_calls_base = malloc(STACK_INIT_SIZE * sizeof(void*));
+
+    if (!native_stack_base || !native_calls_base)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return VM_E_INTERNAL;
+    }
+
+    native_stack_end = native_stack_base + STACK_INIT_SIZE;
+    native_calls_end = native_calls_base + STACK_INIT_SIZE;
+
+    int result = ic21_run();
+
+    fflush(stdout);
+
+    return result;
+}
@@ -13,6 +13,7 @@
 
 #include "parser.h"
 #include "scanner.h"
+#include "lex_thread.h"
 #include "error.h"
 #include "psa.h"
 #include "symtable.h"
@@ -20,11 +21,9 @@
 #include "code_generator.h"
 #include "paramstack.h"
 #include "ids_list.h"
+#include "stats.h"
 
 #define PROLOG "ifj21"
-#define IS_NIL 1
-#define NOT_NIL 0
-#define DEF 2
 #define VALIDATE_TOKEN(token)    \
         if (!valid_token(token)) \
         {                        \
@@ -106,40 +105,7 @@ bool constant (p_data_ptr_t data);
 
 p_data_ptr_t create_data ()
 {    
-    return (p_data_ptr_t) malloc(sizeof(struct p_data));
-}
-
-void delete_data_param(function_params_t* param)
-{
-    function_params_t* current = NULL;
-
-    while (param != NULL)
-    {
-        current = param;
-        param = param->param_next;
-
-        if (current->param_name != NULL)
-        {            
-            current->param_name = NULL;
-        }
-                
-        free(current);
-        current = NULL;
-    }    
-}
-
-void delete_data_ret(function_returns_t* ret)
-{
-    function_returns_t* current = NULL;
-
-    while (ret != NULL)
-    {
-        current = ret;
-        ret = ret->ret_next;
-
-        free(current);
-        current = NULL;   
-    }    
+    return (p_data_ptr_t) calloc(1, sizeof(struct p_data));
 }
 
 void delete_tbl_list_mem(LList* tbl_list)
@@ -155,8 +121,8 @@ void delete_data (p_data_ptr_t data)
     data->func_name = NULL;
     free(data->body_func_name);
     data->body_func_name = NULL;
-    delete_data_param(data->param);
-    delete_data_ret(data->ret);
+    data->param = NULL;
+    data->ret = NULL;
     delete_ids_list(data->ids_list);    
 
     free(data);
@@ -184,7 +150,35 @@ void delete_symtable_data(symData_t** data)
 void next_token(p_data_ptr_t data)
 {
     delete_token(data->token);
-    data->token = get_next_token();
+
+    STATS_PHASE_ENTER(STATS_PHASE_LEX);
+    data->token = lex_get_token();
+    STATS_PHASE_LEAVE();
+
+    if (data->token != NULL)
+    {
+        STATS_INC(tokens);
+    }
+}
+
+/*
+ * Code of the statement which starts with the token belongs to its line
+ */
+static void source_line(p_data_ptr_t data)
+{
+    if (data->token == NULL)
+    {
+        return;
+    }
+
+    if (data->ast != NULL)
+    {
+        ast_set_line(data->ast, data->token->span.line);
+    }
+    else
+    {
+        codeGen_set_line(data->token->span.line);
+    }
 }
 
 bool valid_token (token_t* token)
@@ -194,7 +188,13 @@ bool valid_token (token_t* token)
 
 bool expression (p_data_ptr_t data)
 {
-    return psa(data);
+    bool ret_val;
+
+    STATS_PHASE_ENTER(STATS_PHASE_PSA);
+    ret_val = psa(data);
+    STATS_PHASE_LEAVE();
+
+    return ret_val;
 }
 
 /***** SYMBOL TABLE *****/
@@ -740,6 +740,54 @@ void create_tbl_list_mem (LList** tbl_list)
     }    
 }
 
+/*
+ * Assign pending values of the tree to listed identifiers, list is deleted
+ */
+static void assign_ids_ast(p_data_ptr_t data, ids_list_t** ids_list)
+{
+    uint32_t assign = ast_assign(data->ast);
+
+    for (ids_list_t* item = *ids_list; item != NULL; item = item->next)
+    {
+        ast_assign_target(data->ast, assign, item->id, item->type);
+    }
+
+    delete_ids_list(*ids_list);
+    *ids_list = NULL;
+}
+
+/*
+ * Push parameter of function call to the tree
+ */
+static void push_param_ast(p_data_ptr_t data, param_type_t param_type, param_attribute_t* param_attr)
+{
+    switch (param_type)
+    {
+    case P_ID:
+        ast_push_var(data->ast, param_attr->id, identifier_type(data->tbl_list, param_attr->id));
+        break;
+
+    case P_INT:
+        ast_push_int(data->ast, param_attr->integer);
+        break;
+
+    case P_NUMBER:
+        ast_push_number(data->ast, param_attr->number);
+        break;
+
+    case P_STR:
+        ast_push_string(data->ast, param_attr->str);
+        break;
+
+    case P_NIL:
+        ast_push_nil(data->ast);
+        break;
+
+    default:
+        break;
+    }
+}
+
 bool push_params_code_gen(p_data_ptr_t data)
 {    
     param_type_t* param_type = NULL;
@@ -767,6 +815,12 @@ bool push_params_code_gen(p_data_ptr_t data)
                                                     
     while (param_stack_pop(data->stack, param_type, param_attr))
     {        
+        if (data->ast != NULL)
+        {
+            push_param_ast(data, *param_type, param_attr);
+            continue;
+        }
+
         switch (*param_type)
         {
         case P_ID:            
@@ -907,19 +961,13 @@ void insert_built_in_functions (LList* tbl_list)
     data = NULL;
 
     tbl_list->lastElement->root = glb_tbl; 
-
-    /* -------------- CODE GEN --------------*/
-
-    codeGen_built_in_function();
-
-    /* ----------- END OF CODE GEN ----------*/
 }
 
 /******************* PARSER MAIN *******************/
 /*
- * Parser main function
+ * Parser main function, code is generated or the tree is built (ast is not NULL)
  */
-parser_error_t parser ()
+static parser_error_t parse (ast_t* ast)
 {    
     err = E_NO_ERR;
     p_data_ptr_t data;    
@@ -934,7 +982,10 @@ parser_error_t parser ()
         return PARSE_ERR;
     }
     
-    data->token = get_next_token();    
+    data->ast = ast;
+
+    data->token = NULL;
+    next_token(data);
     
     if (!valid_token(data->token))
     {                                 
@@ -985,6 +1036,19 @@ parser_error_t parser ()
     return PARSE_NO_ERR;
 }
 
+parser_error_t parser ()
+{
+    return parse(NULL);
+}
+
+/*
+ * Parser which builds the tree instead of generating code
+ */
+parser_error_t parser_build_ast (ast_t* ast)
+{
+    return parse(ast);
+}
+
 /*************** NON-TERMINALS RULES ***************/
 
 /*
@@ -1039,7 +1103,11 @@ bool prog (p_data_ptr_t data)
                 return false;
             }
 
-            codeGen_init();
+            // tree is turned into code after parsing
+            if (data->ast == NULL)
+            {
+                codeGen_init();
+            }
 
             /* ----------- END OF CODE GEN ----------*/
 
@@ -1050,6 +1118,15 @@ bool prog (p_data_ptr_t data)
 
             /* ----------- END OF SEMANTIC ----------*/    
 
+            /* -------------- CODE GEN --------------*/
+
+            if (data->ast == NULL)
+            {
+                codeGen_built_in_function();
+            }
+
+            /* ----------- END OF CODE GEN ----------*/
+
             if (main_b(data))
             {                                
                 ret_val = true;
@@ -1067,7 +1144,11 @@ bool prog (p_data_ptr_t data)
 
             /* ----------- END OF SEMANTIC ----------*/                  
             
-            generate_errorOp();
+            if (data->ast == NULL)
+            {
+                codeGen_set_line(0);
+                generate_errorOp();
+            }
         }                                
     }    
 
@@ -1096,6 +1177,7 @@ bool main_b (p_data_ptr_t data)
     unsigned nil_count = 0;    
 
     VALIDATE_TOKEN(data->token);
+    source_line(data);
 
     /* 5. <main_b> -> epsilon */
     if (data->token == NULL)
@@ -1214,7 +1296,14 @@ bool main_b (p_data_ptr_t data)
 
                 /* -------------- CODE GEN --------------*/
                  
-                codeGen_function_start(func_name);
+                if (data->ast != NULL)
+                {
+                    ast_function(data->ast, func_name);
+                }
+                else
+                {
+                    codeGen_function_start(func_name);
+                }
 
                 /* ----------- END OF CODE GEN ----------*/
 
@@ -1318,15 +1407,29 @@ bool main_b (p_data_ptr_t data)
 
                                         /* -------------- CODE GEN --------------*/
                                         
-                                        nil_count = symTableSearch(LL_GetFirst(data->tbl_list), func_name)->returns_count;
+                                        if (data->ast != NULL)
+                                        {
+                                            function_returns_t* ret = symTableSearch(LL_GetFirst(data->tbl_list), func_name)->first_ret;
 
-                                        while (nil_count > 0)
+                                            for (; ret != NULL; ret = ret->ret_next)
+                                            {
+                                                ast_return_type(data->ast, ret->return_type);
+                                            }
+
+                                            ast_function_end(data->ast);
+                                        }
+                                        else
                                         {
-                                            codeGen_push_nil();
-                                            nil_count--;
-                                        }                                        
+                                            nil_count = symTableSearch(LL_GetFirst(data->tbl_list), func_name)->returns_count;
+
+                                            while (nil_count > 0)
+                                            {
+                                                codeGen_push_nil();
+                                                nil_count--;
+                                            }                                        
 
-                                        codeGen_function_end(func_name);
+                                            codeGen_function_end(func_name);
+                                        }
 
                                         /* ----------- END OF CODE GEN ----------*/
 
@@ -1466,11 +1569,8 @@ bool main_b (p_data_ptr_t data)
                 return false;
             }
 
-            if (data->param != NULL)
-            {
-                delete_data_param(data->param);
-                data->param = NULL;
-            }            
+            // parameters are owned by the symbol table
+            data->param = NULL;            
 
             if ((param_val = symTableSearch(LL_GetFirst(data->tbl_list), data->func_name)->first_type_param) != NULL)
             {
@@ -1530,7 +1630,15 @@ bool main_b (p_data_ptr_t data)
                             params_count_code_gen = data->write_params_cnt;
                         }                                                                
 
-                        codeGen_function_call(data->func_name, params_count_code_gen);
+                        if (data->ast != NULL)
+                        {
+                            ast_call(data->ast, data->func_name, params_count_code_gen);
+                            ast_statement(data->ast);
+                        }
+                        else
+                        {
+                            codeGen_function_call(data->func_name, params_count_code_gen);
+                        }
 
                         /* ----------- END OF CODE GEN ----------*/
 
@@ -1570,6 +1678,7 @@ bool stats (p_data_ptr_t data)
 
     VALIDATE_TOKEN(data->token);
     TEST_EOF(data->token);
+    source_line(data);
 
     token_type = data->token->type;    
 
@@ -1619,7 +1728,11 @@ bool stats (p_data_ptr_t data)
 
             /* -------------- CODE GEN --------------*/
 
-            codeGen_new_var(id);                        
+            // tree gets the whole declaration once its type is known
+            if (data->ast == NULL)
+            {
+                codeGen_new_var(id);                        
+            }
 
             /* ----------- END OF CODE GEN ----------*/
 
@@ -1664,8 +1777,15 @@ bool stats (p_data_ptr_t data)
                     idInsert(&(data->ids_list), data->type, data->func_name);                    
                     
                     /* -------------- CODE GEN --------------*/
-                    codeGen_push_nil();
-                    codeGen_assign_var(data->func_name, IS_NIL);
+                    if (data->ast != NULL)
+                    {
+                        ast_local(data->ast, data->func_name, data->type);
+                    }
+                    else
+                    {
+                        codeGen_push_nil();
+                        codeGen_assign_var(data->func_name, IS_NIL);
+                    }
                     /* ----------- END OF CODE GEN ----------*/
 
                     if (assign(data))
@@ -1730,7 +1850,14 @@ bool stats (p_data_ptr_t data)
 
                 /* -------------- CODE GEN --------------*/
                  
-                codeGen_if_start();
+                if (data->ast != NULL)
+                {
+                    ast_if(data->ast);
+                }
+                else
+                {
+                    codeGen_if_start(data->condition);
+                }
 
                 /* ----------- END OF CODE GEN ----------*/
 
@@ -1756,7 +1883,14 @@ bool stats (p_data_ptr_t data)
 
                         /* -------------- CODE GEN --------------*/
                  
-                        codeGen_if_else();
+                        if (data->ast != NULL)
+                        {
+                            ast_else(data->ast);
+                        }
+                        else
+                        {
+                            codeGen_if_else();
+                        }
 
                         /* ----------- END OF CODE GEN ----------*/
 
@@ -1779,7 +1913,14 @@ bool stats (p_data_ptr_t data)
 
                                 /* -------------- CODE GEN --------------*/
                  
-                                codeGen_if_end();
+                                if (data->ast != NULL)
+                                {
+                                    ast_if_end(data->ast);
+                                }
+                                else
+                                {
+                                    codeGen_if_end();
+                                }
 
                                 /* ----------- END OF CODE GEN ----------*/
 
@@ -1801,7 +1942,14 @@ bool stats (p_data_ptr_t data)
     {        
         /* -------------- CODE GEN --------------*/
                  
-        codeGen_while_body_start();
+        if (data->ast != NULL)
+        {
+            ast_while(data->ast);
+        }
+        else
+        {
+            codeGen_while_body_start();
+        }
 
         /* ----------- END OF CODE GEN ----------*/
 
@@ -1826,7 +1974,14 @@ bool stats (p_data_ptr_t data)
 
                 /* -------------- CODE GEN --------------*/
                  
-                codeGen_while_start();
+                if (data->ast != NULL)
+                {
+                    ast_while_do(data->ast);
+                }
+                else
+                {
+                    codeGen_while_start(data->condition);
+                }
 
                 /* ----------- END OF CODE GEN ----------*/
 
@@ -1849,7 +2004,14 @@ bool stats (p_data_ptr_t data)
 
                         /* -------------- CODE GEN --------------*/
                  
-                        codeGen_while_end();
+                        if (data->ast != NULL)
+                        {
+                            ast_while_end(data->ast);
+                        }
+                        else
+                        {
+                            codeGen_while_end();
+                        }
 
                         /* ----------- END OF CODE GEN ----------*/
 
@@ -1983,11 +2145,8 @@ bool id_func (p_data_ptr_t data)
     { 
         /* -------------- SEMANTIC --------------*/           
         
-        if (data->param != NULL)
-        {
-            delete_data_param(data->param);
-            data->param = NULL;
-        }
+        // parameters are owned by the symbol table
+        data->param = NULL;
         
         if ((param_val = symTableSearch(LL_GetFirst(data->tbl_list), data->func_name)->first_type_param) != NULL)
         {
@@ -2040,7 +2199,15 @@ bool id_func (p_data_ptr_t data)
                     params_count_code_gen = data->write_params_cnt;
                 }
                 
-                codeGen_function_call(data->func_name, params_count_code_gen);
+                if (data->ast != NULL)
+                {
+                    ast_call(data->ast, data->func_name, params_count_code_gen);
+                    ast_statement(data->ast);
+                }
+                else
+                {
+                    codeGen_function_call(data->func_name, params_count_code_gen);
+                }
 
                 /* ----------- END OF CODE GEN ----------*/
 
@@ -2120,8 +2287,15 @@ bool params (p_data_ptr_t data)
 
                 /* -------------- CODE GEN --------------*/
 
-                codeGen_new_var(id);
-                codeGen_assign_var(id, NOT_NIL);
+                if (data->ast != NULL)
+                {
+                    ast_param(data->ast, id, data->type);
+                }
+                else
+                {
+                    codeGen_new_var(id);
+                    codeGen_assign_var(id, NOT_NIL);
+                }
 
                 /* ----------- END OF CODE GEN ----------*/
 
@@ -2199,8 +2373,15 @@ bool n_params (p_data_ptr_t data)
 
                     /* -------------- CODE GEN --------------*/
 
-                    codeGen_new_var(id);
-                    codeGen_assign_var(id, NOT_NIL);
+                    if (data->ast != NULL)
+                    {
+                        ast_param(data->ast, id, data->type);
+                    }
+                    else
+                    {
+                        codeGen_new_var(id);
+                        codeGen_assign_var(id, NOT_NIL);
+                    }
 
                     /* ----------- END OF CODE GEN ----------*/
 
@@ -2347,11 +2528,7 @@ bool r_vals (p_data_ptr_t data)
         glb_tbl = LL_GetFirst(data->tbl_list);
         func_data = symTableSearch(glb_tbl, data->body_func_name);        
 
-        if (data->ret != NULL)
-        {
-            delete_data_ret(data->ret);
-        }
-
+        // returns are owned by the symbol table
         data->ret = func_data->first_ret;
 
         if (data->ret != NULL)
@@ -2478,6 +2655,11 @@ bool n_vals (p_data_ptr_t data)
     } 
     else
     {
+        if (data->ast != NULL)
+        {
+            assign_ids_ast(data, &(data->ids_list));
+        }
+
         while (data->ids_list != NULL)
         {                                                                                                 
             codeGen_assign_var(get_last_id(data->ids_list), NOT_NIL);
@@ -2570,7 +2752,14 @@ bool r_n_vals (p_data_ptr_t data)
     {
         /* -------------- CODE GEN --------------*/
 
-        codeGen_function_return();
+        if (data->ast != NULL)
+        {
+            ast_return(data->ast);
+        }
+        else
+        {
+            codeGen_function_return();
+        }
 
         /* ----------- END OF CODE GEN ----------*/
        
@@ -2648,11 +2837,8 @@ bool as_vals (p_data_ptr_t data)
                 return false;
             }
 
-            if (data->param != NULL)
-            {
-                delete_data_param(data->param);
-                data->param = NULL;
-            }
+            // parameters are owned by the symbol table
+            data->param = NULL;
 
             /* For args */            
             if ((param_val = symTableSearch(LL_GetFirst(data->tbl_list), data->func_name)->first_type_param) != NULL)
@@ -2727,7 +2913,15 @@ bool as_vals (p_data_ptr_t data)
                             params_count_code_gen = data->write_params_cnt;
                         }                                                                                    
                         
-                        codeGen_function_call(data->func_name, params_count_code_gen);                                                                                                
+                        if (data->ast != NULL)
+                        {
+                            ast_call(data->ast, data->func_name, params_count_code_gen);
+                            assign_ids_ast(data, &ids_list_copy);
+                        }
+                        else
+                        {
+                            codeGen_function_call(data->func_name, params_count_code_gen);                                                                                                
+                        }
                         
                         while (ids_list_copy != NULL)
                         {                                                                                                 
@@ -2791,7 +2985,14 @@ bool ret_vals (p_data_ptr_t data)
         {
             /* -------------- CODE GEN --------------*/
 
-            codeGen_function_return();
+            if (data->ast != NULL)
+            {
+                ast_return(data->ast);
+            }
+            else
+            {
+                codeGen_function_return();
+            }
 
             /* ----------- END OF CODE GEN ----------*/
 
@@ -2843,7 +3044,14 @@ bool assign (p_data_ptr_t data)
     /* 28. <assign> -> epsilon */                
     else
     {
-        codeGen_assign_var(data->func_name, DEF);
+        if (data->ast != NULL)
+        {
+            ast_local_define(data->ast);
+        }
+        else
+        {
+            codeGen_assign_var(data->func_name, DEF);
+        }
 
         if (stats(data))
         {    
@@ -2890,7 +3098,14 @@ bool assign_val (p_data_ptr_t data)
             {
                 /* -------------- CODE GEN --------------*/
 
-                codeGen_assign_var(data->func_name, NOT_NIL);
+                if (data->ast != NULL)
+                {
+                    ast_local_init(data->ast);
+                }
+                else
+                {
+                    codeGen_assign_var(data->func_name, NOT_NIL);
+                }
 
                 /* ----------- END OF CODE GEN ----------*/
 
@@ -2937,11 +3152,8 @@ bool assign_val (p_data_ptr_t data)
                 return false;
             }
         
-            if (data->param != NULL)
-            {
-                delete_data_param(data->param);
-                data->param = NULL;
-            }                        
+            // parameters are owned by the symbol table
+            data->param = NULL;                        
 
             func_data = symTableSearch(LL_GetFirst(data->tbl_list), func_name);            
 
@@ -3027,9 +3239,17 @@ bool assign_val (p_data_ptr_t data)
                         params_count_code_gen = data->write_params_cnt;
                     }
 
-                    codeGen_function_call(data->func_name, params_count_code_gen);
+                    if (data->ast != NULL)
+                    {
+                        ast_call(data->ast, data->func_name, params_count_code_gen);
+                        ast_local_init(data->ast);
+                    }
+                    else
+                    {
+                        codeGen_function_call(data->func_name, params_count_code_gen);
                                                 
-                    codeGen_assign_var(data->ids_list->id, NOT_NIL);
+                        codeGen_assign_var(data->ids_list->id, NOT_NIL);
+                    }
 
                     free(data->ids_list->id);
                     data->ids_list->id = NULL;
@@ -3053,7 +3273,14 @@ bool assign_val (p_data_ptr_t data)
 
             /* -------------- CODE GEN --------------*/
 
-            codeGen_assign_var(data->func_name, NOT_NIL);
+            if (data->ast != NULL)
+            {
+                ast_local_init(data->ast);
+            }
+            else
+            {
+                codeGen_assign_var(data->func_name, NOT_NIL);
+            }
 
             /* ----------- END OF CODE GEN ----------*/
 
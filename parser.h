@@ -14,6 +14,7 @@
 #include "sym_linked_list.h"
 #include "paramstack.h"
 #include "ids_list.h"
+#include "ast.h"
 
 #define PARSE_NO_ERR false
 #define PARSE_ERR true
@@ -45,9 +46,13 @@ typedef struct p_data {
     param_stack* stack;
     bool return_func_body;
     bool if_while;
+    unsigned condition;     // psa rule of the condition of if or while
+
+    ast_t* ast;             // tree instead of code (multi-pass mode)
 } *p_data_ptr_t;
 
 parser_error_t parser ();
+parser_error_t parser_build_ast (ast_t* ast);
 bool check_identifier_is_defined (LList* tbl_list, char* id);
 data_type_t identifier_type (LList* tbl_list, char* id);
 void next_token(p_data_ptr_t data);
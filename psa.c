@@ -17,6 +17,7 @@
 #include "data_types.h"
 #include "error.h"
 #include "code_generator.h"
+#include "stats.h"
 
 #define P_TAB_SIZE 18
 
@@ -366,8 +367,18 @@ data_type_t get_type(p_data_ptr_t data){
     }
 }
 
+/*
+ * Pending relational operation is an operand of another one
+ */
+static void flush_condition(p_data_ptr_t data){
+    if(data->condition != NOT_A_RULE){
+        generate_operation(data->condition);
+        data->condition = NOT_A_RULE;
+    }
+}
+
 // Function for checking semantics when reducing expression
-static bool check_semantic(psa_rules_enum rule, sym_stack_item* op1, sym_stack_item* op2, sym_stack_item* op3, data_type_t* final_type){
+static bool check_semantic(p_data_ptr_t data, psa_rules_enum rule, sym_stack_item* op1, sym_stack_item* op2, sym_stack_item* op3, data_type_t* final_type){
 
     bool op1_to_number = false;
     bool op3_to_number = false;
@@ -513,6 +524,14 @@ static bool check_semantic(psa_rules_enum rule, sym_stack_item* op1, sym_stack_i
             break;
     }
 
+    if(data->ast != NULL){
+        // Operation of the tree converts its operands
+        ast_int_to_float(data->ast, op3_to_number, op1_to_number);
+        return true;
+    }
+
+    flush_condition(data);
+
     if(op1_to_number == true){
         // Generate code for retotyping (first on stack)       
         generate_IntToFloat1();
@@ -525,6 +544,48 @@ static bool check_semantic(psa_rules_enum rule, sym_stack_item* op1, sym_stack_i
     return true;
 }
 
+/*
+ * Generate code of the operation or add it to the tree. Relational
+ * operation of a condition is pending, when it is the root of the
+ * expression the branch of if or while compares its operands.
+ */
+static void generate(p_data_ptr_t data, psa_rules_enum rule, data_type_t type){
+    if(data->ast != NULL){
+        ast_operation(data->ast, rule, type);
+        return;
+    }
+
+    flush_condition(data);
+
+    if(data->if_while && rule >= NT_EQ_NT && rule <= NT_GTN_NT){
+        data->condition = rule;
+    }else{
+        generate_operation(rule);
+    }
+}
+
+/*
+ * Push constant of the token to the tree
+ */
+static void push_constant_ast(p_data_ptr_t data){
+    switch(get_type(data)){
+        case INT:
+            ast_push_int(data->ast, data->token->attribute.integer);
+        break;
+        case NUMBER:
+            ast_push_number(data->ast, data->token->attribute.decimal);
+        break;
+        case STR:
+            ast_push_string(data->ast, data->token->attribute.string);
+        break;
+        case NIL:
+            ast_push_nil(data->ast);
+        break;
+        default:
+        break;
+    }
+}
+
 psa_error_t psa (p_data_ptr_t data)
 {
     sym_stack stack;
@@ -536,6 +597,9 @@ psa_error_t psa (p_data_ptr_t data)
     sym_stack_item* a;
     bool end_while = false;
     data_type_t final_type = ELSE;
+
+    data->condition = NOT_A_RULE;
+
     do{
         // Stack token and input token
         a = symbol_stack_top_terminal(&stack);
@@ -591,6 +655,8 @@ psa_error_t psa (p_data_ptr_t data)
                 }
 
                 // Generate code
+                flush_condition(data);
+
                 // If it is an identifier, it can be a function
                 if(data->token->type == T_IDENTIFIER){
                     char* id = (char*) malloc(strlen(data->token->attribute.string) + 1);
@@ -618,10 +684,20 @@ psa_error_t psa (p_data_ptr_t data)
                     else
                     {
                         // If it's just a value, I'll run its value on the stack in the resulting code
-                        codeGen_push_var(id);  
+                        if (data->ast != NULL)
+                        {
+                            ast_push_var(data->ast, id, symbol_stack_top(&stack)->data);
+                        }
+                        else
+                        {
+                            codeGen_push_var(id);  
+                        }
                         free(id);
                         id = NULL;
                     }                                                          
+                }else if(data->ast != NULL){
+                    push_constant_ast(data);
+                    next_token(data);
                 }else{
                     switch(get_type(data)){
                         case INT:
@@ -646,6 +722,7 @@ psa_error_t psa (p_data_ptr_t data)
                 break;
             case '>': ;
                 // Reduction
+                STATS_INC(reductions);
                 // Find out how many symbols I have on the stack by <
                 sym_stack_item symbol1;
                 sym_stack_item symbol2;
@@ -709,7 +786,7 @@ psa_error_t psa (p_data_ptr_t data)
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, INT);
                         break;
                     case LBR_NT_RBR:
                         // rule E -> (E)
@@ -720,135 +797,135 @@ psa_error_t psa (p_data_ptr_t data)
                         break;
                     case NT_CONCAT_NT:
                         // rule E -> E .. E
-                        if(!check_semantic(NT_CONCAT_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_CONCAT_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){                            
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }                        
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_PLUS_NT:
                         // rule E -> E + E
-                        if(!check_semantic(NT_PLUS_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_PLUS_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){                            
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_MINUS_NT:
                         // rule E -> E - E
-                        if(!check_semantic(NT_MINUS_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_MINUS_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){                            
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_MUL_NT:
                         // rule E -> E * E
-                        if(!check_semantic(NT_MUL_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_MUL_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){                            
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_DIV_NT:
                         // rule E -> E / E
-                        if(!check_semantic(NT_DIV_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_DIV_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_IDIV_NT:
                         // rule E -> E // E
-                        if(!check_semantic(NT_IDIV_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_IDIV_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_EQ_NT:
                         // rule E -> E == E
-                        if(!check_semantic(NT_EQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_EQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_NEQ_NT:
                         // rule E -> E ~= E
-                        if(!check_semantic(NT_NEQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_NEQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){                            
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_LEQ_NT:
                         // rule E -> E <= E
-                        if(!check_semantic(NT_LEQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_LEQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){ 
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_GEQ_NT:
                         // rule E -> E >= E
-                        if(!check_semantic(NT_GEQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_GEQ_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_LTN_NT:
                         // rule E -> E < E
-                        if(!check_semantic(NT_LTN_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_LTN_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NT_GTN_NT:
                         // rule E -> E > E
-                        if(!check_semantic(NT_GTN_NT,&symbol1,&symbol2,&symbol3,&final_type)){
+                        if(!check_semantic(data, NT_GTN_NT,&symbol1,&symbol2,&symbol3,&final_type)){
                             return PSA_ERR;
                         }
                         if(!symbol_stack_push(&stack,NON_TERM,final_type)){
                             err = E_INTERNAL;
                             return PSA_ERR;
                         }
-                        generate_operation(rule);
+                        generate(data, rule, final_type);
                         break;
                     case NOT_A_RULE:                      
                         err = E_SYNTAX;
@@ -878,7 +955,11 @@ psa_error_t psa (p_data_ptr_t data)
     if(symbol_stack_top(&stack)->symbol == NON_TERM)
     {        
         if (data->if_while == true && symbol_stack_top(&stack)->data != ELSE){
-            generate_toBool();
+            if (data->ast != NULL){
+                ast_to_bool(data->ast);
+            }else{
+                data->condition = OPERAND;
+            }
         }
         data->psa_data_type = symbol_stack_top(&stack)->data;
         symbol_stack_free(&stack);
@@ -11,7 +11,11 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,9 +27,180 @@
 
 #define ASCII_PRINTABLE 32
 #define ASCII_NUMS_START 48
+#define SOURCE_CHUNK 4096
+#define EOF_CHAR ((char)EOF)        // byte 0xff ends the input as EOF does
 
-error_t err;
+// skip loops use SSE2 (AVX2 when the CPU has it), plain loop otherwise
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(SCANNER_NO_SIMD)
+#define SCANNER_SIMD
+#include <immintrin.h>
+#endif
 
+#define MANTISSA_DIGITS 19          // decimal digits which always fit uint64_t
+#define EXACT_MANTISSA (1ull << 53) // integers exactly representable in double
+#define EXACT_POW10 22              // powers of ten exactly representable in double
+#define MAX_EXPONENT 100000         // bigger exponents saturate
+
+_Thread_local error_t err;
+
+/*
+ * Source program in memory, stdin is read whole on the first request,
+ * the buffer read by the scanner is freed when the source is replaced
+ */
+static const char* source = NULL;
+static size_t source_len = 0;
+static size_t source_pos = 0;
+static char* loaded_source = NULL;
+
+/*
+ * Line of the character at line_pos, lines are counted only between
+ * tokens and inside them when their spans are set
+ */
+static size_t line_pos = 0;
+static size_t line_start = 0;
+static unsigned line_no = 1;
+
+void set_source_buffer (const char* data, size_t len)
+{
+    free(loaded_source);
+    loaded_source = NULL;
+
+    source = data;
+    source_len = len;
+    source_pos = 0;
+    line_pos = 0;
+    line_start = 0;
+    line_no = 1;
+}
+
+bool source_exhausted ()
+{
+    return source != NULL && source_pos >= source_len;
+}
+
+static bool load_source ()
+{
+    size_t cap = SOURCE_CHUNK;
+    size_t len = 0;
+    char* data = malloc(cap);
+
+    for (size_t n; data && (n = fread(data + len, 1, cap - len, stdin)) > 0;)
+    {
+        len += n;
+
+        if (len == cap)
+        {
+            char* tmp = realloc(data, cap * 2);
+
+            if (!tmp)
+            {
+                free(data);
+                return false;
+            }
+
+            data = tmp;
+            cap *= 2;
+        }
+    }
+
+    set_source_buffer(data, len);
+    loaded_source = data;
+
+    return data != NULL;
+}
+
+static inline int next_char ()
+{
+    return source_pos < source_len ? (unsigned char)source[source_pos++] : EOF;
+}
+
+static inline void unget_char ()
+{
+    source_pos--;
+}
+
+/*
+ * Skip loops over the source buffer. They return position of the first
+ * character equal to a or b (or less than ASCII_PRINTABLE as signed char
+ * if control is set), source_len if there is none.
+ */
+static size_t skip_scalar (size_t pos, char a, char b, bool control)
+{
+    for (; pos < source_len; pos++)
+    {
+        char c = source[pos];
+
+        if (c == a || c == b || (control && c < ASCII_PRINTABLE))
+        {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+#ifdef SCANNER_SIMD
+static size_t skip_sse2 (size_t pos, char a, char b, bool control)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(control ? ASCII_PRINTABLE : CHAR_MIN);
+
+    for (; pos + 16 <= source_len; pos += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(source + pos));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                   _mm_cmplt_epi8(v, vc));
+        int mask = _mm_movemask_epi8(hit);
+
+        if (mask != 0)
+        {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+
+    return skip_scalar(pos, a, b, control);
+}
+
+__attribute__((target("avx2")))
+static size_t skip_avx2 (size_t pos, char a, char b, bool control)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(control ? ASCII_PRINTABLE : CHAR_MIN);
+
+    for (; pos + 32 <= source_len; pos += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(source + pos));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                      _mm256_cmpgt_epi8(vc, v));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+
+        if (mask != 0)
+        {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+
+    return skip_scalar(pos, a, b, control);
+}
+#endif
+
+static size_t skip (size_t pos, char a, char b, bool control)
+{
+#ifdef SCANNER_SIMD
+    static size_t (*skip_impl) (size_t, char, char, bool) = NULL;
+
+    if (!skip_impl)
+    {
+        skip_impl = __builtin_cpu_supports("avx2") ? skip_avx2 : skip_sse2;
+    }
+
+    return skip_impl(pos, a, b, control);
+#else
+    return skip_scalar(pos, a, b, control);
+#endif
+}
 
 void set_id_keyword (token_t* token, char* str){
     if(strcmp(str,"do") == 0){
@@ -78,9 +253,136 @@ void set_id_keyword (token_t* token, char* str){
     }
 }
 
+/**
+ * @struct Value of numeric literal accumulated while the digits are read.
+ *         Literal is mantissa * 10^(exponent + exp_value * sign).
+ */
+typedef struct number
+{
+    int integer;            /// Value of the integer part.
+    bool int_overflow;      /// Integer part does not fit int.
+    uint64_t mantissa;      /// First MANTISSA_DIGITS significant digits.
+    int digits;             /// Count of digits in mantissa.
+    int exponent;           /// Exponent implied by the digits.
+    bool exact;             /// No significant digit was dropped.
+    int exp_value;          /// Value of the explicit exponent.
+    bool exp_negative;
+} number_t;
+
+static const double pow10_table[EXACT_POW10 + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Digit of the integer part (fraction == false) or of the fraction
+ */
+static void number_digit (number_t* number, char symbol, bool fraction)
+{
+    int digit = symbol - ASCII_NUMS_START;
+
+    if (!fraction)
+    {
+        if (number->integer > (INT_MAX - digit) / 10)
+        {
+            number->int_overflow = true;
+        }
+        else
+        {
+            number->integer = number->integer * 10 + digit;
+        }
+    }
+
+    if (number->digits == 0 && digit == 0)
+    {
+        // leading zeros are not significant
+        number->exponent -= fraction;
+    }
+    else if (number->digits < MANTISSA_DIGITS)
+    {
+        number->mantissa = number->mantissa * 10 + digit;
+        number->digits++;
+        number->exponent -= fraction;
+    }
+    else
+    {
+        number->exact &= digit == 0;
+        number->exponent += !fraction;
+    }
+}
+
+static void number_exp_digit (number_t* number, char symbol)
+{
+    if (number->exp_value < MAX_EXPONENT)
+    {
+        number->exp_value = number->exp_value * 10 + (symbol - ASCII_NUMS_START);
+    }
+}
+
+/*
+ * Value of decimal literal. Short literals are converted exactly by one
+ * multiplication or division of exactly representable numbers, the rest
+ * is left to strtod on the lexeme (numeric literals contain no locale
+ * dependent characters and the compiler runs in the "C" locale).
+ *
+ * @return False if the literal is out of range of double.
+ */
+static bool number_decimal (number_t* number, string_ptr_t lexeme, double* value)
+{
+    int exponent = number->exponent +
+                   (number->exp_negative ? -number->exp_value : number->exp_value);
+
+    if (number->mantissa == 0)
+    {
+        *value = 0.0;
+        return true;
+    }
+
+    if (number->exact && number->mantissa <= EXACT_MANTISSA &&
+        exponent >= -EXACT_POW10 && exponent <= EXACT_POW10)
+    {
+        *value = exponent < 0 ? (double)number->mantissa / pow10_table[-exponent]
+                              : (double)number->mantissa * pow10_table[exponent];
+        return true;
+    }
+
+    errno = 0;
+    *value = strtod(get_char_arr(lexeme), NULL);
+
+    // subnormal numbers are fine, overflow and underflow to zero are not
+    return errno != ERANGE || (*value != 0.0 && *value <= DBL_MAX);
+}
+
+static void advance_line (size_t pos)
+{
+    const char* newline;
+
+    while (line_pos < pos && (newline = memchr(source + line_pos, '\n', pos - line_pos)) != NULL)
+    {
+        line_no++;
+        line_pos = line_start = (size_t)(newline - source) + 1;
+    }
+
+    line_pos = pos;
+}
+
+/*
+ * Span of the token from start to the character before end
+ */
+static void set_span (token_t* token, size_t start, size_t end)
+{
+    advance_line(start);
+    token->span.line = line_no;
+    token->span.column = (unsigned)(start - line_start) + 1;
+
+    advance_line(end - 1);
+    token->span.end_line = line_no;
+    token->span.end_column = (unsigned)(end - 1 - line_start) + 1;
+}
+
 token_t* create_token ()
 {    
-    return (token_t*) malloc(sizeof(token_t));
+    return (token_t*) calloc(1, sizeof(token_t));
 }
 
 void delete_token (token_t* token)
@@ -99,15 +401,26 @@ void delete_token (token_t* token)
     token = NULL;
 }
 
-token_t* get_next_token ()
+/*
+ * Scan one token, start is the position of its first character
+ */
+static token_t* scan_token (size_t* start)
 {
     char symbol;
     token_t* token;        
     string_ptr_t str = NULL;
     state_t state = S_INIT;    
     bool f_state = true;
+    number_t number = { .exact = true };
     
     err = E_NO_ERR;
+
+    if (!source && !load_source())
+    {
+        err = E_INTERNAL;
+        return NULL;
+    }
+
     token = create_token();
 
     if (!token)
@@ -124,8 +437,14 @@ token_t* get_next_token ()
         return NULL;
     }
     
-    while ((symbol = (char)getc(stdin)) != EOF)
-    {                         
+    while ((symbol = (char)next_char()) != EOF)
+    {
+        // the last character read in the initial state starts the token
+        if (state == S_INIT)
+        {
+            *start = source_pos - 1;
+        }
+
         switch (state)
         {            
             //**************** INIT STATE ****************//            
@@ -212,6 +531,7 @@ token_t* get_next_token ()
                 else if (isdigit(symbol))
                 {                    
                     state = S_INT;
+                    number_digit(&number, symbol, false);
 
                     if (!string_append_character(str, symbol))
                     {
@@ -270,6 +590,10 @@ token_t* get_next_token ()
                     f_state = true;
                     state = S_INIT;
                 }                
+                else
+                {
+                    source_pos = skip(source_pos, '\n', EOF_CHAR, false);
+                }
 
                 break; 
 
@@ -290,6 +614,10 @@ token_t* get_next_token ()
                 {
                     state = S_RIGHT_SQUARE_BRACKET;
                 }
+                else
+                {
+                    source_pos = skip(source_pos, ']', EOF_CHAR, false);
+                }
 
                 break;
 
@@ -348,6 +676,7 @@ token_t* get_next_token ()
                 {
                     f_state = true;
                     state = S_DECIMAL;
+                    number_digit(&number, symbol, true);
                     
                     if (!string_append_character(str, symbol))
                     {
@@ -373,6 +702,7 @@ token_t* get_next_token ()
                 if (symbol == '+' || symbol == '-')
                 {
                     state = S_EXP_PLUS_MINUS;
+                    number.exp_negative = symbol == '-';
                     
                     if (!string_append_character(str, symbol))
                     {
@@ -387,6 +717,7 @@ token_t* get_next_token ()
                 {
                     f_state = true;
                     state = S_DECIMAL_W_EXP;
+                    number_exp_digit(&number, symbol);
                     
                     if (!string_append_character(str, symbol))
                     {
@@ -413,6 +744,7 @@ token_t* get_next_token ()
                 {
                     f_state = true;
                     state = S_DECIMAL_W_EXP;
+                    number_exp_digit(&number, symbol);
                     
                     if (!string_append_character(str, symbol))
                     {
@@ -485,6 +817,23 @@ token_t* get_next_token ()
                     return NULL;
                 }
 
+                if (state == S_STRING_CONTENT)
+                {
+                    // plain characters up to the next '"', '\\' or control character
+                    size_t end = skip(source_pos, '"', '\\', true);
+
+                    if (!string_append_string(str, source + source_pos, end - source_pos))
+                    {
+                        err = E_INTERNAL;
+                        delete_token(token);
+                        string_free(str);
+
+                        return NULL;
+                    }
+
+                    source_pos = end;
+                }
+
                 break;
 
             case (S_ESC_SEQ_BACKSLASH):
@@ -696,14 +1045,7 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
-                    {
-                        err = E_INTERNAL;
-                        delete_token(token);
-                        string_free(str);
-
-                        return NULL;
-                    }                    
+                    unget_char();
 
                     token->type = T_DIV;
                     string_free(str);                                        
@@ -721,14 +1063,7 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
-                    {
-                        err = E_INTERNAL;
-                        delete_token(token);
-                        string_free(str);
-
-                        return NULL;
-                    }
+                    unget_char();
 
                     token->type = T_MINUS;
                     string_free(str);                    
@@ -748,14 +1083,7 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
-                    {
-                        err = E_INTERNAL;
-                        delete_token(token);
-                        string_free(str);
-
-                        return NULL;
-                    }
+                    unget_char();
 
                     token->type = T_LESS_THAN;
                     string_free(str);                    
@@ -775,14 +1103,7 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
-                    {
-                        err = E_INTERNAL;
-                        delete_token(token);
-                        string_free(str);
-
-                        return NULL;
-                    }
+                    unget_char();
 
                     token->type = T_GTR_THAN;
                     string_free(str);                    
@@ -802,14 +1123,7 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
-                    {
-                        err = E_INTERNAL;
-                        delete_token(token);
-                        string_free(str);
-
-                        return NULL;
-                    }
+                    unget_char();
 
                     token->type = T_ASSIGN;
                     string_free(str);                    
@@ -850,6 +1164,8 @@ token_t* get_next_token ()
                 }
                 else if (isdigit(symbol))
                 {
+                    number_digit(&number, symbol, false);
+
                     if (!string_append_character(str, symbol))
                     {
                         err = E_INTERNAL;
@@ -861,9 +1177,11 @@ token_t* get_next_token ()
                 }                
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
+                    unget_char();
+
+                    if (number.int_overflow)
                     {
-                        err = E_INTERNAL;
+                        err = E_LEX;
                         delete_token(token);
                         string_free(str);
 
@@ -871,7 +1189,7 @@ token_t* get_next_token ()
                     }
 
                     token->type = T_INT;                                        
-                    token->attribute.integer = string_to_int(str);                    
+                    token->attribute.integer = number.integer;
                     
                     string_free(str);
                                         
@@ -896,6 +1214,8 @@ token_t* get_next_token ()
                 }
                 else if (isdigit(symbol))
                 {
+                    number_digit(&number, symbol, true);
+
                     if (!string_append_character(str, symbol))
                     {
                         err = E_INTERNAL;
@@ -907,18 +1227,19 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
+                    unget_char();
+
+                    token->type = T_DECIMAL;                    
+
+                    if (!number_decimal(&number, str, &token->attribute.decimal))
                     {
-                        err = E_INTERNAL;
+                        err = E_LEX;
                         delete_token(token);
                         string_free(str);
 
                         return NULL;
                     }
 
-                    token->type = T_DECIMAL;                    
-                    token->attribute.decimal = string_to_dec(str);                    
-
                     string_free(str);                    
 
                     return token;
@@ -940,14 +1261,7 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
-                    {
-                        err = E_INTERNAL;
-                        delete_token(token);
-                        string_free(str);
-
-                        return NULL;
-                    }                                     
+                    unget_char();
                     
                     char* id_keyword = get_char_arr(str);                    
 
@@ -979,6 +1293,8 @@ token_t* get_next_token ()
             case (S_DECIMAL_W_EXP):
                 if (isdigit(symbol))
                 {
+                    number_exp_digit(&number, symbol);
+
                     if (!string_append_character(str, symbol))
                     {
                         err = E_INTERNAL;
@@ -990,18 +1306,19 @@ token_t* get_next_token ()
                 }
                 else
                 {
-                    if (ungetc(symbol, stdin) == EOF)
+                    unget_char();
+
+                    token->type = T_DECIMAL_W_EXP;
+
+                    if (!number_decimal(&number, str, &token->attribute.decimal))
                     {
-                        err = E_INTERNAL;
+                        err = E_LEX;
                         delete_token(token);
                         string_free(str);
 
                         return NULL;
                     }
 
-                    token->type = T_DECIMAL_W_EXP;
-                    token->attribute.decimal = string_to_dec(str);                    
-
                     string_free(str);                    
 
                     return token;
@@ -1021,3 +1338,16 @@ token_t* get_next_token ()
 
     return NULL;
 }
+
+token_t* get_next_token ()
+{
+    size_t start = 0;
+    token_t* token = scan_token(&start);
+
+    if (token != NULL)
+    {
+        set_span(token, start, source_pos);
+    }
+
+    return token;
+}
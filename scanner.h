@@ -12,6 +12,8 @@
 #define IFJ_BRATWURST2021_SCANNER_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 
 typedef enum state {
@@ -102,12 +104,27 @@ typedef union attribute
     keyword_t keyword;
 } attribute_t;
 
+/*
+ * Position of the token in the source, lines and columns count from 1,
+ * the end is the last character of the token
+ */
+typedef struct token_span
+{
+    unsigned line;
+    unsigned column;
+    unsigned end_line;
+    unsigned end_column;
+} token_span_t;
+
 typedef struct struct_token
 {
     token_type_t type;
     attribute_t attribute;
+    token_span_t span;
 } token_t;
 
+void set_source_buffer (const char* data, size_t len);
+bool source_exhausted ();
 void delete_token (token_t* token);
 token_t* get_next_token ();
 
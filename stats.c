@@ -0,0 +1,215 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Compile time statistics (per-phase timing and counters)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define PHASE_STACK_SIZE 16
+#define NS_IN_MS 1000000.0
+
+static const char* phase_names[STATS_PHASE_COUNT] = {
+    "parse",
+    "lex",
+    "psa",
+    "emit",
+    "gen"
+};
+
+#ifdef IFJ21_STATS
+
+stats_t compiler_stats;
+
+static stats_phase_t phase_stack[PHASE_STACK_SIZE];
+static int phase_top = -1;
+static uint64_t phase_switch_ns = 0;
+static uint64_t start_ns = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Charge time since last phase switch to the active phase
+ */
+static void phase_account(uint64_t now)
+{
+    if (phase_top >= 0)
+    {
+        compiler_stats.phase_ns[phase_stack[phase_top]] += now - phase_switch_ns;
+    }
+
+    phase_switch_ns = now;
+}
+
+void stats_start()
+{
+    start_ns = now_ns();
+    phase_switch_ns = start_ns;
+    phase_top = 0;
+    phase_stack[phase_top] = STATS_PHASE_PARSE;
+}
+
+void stats_stop()
+{
+    uint64_t now = now_ns();
+    struct rusage usage;
+
+    phase_account(now);
+    phase_top = -1;
+    compiler_stats.total_ns = now - start_ns;
+
+    // ru_maxrss is in kilobytes on Linux
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        compiler_stats.peak_rss_kb = (uint64_t)usage.ru_maxrss;
+    }
+}
+
+void stats_phase_enter(stats_phase_t phase)
+{
+    if (phase_top < 0 || phase_top + 1 >= PHASE_STACK_SIZE)
+    {
+        return;
+    }
+
+    phase_account(now_ns());
+    phase_stack[++phase_top] = phase;
+}
+
+void stats_phase_leave()
+{
+    if (phase_top <= 0)
+    {
+        return;
+    }
+
+    phase_account(now_ns());
+    phase_top--;
+}
+
+/*
+ * Allocation counters, the build links with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    compiler_stats.allocs++;
+    compiler_stats.alloc_bytes += size;
+
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    compiler_stats.allocs++;
+    compiler_stats.alloc_bytes += nmemb * size;
+
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    compiler_stats.allocs++;
+    compiler_stats.alloc_bytes += size;
+
+    return __real_realloc(ptr, size);
+}
+
+void stats_print(FILE* file, stats_format_t format)
+{
+    if (format == STATS_JSON)
+    {
+        fprintf(file, "{\"phases_ms\": {");
+
+        for (int i = 0; i < STATS_PHASE_COUNT; i++)
+        {
+            fprintf(file, "\"%s\": %.3f, ", phase_names[i], compiler_stats.phase_ns[i] / NS_IN_MS);
+        }
+
+        fprintf(file, "\"total\": %.3f}, ", compiler_stats.total_ns / NS_IN_MS);
+        fprintf(file, "\"tokens\": %lu, ", (unsigned long)compiler_stats.tokens);
+        fprintf(file, "\"reductions\": %lu, ", (unsigned long)compiler_stats.reductions);
+        fprintf(file, "\"symtable\": {\"lookups\": %lu, \"probes\": %lu, \"max_depth\": %lu}, ",
+                (unsigned long)compiler_stats.sym_lookups,
+                (unsigned long)compiler_stats.sym_probes,
+                (unsigned long)compiler_stats.sym_max_depth);
+        fprintf(file, "\"allocations\": {\"count\": %lu, \"bytes\": %lu}, ",
+                (unsigned long)compiler_stats.allocs,
+                (unsigned long)compiler_stats.alloc_bytes);
+        fprintf(file, "\"emitted_bytes\": %lu, ", (unsigned long)compiler_stats.emitted_bytes);
+        fprintf(file, "\"ast\": {\"nodes\": %lu, \"bytes\": %lu}, ",
+                (unsigned long)compiler_stats.ast_nodes,
+                (unsigned long)compiler_stats.ast_bytes);
+        fprintf(file, "\"peak_rss_kb\": %lu}\n", (unsigned long)compiler_stats.peak_rss_kb);
+    }
+    else
+    {
+        fprintf(file, "---- IFJ21 compiler statistics ----\n");
+
+        for (int i = 0; i < STATS_PHASE_COUNT; i++)
+        {
+            fprintf(file, "%-18s %10.3f ms\n", phase_names[i], compiler_stats.phase_ns[i] / NS_IN_MS);
+        }
+
+        fprintf(file, "%-18s %10.3f ms\n", "total", compiler_stats.total_ns / NS_IN_MS);
+        fprintf(file, "%-18s %10lu\n", "tokens", (unsigned long)compiler_stats.tokens);
+        fprintf(file, "%-18s %10lu\n", "reductions", (unsigned long)compiler_stats.reductions);
+        fprintf(file, "%-18s %10lu\n", "symtable lookups", (unsigned long)compiler_stats.sym_lookups);
+        fprintf(file, "%-18s %10lu\n", "symtable probes", (unsigned long)compiler_stats.sym_probes);
+        fprintf(file, "%-18s %10lu\n", "symtable depth", (unsigned long)compiler_stats.sym_max_depth);
+        fprintf(file, "%-18s %10lu\n", "allocations", (unsigned long)compiler_stats.allocs);
+        fprintf(file, "%-18s %10lu\n", "allocated bytes", (unsigned long)compiler_stats.alloc_bytes);
+        fprintf(file, "%-18s %10lu\n", "emitted bytes", (unsigned long)compiler_stats.emitted_bytes);
+        fprintf(file, "%-18s %10lu\n", "ast nodes", (unsigned long)compiler_stats.ast_nodes);
+        fprintf(file, "%-18s %10lu\n", "ast bytes", (unsigned long)compiler_stats.ast_bytes);
+        fprintf(file, "%-18s %10lu kB\n", "peak rss", (unsigned long)compiler_stats.peak_rss_kb);
+    }
+}
+
+#else
+
+void stats_start()
+{
+}
+
+void stats_stop()
+{
+}
+
+void stats_phase_enter(stats_phase_t phase)
+{
+    (void)phase;
+}
+
+void stats_phase_leave()
+{
+}
+
+void stats_print(FILE* file, stats_format_t format)
+{
+    (void)format;
+    (void)phase_names;
+
+    fprintf(file, "Statistics are not compiled in, build the compiler with 'make STATS=1'.\n");
+}
+
+#endif // IFJ21_STATS
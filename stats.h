@@ -0,0 +1,113 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Compile time statistics (per-phase timing and counters)
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_STATS_H
+#define IFJ_BRATWURST2021_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @enum Compiler phases which are timed separately. Times are exclusive,
+ *       e.g. time of get_next_token called from psa() is accounted to lexer.
+ */
+typedef enum stats_phase
+{
+    STATS_PHASE_PARSE,  // recursive descent (prog, stats, ...)
+    STATS_PHASE_LEX,    // get_next_token
+    STATS_PHASE_PSA,    // precedence analysis of expressions
+    STATS_PHASE_EMIT,   // formatting and writing of IFJcode21
+    STATS_PHASE_GEN,    // code generation from the tree (--ast)
+    STATS_PHASE_COUNT
+} stats_phase_t;
+
+/**
+ * @enum Format of the statistics report.
+ */
+typedef enum stats_format
+{
+    STATS_TEXT,
+    STATS_JSON
+} stats_format_t;
+
+/**
+ * @struct Counters collected during one compilation.
+ */
+typedef struct stats
+{
+    uint64_t phase_ns[STATS_PHASE_COUNT]; /// Exclusive wall time of phases.
+    uint64_t total_ns;                    /// Wall time of whole compilation.
+    uint64_t tokens;                      /// Tokens returned by scanner.
+    uint64_t reductions;                  /// Reductions done by psa().
+    uint64_t sym_lookups;                 /// Calls of symTableSearch.
+    uint64_t sym_probes;                  /// Tree nodes visited by lookups.
+    uint64_t sym_max_depth;               /// Deepest node visited by lookup.
+    _Atomic uint64_t allocs;              /// Count of malloc/calloc/realloc (all threads).
+    _Atomic uint64_t alloc_bytes;         /// Bytes requested by allocations (all threads).
+    uint64_t emitted_bytes;               /// Bytes of generated IFJcode21.
+    uint64_t ast_nodes;                   /// Nodes of the tree (--ast).
+    uint64_t ast_bytes;                   /// Memory held by the tree (--ast).
+    uint64_t peak_rss_kb;                 /// Peak resident set size of the process.
+} stats_t;
+
+#ifdef IFJ21_STATS
+
+extern stats_t compiler_stats;
+
+#define STATS_ENABLED true
+#define STATS_INC(counter)        (compiler_stats.counter++)
+#define STATS_ADD(counter, n)     (compiler_stats.counter += (uint64_t)(n))
+#define STATS_MAX(counter, n)                              \
+        (compiler_stats.counter = ((uint64_t)(n) > compiler_stats.counter) ? \
+                         (uint64_t)(n) : compiler_stats.counter)
+#define STATS_PHASE_ENTER(phase)  stats_phase_enter(phase)
+#define STATS_PHASE_LEAVE()       stats_phase_leave()
+
+#else
+
+#define STATS_ENABLED false
+#define STATS_INC(counter)        ((void)0)
+#define STATS_ADD(counter, n)     ((void)0)
+#define STATS_MAX(counter, n)     ((void)0)
+#define STATS_PHASE_ENTER(phase)  ((void)0)
+#define STATS_PHASE_LEAVE()       ((void)0)
+
+#endif // IFJ21_STATS
+
+/**
+ * Start measuring of the compilation, current phase is set to parser.
+ */
+void stats_start();
+
+/**
+ * Stop measuring of the compilation.
+ */
+void stats_stop();
+
+/**
+ * Switch to the nested phase. Time since last switch is accounted
+ * to the phase which was active until now.
+ *
+ * @param phase Entered phase.
+ */
+void stats_phase_enter(stats_phase_t phase);
+
+/**
+ * Return to the phase which was active before the last stats_phase_enter.
+ */
+void stats_phase_leave();
+
+/**
+ * Print collected statistics.
+ *
+ * @param file Output stream (generated code is on stdout, so use stderr).
+ * @param format Text or JSON report.
+ */
+void stats_print(FILE* file, stats_format_t format);
+
+#endif //IFJ_BRATWURST2021_STATS_H
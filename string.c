@@ -11,6 +11,7 @@
 #include "string.h"
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define ALLOCATE_LENGTH 8
 
@@ -45,17 +46,26 @@ bool string_append_character(string_ptr_t string, char a){
     return true;
 }
 
-char* get_char_arr(string_ptr_t string)
-{
-    return string->string;
-}
-
-int string_to_int (string_ptr_t string)
-{
-    return atoi(string->string);
+bool string_append_string(string_ptr_t string, const char* a, unsigned len){
+    if (string->lenght + len >= string->alloc_lenght){
+        unsigned alloc = string->alloc_lenght == 0 ? ALLOCATE_LENGTH : string->alloc_lenght;
+        while (string->lenght + len >= alloc){
+            alloc *= 2;
+        }
+        char* tmp = (char *) realloc(string->string, alloc);
+        if (!tmp){
+            return false;
+        }
+        string->string = tmp;
+        string->alloc_lenght = alloc;
+    }
+    memcpy(string->string + string->lenght, a, len);
+    string->lenght += len;
+    string->string[string->lenght] = '\0';
+    return true;
 }
 
-double string_to_dec (string_ptr_t string)
+char* get_char_arr(string_ptr_t string)
 {
-    return atof(string->string);
+    return string->string;
 }
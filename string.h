@@ -49,31 +49,24 @@ void string_free(string_ptr_t string);
 bool string_append_character(string_ptr_t string, char a);
 
 /**
- * Get parametr of struct and returned pointer of char.
+ * Append len characters at once.
  *
  * @param string Pointer to string.
- * @return Pointer to string.
- *
- */
-char* get_char_arr(string_ptr_t string);
-
-/**
- * String from struct parse to int.
- *
- * @param string Pointer to string.
- * @return Parse string to int value.
+ * @param a Characters that we append.
+ * @param len Count of characters.
+ * @return True if append was successful, false otherwise.
  *
  */
-int string_to_int (string_ptr_t string);
+bool string_append_string(string_ptr_t string, const char* a, unsigned len);
 
 /**
- * String from struct parse to double.
+ * Get parametr of struct and returned pointer of char.
  *
  * @param string Pointer to string.
- * @return Parse string to double value.
+ * @return Pointer to string.
  *
  */
-double string_to_dec (string_ptr_t string);
+char* get_char_arr(string_ptr_t string);
 
 #endif //IFJ_BRATWURST2021_STRING_H
 
@@ -10,6 +10,7 @@
  */
 
 #include "symtable.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -198,8 +199,20 @@ void returnInsert(symData_t* data, data_type_t type){
 }
 
 symData_t* symTableSearch(symTree_t* tree, char* key){       
+#ifdef IFJ21_STATS
+    unsigned depth = 0;
+#endif
+
+    STATS_INC(sym_lookups);
+
     while(tree != NULL && tree->key != NULL){    
+        STATS_INC(sym_probes);
+#ifdef IFJ21_STATS
+        depth++;
+#endif
+
         if(strcmp(tree->key, key) == 0){        
+            STATS_MAX(sym_max_depth, depth);
             
             return tree->data;
         }
@@ -211,6 +224,8 @@ symData_t* symTableSearch(symTree_t* tree, char* key){
         }
     }
     
+    STATS_MAX(sym_max_depth, depth);
+
     return NULL;
 }
 
@@ -261,6 +276,10 @@ void symTableInsert(symTree_t **tree, char* key, symData_t* data){
     (*tree)->data->params_type_count = data->params_type_count;
     (*tree)->data->returns_def_count = data->returns_def_count;
     (*tree)->data->returns_count = data->returns_count;
+    (*tree)->data->first_param = NULL;
+    (*tree)->data->first_type_param = NULL;
+    (*tree)->data->first_def_ret = NULL;
+    (*tree)->data->first_ret = NULL;
            
     deep_copy_function_param((*tree)->data, data->first_param);
     deep_copy_function_type_param((*tree)->data, data->first_type_param);
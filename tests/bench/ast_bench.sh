@@ -0,0 +1,91 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Benchmark of the multi-pass compilation - every workload is
+#          compiled in single pass and with --ast, best time and peak
+#          resident memory of both modes are compared, --jobs=JOBS shows
+#          the speedup of parallel code generation over --ast. One JSON
+#          record per run is appended to results file.
+#
+# Usage:   ast_bench.sh [compiler] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-./compiler-stats}
+RESULTS=${2:-ast_bench_results.json}
+GENERATOR=./bench-gen
+REPEAT=${REPEAT:-3}
+JOBS=${JOBS:-4}
+
+# Workload scales, override e.g. with SCALES_expr="100 1000"
+SCALES_expr=${SCALES_expr:-"1000 5000 20000"}
+SCALES_functions=${SCALES_functions:-"500 2000 5000"}
+SCALES_strings=${SCALES_strings:-"100 1000 5000"}
+SCALES_nested=${SCALES_nested:-"50 200 500"}
+SCALES_globals=${SCALES_globals:-"500 2000 5000"}
+
+make_workdir
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+value() {
+    echo "$1" | grep -o "\"$2\": [0-9.]*" | head -1 | cut -d' ' -f2
+}
+
+# Run one mode REPEAT times, prints best total_ms, peak_rss_kb and ast bytes
+measure() {
+    local program=$1 workload=$2 scale=$3 mode=$4
+    local best_ms="" best_rss="" ast_bytes=0
+
+    for run in $(seq 1 "$REPEAT"); do
+        stats=$("$COMPILER" --no-cache $mode --stats=json < "$program" 2>&1 >/dev/null)
+        ret=$?
+
+        echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"workload\": \"$workload\", \"scale\": $scale, \"mode\": \"${mode:-single}\", \"run\": $run, \"return\": $ret, \"stats\": $stats}" >> "$RESULTS"
+
+        ms=$(value "$stats" total)
+        rss=$(value "$stats" peak_rss_kb)
+        ast_bytes=$(echo "$stats" | grep -o '"ast": {"nodes": [0-9]*, "bytes": [0-9]*' | grep -o '[0-9]*$')
+
+        if [ -z "$best_ms" ] || awk "BEGIN { exit !($ms < $best_ms) }"; then
+            best_ms=$ms
+        fi
+
+        if [ -z "$best_rss" ] || [ "$rss" -lt "$best_rss" ]; then
+            best_rss=$rss
+        fi
+    done
+
+    echo "$best_ms $best_rss $((ast_bytes / 1024)) $ret"
+}
+
+printf "%-10s %7s %12s %12s %12s %12s %12s %10s %8s %8s %8s\n" \
+       workload scale single_ms ast_ms jobs_ms single_kB ast_kB tree_kB time mem jobs
+
+for workload in $("$GENERATOR" --list); do
+    scales_var="SCALES_$workload"
+
+    for scale in ${!scales_var}; do
+        program="$WORKDIR/$workload-$scale.tl"
+        "$GENERATOR" "$workload" "$scale" > "$program"
+
+        read -r single_ms single_rss _ single_ret < <(measure "$program" "$workload" "$scale" "")
+        read -r ast_ms ast_rss tree_kb ast_ret < <(measure "$program" "$workload" "$scale" "--ast")
+        read -r jobs_ms _ _ _ < <(measure "$program" "$workload" "$scale" "--jobs=$JOBS")
+
+        printf "%-10s %7s %12s %12s %12s %12s %12s %10s %7.2fx %7.2fx %7.2fx" \
+               "$workload" "$scale" "$single_ms" "$ast_ms" "$jobs_ms" "$single_rss" "$ast_rss" "$tree_kb" \
+               "$(awk "BEGIN { print $ast_ms / ($single_ms > 0 ? $single_ms : 1) }")" \
+               "$(awk "BEGIN { print $ast_rss / ($single_rss > 0 ? $single_rss : 1) }")" \
+               "$(awk "BEGIN { print $ast_ms / ($jobs_ms > 0 ? $jobs_ms : 1) }")"
+        [ "$single_ret" -ne "$ast_ret" ] && printf "   (return %s vs %s)" "$single_ret" "$ast_ret"
+        printf "\n"
+    done
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
@@ -0,0 +1,65 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Compiler benchmark - generates workloads, runs the compiler with
+#          --stats=json and appends one JSON record per run to results file,
+#          records of earlier commits are kept for comparison
+#
+# Usage:   bench.sh [compiler] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-./compiler-stats}
+RESULTS=${2:-bench_results.json}
+GENERATOR=./bench-gen
+REPEAT=${REPEAT:-3}
+
+# Workload scales, override e.g. with SCALES_expr="100 1000"
+SCALES_expr=${SCALES_expr:-"1000 5000 20000"}
+SCALES_functions=${SCALES_functions:-"500 2000 5000"}
+SCALES_strings=${SCALES_strings:-"100 1000 5000"}
+SCALES_nested=${SCALES_nested:-"50 200 500"}
+SCALES_globals=${SCALES_globals:-"500 2000 5000"}
+
+make_workdir
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+printf "%-10s %7s %10s %10s %10s %10s %10s %10s\n" \
+       workload scale bytes lex_ms parse_ms psa_ms emit_ms total_ms
+
+for workload in $("$GENERATOR" --list); do
+    scales_var="SCALES_$workload"
+
+    for scale in ${!scales_var}; do
+        program="$WORKDIR/$workload-$scale.tl"
+        "$GENERATOR" "$workload" "$scale" > "$program"
+        bytes=$(wc -c < "$program")
+
+        for run in $(seq 1 "$REPEAT"); do
+            stats=$("$COMPILER" --no-cache --stats=json < "$program" 2>&1 >/dev/null)
+            ret=$?
+
+            echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"workload\": \"$workload\", \"scale\": $scale, \"source_bytes\": $bytes, \"run\": $run, \"return\": $ret, \"stats\": $stats}" >> "$RESULTS"
+        done
+
+        # Human readable summary of the last run
+        lex=$(echo "$stats" | grep -o '"lex": [0-9.]*' | cut -d' ' -f2)
+        parse=$(echo "$stats" | grep -o '"parse": [0-9.]*' | cut -d' ' -f2)
+        psa=$(echo "$stats" | grep -o '"psa": [0-9.]*' | cut -d' ' -f2)
+        emit=$(echo "$stats" | grep -o '"emit": [0-9.]*' | cut -d' ' -f2)
+        total=$(echo "$stats" | grep -o '"total": [0-9.]*' | cut -d' ' -f2)
+
+        printf "%-10s %7s %10s %10s %10s %10s %10s %10s" \
+               "$workload" "$scale" "$bytes" "$lex" "$parse" "$psa" "$emit" "$total"
+        [ "$ret" -ne 0 ] && printf "   (compiler returned %s)" "$ret"
+        printf "\n"
+    done
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
@@ -0,0 +1,301 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   Generator of synthetic IFJ21 programs for benchmarking
+ *
+ * Usage:   bench-gen <workload> <scale> > program.tl
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRING_CHUNK "Lorem \\\"ipsum\\\" dolor\\tsit\\\\amet \\065\\066\\067 # consectetur\\n"
+
+typedef void (*workload_fn_t)(unsigned scale);
+
+typedef struct workload {
+    const char* name;
+    const char* description;
+    workload_fn_t generate;
+} workload_t;
+
+/*
+ * Deeply nested expression ((((1 + 1) - 1) + 1) ...)
+ */
+void gen_expr (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+    printf("function main()\n");
+    printf("  local x : integer = 1\n");
+    printf("  local y : integer = ");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("(");
+    }
+
+    printf("x");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf(" %c %u)", (i % 2 == 0) ? '+' : '-', i % 7 + 1);
+    }
+
+    printf("\n  write(y, \"\\n\")\nend\n\nmain()\n");
+}
+
+/*
+ * Thousands of small functions called one after another
+ */
+void gen_functions (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("function f%u(a : integer) : integer\n", i);
+        printf("  local b : integer = a + %u\n", i % 10);
+        printf("  if b > 1000 then\n    b = b - 1000\n  else\n  end\n");
+        printf("  return b\n");
+        printf("end\n\n");
+    }
+
+    printf("function main()\n");
+    printf("  local s : integer = 0\n");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("  s = f%u(s)\n", i);
+    }
+
+    printf("  write(s, \"\\n\")\nend\n\nmain()\n");
+}
+
+/*
+ * Long string literals full of escape sequences
+ */
+void gen_strings (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+    printf("function main()\n");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("  write(\"");
+
+        for (unsigned j = 0; j < 16; j++)
+        {
+            printf(STRING_CHUNK);
+        }
+
+        printf("\")\n");
+    }
+
+    printf("end\n\nmain()\n");
+}
+
+/*
+ * Deeply nested while/if statements
+ */
+void gen_nested (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+    printf("function main()\n");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("  local i%u : integer = 0\n", i);
+    }
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        if (i % 2 == 0)
+        {
+            printf("%*swhile i%u < 1 do\n", (int)i + 2, "", i);
+        }
+        else
+        {
+            printf("%*sif i%u == 0 then\n", (int)i + 2, "", i);
+        }
+    }
+
+    printf("%*swrite(\"leaf\\n\")\n", (int)scale + 2, "");
+
+    for (unsigned i = scale; i-- > 0;)
+    {
+        if (i % 2 == 0)
+        {
+            printf("%*si%u = i%u + 1\n", (int)i + 3, "", i, i);
+            printf("%*send\n", (int)i + 2, "");
+        }
+        else
+        {
+            printf("%*selse\n%*send\n", (int)i + 2, "", (int)i + 2, "");
+        }
+    }
+
+    printf("end\n\nmain()\n");
+}
+
+/*
+ * Wide list of global function declarations
+ */
+void gen_globals (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("global g%u : function (integer, number, string) : integer, string\n", i);
+    }
+
+    printf("\n");
+
+    for (unsigned i = 0; i < scale; i++)
+    {
+        printf("function g%u(a : integer, b : number, c : string) : integer, string\n", i);
+        printf("  return a, c\nend\n");
+    }
+
+    printf("\nfunction main()\n");
+    printf("  local a : integer\n  local c : string\n");
+    printf("  a, c = g0(1, 2.5, \"x\")\n");
+    printf("  write(a, c, \"\\n\")\nend\n\nmain()\n");
+}
+
+/*
+ * Loop with arithmetic, comparisons and strings running scale times,
+ * a workload for the interpreter rather than the compiler
+ */
+void gen_loop (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+    printf("function step(a : integer, b : integer) : integer\n");
+    printf("  return (a * 3 + b) // 2 - (a - b) * (b + 1)\n");
+    printf("end\n\n");
+    printf("function main()\n");
+    printf("  local i : integer = 0\n");
+    printf("  local s : integer = 0\n");
+    printf("  local f : number = 0.5\n");
+    printf("  local t : string = \"\"\n");
+    printf("  while i < %u do\n", scale);
+    printf("    s = s - (s // 5 + 1) + (i * 7 - i // 3) * 2\n");
+    printf("    f = f + i / 4 * 1.5 - f * 0.25\n");
+    printf("    if s > 100000 then\n");
+    printf("      s = s - 100000\n");
+    printf("    else\n");
+    printf("      s = step(s, i)\n");
+    printf("    end\n");
+    printf("    if #t < 20 then\n");
+    printf("      t = t .. \"x\"\n");
+    printf("    else\n");
+    printf("      t = \"\"\n");
+    printf("    end\n");
+    printf("    i = i + 1\n");
+    printf("  end\n");
+    printf("  write(s, \" \", f, \" \", t, \"\\n\")\n");
+    printf("end\n\nmain()\n");
+}
+
+/*
+ * String built by scale appends and copied by substr (one character at
+ * a time), a workload for the string representation of the interpreter
+ */
+void gen_concat (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+    printf("function main()\n");
+    printf("  local s : string = \"\"\n");
+    printf("  local i : integer = 0\n");
+    printf("  local n : integer = %u\n", scale);
+    printf("  while i < n do\n");
+    printf("    s = s .. \"ab\"\n");
+    printf("    i = i + 1\n");
+    printf("  end\n");
+    printf("  local t : string = substr(s, 2, n)\n");
+    printf("  local len : integer = #t\n");
+    printf("  write(i, \" \", len, \" \", t, \"\\n\")\n");
+    printf("end\n\nmain()\n");
+}
+
+/*
+ * Words cut from a line by substr in a loop, a workload for the built-in
+ * functions of the interpreter
+ */
+void gen_substr (unsigned scale)
+{
+    printf("require \"ifj21\"\n\n");
+    printf("function main()\n");
+    printf("  local text : string = \"lorem ipsum dolor sit amet consectetur adipiscing elit\"\n");
+    printf("  local word : string\n");
+    printf("  local i : integer = 0\n");
+    printf("  local j : integer\n");
+    printf("  local k : integer\n");
+    printf("  local total : integer = 0\n");
+    printf("  while i < %u do\n", scale);
+    printf("    k = (i - i // 6 * 6) * 7 + 1\n");
+    printf("    j = k + 11\n");
+    printf("    word = substr(text, k, j)\n");
+    printf("    total = total + #word\n");
+    printf("    i = i + 1\n");
+    printf("  end\n");
+    printf("  write(total, \" \", word, \"\\n\")\n");
+    printf("end\n\nmain()\n");
+}
+
+static workload_t workloads[] = {
+    {"expr",      "deeply nested expression",          gen_expr},
+    {"functions", "many small functions",              gen_functions},
+    {"strings",   "long string literals with escapes", gen_strings},
+    {"nested",    "deeply nested while/if",            gen_nested},
+    {"globals",   "wide global declaration list",      gen_globals},
+    {"loop",      "arithmetic loop (run time)",        gen_loop},
+    {"concat",    "string appends (run time)",         gen_concat},
+    {"substr",    "substr in a loop (run time)",       gen_substr},
+};
+
+#define WORKLOADS_CNT (sizeof(workloads) / sizeof(workloads[0]))
+
+void usage (const char* prog)
+{
+    fprintf(stderr, "Usage: %s <workload> <scale>\n\nWorkloads:\n", prog);
+
+    for (size_t i = 0; i < WORKLOADS_CNT; i++)
+    {
+        fprintf(stderr, "  %-10s %s\n", workloads[i].name, workloads[i].description);
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    if (argc == 2 && strcmp(argv[1], "--list") == 0)
+    {
+        for (size_t i = 0; i < WORKLOADS_CNT; i++)
+        {
+            printf("%s\n", workloads[i].name);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc != 3)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < WORKLOADS_CNT; i++)
+    {
+        if (strcmp(argv[1], workloads[i].name) == 0)
+        {
+            workloads[i].generate((unsigned)strtoul(argv[2], NULL, 10));
+            return EXIT_SUCCESS;
+        }
+    }
+
+    usage(argv[0]);
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Benchmark of the string representation of ic21vm - the concat
+#          workload (appends in a loop and substr of the result) is compiled
+#          to IFJcode21 (stack mode and -O2 --temps) and run with and without
+#          JIT for growing scales. Run time per appended string stays flat
+#          when concatenation is amortized linear. One JSON record per run
+#          is appended to results file.
+#
+# Usage:   concat_bench.sh [compiler] [interpreter] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+RESULTS=${3:-concat_bench_results.json}
+GENERATOR=./bench-gen
+REPEAT=${REPEAT:-3}
+SCALES_concat=${SCALES_concat:-"10000 100000 1000000"}
+
+make_workdir
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+# Best run time in ms of the command over REPEAT runs
+run_ms() {
+    local best=""
+
+    for run in $(seq 1 "$REPEAT"); do
+        start=$(date +%s%N)
+        "$@" < /dev/null > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(awk "BEGIN { printf \"%.3f\", ($end - $start) / 1000000 }")
+
+        if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+            best=$ms
+        fi
+    done
+
+    echo "$best"
+}
+
+printf "%-8s %-6s %12s %10s %12s\n" scale mode no_jit_ms jit_ms ns_per_iter
+
+for scale in $SCALES_concat; do
+    "$GENERATOR" concat "$scale" > "$WORKDIR/concat.tl"
+
+    for mode in stack temps; do
+        if [ "$mode" = temps ]; then
+            "$COMPILER" --no-cache -O2 --temps < "$WORKDIR/concat.tl" > "$WORKDIR/concat.code" || exit 1
+        else
+            "$COMPILER" --no-cache < "$WORKDIR/concat.tl" > "$WORKDIR/concat.code" || exit 1
+        fi
+
+        interp_ms=$(run_ms "$VM" --no-jit "$WORKDIR/concat.code")
+        jit_ms=$(run_ms "$VM" "$WORKDIR/concat.code")
+
+        printf "%-8s %-6s %12s %10s %12.1f\n" "$scale" "$mode" "$interp_ms" "$jit_ms" \
+               "$(awk "BEGIN { print $interp_ms * 1000000 / $scale }")"
+
+        echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"scale\": $scale, \"mode\": \"$mode\", \"interpreter_ms\": $interp_ms, \"jit_ms\": $jit_ms}" >> "$RESULTS"
+    done
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
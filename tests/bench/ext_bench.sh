@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Benchmark of the extended instructions of ic21vm - the substr and
+#          concat workloads and the student test programs are compiled to
+#          IFJcode21 (stack mode and -O2 --temps) with built-in functions as
+#          IFJcode21 functions and as extended instructions ('--vm-ext'),
+#          best run times on ic21vm are compared. One JSON record per program
+#          is appended to results file.
+#
+# Usage:   ext_bench.sh [compiler] [interpreter] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+RESULTS=${3:-ext_bench_results.json}
+GENERATOR=./bench-gen
+TEST_DIR=../disc_test/test_cases
+REPEAT=${REPEAT:-3}
+SCALES_substr=${SCALES_substr:-"100000 1000000"}
+SCALES_concat=${SCALES_concat:-"100000"}
+
+make_workdir
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+# Best run time in ms of the command over REPEAT runs
+run_ms() {
+    local input=$1 best=""
+    shift
+
+    for run in $(seq 1 "$REPEAT"); do
+        start=$(date +%s%N)
+        "$@" < "$input" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(awk "BEGIN { printf \"%.3f\", ($end - $start) / 1000000 }")
+
+        if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+            best=$ms
+        fi
+    done
+
+    echo "$best"
+}
+
+measure() {
+    local name=$1 program=$2 input=$3 mode options
+
+    for mode in stack temps; do
+        options=""
+        [ "$mode" = temps ] && options="-O2 --temps"
+
+        "$COMPILER" --no-cache $options < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+        "$COMPILER" --no-cache $options --vm-ext < "$program" > "$WORKDIR/ext.code" 2>/dev/null || return
+
+        plain_ms=$(run_ms "$input" "$VM" "$WORKDIR/program.code")
+        ext_ms=$(run_ms "$input" "$VM" "$WORKDIR/ext.code")
+
+        printf "%-24s %-6s %10s %10s %9.2fx\n" "$name" "$mode" "$plain_ms" "$ext_ms" \
+               "$(awk "BEGIN { print $plain_ms / ($ext_ms > 0 ? $ext_ms : 1) }")"
+
+        echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"program\": \"$name\", \"mode\": \"$mode\", \"ifjcode_ms\": $plain_ms, \"ext_ms\": $ext_ms}" >> "$RESULTS"
+    done
+}
+
+printf "%-24s %-6s %10s %10s %10s\n" program mode ifjcode_ms ext_ms speedup
+
+for workload in substr concat; do
+    scales_var="SCALES_$workload"
+
+    for scale in ${!scales_var}; do
+        "$GENERATOR" "$workload" "$scale" > "$WORKDIR/$workload-$scale.tl"
+        measure "$workload-$scale" "$WORKDIR/$workload-$scale.tl" /dev/null
+    done
+done
+
+for test in "$TEST_DIR"/*; do
+    measure "$(basename "$test" | tr ' ' '_')" "$test/program.tl" "$test/input"
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Benchmark of the template JIT of ic21vm - the run time workload
+#          and the student test programs are compiled to IFJcode21 (stack
+#          mode and -O2 --temps), best run time of 'ic21vm --no-jit' and of
+#          ic21vm with JIT are compared. One JSON record per program is
+#          appended to results file.
+#
+# Usage:   jit_bench.sh [compiler] [interpreter] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+RESULTS=${3:-jit_bench_results.json}
+GENERATOR=./bench-gen
+TEST_DIR=../disc_test/test_cases
+REPEAT=${REPEAT:-3}
+SCALES_loop=${SCALES_loop:-"100000 1000000"}
+
+make_workdir
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+# Best run time in ms of the command over REPEAT runs
+run_ms() {
+    local input=$1 best=""
+    shift
+
+    for run in $(seq 1 "$REPEAT"); do
+        start=$(date +%s%N)
+        "$@" < "$input" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(awk "BEGIN { printf \"%.3f\", ($end - $start) / 1000000 }")
+
+        if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+            best=$ms
+        fi
+    done
+
+    echo "$best"
+}
+
+measure() {
+    local name=$1 program=$2 input=$3 mode
+
+    for mode in stack temps; do
+        if [ "$mode" = temps ]; then
+            "$COMPILER" --no-cache -O2 --temps < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+        else
+            "$COMPILER" --no-cache < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+        fi
+
+        interp_ms=$(run_ms "$input" "$VM" --no-jit "$WORKDIR/program.code")
+        jit_ms=$(run_ms "$input" "$VM" "$WORKDIR/program.code")
+
+        printf "%-24s %-6s %12s %10s %9.2fx\n" "$name" "$mode" "$interp_ms" "$jit_ms" \
+               "$(awk "BEGIN { print $interp_ms / ($jit_ms > 0 ? $jit_ms : 1) }")"
+
+        echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"program\": \"$name\", \"mode\": \"$mode\", \"interpreter_ms\": $interp_ms, \"jit_ms\": $jit_ms}" >> "$RESULTS"
+    done
+}
+
+printf "%-24s %-6s %12s %10s %10s\n" program mode no_jit_ms jit_ms speedup
+
+for scale in $SCALES_loop; do
+    "$GENERATOR" loop "$scale" > "$WORKDIR/loop-$scale.tl"
+    measure "loop-$scale" "$WORKDIR/loop-$scale.tl" /dev/null
+done
+
+for test in "$TEST_DIR"/*; do
+    measure "$(basename "$test" | tr ' ' '_')" "$test/program.tl" "$test/input"
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
@@ -0,0 +1,84 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Benchmark of the native x86-64 backend - the run time workload
+#          and the student test programs are compiled to IFJcode21 and by
+#          'compiler --native', best run time of the reference ic21int,
+#          of ic21vm and of the native program are compared. One JSON
+#          record per program is appended to results file.
+#
+# Usage:   native_bench.sh [compiler] [interpreter] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+RESULTS=${3:-native_bench_results.json}
+REFERENCE=../disc_test/ic21int
+RUNTIME=../../native_rt.c
+GENERATOR=./bench-gen
+TEST_DIR=../disc_test/test_cases
+CC=${CC:-gcc}
+REPEAT=${REPEAT:-3}
+SCALES_loop=${SCALES_loop:-"10000 100000"}
+
+make_workdir
+
+"$CC" -std=c11 -O2 -c -o "$WORKDIR/native_rt.o" "$RUNTIME" || exit 1
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+# Best run time in ms of the command over REPEAT runs
+run_ms() {
+    local input=$1 best=""
+    shift
+
+    for run in $(seq 1 "$REPEAT"); do
+        start=$(date +%s%N)
+        "$@" < "$input" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(awk "BEGIN { printf \"%.3f\", ($end - $start) / 1000000 }")
+
+        if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+            best=$ms
+        fi
+    done
+
+    echo "$best"
+}
+
+measure() {
+    local name=$1 program=$2 input=$3
+
+    "$COMPILER" --no-cache < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+    "$COMPILER" --no-cache --native < "$program" > "$WORKDIR/program.s" 2>/dev/null || return
+    "$CC" -o "$WORKDIR/program" "$WORKDIR/program.s" "$WORKDIR/native_rt.o" || return
+
+    ref_ms=$(run_ms "$input" "$REFERENCE" "$WORKDIR/program.code")
+    vm_ms=$(run_ms "$input" "$VM" "$WORKDIR/program.code")
+    native_ms=$(run_ms "$input" "$WORKDIR/program")
+
+    printf "%-24s %10s %10s %10s %9.2fx %9.2fx\n" "$name" "$ref_ms" "$vm_ms" "$native_ms" \
+           "$(awk "BEGIN { print $ref_ms / ($native_ms > 0 ? $native_ms : 1) }")" \
+           "$(awk "BEGIN { print $vm_ms / ($native_ms > 0 ? $native_ms : 1) }")"
+
+    echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"program\": \"$name\", \"ic21int_ms\": $ref_ms, \"ic21vm_ms\": $vm_ms, \"native_ms\": $native_ms}" >> "$RESULTS"
+}
+
+printf "%-24s %10s %10s %10s %10s %10s\n" program ic21int_ms ic21vm_ms native_ms vs_ic21int vs_ic21vm
+
+for scale in $SCALES_loop; do
+    "$GENERATOR" loop "$scale" > "$WORKDIR/loop-$scale.tl"
+    measure "loop-$scale" "$WORKDIR/loop-$scale.tl" /dev/null
+done
+
+for test in "$TEST_DIR"/*; do
+    measure "$(basename "$test" | tr ' ' '_')" "$test/program.tl" "$test/input"
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
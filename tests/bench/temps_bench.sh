@@ -0,0 +1,77 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Benchmark of the temporaries mode on the interpreter - the run
+#          time workload and the student test programs are compiled in stack
+#          mode and with --temps, generated code size and best run time on
+#          ic21vm are compared. One JSON record per program is appended to
+#          results file.
+#
+# Usage:   temps_bench.sh [compiler] [interpreter] [results]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+RESULTS=${3:-temps_bench_results.json}
+GENERATOR=./bench-gen
+TEST_DIR=../disc_test/test_cases
+REPEAT=${REPEAT:-3}
+SCALES_loop=${SCALES_loop:-"10000 100000 1000000"}
+
+make_workdir
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+stamp=$(date +%s)
+
+# Best run time in ms of code over REPEAT runs
+run_ms() {
+    local code=$1 input=$2 best=""
+
+    for run in $(seq 1 "$REPEAT"); do
+        start=$(date +%s%N)
+        "$VM" "$code" < "$input" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(awk "BEGIN { printf \"%.3f\", ($end - $start) / 1000000 }")
+
+        if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+            best=$ms
+        fi
+    done
+
+    echo "$best"
+}
+
+measure() {
+    local name=$1 program=$2 input=$3
+
+    "$COMPILER" --no-cache < "$program" > "$WORKDIR/stack.code" 2>/dev/null || return
+    "$COMPILER" --no-cache --temps < "$program" > "$WORKDIR/temps.code" 2>/dev/null || return
+
+    stack_lines=$(grep -c . "$WORKDIR/stack.code")
+    temps_lines=$(grep -c . "$WORKDIR/temps.code")
+    stack_ms=$(run_ms "$WORKDIR/stack.code" "$input")
+    temps_ms=$(run_ms "$WORKDIR/temps.code" "$input")
+
+    printf "%-24s %12s %12s %10s %10s %7.2fx\n" "$name" "$stack_lines" "$temps_lines" "$stack_ms" "$temps_ms" \
+           "$(awk "BEGIN { print $stack_ms / ($temps_ms > 0 ? $temps_ms : 1) }")"
+
+    echo "{\"commit\": \"$commit\", \"timestamp\": $stamp, \"program\": \"$name\", \"stack\": {\"instructions\": $stack_lines, \"run_ms\": $stack_ms}, \"temps\": {\"instructions\": $temps_lines, \"run_ms\": $temps_ms}}" >> "$RESULTS"
+}
+
+printf "%-24s %12s %12s %10s %10s %8s\n" program stack_instr temps_instr stack_ms temps_ms speedup
+
+for scale in $SCALES_loop; do
+    "$GENERATOR" loop "$scale" > "$WORKDIR/loop-$scale.tl"
+    measure "loop-$scale" "$WORKDIR/loop-$scale.tl" /dev/null
+done
+
+for test in "$TEST_DIR"/*; do
+    measure "$(basename "$test" | tr ' ' '_')" "$test/program.tl" "$test/input"
+done
+
+echo
+echo "Results written to tests/bench/$RESULTS"
@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the compilation cache. For every student test program
+#          the output and exit code of a cold and a warm cached compilation
+#          must equal the uncached compilation, parallel compilers must
+#          share the cache safely and the cache must stay within its bound.
+#
+# Usage:   cache_test.sh [compiler]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+TEST_DIR=../disc_test/test_cases
+
+make_workdir
+CACHE=$WORKDIR/cache
+
+tests=0
+passed=0
+
+check() {
+    local program=$1 option=$2 ok=1
+
+    "$COMPILER" $option < "$program" > "$WORKDIR/plain" 2>/dev/null
+    local ret=$?
+    "$COMPILER" $option --cache="$CACHE" < "$program" > "$WORKDIR/cold" 2>/dev/null
+    local cold=$?
+    "$COMPILER" $option --cache="$CACHE" < "$program" > "$WORKDIR/warm" 2>/dev/null
+    local warm=$?
+
+    cmp -s "$WORKDIR/plain" "$WORKDIR/cold" && [ $ret -eq $cold ] || ok=''
+    cmp -s "$WORKDIR/plain" "$WORKDIR/warm" && [ $ret -eq $warm ] || ok=''
+
+    [ $ok ]
+}
+
+for test in "$TEST_DIR"/*; do
+    for option in "" --binary; do
+        tests=$((tests+1))
+
+        if check "$test/program.tl" "$option"; then
+            passed=$((passed+1))
+        else
+            echo "$(basename "$test") $option: cached compilation differs"
+        fi
+    done
+done
+
+# warm runs must not recompile, entries are never rewritten on hit
+entries=$(ls "$CACHE" | wc -l)
+before=$(cat "$CACHE"/*.ifjc | md5sum)
+for test in "$TEST_DIR"/*; do
+    "$COMPILER" --cache="$CACHE" < "$test/program.tl" > /dev/null 2>&1
+done
+tests=$((tests+1))
+if [ "$(ls "$CACHE" | wc -l)" -eq "$entries" ] && [ "$(cat "$CACHE"/*.ifjc | md5sum)" = "$before" ]; then
+    passed=$((passed+1))
+else
+    echo "warm run changed the cache"
+fi
+
+# parallel compilers with an empty cache
+rm -rf "$CACHE"
+program=$(ls -d "$TEST_DIR"/* | head -1)/program.tl
+"$COMPILER" < "$program" > "$WORKDIR/plain"
+for i in $(seq 8); do
+    "$COMPILER" --cache="$CACHE" < "$program" > "$WORKDIR/parallel$i" &
+done
+wait
+tests=$((tests+1))
+ok=1
+for i in $(seq 8); do
+    cmp -s "$WORKDIR/plain" "$WORKDIR/parallel$i" || ok=''
+done
+[ "$(ls "$CACHE" | wc -l)" -eq 1 ] || ok=''
+if [ $ok ]; then passed=$((passed+1)); else echo "parallel compilation differs"; fi
+
+# size bound, every entry is bigger than the whole cache
+rm -rf "$CACHE"
+for test in "$TEST_DIR"/*; do
+    "$COMPILER" --cache="$CACHE" --cache-size=0 < "$test/program.tl" > /dev/null 2>&1
+done
+tests=$((tests+1))
+if [ "$(ls "$CACHE" | wc -l)" -eq 0 ]; then passed=$((passed+1)); else echo "size bound not kept"; fi
+
+# size in bytes out of range
+tests=$((tests+1))
+"$COMPILER" --cache="$CACHE" --cache-size=17592186044416 < "$program" > /dev/null 2>&1
+if [ $? -eq 99 ]; then passed=$((passed+1)); else echo "cache size out of range accepted"; fi
+
+echo "Cache: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
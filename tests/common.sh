@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Functions shared by the test and benchmark scripts, sourced after
+#          changing to the directory of the script.
+#
+# Usage:   . ../common.sh
+#
+
+# Create working directory WORKDIR of this run, removed when the script exits.
+# Scripts run by parallel make must not share one, it is created next to the
+# script as programs built in it are executed (/tmp may be mounted noexec).
+make_workdir() {
+    WORKDIR=$(mktemp -d tmp.XXXXXX) || exit 1
+    trap 'rm -rf "$WORKDIR"' EXIT
+}
+
+# Compile PROGRAM without and with OPTIONS and count the test in tests and
+# passed. Exit codes must be equal and so must be outputs, with "success" only
+# outputs of programs which compiled and with "exit" none.
+# Usage: compare_program all|success|exit what program [options]
+compare_program() {
+    local compare=$1 what=$2 program=$3 ret
+    shift 3
+
+    tests=$((tests+1))
+
+    "$COMPILER" < "$program" > "$WORKDIR/plain" 2>/dev/null
+    ret=$?
+    "$COMPILER" "$@" < "$program" > "$WORKDIR/mode" 2>/dev/null
+
+    if [ $? -eq $ret ] &&
+       { [ "$compare" = exit ] || { [ "$compare" = success ] && [ $ret -ne 0 ]; } ||
+         cmp -s "$WORKDIR/plain" "$WORKDIR/mode"; }; then
+        passed=$((passed+1))
+    else
+        echo "$program: $what differs"
+    fi
+}
+
+# compare_program for every test program of all test directories
+# Usage: compare_all_programs all|success|exit what [options]
+compare_all_programs() {
+    local program
+
+    while IFS= read -r -d '' program; do
+        compare_program "$1" "$2" "$program" "${@:3}"
+    done < <(find .. -name "*.tl" -print0 | sort -z)
+}
+
+# Succeed if a run ended with the expected exit code and, if that is 0, its
+# output equals the reference output.
+# Usage: same_result ret expected output reference
+same_result() {
+    [ "$1" -eq "$2" ] && { [ "$1" -ne 0 ] || cmp -s "$3" "$4"; }
+}
+
+# Call FUNCTION [arguments] name program input return output for every student
+# test program and for every example program with expected output.
+# Usage: for_each_reference function [arguments]
+for_each_reference() {
+    local test program name input
+
+    for test in ../disc_test/test_cases/*; do
+        "$@" "$(basename "$test")" "$test/program.tl" "$test/input" "$(cat "$test/return")" "$test/output"
+    done
+
+    for program in ../gen/example_programs/*.tl; do
+        name=$(basename "$program" .tl)
+
+        [ -f "../gen/$name.out" ] || continue
+        input=/dev/null
+        [ -f "../gen/$name.in" ] && input=../gen/$name.in
+
+        "$@" "$name" "$program" "$input" 0 "../gen/$name.out"
+    done
+}
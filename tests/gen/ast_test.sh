@@ -0,0 +1,27 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the multi-pass compilation. For every test program the
+#          exit code of 'compiler --ast' must equal the single pass
+#          compilation and so must the output of programs without errors
+#          (with errors the tree is not turned into code at all).
+#
+# Usage:   ast_test.sh [compiler]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+
+make_workdir
+
+tests=0
+passed=0
+
+compare_all_programs success "multi-pass compilation" --ast
+
+echo "Multi-pass compilation: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
@@ -0,0 +1,51 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the writer thread. For every test program the output
+#          and exit code of 'compiler --async-output' must equal the
+#          compilation writing the output directly. Output bigger than all
+#          chunks and instructions bigger than one chunk go through a slow
+#          pipe.
+#
+# Usage:   async_output_test.sh [compiler]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+
+make_workdir
+
+tests=0
+passed=0
+
+compare_all_programs all "writer thread" --async-output
+
+# big output with a literal longer than one chunk, read slowly
+{
+    echo 'require "ifj21"'
+    echo 'function main()'
+    printf '    write("%s")\n' "$(head -c 100000 /dev/zero | tr '\0' 'x')"
+    for i in $(seq 6000); do
+        echo "    write(\"line $i of the output\\n\", $i, \"\\n\")"
+    done
+    echo 'end'
+    echo 'main()'
+} > "$WORKDIR/big.tl"
+
+tests=$((tests+1))
+"$COMPILER" < "$WORKDIR/big.tl" > "$WORKDIR/sync" 2>/dev/null
+ret=$?
+"$COMPILER" --async-output < "$WORKDIR/big.tl" 2>/dev/null | { sleep 1; cat; } > "$WORKDIR/thread"
+
+if [ "${PIPESTATUS[0]}" -eq $ret ] && cmp -s "$WORKDIR/sync" "$WORKDIR/thread"; then
+    passed=$((passed+1))
+else
+    echo "big output: writer thread differs"
+fi
+
+echo "Writer thread: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the C source backend. Every student test program and
+#          every example program of the code generation tests is translated
+#          by 'compiler --csrc' (also with -O2), compiled by the C compiler
+#          with the runtime; exit code and output must match the reference.
+#
+# Usage:   csrc_test.sh [compiler] [runtime.c]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+RUNTIME=${2:-../../csrc_rt.c}
+INCLUDE=$(dirname "$RUNTIME")
+CC=${CC:-gcc}
+CFLAGS="-std=c11 -O2 -pedantic-errors"
+
+make_workdir
+
+"$CC" $CFLAGS -Wall -Werror -c -o "$WORKDIR/csrc_rt.o" "$RUNTIME" || exit 1
+
+tests=0
+passed=0
+
+# Translate program to C, run it and compare with expected return code and output
+check() {
+    local opt=$1 name=$2 program=$3 input=$4 ret_expected=$5 output=$6
+
+    # only programs which compile are interesting
+    "$COMPILER" < "$program" > /dev/null 2>&1 || return
+    tests=$((tests+1))
+
+    if ! "$COMPILER" --csrc "$opt" < "$program" > "$WORKDIR/program.c" 2>/dev/null ||
+       ! "$CC" $CFLAGS -I"$INCLUDE" -o "$WORKDIR/program" "$WORKDIR/program.c" "$WORKDIR/csrc_rt.o" -lm 2> "$WORKDIR/cc.log"; then
+        echo "$name $opt: C build failed"
+        return
+    fi
+
+    "$WORKDIR/program" < "$input" > "$WORKDIR/output" 2>/dev/null
+    ret=$?
+
+    if ! same_result "$ret" "$ret_expected" "$WORKDIR/output" "$output"; then
+        echo "$name $opt: C program differs from reference (exit code $ret, expected $ret_expected)"
+        return
+    fi
+
+    passed=$((passed+1))
+}
+
+for opt in -O0 -O2; do
+    for_each_reference check "$opt"
+done
+
+echo "C source backend: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
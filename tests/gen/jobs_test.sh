@@ -0,0 +1,36 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the parallel code generation. For every test program and
+#          for generated workloads with many functions the exit code and the
+#          output of 'compiler --jobs=N' must equal the serial compilation.
+#
+# Usage:   jobs_test.sh [compiler] [jobs]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+JOBS=${2:-4}
+GENERATOR=../bench/bench-gen
+
+make_workdir
+
+tests=0
+passed=0
+
+compare_all_programs success "parallel code generation" --jobs="$JOBS"
+
+# bigger programs, generator is built by 'make bench-build'
+if [ -x "$GENERATOR" ]; then
+    for workload in functions nested expr; do
+        "$GENERATOR" "$workload" 500 > "$WORKDIR/$workload.tl"
+        compare_program success "parallel code generation" "$WORKDIR/$workload.tl" --jobs="$JOBS"
+    done
+fi
+
+echo "Parallel code generation: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
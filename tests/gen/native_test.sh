@@ -0,0 +1,56 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the native x86-64 backend. Every student test program
+#          and every example program of the code generation tests is
+#          compiled by 'compiler --native', assembled and linked with the
+#          runtime; exit code and output must match the reference.
+#
+# Usage:   native_test.sh [compiler] [runtime.c]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+RUNTIME=${2:-../../native_rt.c}
+CC=${CC:-gcc}
+
+make_workdir
+
+"$CC" -std=c11 -O2 -c -o "$WORKDIR/native_rt.o" "$RUNTIME" || exit 1
+
+tests=0
+passed=0
+
+# Compile program natively, run it and compare with expected return code and output
+check() {
+    local name=$1 program=$2 input=$3 ret_expected=$4 output=$5
+
+    # only programs which compile are interesting
+    "$COMPILER" < "$program" > /dev/null 2>&1 || return
+    tests=$((tests+1))
+
+    if ! "$COMPILER" --native < "$program" > "$WORKDIR/program.s" 2>/dev/null ||
+       ! "$CC" -o "$WORKDIR/program" "$WORKDIR/program.s" "$WORKDIR/native_rt.o" 2> "$WORKDIR/cc.log"; then
+        echo "$name: native build failed"
+        return
+    fi
+
+    "$WORKDIR/program" < "$input" > "$WORKDIR/output" 2>/dev/null
+    ret=$?
+
+    if ! same_result "$ret" "$ret_expected" "$WORKDIR/output" "$output"; then
+        echo "$name: native run differs from reference (exit code $ret, expected $ret_expected)"
+        return
+    fi
+
+    passed=$((passed+1))
+}
+
+for_each_reference check
+
+echo "Native backend: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
@@ -0,0 +1,72 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the optimized tree. Every test program must compile with
+#          each optimization level to the same exit code as without it,
+#          example programs and student test programs compiled with it must
+#          behave as the reference when interpreted.
+#
+# Usage:   opt_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+TEST_DIR=../disc_test/test_cases
+MODES=("-O1" "-O1 --temps" "-O1 --jobs=4" "-O2" "-O2 --temps" "-O2 --jobs=4")
+
+make_workdir
+
+tests=0
+passed=0
+
+# run compiled program, compare exit code and output with the reference
+check_run() {
+    local name=$1 input=$2 output=$3 expected=$4
+
+    tests=$((tests+1))
+
+    "$VM" "$WORKDIR/program.code" < "$input" > "$WORKDIR/output" 2>/dev/null
+
+    if same_result $? "$expected" "$WORKDIR/output" "$output"; then
+        passed=$((passed+1))
+    else
+        echo "$name: run differs from reference"
+    fi
+}
+
+for mode in "${MODES[@]}"; do
+    # shellcheck disable=SC2086
+    compare_all_programs exit "exit code of compilation with $mode" $mode
+
+    for program in example_programs/*.tl; do
+        name=$(basename "$program" .tl)
+
+        [ -f "$name.in" ] || continue
+
+        # reference exit code is the one of the unoptimized program
+        "$COMPILER" < "$program" > "$WORKDIR/program.code" 2>/dev/null || continue
+        "$VM" "$WORKDIR/program.code" < "$name.in" > /dev/null 2>&1
+        expected=$?
+
+        # shellcheck disable=SC2086
+        "$COMPILER" $mode < "$program" > "$WORKDIR/program.code" 2>/dev/null
+        check_run "$name ($mode)" "$name.in" "$name.out" "$expected"
+    done
+
+    for test in "$TEST_DIR"/*; do
+        name=$(basename "$test")
+
+        # shellcheck disable=SC2086
+        "$COMPILER" $mode < "$test/program.tl" > "$WORKDIR/program.code" 2>/dev/null || continue
+
+        check_run "$name ($mode)" "$test/input" "$test/output" "$(cat "$test/return")"
+    done
+done
+
+echo "Optimization: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
@@ -0,0 +1,119 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the source map ('compiler --source-map=FILE'). Every test
+#          program is compiled with and without the map in several modes;
+#          the output and exit code must be the same and the map must be
+#          ordered and refer to lines of both files. In the programs of
+#          source_map_programs every literal "L<n>" has to be generated on
+#          a line mapped to line n. Profile of ic21vm with the map has to
+#          count all instructions by source lines. The map is refused with
+#          --native and --csrc.
+#
+# Usage:   source_map_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+
+make_workdir
+
+tests=0
+passed=0
+
+check_program() {
+    local program=$1
+    shift
+
+    tests=$((tests+1))
+
+    "$COMPILER" "$@" < "$program" > "$WORKDIR/plain" 2>/dev/null
+    local ret=$?
+    "$COMPILER" "$@" --source-map="$WORKDIR/map" < "$program" > "$WORKDIR/mapped" 2>/dev/null
+
+    if [ $? -ne $ret ] || ! cmp -s "$WORKDIR/plain" "$WORKDIR/mapped"; then
+        echo "$program $*: output differs with the source map"
+        return
+    fi
+
+    # failed compilation leaves incomplete map
+    if [ $ret -ne 0 ]; then
+        passed=$((passed+1))
+        return
+    fi
+
+    # lines of the binary object are known only to the compiler
+    local code_lines=0
+    [[ " $* " != *" --binary "* ]] && code_lines=$(wc -l < "$WORKDIR/plain")
+
+    if ! awk -v source_lines="$(wc -l < "$program")" -v code_lines="$code_lines" '
+            NF != 2 || $1 !~ /^[0-9]+$/ || $2 !~ /^[0-9]+$/ { exit 1 }
+            NR == 1 && $1 != 1 { exit 1 }
+            $1 <= last || $2 > source_lines + 1 || (code_lines > 0 && $1 > code_lines) { exit 1 }
+            { last = $1 }' "$WORKDIR/map"; then
+        echo "$program $*: malformed source map"
+        return
+    fi
+
+    # literals with line numbers are checked in the textual code only
+    if [[ "$program" == source_map_programs/* && " $* " != *" --binary "* ]] &&
+       ! awk 'NR == FNR { start[NR] = $1; line[NR] = $2; runs = NR; next }
+              {
+                  while (run < runs && start[run + 1] <= FNR) run++
+                  if (match($0, /string@L[0-9]+/) && substr($0, RSTART + 8, RLENGTH - 8) != line[run]) exit 1
+              }' "$WORKDIR/map" "$WORKDIR/plain"; then
+        echo "$program $*: literal on a line of other source line"
+        return
+    fi
+
+    passed=$((passed+1))
+}
+
+for options in "" "--ast" "-O2 --temps" "--jobs=4" "--binary" "--lex-thread --async-output" "--vm-ext"; do
+    while IFS= read -r -d '' program; do
+        check_program "$program" $options
+    done < <(find ../disc_test/test_cases example_programs source_map_programs -name "*.tl" -print0 | sort -z)
+done
+
+# native code and C source have no map, an existing map file is kept
+for options in "--native" "--csrc"; do
+    tests=$((tests+1))
+
+    echo "old" > "$WORKDIR/map"
+
+    if ! "$COMPILER" $options --source-map="$WORKDIR/map" < example_programs/hello.tl > /dev/null 2>&1 &&
+       [ "$(cat "$WORKDIR/map")" = "old" ]; then
+        passed=$((passed+1))
+    else
+        echo "$options: source map accepted"
+    fi
+done
+
+# instructions of the profile by source lines
+for program in example_programs/*.tl source_map_programs/*.tl; do
+    tests=$((tests+1))
+
+    input=/dev/null
+    [ -f "$(basename "$program" .tl).in" ] && input=$(basename "$program" .tl).in
+
+    "$COMPILER" --source-map="$WORKDIR/map" < "$program" > "$WORKDIR/program.code" 2>/dev/null
+    "$VM" --source-map="$WORKDIR/map" --profile="$WORKDIR/report" --profile-top=100000 \
+        "$WORKDIR/program.code" < "$input" > /dev/null 2>&1
+
+    if awk '/^Profile:/ { total = $2 }
+            /^Source lines/ { table = 1; next }
+            table && $1 ~ /^[0-9]+$/ { sum += $1 }
+            END { exit !(table && sum == total) }' "$WORKDIR/report"; then
+        passed=$((passed+1))
+    else
+        echo "$program: profile does not count instructions by source lines"
+    fi
+done
+
+echo "Source map: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the temporaries mode. Every test program must compile
+#          with 'compiler --temps' to the same exit code as in stack mode and
+#          student test programs compiled with --temps must behave as the
+#          reference when interpreted.
+#
+# Usage:   temps_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+TEST_DIR=../disc_test/test_cases
+
+make_workdir
+
+tests=0
+passed=0
+
+compare_all_programs exit "exit code of compilation" --temps
+
+for test in "$TEST_DIR"/*; do
+    name=$(basename "$test")
+
+    "$COMPILER" --temps < "$test/program.tl" > "$WORKDIR/program.code" 2>/dev/null || continue
+
+    tests=$((tests+1))
+
+    "$VM" "$WORKDIR/program.code" < "$test/input" > "$WORKDIR/output" 2>/dev/null
+
+    if same_result $? "$(cat "$test/return")" "$WORKDIR/output" "$test/output"; then
+        passed=$((passed+1))
+    else
+        echo "$name: run differs from reference"
+    fi
+done
+
+echo "Temporaries: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
@@ -0,0 +1,26 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the scanner thread. For every test program the output
+#          and exit code of 'compiler --lex-thread' must equal the
+#          compilation with the synchronous scanner.
+#
+# Usage:   lex_thread_test.sh [compiler]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+
+make_workdir
+
+tests=0
+passed=0
+
+compare_all_programs all "scanner thread" --lex-thread
+
+echo "Scanner thread: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
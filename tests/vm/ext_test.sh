@@ -0,0 +1,77 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the extended instructions of ic21vm ('compiler --vm-ext').
+#          Every student test program and every example program of the code
+#          generation tests (also with -O2 --temps) is compiled with built-in
+#          functions as IFJcode21 functions and as extended instructions;
+#          exit code and output of ic21vm (also with regions compiled on the
+#          first execution) must be the same. Error messages are not compared,
+#          their lines differ.
+#
+# Usage:   ext_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+TEST_DIR=../disc_test/test_cases
+GEN_DIR=../gen
+
+make_workdir
+
+tests=0
+passed=0
+
+check_program() {
+    local name=$1 program=$2 input=$3
+    shift 3
+
+    # only programs which compile are interesting
+    "$COMPILER" "$@" < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+    "$COMPILER" "$@" --vm-ext < "$program" > "$WORKDIR/ext.code" 2>/dev/null || return
+
+    tests=$((tests+1))
+
+    "$VM" "$WORKDIR/program.code" < "$input" > "$WORKDIR/output" 2>/dev/null
+    local ret=$?
+    for threshold in 1000 1; do
+        "$VM" --jit-threshold=$threshold "$WORKDIR/ext.code" < "$input" > "$WORKDIR/ext_output" 2>/dev/null
+        local ext_ret=$?
+
+        if [ "$ext_ret" -ne "$ret" ] || ! cmp -s "$WORKDIR/output" "$WORKDIR/ext_output"; then
+            echo "$name $*: extended instructions (JIT threshold $threshold) differ from IFJcode21 (exit code $ext_ret, expected $ret)"
+            return
+        fi
+    done
+
+    # built-in functions are not generated
+    if grep -q "^LABEL substr$" "$WORKDIR/ext.code"; then
+        echo "$name $*: built-in functions are generated with --vm-ext"
+        return
+    fi
+
+    passed=$((passed+1))
+}
+
+for options in "-O0" "-O2 --temps"; do
+    for test in "$TEST_DIR"/*; do
+        check_program "$(basename "$test")" "$test/program.tl" "$test/input" $options
+    done
+
+    for program in "$GEN_DIR"/example_programs/*.tl ext_programs/*.tl; do
+        name=$(basename "$program" .tl)
+        input=/dev/null
+        [ -f "${program%.tl}.in" ] && input=${program%.tl}.in
+        [ -f "$GEN_DIR/$name.in" ] && input=$GEN_DIR/$name.in
+
+        check_program "$name" "$program" "$input" $options
+    done
+done
+
+echo "Extended instructions: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
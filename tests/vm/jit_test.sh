@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the template JIT of ic21vm. Every student test program,
+#          every example program of the code generation tests (also with
+#          -O2 --temps) and the hand written IFJcode21 programs are run with
+#          regions compiled on the first and on the second execution; exit
+#          code, output and error messages must be the same as with --no-jit.
+#
+# Usage:   jit_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+TEST_DIR=../disc_test/test_cases
+GEN_DIR=../gen
+
+make_workdir
+
+tests=0
+passed=0
+
+# Run IFJcode21 program with and without JIT and compare the results
+check() {
+    local name=$1 code=$2 input=$3
+
+    tests=$((tests+1))
+
+    "$VM" --no-jit "$code" < "$input" > "$WORKDIR/output" 2> "$WORKDIR/errors"
+    local ret=$?
+
+    for threshold in 1 2; do
+        "$VM" --jit-threshold=$threshold "$code" < "$input" > "$WORKDIR/jit_output" 2> "$WORKDIR/jit_errors"
+        local jit_ret=$?
+
+        if [ "$jit_ret" -ne "$ret" ] || ! cmp -s "$WORKDIR/output" "$WORKDIR/jit_output" ||
+           ! cmp -s "$WORKDIR/errors" "$WORKDIR/jit_errors"; then
+            echo "$name: JIT (threshold $threshold) differs from interpreter (exit code $jit_ret, expected $ret)"
+            return
+        fi
+    done
+
+    passed=$((passed+1))
+}
+
+# Compile program and check the generated code
+check_program() {
+    local name=$1 program=$2 input=$3
+    shift 3
+
+    # only programs which compile are interesting
+    "$COMPILER" "$@" < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+
+    check "$name $*" "$WORKDIR/program.code" "$input"
+}
+
+for options in "-O0" "-O2 --temps"; do
+    for test in "$TEST_DIR"/*; do
+        check_program "$(basename "$test")" "$test/program.tl" "$test/input" $options
+    done
+
+    for program in "$GEN_DIR"/example_programs/*.tl; do
+        name=$(basename "$program" .tl)
+        input=/dev/null
+        [ -f "$GEN_DIR/$name.in" ] && input=$GEN_DIR/$name.in
+
+        check_program "$name" "$program" "$input" $options
+    done
+done
+
+for code in jit_programs/*.code; do
+    check "$(basename "$code")" "$code" /dev/null
+done
+
+echo "JIT: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
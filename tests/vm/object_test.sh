@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Round-trip test of the binary IFJcode21 object format. For every
+#          student test program the object made by 'compiler --binary'
+#          must disassemble to the same code as the textual IFJcode21,
+#          the disassembly must survive another round and the object
+#          must behave as the reference.
+#
+# Usage:   object_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+TEST_DIR=../disc_test/test_cases
+
+make_workdir
+
+tests=0
+passed=0
+
+for test in "$TEST_DIR"/*; do
+    name=$(basename "$test")
+
+    # only programs which compile are interesting
+    "$COMPILER" < "$test/program.tl" > "$WORKDIR/program.code" 2>/dev/null || continue
+    "$COMPILER" --binary < "$test/program.tl" > "$WORKDIR/program.obj" 2>/dev/null
+
+    tests=$((tests+1))
+    ok=1
+
+    "$VM" -d "$WORKDIR/program.code" > "$WORKDIR/text.code"
+    "$VM" -d "$WORKDIR/program.obj" > "$WORKDIR/object.code"
+    "$VM" -c "$WORKDIR/text.code" > "$WORKDIR/text.obj"
+    "$VM" -d "$WORKDIR/text.obj" > "$WORKDIR/again.code"
+
+    diff -q "$WORKDIR/text.code" "$WORKDIR/object.code" > /dev/null || { echo "$name: disassembly differs"; ok=''; }
+    diff -q "$WORKDIR/text.code" "$WORKDIR/again.code" > /dev/null || { echo "$name: second round differs"; ok=''; }
+
+    "$VM" "$WORKDIR/program.obj" < "$test/input" > "$WORKDIR/output" 2>/dev/null
+    ret=$?
+
+    if [ "$ret" -ne "$(cat "$test/return")" ] || { [ "$ret" -eq 0 ] && ! diff -q "$WORKDIR/output" "$test/output" > /dev/null; }; then
+        echo "$name: run of object differs from reference"
+        ok=''
+    fi
+
+    [ $ok ] && passed=$((passed+1))
+done
+
+echo "Object round-trip: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
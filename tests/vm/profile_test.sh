@@ -0,0 +1,111 @@
+#!/bin/bash
+#
+# Project: IFJ21 imperative language compiler
+#
+# Brief:   Test of the profiler of ic21vm ('ic21vm --profile=FILE --folded=FILE').
+#          Every student test program and every example program of the code
+#          generation tests is compiled and run with and without the profile;
+#          exit code and output must be the same. Counts of the report must
+#          not change between two runs, exclusive instructions of functions
+#          must add up to all instructions and folded stacks must have one
+#          context and weight per line. Call counts of the programs in
+#          profile_programs are compared with the .calls files.
+#
+# Usage:   profile_test.sh [compiler] [interpreter]
+#
+
+cd "$(dirname "$0")" || exit 1
+. ../common.sh
+
+COMPILER=${1:-../../compiler}
+VM=${2:-../../ic21vm}
+TEST_DIR=../disc_test/test_cases
+GEN_DIR=../gen
+
+make_workdir
+
+tests=0
+passed=0
+
+# report without times, functions are sorted by name
+counts() {
+    awk '/^Profile:/ { print $2, $4; next }
+         /^Functions/ { table = 1; next }
+         /^Label|^Opcodes/ { table = 2 }
+         table == 1 && $1 ~ /^[0-9]+$/ { print $1, $5, $6, $7 | "LC_ALL=C sort -k4"; next }
+         table == 2 { print }' "$1"
+}
+
+check_program() {
+    local name=$1 program=$2 input=$3 calls=$4
+
+    # only programs which compile are interesting
+    "$COMPILER" < "$program" > "$WORKDIR/program.code" 2>/dev/null || return
+
+    tests=$((tests+1))
+
+    "$VM" --no-jit "$WORKDIR/program.code" < "$input" > "$WORKDIR/output" 2>/dev/null
+    local ret=$?
+
+    for run in 1 2; do
+        "$VM" --profile="$WORKDIR/report$run" --folded="$WORKDIR/folded" --profile-top=1000 \
+            "$WORKDIR/program.code" < "$input" > "$WORKDIR/profile_output" 2>/dev/null
+        local profile_ret=$?
+
+        if [ "$profile_ret" -ne "$ret" ] || ! cmp -s "$WORKDIR/output" "$WORKDIR/profile_output"; then
+            echo "$name: profiled run differs from plain run (exit code $profile_ret, expected $ret)"
+            return
+        fi
+    done
+
+    counts "$WORKDIR/report1" > "$WORKDIR/counts1"
+    counts "$WORKDIR/report2" > "$WORKDIR/counts2"
+
+    if [ ! -s "$WORKDIR/counts1" ] || ! cmp -s "$WORKDIR/counts1" "$WORKDIR/counts2"; then
+        echo "$name: counts of the profile differ between runs"
+        return
+    fi
+
+    if ! awk '/^Profile:/ { total = $2 }
+              /^Functions/ { table = 1; next }
+              /^Label/ { table = 0 }
+              table && $1 ~ /^[0-9]+$/ { sum += $6 }
+              END { exit sum != total }' "$WORKDIR/report1"; then
+        echo "$name: exclusive instructions of functions do not add up"
+        return
+    fi
+
+    if grep -qvE '^[^ ;]+(;[^ ;]+)* [0-9]+$' "$WORKDIR/folded"; then
+        echo "$name: malformed folded stacks"
+        return
+    fi
+
+    if [ -n "$calls" ] && ! awk '/^Functions/ { table = 1; next }
+                                 /^Label/ { table = 0 }
+                                 table && $1 ~ /^[0-9]+$/ && $7 != "<program>" { print $1, $7 }' \
+                             "$WORKDIR/report1" | LC_ALL=C sort -k2 | cmp -s - "$calls"; then
+        echo "$name: call counts differ from $calls"
+        return
+    fi
+
+    passed=$((passed+1))
+}
+
+for test in "$TEST_DIR"/*; do
+    check_program "$(basename "$test")" "$test/program.tl" "$test/input"
+done
+
+for program in "$GEN_DIR"/example_programs/*.tl profile_programs/*.tl; do
+    name=$(basename "$program" .tl)
+    input=/dev/null
+    calls=
+    [ -f "${program%.tl}.in" ] && input=${program%.tl}.in
+    [ -f "$GEN_DIR/$name.in" ] && input=$GEN_DIR/$name.in
+    [ -f "${program%.tl}.calls" ] && calls=${program%.tl}.calls
+
+    check_program "$name" "$program" "$input" "$calls"
+done
+
+echo "Profile: $passed/$tests passed"
+
+[ "$passed" -eq "$tests" ]
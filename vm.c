@@ -0,0 +1,1611 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - execution of the bytecode
+ *
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+#include "vm_jit.h"
+#include "vm_profile.h"
+
+/* Threaded dispatch needs computed goto (GCC, Clang) */
+#if defined(__GNUC__) && !defined(VM_NO_THREADED)
+#define VM_THREADED
+#endif
+
+/* Internal instruction appended behind the last instruction of the program */
+#define VM_HALT VM_OPCODE_COUNT
+
+#define STACK_INIT_SIZE 64
+#define FRAME_INIT_SIZE 8
+#define LINE_INIT_SIZE 64
+
+static const char* type_names[] = {
+    "",
+    "nil",
+    "int",
+    "float",
+    "bool",
+    "string"
+};
+
+static void value_free(vm_value_t* value)
+{
+    if (value->type == VM_T_STRING)
+    {
+        vm_string_release(value->s.data);
+    }
+
+    value->type = VM_T_UNDEF;
+}
+
+/*
+ * Store preallocated string, it is created on the first use and it is shared
+ * by all values until the end of interpretation
+ */
+static bool string_static(char** cache, vm_value_t* value, const char* data, size_t len)
+{
+    if (!*cache)
+    {
+        vm_string_t str;
+
+        if (!vm_string_new(&str, data, len))
+        {
+            return false;
+        }
+
+        VM_STRBUF(str.data)->refs = VM_STATIC_REFS;
+        *cache = str.data;
+    }
+
+    VM_STRBUF(*cache)->refs++;
+
+    value->type = VM_T_STRING;
+    value->s.data = *cache;
+    value->s.len = len;
+
+    return true;
+}
+
+static inline bool string_char(vm_t* vm, vm_value_t* value, char c)
+{
+    return string_static(&vm->chars[(unsigned char)c], value, &c, 1);
+}
+
+/*
+ * Copy value, destination is released before, strings share the buffer
+ */
+static void value_copy(vm_value_t* dst, const vm_value_t* src)
+{
+    if (dst == src)
+    {
+        return;
+    }
+
+    if (src->type == VM_T_STRING)
+    {
+        VM_STRBUF(src->s.data)->refs++;
+    }
+
+    value_free(dst);
+    *dst = *src;
+}
+
+static vm_frame_t* frame_new(vm_t* vm)
+{
+    vm_frame_t* frame = vm->free_frames;
+
+    if (frame)
+    {
+        vm->free_frames = frame->next;
+        frame->next = NULL;
+        return frame;
+    }
+
+    return calloc(1, sizeof(vm_frame_t));
+}
+
+static void frame_release(vm_t* vm, vm_frame_t* frame)
+{
+    if (!frame)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < frame->len; i++)
+    {
+        value_free(&frame->vals[i]);
+    }
+
+    frame->len = 0;
+    frame->next = vm->free_frames;
+    vm->free_frames = frame;
+}
+
+static void frame_destroy(vm_frame_t* frame)
+{
+    while (frame)
+    {
+        vm_frame_t* next = frame->next;
+
+        for (uint32_t i = 0; i < frame->len; i++)
+        {
+            value_free(&frame->vals[i]);
+        }
+
+        free(frame->names);
+        free(frame->vals);
+        free(frame);
+
+        frame = next;
+    }
+}
+
+static inline vm_value_t* frame_find(vm_frame_t* frame, vm_operand_t* operand)
+{
+    uint32_t hint = operand->hint;
+
+    if (hint < frame->len && frame->names[hint] == operand->index)
+    {
+        return &frame->vals[hint];
+    }
+
+    for (uint32_t i = frame->len; i-- > 0;)
+    {
+        if (frame->names[i] == operand->index)
+        {
+            operand->hint = i;
+            return &frame->vals[i];
+        }
+    }
+
+    return NULL;
+}
+
+static inline vm_value_t* vm_fail(vm_t* vm, vm_error_t error, const char* message)
+{
+    vm->error = error;
+    vm->message = message;
+
+    return NULL;
+}
+
+/*
+ * Variable of the operand (defined, but possibly without value)
+ */
+static inline vm_value_t* vm_var(vm_t* vm, vm_operand_t* operand)
+{
+    vm_frame_t* frame;
+    vm_value_t* value;
+
+    switch (operand->kind)
+    {
+        case VM_OPND_GF:
+            if (!vm->defined[operand->index])
+            {
+                return vm_fail(vm, VM_E_VAR, "Variable is not defined!");
+            }
+
+            return &vm->globals[operand->index];
+
+        case VM_OPND_LF:
+            frame = vm->lf;
+
+            if (!frame)
+            {
+                return vm_fail(vm, VM_E_FRAME, "Local frame does not exist!");
+            }
+
+            break;
+
+        default:
+            frame = vm->tf;
+
+            if (!frame)
+            {
+                return vm_fail(vm, VM_E_FRAME, "Temporary frame does not exist!");
+            }
+
+            break;
+    }
+
+    value = frame_find(frame, operand);
+
+    return value ? value : vm_fail(vm, VM_E_VAR, "Variable is not defined!");
+}
+
+/*
+ * Value of the symbol operand, it must be initialized
+ */
+static inline vm_value_t* vm_symb(vm_t* vm, vm_operand_t* operand)
+{
+    vm_value_t* value;
+
+    if (operand->kind == VM_OPND_CONST)
+    {
+        return &vm->program->consts[operand->index];
+    }
+
+    value = vm_var(vm, operand);
+
+    if (value && value->type == VM_T_UNDEF)
+    {
+        return vm_fail(vm, VM_E_VALUE, "Variable has not been initialized!");
+    }
+
+    return value;
+}
+
+static vm_error_t vm_defvar(vm_t* vm, vm_operand_t* operand)
+{
+    vm_frame_t* frame;
+
+    if (operand->kind == VM_OPND_GF)
+    {
+        if (vm->defined[operand->index])
+        {
+            vm_fail(vm, VM_E_SEMANTIC, "Variable already exists!");
+            return VM_E_SEMANTIC;
+        }
+
+        vm->defined[operand->index] = true;
+        vm->globals[operand->index].type = VM_T_UNDEF;
+
+        return VM_OK;
+    }
+
+    frame = operand->kind == VM_OPND_LF ? vm->lf : vm->tf;
+
+    if (!frame)
+    {
+        vm_fail(vm, VM_E_FRAME, "Frame does not exist!");
+        return VM_E_FRAME;
+    }
+
+    for (uint32_t i = 0; i < frame->len; i++)
+    {
+        if (frame->names[i] == operand->index)
+        {
+            vm_fail(vm, VM_E_SEMANTIC, "Variable already exists!");
+            return VM_E_SEMANTIC;
+        }
+    }
+
+    if (frame->len == frame->cap)
+    {
+        uint32_t cap = frame->cap == 0 ? FRAME_INIT_SIZE : frame->cap * 2;
+        uint32_t* names = realloc(frame->names, cap * sizeof(uint32_t));
+
+        if (!names)
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            return VM_E_INTERNAL;
+        }
+
+        frame->names = names;
+
+        vm_value_t* vals = realloc(frame->vals, cap * sizeof(vm_value_t));
+
+        if (!vals)
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            return VM_E_INTERNAL;
+        }
+
+        frame->vals = vals;
+        frame->cap = cap;
+    }
+
+    operand->hint = frame->len;
+    frame->names[frame->len] = operand->index;
+    frame->vals[frame->len++].type = VM_T_UNDEF;
+
+    return VM_OK;
+}
+
+static inline bool vm_push(vm_t* vm, const vm_value_t* value)
+{
+    if (vm->stack_len == vm->stack_cap)
+    {
+        uint32_t cap = vm->stack_cap == 0 ? STACK_INIT_SIZE : vm->stack_cap * 2;
+        vm_value_t* stack = realloc(vm->stack, cap * sizeof(vm_value_t));
+
+        if (!stack)
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            return false;
+        }
+
+        vm->stack = stack;
+        vm->stack_cap = cap;
+    }
+
+    vm_value_t* top = &vm->stack[vm->stack_len];
+
+    top->type = VM_T_UNDEF;
+    value_copy(top, value);
+
+    vm->stack_len++;
+
+    return true;
+}
+
+/*
+ * Integer division rounds towards negative infinity
+ */
+static inline int64_t int_div(int64_t a, int64_t b)
+{
+    if (b == -1)
+    {
+        return (int64_t)(0 - (uint64_t)a);
+    }
+
+    int64_t q = a / b;
+
+    if (a % b != 0 && ((a < 0) != (b < 0)))
+    {
+        q--;
+    }
+
+    return q;
+}
+
+/*
+ * Arithmetic instruction, result is stored to res
+ */
+static inline vm_error_t vm_arith(vm_t* vm, int opcode, const vm_value_t* a, const vm_value_t* b, vm_value_t* res)
+{
+    if (a->type == VM_T_INT && b->type == VM_T_INT && opcode != VM_DIV && opcode != VM_DIVS)
+    {
+        uint64_t x = (uint64_t)a->i;
+        uint64_t y = (uint64_t)b->i;
+
+        res->type = VM_T_INT;
+
+        switch (opcode)
+        {
+            case VM_ADD:
+            case VM_ADDS:
+                res->i = (int64_t)(x + y);
+                break;
+            case VM_SUB:
+            case VM_SUBS:
+                res->i = (int64_t)(x - y);
+                break;
+            case VM_MUL:
+            case VM_MULS:
+                res->i = (int64_t)(x * y);
+                break;
+            default:
+                if (b->i == 0)
+                {
+                    vm_fail(vm, VM_E_OPERAND, "Division by zero!");
+                    return VM_E_OPERAND;
+                }
+
+                res->i = int_div(a->i, b->i);
+                break;
+        }
+
+        return VM_OK;
+    }
+
+    if (a->type == VM_T_FLOAT && b->type == VM_T_FLOAT && opcode != VM_IDIV && opcode != VM_IDIVS)
+    {
+        res->type = VM_T_FLOAT;
+
+        switch (opcode)
+        {
+            case VM_ADD:
+            case VM_ADDS:
+                res->f = a->f + b->f;
+                break;
+            case VM_SUB:
+            case VM_SUBS:
+                res->f = a->f - b->f;
+                break;
+            case VM_MUL:
+            case VM_MULS:
+                res->f = a->f * b->f;
+                break;
+            default:
+                if (b->f == 0.0)
+                {
+                    vm_fail(vm, VM_E_OPERAND, "Division by zero!");
+                    return VM_E_OPERAND;
+                }
+
+                res->f = a->f / b->f;
+                break;
+        }
+
+        return VM_OK;
+    }
+
+    vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+
+    return VM_E_TYPE;
+}
+
+/*
+ * Relational instruction, result is stored to res
+ */
+static inline vm_error_t vm_compare(vm_t* vm, int opcode, const vm_value_t* a, const vm_value_t* b, bool* res)
+{
+    bool eq = opcode == VM_EQ || opcode == VM_EQS || opcode == VM_JUMPIFEQ || opcode == VM_JUMPIFNEQ ||
+              opcode == VM_JUMPIFEQS || opcode == VM_JUMPIFNEQS;
+    int cmp = 0;
+
+    if (eq && (a->type == VM_T_NIL || b->type == VM_T_NIL))
+    {
+        *res = a->type == b->type;
+        return VM_OK;
+    }
+
+    if (a->type != b->type || a->type == VM_T_NIL)
+    {
+        vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+        return VM_E_TYPE;
+    }
+
+    switch (a->type)
+    {
+        case VM_T_INT:
+            cmp = (a->i > b->i) - (a->i < b->i);
+            break;
+        case VM_T_FLOAT:
+            if (eq)
+            {
+                *res = a->f == b->f;
+                return VM_OK;
+            }
+
+            cmp = (a->f > b->f) - (a->f < b->f);
+            break;
+        case VM_T_BOOL:
+            cmp = (int)a->b - (int)b->b;
+            break;
+        default:
+            cmp = memcmp(a->s.data, b->s.data, a->s.len < b->s.len ? a->s.len : b->s.len);
+
+            if (cmp == 0)
+            {
+                cmp = (a->s.len > b->s.len) - (a->s.len < b->s.len);
+            }
+            break;
+    }
+
+    switch (opcode)
+    {
+        case VM_LT:
+        case VM_LTS:
+            *res = cmp < 0;
+            break;
+        case VM_GT:
+        case VM_GTS:
+            *res = cmp > 0;
+            break;
+        default:
+            *res = cmp == 0;
+            break;
+    }
+
+    return VM_OK;
+}
+
+static inline vm_error_t vm_logic(vm_t* vm, int opcode, const vm_value_t* a, const vm_value_t* b, vm_value_t* res)
+{
+    if (a->type != VM_T_BOOL || (b && b->type != VM_T_BOOL))
+    {
+        vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+        return VM_E_TYPE;
+    }
+
+    res->type = VM_T_BOOL;
+
+    switch (opcode)
+    {
+        case VM_AND:
+        case VM_ANDS:
+            res->b = a->b && b->b;
+            break;
+        case VM_OR:
+        case VM_ORS:
+            res->b = a->b || b->b;
+            break;
+        default:
+            res->b = !a->b;
+            break;
+    }
+
+    return VM_OK;
+}
+
+/*
+ * Type conversion instructions, b is used only by STRI2INT
+ */
+static vm_error_t vm_convert(vm_t* vm, int opcode, const vm_value_t* a, const vm_value_t* b, vm_value_t* res)
+{
+    switch (opcode)
+    {
+        case VM_INT2FLOAT:
+        case VM_INT2FLOATS:
+            if (a->type != VM_T_INT)
+            {
+                break;
+            }
+
+            res->type = VM_T_FLOAT;
+            res->f = (double)a->i;
+            return VM_OK;
+
+        case VM_FLOAT2INT:
+        case VM_FLOAT2INTS:
+            if (a->type != VM_T_FLOAT)
+            {
+                break;
+            }
+
+            res->type = VM_T_INT;
+            // out of range conversion behaves as on x86-64 (like ic21int)
+            res->i = (a->f >= -9223372036854775808.0 && a->f < 9223372036854775808.0) ?
+                     (int64_t)a->f : INT64_MIN;
+            return VM_OK;
+
+        case VM_INT2CHAR:
+        case VM_INT2CHARS:
+            if (a->type != VM_T_INT)
+            {
+                break;
+            }
+
+            if (a->i < 0 || a->i > 255)
+            {
+                vm_fail(vm, VM_E_STRING, "Character code is not in the 0-255 range!");
+                return VM_E_STRING;
+            }
+
+            if (!string_char(vm, res, (char)a->i))
+            {
+                vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+                return VM_E_INTERNAL;
+            }
+
+            return VM_OK;
+
+        default:
+            if (a->type != VM_T_STRING || b->type != VM_T_INT)
+            {
+                break;
+            }
+
+            if (b->i < 0 || (uint64_t)b->i >= a->s.len)
+            {
+                vm_fail(vm, VM_E_STRING, "String index out of bounds!");
+                return VM_E_STRING;
+            }
+
+            res->type = VM_T_INT;
+            res->i = (unsigned char)a->s.data[b->i];
+            return VM_OK;
+    }
+
+    vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+
+    return VM_E_TYPE;
+}
+
+static void vm_write(FILE* out, const vm_value_t* value)
+{
+    switch (value->type)
+    {
+        case VM_T_INT:
+            fprintf(out, "%" PRId64, value->i);
+            break;
+
+        case VM_T_FLOAT:
+        {
+            double f = value->f;
+
+            // integral floats are written as integers (like ic21int)
+            if (f != f)
+            {
+                fprintf(out, "%a", f);
+            }
+            else if (f < -9223372036854775808.0 || f >= 9223372036854775808.0)
+            {
+                fprintf(out, "%" PRId64, INT64_MIN);
+            }
+            else if ((double)(int64_t)f == f)
+            {
+                fprintf(out, "%" PRId64, (int64_t)f);
+            }
+            else
+            {
+                fprintf(out, "%a", f);
+            }
+            break;
+        }
+
+        case VM_T_BOOL:
+            fputs(value->b ? "true" : "false", out);
+            break;
+
+        case VM_T_STRING:
+            fwrite(value->s.data, 1, value->s.len, out);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * Read one line without the line terminator to a new string buffer
+ * (terminated for the number conversions), false on end of input
+ */
+static bool read_line(FILE* in, vm_string_t* line)
+{
+    size_t cap = LINE_INIT_SIZE;
+    int c;
+
+    line->len = 0;
+    line->data = vm_string_alloc(cap);
+
+    if (!line->data)
+    {
+        return false;
+    }
+
+    while ((c = getc(in)) != EOF && c != '\n')
+    {
+        if (line->len + 1 == cap)
+        {
+            vm_strbuf_t* tmp = realloc(VM_STRBUF(line->data), sizeof(vm_strbuf_t) + cap * 2);
+
+            if (!tmp)
+            {
+                vm_string_release(line->data);
+                return false;
+            }
+
+            line->data = tmp->data;
+            cap *= 2;
+            tmp->cap = cap;
+        }
+
+        line->data[line->len++] = (char)c;
+    }
+
+    if (c == EOF && line->len == 0)
+    {
+        vm_string_release(line->data);
+        return false;
+    }
+
+    line->data[line->len] = '\0';
+    VM_STRBUF(line->data)->used = line->len;
+
+    return true;
+}
+
+static bool only_spaces(const char* str)
+{
+    while (isspace((unsigned char)*str))
+    {
+        str++;
+    }
+
+    return *str == '\0';
+}
+
+/*
+ * READ instruction, nil is stored on wrong or missing input
+ */
+static void vm_read(FILE* in, vm_type_t type, vm_value_t* res)
+{
+    vm_string_t line;
+    char* end;
+
+    res->type = VM_T_NIL;
+
+    if (!read_line(in, &line))
+    {
+        return;
+    }
+
+    switch (type)
+    {
+        case VM_T_INT:
+            res->i = strtoll(line.data, &end, 0);
+
+            if (end != line.data && only_spaces(end))
+            {
+                res->type = VM_T_INT;
+            }
+            break;
+
+        case VM_T_FLOAT:
+            res->f = strtod(line.data, &end);
+
+            if (end != line.data && only_spaces(end))
+            {
+                res->type = VM_T_FLOAT;
+            }
+            break;
+
+        case VM_T_BOOL:
+            if (line.len > 0)
+            {
+                res->type = VM_T_BOOL;
+                res->b = line.len == 4 && tolower((unsigned char)line.data[0]) == 't' &&
+                         tolower((unsigned char)line.data[1]) == 'r' &&
+                         tolower((unsigned char)line.data[2]) == 'u' &&
+                         tolower((unsigned char)line.data[3]) == 'e';
+            }
+            break;
+
+        default:
+            res->type = VM_T_STRING;
+            res->s = line;
+            return;
+    }
+
+    vm_string_release(line.data);
+}
+
+/*
+ * Empty string is shared like the result of TYPE of undefined value
+ */
+static inline bool string_empty(vm_t* vm, vm_value_t* value)
+{
+    return string_static(&vm->types[VM_T_UNDEF], value, "", 0);
+}
+
+/*
+ * SUBSTRS, ORDS and CHRS - operands and results are on the data stack in
+ * the order of the IFJcode21 bodies of substr, ord and chr
+ */
+static vm_error_t vm_builtin(vm_t* vm, int opcode)
+{
+    uint32_t operands = opcode == VM_SUBSTRS ? 3 : (opcode == VM_ORDS ? 2 : 1);
+    vm_value_t res;
+    int64_t err = 1;
+    bool done;
+
+    if (vm->stack_len < operands)
+    {
+        vm_fail(vm, VM_E_VALUE, "Data stack is empty!");
+        return VM_E_VALUE;
+    }
+
+    vm_value_t* top = &vm->stack[vm->stack_len - 1];
+
+    for (uint32_t k = 0; k < operands; k++)
+    {
+        // string is on the top of substr and ord, the other operands are integers
+        if (top[-(int)k].type != (k == 0 && opcode != VM_CHRS ? VM_T_STRING : VM_T_INT))
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            return VM_E_TYPE;
+        }
+    }
+
+    if (opcode == VM_SUBSTRS)
+    {
+        int64_t begin = top[-1].i - 1;
+        int64_t end = top[-2].i < (int64_t)top->s.len ? top[-2].i : (int64_t)top->s.len;
+
+        if (begin < 0 || begin > (int64_t)top->s.len || top[-2].i < 0 || begin >= end)
+        {
+            done = string_empty(vm, &res);
+        }
+        else if (begin == 0)
+        {
+            // prefix shares the buffer
+            VM_STRBUF(top->s.data)->refs++;
+            res = *top;
+            res.s.len = (size_t)end;
+            done = true;
+        }
+        else
+        {
+            res.type = VM_T_STRING;
+            done = vm_string_new(&res.s, top->s.data + begin, (size_t)(end - begin));
+        }
+    }
+    else if (opcode == VM_ORDS)
+    {
+        if (top[-1].i >= 0 && top[-1].i < (int64_t)top->s.len)
+        {
+            res.type = VM_T_INT;
+            res.i = (unsigned char)top->s.data[top[-1].i];
+            err = 0;
+            done = true;
+        }
+        else
+        {
+            done = string_empty(vm, &res);
+        }
+    }
+    else
+    {
+        if (top->i >= 0 && top->i <= 255)
+        {
+            err = 0;
+            done = string_char(vm, &res, (char)top->i);
+        }
+        else
+        {
+            done = string_empty(vm, &res);
+        }
+    }
+
+    if (!done)
+    {
+        vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+        return VM_E_INTERNAL;
+    }
+
+    for (uint32_t k = 0; k < operands; k++)
+    {
+        value_free(&vm->stack[--vm->stack_len]);
+    }
+
+    vm->stack[vm->stack_len++] = res;
+
+    // ord and chr return the error flag too
+    if (opcode != VM_SUBSTRS)
+    {
+        res.type = VM_T_INT;
+        res.i = err;
+
+        if (!vm_push(vm, &res))
+        {
+            return VM_E_INTERNAL;
+        }
+    }
+
+    return VM_OK;
+}
+
+static void vm_dprint(vm_t* vm, const vm_value_t* value, uint32_t ip)
+{
+    if (value)
+    {
+        vm_write(stderr, value);
+        return;
+    }
+
+    fprintf(stderr, "Current line: %" PRIu32 "\n", vm->program->code[ip].line);
+    fprintf(stderr, "Data stack size: %" PRIu32 "\n", vm->stack_len);
+    fprintf(stderr, "Call stack size: %" PRIu32 "\n", vm->calls_len);
+    fprintf(stderr, "Temporary frame: %s\n", vm->tf ? "defined" : "undefined");
+    fprintf(stderr, "Local frame: %s\n", vm->lf ? "defined" : "undefined");
+}
+
+static bool vm_init(vm_t* vm, vm_program_t* program)
+{
+    memset(vm, 0, sizeof(vm_t));
+
+    vm->program = program;
+
+    // sentinel instruction stops the interpretation at the end of program
+    if (program->code_cap <= program->code_len)
+    {
+        vm_instr_t* code = realloc(program->code, (program->code_len + 1) * sizeof(vm_instr_t));
+
+        if (!code)
+        {
+            return false;
+        }
+
+        program->code = code;
+        program->code_cap = program->code_len + 1;
+    }
+
+    memset(&program->code[program->code_len], 0, sizeof(vm_instr_t));
+    program->code[program->code_len].opcode = VM_HALT;
+
+    vm->globals = calloc(program->names_len + 1, sizeof(vm_value_t));
+    vm->defined = calloc(program->names_len + 1, sizeof(bool));
+
+    return vm->globals && vm->defined;
+}
+
+static void vm_free(vm_t* vm)
+{
+    for (uint32_t i = 0; vm->globals && i < vm->program->names_len; i++)
+    {
+        value_free(&vm->globals[i]);
+    }
+
+    for (uint32_t i = 0; i < vm->stack_len; i++)
+    {
+        value_free(&vm->stack[i]);
+    }
+
+    frame_destroy(vm->lf);
+    frame_destroy(vm->tf);
+    frame_destroy(vm->free_frames);
+
+    // preallocated strings are never released by values
+    for (int i = 0; i < 256; i++)
+    {
+        if (vm->chars[i])
+        {
+            free(VM_STRBUF(vm->chars[i]));
+        }
+    }
+
+    for (int i = 0; i <= VM_T_STRING; i++)
+    {
+        if (vm->types[i])
+        {
+            free(VM_STRBUF(vm->types[i]));
+        }
+    }
+
+    free(vm->globals);
+    free(vm->defined);
+    free(vm->stack);
+    free(vm->calls);
+}
+
+/* Fetch operands, jump to the error handler on failure */
+#define VAR(dst, n)   if (!((dst) = vm_var(vm, &ins->op[n]))) goto error
+#define SYMB(dst, n)  if (!((dst) = vm_symb(vm, &ins->op[n]))) goto error
+#define CHECK(expr)   if ((expr) != VM_OK) goto error
+
+/* Pop operands of stack instruction, a is below b */
+#define POP1(a)                                                                  \
+        if (vm->stack_len < 1) { vm_fail(vm, VM_E_VALUE, "Data stack is empty!"); goto error; } \
+        a = vm->stack[--vm->stack_len]
+#define POP2(a, b)                                                               \
+        if (vm->stack_len < 2) { vm_fail(vm, VM_E_VALUE, "Data stack is empty!"); goto error; } \
+        b = vm->stack[--vm->stack_len];                                          \
+        a = vm->stack[--vm->stack_len]
+
+/* Store result to the variable, old value of variable is released */
+#define STORE(dst, res)  do { value_free(dst); *(dst) = (res); } while (0)
+
+#define JUMP_TO(target)                                                          \
+        do {                                                                     \
+            if ((target) == VM_NO_TARGET)                                        \
+            {                                                                    \
+                vm_fail(vm, VM_E_SEMANTIC, "Label does not exist!");             \
+                goto error;                                                      \
+            }                                                                    \
+            ip = (target);                                                       \
+        } while (0)
+
+/* Hot target of the jump, call or return continues in compiled code */
+#define JIT_ENTER()                                                              \
+        if (jit && vm_jit_enter(jit, vm, &ip) != VM_OK)                          \
+        {                                                                        \
+            ins = &code[ip];                                                     \
+            goto error;                                                          \
+        }
+
+/* Jump to target, backward jumps are checked by the JIT */
+#define JUMP_BACK(target)                                                        \
+        do {                                                                     \
+            JUMP_TO(target);                                                     \
+            if (ip <= (uint32_t)(ins - code))                                    \
+            {                                                                    \
+                JIT_ENTER();                                                     \
+            }                                                                    \
+        } while (0)
+
+/*
+ * Single step (slow path of compiled code) stops before the next
+ * instruction. Threaded code switches to a table where every opcode stops,
+ * profiled code to a table where every opcode is counted first.
+ */
+#ifdef VM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define VM_LABEL_ADDR(op, name, operands) &&op_##op,
+#define VM_STEP_ADDR(op, name, operands)  &&stepped,
+#define VM_PROFILE_ADDR(op, name, operands) &&profiled,
+#define VM_OP(op)       op_##op:
+#define VM_DISPATCH()   do { ins = &code[ip++]; goto *table[ins->opcode]; } while (0)
+#else
+#define VM_OP(op)       case VM_##op:
+#define VM_DISPATCH()   do { if (step) goto stepped; goto dispatch; } while (0)
+#endif
+
+/*
+ * Interpret the program from ip, the state is initialized by the caller.
+ * Step executes only one instruction (not EXIT), its errors are not printed.
+ */
+static int vm_execute(vm_t* vm, vm_jit_t* jit, uint32_t ip, bool step)
+{
+    vm_program_t* program = vm->program;
+    vm_instr_t* code = program->code;
+    vm_instr_t* ins;
+    int exit_code = 0;
+    vm_error_t result;
+
+    vm_value_t* dst;
+    vm_value_t* a;
+    vm_value_t* b;
+    vm_value_t x, y, res;
+    bool cond;
+
+#ifdef VM_THREADED
+    static void* dispatch[VM_OPCODE_COUNT + 1] = {
+        VM_OPCODES(VM_LABEL_ADDR)
+        &&op_HALT
+    };
+    static void* stepping[VM_OPCODE_COUNT + 1] = {
+        VM_OPCODES(VM_STEP_ADDR)
+        &&stepped
+    };
+    static void* profiling[VM_OPCODE_COUNT + 1] = {
+        VM_OPCODES(VM_PROFILE_ADDR)
+        &&profiled
+    };
+    void** table = step ? stepping : vm->profile ? profiling : dispatch;
+
+    ins = &code[ip++];
+    goto *(step ? dispatch : table)[ins->opcode];
+
+profiled:
+    vm->profile->counts[ins - code]++;
+    vm->profile->steps++;
+    goto *dispatch[ins->opcode];
+#else
+dispatch:
+    ins = &code[ip++];
+
+    if (vm->profile)
+    {
+        vm->profile->counts[ins - code]++;
+        vm->profile->steps++;
+    }
+
+    switch (ins->opcode)
+    {
+#endif
+
+    VM_OP(MOVE)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        value_copy(dst, a);
+        VM_DISPATCH();
+
+    VM_OP(CREATEFRAME)
+        frame_release(vm, vm->tf);
+        vm->tf = frame_new(vm);
+        if (!vm->tf)
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            goto error;
+        }
+        VM_DISPATCH();
+
+    VM_OP(PUSHFRAME)
+        if (!vm->tf)
+        {
+            vm_fail(vm, VM_E_FRAME, "Temporary frame does not exist!");
+            goto error;
+        }
+        vm->tf->next = vm->lf;
+        vm->lf = vm->tf;
+        vm->tf = NULL;
+        VM_DISPATCH();
+
+    VM_OP(POPFRAME)
+        if (!vm->lf)
+        {
+            vm_fail(vm, VM_E_FRAME, "Local frame does not exist!");
+            goto error;
+        }
+        frame_release(vm, vm->tf);
+        vm->tf = vm->lf;
+        vm->lf = vm->lf->next;
+        vm->tf->next = NULL;
+        VM_DISPATCH();
+
+    VM_OP(DEFVAR)
+        CHECK(vm_defvar(vm, &ins->op[0]));
+        VM_DISPATCH();
+
+    VM_OP(CALL)
+        if (vm->calls_len == vm->calls_cap)
+        {
+            uint32_t cap = vm->calls_cap == 0 ? STACK_INIT_SIZE : vm->calls_cap * 2;
+            uint32_t* calls = realloc(vm->calls, cap * sizeof(uint32_t));
+
+            if (!calls)
+            {
+                vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+                goto error;
+            }
+
+            vm->calls = calls;
+            vm->calls_cap = cap;
+        }
+        vm->calls[vm->calls_len++] = ip;
+        JUMP_TO(ins->op[0].index);
+        if (vm->profile)
+        {
+            vm_profile_call(vm->profile, ins->op[0].hint);
+        }
+        JIT_ENTER();
+        VM_DISPATCH();
+
+    VM_OP(RETURN)
+        if (vm->calls_len == 0)
+        {
+            vm_fail(vm, VM_E_VALUE, "Call stack is empty!");
+            goto error;
+        }
+        ip = vm->calls[--vm->calls_len];
+        if (vm->profile)
+        {
+            vm_profile_return(vm->profile);
+        }
+        JIT_ENTER();
+        VM_DISPATCH();
+
+    VM_OP(PUSHS)
+        SYMB(a, 0);
+        if (!vm_push(vm, a))
+        {
+            goto error;
+        }
+        VM_DISPATCH();
+
+    VM_OP(POPS)
+        VAR(dst, 0);
+        POP1(x);
+        STORE(dst, x);
+        VM_DISPATCH();
+
+    VM_OP(CLEARS)
+        while (vm->stack_len > 0)
+        {
+            value_free(&vm->stack[--vm->stack_len]);
+        }
+        VM_DISPATCH();
+
+    VM_OP(ADD)
+    VM_OP(SUB)
+    VM_OP(MUL)
+    VM_OP(DIV)
+    VM_OP(IDIV)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        SYMB(b, 2);
+        CHECK(vm_arith(vm, ins->opcode, a, b, &res));
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(ADDS)
+    VM_OP(SUBS)
+    VM_OP(MULS)
+    VM_OP(DIVS)
+    VM_OP(IDIVS)
+        POP2(x, y);
+        if (vm_arith(vm, ins->opcode, &x, &y, &res) != VM_OK)
+        {
+            value_free(&x);
+            value_free(&y);
+            goto error;
+        }
+        vm->stack[vm->stack_len++] = res;
+        VM_DISPATCH();
+
+    VM_OP(LT)
+    VM_OP(GT)
+    VM_OP(EQ)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        SYMB(b, 2);
+        CHECK(vm_compare(vm, ins->opcode, a, b, &cond));
+        value_free(dst);
+        dst->type = VM_T_BOOL;
+        dst->b = cond;
+        VM_DISPATCH();
+
+    VM_OP(LTS)
+    VM_OP(GTS)
+    VM_OP(EQS)
+        POP2(x, y);
+        result = vm_compare(vm, ins->opcode, &x, &y, &cond);
+        value_free(&x);
+        value_free(&y);
+        CHECK(result);
+        vm->stack[vm->stack_len].type = VM_T_BOOL;
+        vm->stack[vm->stack_len++].b = cond;
+        VM_DISPATCH();
+
+    VM_OP(AND)
+    VM_OP(OR)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        SYMB(b, 2);
+        CHECK(vm_logic(vm, ins->opcode, a, b, &res));
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(NOT)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        CHECK(vm_logic(vm, ins->opcode, a, NULL, &res));
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(ANDS)
+    VM_OP(ORS)
+        POP2(x, y);
+        if (vm_logic(vm, ins->opcode, &x, &y, &res) != VM_OK)
+        {
+            value_free(&x);
+            value_free(&y);
+            goto error;
+        }
+        vm->stack[vm->stack_len++] = res;
+        VM_DISPATCH();
+
+    VM_OP(NOTS)
+        POP1(x);
+        if (vm_logic(vm, ins->opcode, &x, NULL, &res) != VM_OK)
+        {
+            value_free(&x);
+            goto error;
+        }
+        vm->stack[vm->stack_len++] = res;
+        VM_DISPATCH();
+
+    VM_OP(INT2FLOAT)
+    VM_OP(FLOAT2INT)
+    VM_OP(INT2CHAR)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        CHECK(vm_convert(vm, ins->opcode, a, NULL, &res));
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(STRI2INT)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        SYMB(b, 2);
+        CHECK(vm_convert(vm, ins->opcode, a, b, &res));
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(INT2FLOATS)
+    VM_OP(FLOAT2INTS)
+    VM_OP(INT2CHARS)
+        POP1(x);
+        result = vm_convert(vm, ins->opcode, &x, NULL, &res);
+        value_free(&x);
+        CHECK(result);
+        vm->stack[vm->stack_len++] = res;
+        VM_DISPATCH();
+
+    VM_OP(STRI2INTS)
+        POP2(x, y);
+        result = vm_convert(vm, ins->opcode, &x, &y, &res);
+        value_free(&x);
+        value_free(&y);
+        CHECK(result);
+        vm->stack[vm->stack_len++] = res;
+        VM_DISPATCH();
+
+    VM_OP(READ)
+        VAR(dst, 0);
+        if (ins->op[1].index == VM_T_NIL)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        fflush(vm->out);
+        vm_read(vm->in, (vm_type_t)ins->op[1].index, &res);
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(WRITE)
+        SYMB(a, 0);
+        vm_write(vm->out, a);
+        VM_DISPATCH();
+
+    VM_OP(CONCAT)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        SYMB(b, 2);
+        if (a->type != VM_T_STRING || b->type != VM_T_STRING)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        res.type = VM_T_STRING;
+        if (!vm_string_concat(&res.s, &a->s, &b->s))
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            goto error;
+        }
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(STRLEN)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        if (a->type != VM_T_STRING)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        res.type = VM_T_INT;
+        res.i = (int64_t)a->s.len;
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(GETCHAR)
+        VAR(dst, 0);
+        SYMB(a, 1);
+        SYMB(b, 2);
+        if (a->type != VM_T_STRING || b->type != VM_T_INT)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        if (b->i < 0 || (uint64_t)b->i >= a->s.len)
+        {
+            vm_fail(vm, VM_E_STRING, "String index out of bounds!");
+            goto error;
+        }
+        if (!string_char(vm, &res, a->s.data[b->i]))
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            goto error;
+        }
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(SETCHAR)
+        VAR(dst, 0);
+        if (dst->type == VM_T_UNDEF)
+        {
+            vm_fail(vm, VM_E_VALUE, "Variable has not been initialized!");
+            goto error;
+        }
+        SYMB(a, 1);
+        SYMB(b, 2);
+        if (dst->type != VM_T_STRING || a->type != VM_T_INT || b->type != VM_T_STRING)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        if (a->i < 0 || (uint64_t)a->i >= dst->s.len || b->s.len == 0)
+        {
+            vm_fail(vm, VM_E_STRING, "String index out of bounds!");
+            goto error;
+        }
+        if (!vm_string_unique(&dst->s))
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            goto error;
+        }
+        dst->s.data[a->i] = b->s.data[0];
+        VM_DISPATCH();
+
+    VM_OP(TYPE)
+        VAR(dst, 0);
+        if (ins->op[1].kind == VM_OPND_CONST)
+        {
+            a = &program->consts[ins->op[1].index];
+        }
+        else
+        {
+            VAR(a, 1);
+        }
+        if (!string_static(&vm->types[a->type], &res, type_names[a->type],
+                           strlen(type_names[a->type])))
+        {
+            vm_fail(vm, VM_E_INTERNAL, "Out of memory!");
+            goto error;
+        }
+        STORE(dst, res);
+        VM_DISPATCH();
+
+    VM_OP(JUMP)
+        JUMP_BACK(ins->op[0].index);
+        VM_DISPATCH();
+
+    VM_OP(JUMPIFEQ)
+    VM_OP(JUMPIFNEQ)
+        SYMB(a, 1);
+        SYMB(b, 2);
+        CHECK(vm_compare(vm, ins->opcode, a, b, &cond));
+        if (cond == (ins->opcode == VM_JUMPIFEQ))
+        {
+            JUMP_BACK(ins->op[0].index);
+        }
+        VM_DISPATCH();
+
+    VM_OP(JUMPIFEQS)
+    VM_OP(JUMPIFNEQS)
+        POP2(x, y);
+        result = vm_compare(vm, ins->opcode, &x, &y, &cond);
+        value_free(&x);
+        value_free(&y);
+        CHECK(result);
+        if (cond == (ins->opcode == VM_JUMPIFEQS))
+        {
+            JUMP_BACK(ins->op[0].index);
+        }
+        VM_DISPATCH();
+
+    VM_OP(EXIT)
+        SYMB(a, 0);
+        if (a->type != VM_T_INT)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        if (a->i < 0 || a->i > 49)
+        {
+            vm_fail(vm, VM_E_OPERAND, "EXIT instruction expects values in the range 0-49!");
+            goto error;
+        }
+        exit_code = (int)a->i;
+        goto halt;
+
+    VM_OP(BREAK)
+        vm_dprint(vm, NULL, ip - 1);
+        VM_DISPATCH();
+
+    VM_OP(DPRINT)
+        SYMB(a, 0);
+        vm_dprint(vm, a, ip - 1);
+        VM_DISPATCH();
+
+    VM_OP(WRITEN)
+        SYMB(a, 0);
+        if (a->type != VM_T_INT)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        if (a->i < 0 || a->i > (int64_t)vm->stack_len)
+        {
+            vm_fail(vm, VM_E_VALUE, "Data stack is empty!");
+            goto error;
+        }
+        for (int64_t k = a->i; k > 0; k--)
+        {
+            x = vm->stack[--vm->stack_len];
+            if (x.type == VM_T_NIL)
+            {
+                fputs("nil", vm->out);
+            }
+            vm_write(vm->out, &x);
+            value_free(&x);
+        }
+        VM_DISPATCH();
+
+    VM_OP(READS)
+        if (ins->op[0].index == VM_T_NIL)
+        {
+            vm_fail(vm, VM_E_TYPE, "Wrong operand type!");
+            goto error;
+        }
+        fflush(vm->out);
+        vm_read(vm->in, (vm_type_t)ins->op[0].index, &res);
+        cond = vm_push(vm, &res);
+        value_free(&res);
+        if (!cond)
+        {
+            goto error;
+        }
+        VM_DISPATCH();
+
+    VM_OP(SUBSTRS)
+    VM_OP(ORDS)
+    VM_OP(CHRS)
+        CHECK(vm_builtin(vm, ins->opcode));
+        VM_DISPATCH();
+
+    VM_OP(HALT)
+        exit_code = 0;
+        goto halt;
+
+#ifndef VM_THREADED
+        default:
+            exit_code = 0;
+            goto halt;
+    }
+#endif
+
+stepped:
+#ifdef VM_THREADED
+    ip--;       // next instruction is already fetched
+#endif
+    vm->ip = ip;
+    return VM_OK;
+
+error:
+    if (!step)
+    {
+        fflush(vm->out);
+
+        if (program->source_lines && program->source_lines[ins - code] != 0)
+        {
+            fprintf(stderr, "Error at line %" PRIu32 " (source line %" PRIu32 "): %s\n",
+                    ins->line, program->source_lines[ins - code], vm->message);
+        }
+        else
+        {
+            fprintf(stderr, "Error at line %" PRIu32 ": %s\n", ins->line, vm->message);
+        }
+    }
+    return vm->error;
+
+halt:
+    return exit_code;
+}
+
+uint32_t vm_jit_step(vm_t* vm, uint32_t ip)
+{
+    if (vm_execute(vm, NULL, ip, true) != VM_OK)
+    {
+        return ip | VM_JIT_ERROR;
+    }
+
+    return vm->ip | VM_JIT_TRANSFER;
+}
+
+int vm_run(vm_program_t* program, FILE* in, FILE* out, uint32_t jit_threshold, vm_profile_t* profile)
+{
+    vm_t vm;
+    vm_jit_t jit;
+    bool compiled;
+    int exit_code;
+
+    if (!vm_init(&vm, program))
+    {
+        vm_free(&vm);
+        fprintf(stderr, "Out of memory!\n");
+        return VM_E_INTERNAL;
+    }
+
+    vm.in = in;
+    vm.out = out;
+    vm.profile = profile;
+
+    // program is interpreted when JIT is disabled or not available,
+    // compiled code would bypass the counters of the profile
+    compiled = jit_threshold > 0 && !profile && vm_jit_init(&jit, program, jit_threshold);
+
+    exit_code = vm_execute(&vm, compiled ? &jit : NULL, 0, false);
+
+    fflush(out);
+
+    if (profile)
+    {
+        vm_profile_finish(profile);
+    }
+
+    if (compiled)
+    {
+        vm_jit_free(&jit);
+    }
+
+    vm_free(&vm);
+
+    return exit_code;
+}
+
+#ifdef VM_THREADED
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,397 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - program representation and interface
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_VM_H
+#define IFJ_BRATWURST2021_VM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * List of all IFJcode21 instructions.
+ *
+ * X(opcode, name, operands) where operands is a signature string:
+ * 'v' variable, 's' symbol (variable or constant), 'l' label, 't' type.
+ *
+ * Instructions behind DPRINT are extensions of ic21vm (not known to ic21int),
+ * they replace the calls of built-in functions ('compiler --vm-ext'):
+ * WRITEN n writes n values from the data stack (nil as "nil"), READS pushes
+ * the read value, SUBSTRS, ORDS and CHRS have the stack effect of the bodies
+ * of substr, ord and chr generated in IFJcode21.
+ */
+#define VM_OPCODES(X)                     \
+        X(MOVE,        "MOVE",        "vs")  \
+        X(CREATEFRAME, "CREATEFRAME", "")    \
+        X(PUSHFRAME,   "PUSHFRAME",   "")    \
+        X(POPFRAME,    "POPFRAME",    "")    \
+        X(DEFVAR,      "DEFVAR",      "v")   \
+        X(CALL,        "CALL",        "l")   \
+        X(RETURN,      "RETURN",      "")    \
+        X(PUSHS,       "PUSHS",       "s")   \
+        X(POPS,        "POPS",        "v")   \
+        X(CLEARS,      "CLEARS",      "")    \
+        X(ADD,         "ADD",         "vss") \
+        X(SUB,         "SUB",         "vss") \
+        X(MUL,         "MUL",         "vss") \
+        X(DIV,         "DIV",         "vss") \
+        X(IDIV,        "IDIV",        "vss") \
+        X(ADDS,        "ADDS",        "")    \
+        X(SUBS,        "SUBS",        "")    \
+        X(MULS,        "MULS",        "")    \
+        X(DIVS,        "DIVS",        "")    \
+        X(IDIVS,       "IDIVS",       "")    \
+        X(LT,          "LT",          "vss") \
+        X(GT,          "GT",          "vss") \
+        X(EQ,          "EQ",          "vss") \
+        X(LTS,         "LTS",         "")    \
+        X(GTS,         "GTS",         "")    \
+        X(EQS,         "EQS",         "")    \
+        X(AND,         "AND",         "vss") \
+        X(OR,          "OR",          "vss") \
+        X(NOT,         "NOT",         "vs")  \
+        X(ANDS,        "ANDS",        "")    \
+        X(ORS,         "ORS",         "")    \
+        X(NOTS,        "NOTS",        "")    \
+        X(INT2FLOAT,   "INT2FLOAT",   "vs")  \
+        X(FLOAT2INT,   "FLOAT2INT",   "vs")  \
+        X(INT2CHAR,    "INT2CHAR",    "vs")  \
+        X(STRI2INT,    "STRI2INT",    "vss") \
+        X(INT2FLOATS,  "INT2FLOATS",  "")    \
+        X(FLOAT2INTS,  "FLOAT2INTS",  "")    \
+        X(INT2CHARS,   "INT2CHARS",   "")    \
+        X(STRI2INTS,   "STRI2INTS",   "")    \
+        X(READ,        "READ",        "vt")  \
+        X(WRITE,       "WRITE",       "s")   \
+        X(CONCAT,      "CONCAT",      "vss") \
+        X(STRLEN,      "STRLEN",      "vs")  \
+        X(GETCHAR,     "GETCHAR",     "vss") \
+        X(SETCHAR,     "SETCHAR",     "vss") \
+        X(TYPE,        "TYPE",        "vs")  \
+        X(JUMP,        "JUMP",        "l")   \
+        X(JUMPIFEQ,    "JUMPIFEQ",    "lss") \
+        X(JUMPIFNEQ,   "JUMPIFNEQ",   "lss") \
+        X(JUMPIFEQS,   "JUMPIFEQS",   "l")   \
+        X(JUMPIFNEQS,  "JUMPIFNEQS",  "l")   \
+        X(EXIT,        "EXIT",        "s")   \
+        X(BREAK,       "BREAK",       "")    \
+        X(DPRINT,      "DPRINT",      "s")   \
+        X(WRITEN,      "WRITEN",      "s")   \
+        X(READS,       "READS",       "t")   \
+        X(SUBSTRS,     "SUBSTRS",     "")    \
+        X(ORDS,        "ORDS",        "")    \
+        X(CHRS,        "CHRS",        "")
+
+#define VM_OPCODE_ENUM(op, name, operands) VM_##op,
+
+/**
+ * @enum Opcodes of the compact bytecode. LABEL is not an instruction,
+ *       labels are resolved to instruction indexes by the loader.
+ */
+typedef enum vm_opcode
+{
+    VM_OPCODES(VM_OPCODE_ENUM)
+    VM_OPCODE_COUNT
+} vm_opcode_t;
+
+/**
+ * @enum Exit codes of the interpreter (same as the reference ic21int).
+ */
+typedef enum vm_error
+{
+    VM_OK          = 0,
+    VM_E_PARAM     = 50,  // wrong command line arguments
+    VM_E_SYNTAX    = 51,  // lexical or syntax error in IFJcode21
+    VM_E_SEMANTIC  = 52,  // undefined label, variable redefinition
+    VM_E_TYPE      = 53,  // wrong operand types
+    VM_E_VAR       = 54,  // access to undefined variable
+    VM_E_FRAME     = 55,  // frame does not exist
+    VM_E_VALUE     = 56,  // missing value (variable, data or call stack)
+    VM_E_OPERAND   = 57,  // wrong operand value (division by zero, EXIT)
+    VM_E_STRING    = 58,  // wrong string operation
+    VM_E_FILE      = 60,  // input file cannot be opened
+    VM_E_INTERNAL  = 99
+} vm_error_t;
+
+/**
+ * @enum Types of runtime values.
+ */
+typedef enum vm_type
+{
+    VM_T_UNDEF,   // defined variable without value
+    VM_T_NIL,
+    VM_T_INT,
+    VM_T_FLOAT,
+    VM_T_BOOL,
+    VM_T_STRING
+} vm_type_t;
+
+/**
+ * @struct Reference counted buffer of strings. Every string sharing the buffer
+ *         sees its prefix, the string ending at the used part appends in place.
+ */
+typedef struct vm_strbuf
+{
+    size_t refs;
+    size_t used;
+    size_t cap;
+    char data[];
+} vm_strbuf_t;
+
+/* References of the preallocated strings which are never released */
+#define VM_STATIC_REFS ((size_t)1 << (sizeof(size_t) * 8 - 2))
+
+#define VM_STRBUF(str) ((vm_strbuf_t*)((str) - offsetof(vm_strbuf_t, data)))
+
+/**
+ * @struct Byte string, may contain '\0' and it is not terminated. Data point
+ *         into the buffer, the value holding the string owns one reference.
+ */
+typedef struct vm_string
+{
+    char* data;
+    size_t len;
+} vm_string_t;
+
+/**
+ * @struct Runtime value.
+ */
+typedef struct vm_value
+{
+    vm_type_t type;
+    union
+    {
+        int64_t i;
+        double f;
+        bool b;
+        vm_string_t s;
+    };
+} vm_value_t;
+
+/**
+ * @enum Kinds of instruction operands.
+ */
+typedef enum vm_operand_kind
+{
+    VM_OPND_NONE,
+    VM_OPND_GF,     // index is slot of the global frame
+    VM_OPND_LF,     // index is variable name, hint is cached frame slot
+    VM_OPND_TF,     // index is variable name, hint is cached frame slot
+    VM_OPND_CONST,  // index into constant pool
+    VM_OPND_LABEL,  // index is target instruction, hint is label
+    VM_OPND_TYPE    // index is vm_type_t
+} vm_operand_kind_t;
+
+#define VM_NO_TARGET UINT32_MAX
+
+/**
+ * @struct Instruction operand.
+ */
+typedef struct vm_operand
+{
+    uint8_t kind;
+    uint32_t index;
+    uint32_t hint;
+} vm_operand_t;
+
+/**
+ * @struct One instruction of the bytecode.
+ */
+typedef struct vm_instr
+{
+    uint8_t opcode;
+    uint32_t line;       /// Line in the IFJcode21 source.
+    vm_operand_t op[3];
+} vm_instr_t;
+
+/**
+ * @struct Label of the source program.
+ */
+typedef struct vm_label
+{
+    char* name;
+    uint32_t target;     /// Index of the instruction or VM_NO_TARGET.
+} vm_label_t;
+
+/**
+ * @struct Loaded program. Variable names are shared by all frames,
+ *         global frame has one slot for every name.
+ */
+typedef struct vm_program
+{
+    vm_instr_t* code;
+    uint32_t code_len;
+    uint32_t code_cap;
+
+    vm_value_t* consts;
+    uint32_t consts_len;
+    uint32_t consts_cap;
+
+    char** names;
+    uint32_t names_len;
+    uint32_t names_cap;
+
+    vm_label_t* labels;
+    uint32_t labels_len;
+    uint32_t labels_cap;
+
+    uint32_t* source_lines;  /// IFJ21 line of every instruction (0 unknown) or NULL.
+} vm_program_t;
+
+/**
+ * Allocate string buffer with one reference.
+ *
+ * @param cap Capacity of the buffer.
+ * @return Data of the buffer or NULL.
+ */
+char* vm_string_alloc(size_t cap);
+
+/**
+ * Create string with a copy of the data in a new buffer.
+ *
+ * @param str String to fill.
+ * @param data Content of the string.
+ * @param len Length of data.
+ * @return True on success.
+ */
+bool vm_string_new(vm_string_t* str, const char* data, size_t len);
+
+/**
+ * Concatenate strings. Content of b is appended in place when a ends at the
+ * used part of its buffer, otherwise the result gets a new buffer with
+ * a spare capacity, so repeated appends are amortized linear.
+ *
+ * @param res String to fill, it holds a new reference.
+ * @param a First string.
+ * @param b Second string.
+ * @return True on success.
+ */
+bool vm_string_concat(vm_string_t* res, const vm_string_t* a, const vm_string_t* b);
+
+/**
+ * Make the buffer of the string owned only by the string (before a write).
+ *
+ * @param str String.
+ * @return True on success.
+ */
+bool vm_string_unique(vm_string_t* str);
+
+/**
+ * Drop one reference of the buffer, the last one frees it.
+ *
+ * @param data Data of the buffer.
+ */
+void vm_string_release(char* data);
+
+/**
+ * Name of the opcode.
+ *
+ * @param opcode Opcode.
+ * @return Instruction name.
+ */
+const char* vm_opcode_name(vm_opcode_t opcode);
+
+/**
+ * Operand signature of the opcode ('v', 's', 'l', 't' for every operand).
+ *
+ * @param opcode Opcode.
+ * @return Signature string.
+ */
+const char* vm_opcode_operands(vm_opcode_t opcode);
+
+/**
+ * Initialization of an empty program.
+ *
+ * @param program Pointer to program.
+ */
+void vm_program_init(vm_program_t* program);
+
+/**
+ * Release all memory of the program.
+ *
+ * @param program Pointer to program.
+ */
+void vm_program_free(vm_program_t* program);
+
+/**
+ * Load IFJcode21 source or binary object, resolve labels and variable names.
+ *
+ * @param file Source stream.
+ * @param program Initialized program to fill.
+ * @return VM_OK or VM_E_SYNTAX, VM_E_SEMANTIC, VM_E_INTERNAL.
+ */
+vm_error_t vm_load(FILE* file, vm_program_t* program);
+
+/**
+ * Load source map written by the compiler ('compiler --source-map=FILE').
+ * Every entry "<IFJcode21 line> <IFJ21 line>" starts a run of lines of one
+ * IFJ21 line, instructions are found by their IFJcode21 line.
+ *
+ * @param file Source map stream.
+ * @param program Loaded program.
+ * @return VM_OK or VM_E_SYNTAX for malformed map, VM_E_INTERNAL.
+ */
+vm_error_t vm_load_source_map(FILE* file, vm_program_t* program);
+
+/**
+ * Check the magic number of binary object.
+ *
+ * @param data Content of the file.
+ * @param len Length of data.
+ * @return True if data are a binary object.
+ */
+bool vm_is_object(const char* data, size_t len);
+
+/**
+ * Load program from binary object.
+ *
+ * @param data Content of the object.
+ * @param len Length of data.
+ * @param program Initialized program to fill.
+ * @return VM_OK or VM_E_SYNTAX for malformed object.
+ */
+vm_error_t vm_object_parse(const char* data, size_t len, vm_program_t* program);
+
+/**
+ * Write program as binary object.
+ *
+ * @param file Output stream (binary).
+ * @param program Loaded program.
+ * @return True on success.
+ */
+bool vm_object_write(FILE* file, const vm_program_t* program);
+
+/**
+ * Write program in the textual IFJcode21 form.
+ *
+ * @param file Output stream.
+ * @param program Loaded program.
+ */
+void vm_disassemble(FILE* file, const vm_program_t* program);
+
+/**
+ * Default count of executions of a jump target, call or return before the
+ * following code is compiled to machine code.
+ */
+#define VM_JIT_THRESHOLD 1000
+
+struct vm_profile;
+
+/**
+ * Interpret the program.
+ *
+ * @param program Loaded program.
+ * @param in Input for READ.
+ * @param out Output for WRITE.
+ * @param jit_threshold Executions before a hot region is compiled, 0 disables JIT.
+ * @param profile Initialized profile (vm_profile.h) or NULL, profiling disables JIT.
+ * @return Exit code of the program (EXIT operand, 0 or vm_error_t).
+ */
+int vm_run(vm_program_t* program, FILE* in, FILE* out, uint32_t jit_threshold, struct vm_profile* profile);
+
+#endif //IFJ_BRATWURST2021_VM_H
@@ -0,0 +1,1377 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - template JIT compiler of hot regions
+ *          to x86-64 machine code (System V, Linux)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_jit.h"
+
+#ifdef VM_JIT
+
+#include <sys/mman.h>
+
+/*
+ * Every instruction of a region is stitched from a template: fast path
+ * for the common operand types guarded by type and frame checks and a slow
+ * path which interprets the instruction (vm_jit_step). Instructions keep
+ * no state in registers, so a region can be entered at any instruction.
+ * Registers: rbx is the interpreter state, r8 destination, r9 and r10
+ * source operands, rax, rcx and rdx are scratch.
+ */
+
+#define REGION_MAX_SIZE 2048      // instructions of one region
+#define BUF_INIT_SIZE 4096
+#define FIXUPS_INIT_SIZE 64
+
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSI 6
+#define RDI 7
+#define R8  8
+#define R9  9
+#define R10 10
+
+/* Condition codes of jcc and setcc */
+#define CC_B  0x2
+#define CC_E  0x4
+#define CC_BE 0x6
+#define CC_NE 0x5
+#define CC_A  0x7
+#define CC_NS 0x9
+#define CC_L  0xc
+#define CC_G  0xf
+
+#define VAL_TYPE ((int32_t)offsetof(vm_value_t, type))
+#define VAL_DATA ((int32_t)offsetof(vm_value_t, i))
+#define VAL_SIZE ((int32_t)sizeof(vm_value_t))
+
+#define VM_OFF(member)    ((int32_t)offsetof(vm_t, member))
+#define FRAME_OFF(member) ((int32_t)offsetof(vm_frame_t, member))
+
+_Static_assert(sizeof(vm_value_t) == 24 && offsetof(vm_value_t, i) == 8, "unexpected layout of vm_value_t");
+
+typedef uint32_t (*jit_code_t)(vm_t* vm, const uint8_t* entry);
+
+/**
+ * @enum Targets of rel32 displacements resolved after the region is emitted.
+ */
+typedef enum fixup_kind
+{
+    FIX_INSTR,      // instruction of the region
+    FIX_SLOW,       // slow path of the instruction
+    FIX_EPILOGUE,
+    FIX_EXIT        // instruction outside of the region
+} fixup_kind_t;
+
+typedef struct fixup
+{
+    size_t pos;
+    fixup_kind_t kind;
+    uint32_t value;
+} fixup_t;
+
+/**
+ * @struct Region being compiled.
+ */
+typedef struct jit_ctx
+{
+    vm_jit_t* jit;
+    vm_t* vm;
+    const vm_program_t* program;
+
+    uint32_t start;
+    uint32_t end;
+    uint32_t k;             /// Instruction being emitted.
+
+    uint8_t* buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+
+    size_t* offs;           /// Code of instructions.
+    size_t* slows;          /// Slow paths, SIZE_MAX when not needed.
+
+    fixup_t* fixups;
+    size_t fixups_len;
+    size_t fixups_cap;
+} jit_ctx_t;
+
+/*
+ * Machine code encoding
+ */
+static void emit8(jit_ctx_t* c, uint8_t x)
+{
+    if (c->len == c->cap)
+    {
+        size_t cap = c->cap == 0 ? BUF_INIT_SIZE : c->cap * 2;
+        uint8_t* buf = realloc(c->buf, cap);
+
+        if (!buf)
+        {
+            c->failed = true;
+            c->len = 0;
+            return;
+        }
+
+        c->buf = buf;
+        c->cap = cap;
+    }
+
+    c->buf[c->len++] = x;
+}
+
+static void emit32(jit_ctx_t* c, uint32_t x)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        emit8(c, (uint8_t)(x >> (8 * i)));
+    }
+}
+
+static void emit64(jit_ctx_t* c, uint64_t x)
+{
+    emit32(c, (uint32_t)x);
+    emit32(c, (uint32_t)(x >> 32));
+}
+
+static void rex(jit_ctx_t* c, bool w, int reg, int base)
+{
+    uint8_t prefix = (uint8_t)(0x40 | (w ? 8 : 0) | ((reg >> 3) << 2) | (base >> 3));
+
+    if (prefix != 0x40)
+    {
+        emit8(c, prefix);
+    }
+}
+
+/*
+ * Instruction with register and memory operand [base + disp], base is
+ * never rsp, rbp, r12 or r13 (no SIB byte), op2 follows the 0x0f escape
+ */
+static void op_mem(jit_ctx_t* c, uint8_t prefix, bool w, uint8_t op, uint8_t op2, int reg, int base, int32_t disp)
+{
+    if (prefix)
+    {
+        emit8(c, prefix);
+    }
+
+    rex(c, w, reg, base);
+    emit8(c, op);
+
+    if (op == 0x0f)
+    {
+        emit8(c, op2);
+    }
+
+    uint8_t modrm = (uint8_t)(((reg & 7) << 3) | (base & 7));
+
+    if (disp == 0)
+    {
+        emit8(c, modrm);
+    }
+    else if (disp >= -128 && disp <= 127)
+    {
+        emit8(c, 0x40 | modrm);
+        emit8(c, (uint8_t)disp);
+    }
+    else
+    {
+        emit8(c, 0x80 | modrm);
+        emit32(c, (uint32_t)disp);
+    }
+}
+
+/* Instruction with two register operands (reg is the ModRM reg field) */
+static void op_reg(jit_ctx_t* c, bool w, uint8_t op, int reg, int rm)
+{
+    rex(c, w, reg, rm);
+    emit8(c, op);
+    emit8(c, (uint8_t)(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+static void mov_imm64(jit_ctx_t* c, int reg, uint64_t imm)
+{
+    rex(c, true, 0, reg);
+    emit8(c, (uint8_t)(0xb8 | (reg & 7)));
+    emit64(c, imm);
+}
+
+static void mov_ptr(jit_ctx_t* c, int reg, const void* ptr)
+{
+    mov_imm64(c, reg, (uint64_t)(uintptr_t)ptr);
+}
+
+/* cmp dword [base + disp], imm8 */
+static void cmp_mem32_imm8(jit_ctx_t* c, int base, int32_t disp, int8_t imm)
+{
+    op_mem(c, 0, false, 0x83, 0, 7, base, disp);
+    emit8(c, (uint8_t)imm);
+}
+
+/* mov dword [base + disp], imm32 */
+static void mov_mem32_imm(jit_ctx_t* c, int base, int32_t disp, uint32_t imm)
+{
+    op_mem(c, 0, false, 0xc7, 0, 0, base, disp);
+    emit32(c, imm);
+}
+
+/* add dword [base + disp], imm8 */
+static void add_mem32_imm8(jit_ctx_t* c, int base, int32_t disp, int8_t imm)
+{
+    op_mem(c, 0, false, 0x83, 0, 0, base, disp);
+    emit8(c, (uint8_t)imm);
+}
+
+static void fixup(jit_ctx_t* c, fixup_kind_t kind, uint32_t value)
+{
+    if (c->fixups_len == c->fixups_cap)
+    {
+        size_t cap = c->fixups_cap == 0 ? FIXUPS_INIT_SIZE : c->fixups_cap * 2;
+        fixup_t* fixups = realloc(c->fixups, cap * sizeof(fixup_t));
+
+        if (!fixups)
+        {
+            c->failed = true;
+            return;
+        }
+
+        c->fixups = fixups;
+        c->fixups_cap = cap;
+    }
+
+    c->fixups[c->fixups_len++] = (fixup_t){ .pos = c->len, .kind = kind, .value = value };
+    emit32(c, 0);
+}
+
+static void jmp_to(jit_ctx_t* c, fixup_kind_t kind, uint32_t value)
+{
+    emit8(c, 0xe9);
+    fixup(c, kind, value);
+}
+
+static void jcc_to(jit_ctx_t* c, int cc, fixup_kind_t kind, uint32_t value)
+{
+    emit8(c, 0x0f);
+    emit8(c, (uint8_t)(0x80 | cc));
+    fixup(c, kind, value);
+}
+
+static void jcc_slow(jit_ctx_t* c, int cc);
+
+/* Jump to instruction, inside the region or out of it */
+static void jcc_target(jit_ctx_t* c, int cc, uint32_t target)
+{
+    // undefined label fails in the interpreter when the jump is taken
+    if (target == VM_NO_TARGET)
+    {
+        jcc_slow(c, cc);
+        return;
+    }
+
+    bool inside = target >= c->start && target < c->end;
+
+    if (cc < 0)
+    {
+        jmp_to(c, inside ? FIX_INSTR : FIX_EXIT, target);
+    }
+    else
+    {
+        jcc_to(c, cc, inside ? FIX_INSTR : FIX_EXIT, target);
+    }
+}
+
+static void jcc_slow(jit_ctx_t* c, int cc)
+{
+    if (cc < 0)
+    {
+        jmp_to(c, FIX_SLOW, c->k);
+    }
+    else
+    {
+        jcc_to(c, cc, FIX_SLOW, c->k);
+    }
+
+    c->slows[c->k - c->start] = 0;
+}
+
+/* Short forward jump inside of a template, returns position to patch */
+static size_t jcc_short(jit_ctx_t* c, int cc)
+{
+    emit8(c, cc < 0 ? 0xeb : (uint8_t)(0x70 | cc));
+    emit8(c, 0);
+
+    return c->len - 1;
+}
+
+static void patch_short(jit_ctx_t* c, size_t pos)
+{
+    if (!c->failed)
+    {
+        c->buf[pos] = (uint8_t)(c->len - pos - 1);
+    }
+}
+
+/*
+ * Operands
+ */
+
+/* Type of the constant operand, -1 for variables and stack values */
+static int const_type(jit_ctx_t* c, const vm_operand_t* op)
+{
+    return op && op->kind == VM_OPND_CONST ? (int)c->program->consts[op->index].type : -1;
+}
+
+/*
+ * Address of the variable to register, undefined variable or missing frame
+ * continues on the slow path. Frame slot is the hint of the operand at the
+ * time of compilation (set by the interpreter before the code became hot).
+ */
+static void var_addr(jit_ctx_t* c, const vm_operand_t* op, int reg)
+{
+    if (op->kind == VM_OPND_GF)
+    {
+        // global variable cannot be undefined again
+        if (!c->vm->defined[op->index])
+        {
+            mov_ptr(c, RAX, &c->vm->defined[op->index]);
+            op_mem(c, 0, false, 0x80, 0, 7, RAX, 0);    // cmp byte [rax], 0
+            emit8(c, 0);
+            jcc_slow(c, CC_E);
+        }
+
+        mov_ptr(c, reg, &c->vm->globals[op->index]);
+        return;
+    }
+
+    if (op->hint > (uint32_t)INT32_MAX / VAL_SIZE)
+    {
+        jcc_slow(c, -1);
+        return;
+    }
+
+    op_mem(c, 0, true, 0x8b, 0, RAX, RBX, op->kind == VM_OPND_LF ? VM_OFF(lf) : VM_OFF(tf));
+    op_reg(c, true, 0x85, RAX, RAX);                            // test rax, rax
+    jcc_slow(c, CC_E);
+    op_mem(c, 0, false, 0x81, 0, 7, RAX, FRAME_OFF(len));       // cmp dword [rax + len], hint
+    emit32(c, op->hint);
+    jcc_slow(c, CC_BE);
+    op_mem(c, 0, true, 0x8b, 0, RCX, RAX, FRAME_OFF(names));
+    op_mem(c, 0, false, 0x81, 0, 7, RCX, (int32_t)(op->hint * sizeof(uint32_t)));
+    emit32(c, op->index);
+    jcc_slow(c, CC_NE);
+    op_mem(c, 0, true, 0x8b, 0, reg, RAX, FRAME_OFF(vals));
+    op_mem(c, 0, true, 0x8d, 0, reg, reg, (int32_t)op->hint * VAL_SIZE);   // lea reg, [reg + slot]
+}
+
+static void symb_addr(jit_ctx_t* c, const vm_operand_t* op, int reg)
+{
+    if (op->kind == VM_OPND_CONST)
+    {
+        mov_ptr(c, reg, &c->program->consts[op->index]);
+        return;
+    }
+
+    var_addr(c, op, reg);
+}
+
+/* Value must have the type, otherwise slow path (also for constants) */
+static void guard_type(jit_ctx_t* c, const vm_operand_t* op, int reg, vm_type_t type)
+{
+    int known = const_type(c, op);
+
+    if (known >= 0)
+    {
+        if (known != (int)type)
+        {
+            jcc_slow(c, -1);
+        }
+
+        return;
+    }
+
+    cmp_mem32_imm8(c, reg, VAL_TYPE, (int8_t)type);
+    jcc_slow(c, CC_NE);
+}
+
+/* Value is initialized and it is not a string (copied without allocation) */
+static void guard_scalar(jit_ctx_t* c, const vm_operand_t* op, int reg)
+{
+    int known = const_type(c, op);
+
+    if (known >= 0)
+    {
+        if (known == VM_T_STRING)
+        {
+            jcc_slow(c, -1);
+        }
+
+        return;
+    }
+
+    op_mem(c, 0, false, 0x8b, 0, RAX, reg, VAL_TYPE);      // mov eax, [reg]
+    emit8(c, 0x83);                                       // sub eax, 1
+    emit8(c, 0xe8);
+    emit8(c, 1);
+    emit8(c, 0x83);                                       // cmp eax, 3
+    emit8(c, 0xf8);
+    emit8(c, VM_T_BOOL - 1);
+    jcc_slow(c, CC_A);
+}
+
+/* String of the destination to rdi (or NULL), it is released after the store */
+static void old_string(jit_ctx_t* c)
+{
+    op_reg(c, false, 0x31, RDI, RDI);                     // xor edi, edi
+    cmp_mem32_imm8(c, R8, VAL_TYPE, VM_T_STRING);
+    size_t other = jcc_short(c, CC_NE);
+    op_mem(c, 0, true, 0x8b, 0, RDI, R8, VAL_DATA);
+    patch_short(c, other);
+}
+
+static void release_old(jit_ctx_t* c)
+{
+    op_reg(c, true, 0x85, RDI, RDI);
+    size_t none = jcc_short(c, CC_E);
+    mov_ptr(c, RAX, (const void*)(uintptr_t)vm_string_release);
+    emit8(c, 0xff);                                       // call rax
+    emit8(c, 0xd0);
+    patch_short(c, none);
+}
+
+/* Two values on top of the data stack to r9 (below) and r10 */
+static void stack_top2(jit_ctx_t* c)
+{
+    op_mem(c, 0, false, 0x8b, 0, RAX, RBX, VM_OFF(stack_len));
+    emit8(c, 0x83);                                       // cmp eax, 2
+    emit8(c, 0xf8);
+    emit8(c, 2);
+    jcc_slow(c, CC_B);
+    op_mem(c, 0, true, 0x8b, 0, RCX, RBX, VM_OFF(stack));
+    op_reg(c, true, 0x6b, RAX, RAX);                      // imul rax, rax, 24
+    emit8(c, VAL_SIZE);
+    op_reg(c, true, 0x01, RAX, RCX);                      // add rcx, rax
+    op_mem(c, 0, true, 0x8d, 0, R9, RCX, -2 * VAL_SIZE);
+    op_mem(c, 0, true, 0x8d, 0, R10, RCX, -VAL_SIZE);
+}
+
+static void store_type(jit_ctx_t* c, int reg, vm_type_t type)
+{
+    mov_mem32_imm(c, reg, VAL_TYPE, type);
+}
+
+/*
+ * Templates
+ */
+
+/* Slow path, the instruction is interpreted */
+static void emit_step(jit_ctx_t* c, uint32_t k)
+{
+    const vm_instr_t* ins = &c->program->code[k];
+
+    op_reg(c, true, 0x89, RBX, RDI);                      // mov rdi, rbx
+    emit8(c, 0xb8 | RSI);                                 // mov esi, k
+    emit32(c, k);
+    mov_ptr(c, RAX, (const void*)(uintptr_t)vm_jit_step);
+    emit8(c, 0xff);                                       // call rax
+    emit8(c, 0xd0);
+
+    if (k + 1 < c->end)
+    {
+        emit8(c, 0x3d);                                   // cmp eax, (k + 1) | transfer
+        emit32(c, (k + 1) | VM_JIT_TRANSFER);
+        jcc_to(c, CC_E, FIX_INSTR, k + 1);
+    }
+
+    if (ins->op[0].kind == VM_OPND_LABEL && ins->op[0].index >= c->start && ins->op[0].index < c->end)
+    {
+        emit8(c, 0x3d);
+        emit32(c, ins->op[0].index | VM_JIT_TRANSFER);
+        jcc_to(c, CC_E, FIX_INSTR, ins->op[0].index);
+    }
+
+    jmp_to(c, FIX_EPILOGUE, 0);
+}
+
+/* Instruction is left to the interpreter */
+static void emit_interpret(jit_ctx_t* c, uint32_t k)
+{
+    emit8(c, 0xb8);                                       // mov eax, k
+    emit32(c, k);
+    jmp_to(c, FIX_EPILOGUE, 0);
+}
+
+static void emit_move(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    var_addr(c, &ins->op[0], R8);
+    symb_addr(c, &ins->op[1], R9);
+    old_string(c);
+    guard_scalar(c, &ins->op[1], R9);
+    op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_TYPE);
+    op_mem(c, 0, true, 0x8b, 0, RCX, R9, VAL_DATA);
+    op_mem(c, 0, true, 0x89, 0, RAX, R8, VAL_TYPE);
+    op_mem(c, 0, true, 0x89, 0, RCX, R8, VAL_DATA);
+    release_old(c);
+}
+
+static void emit_pushs(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    symb_addr(c, &ins->op[0], R9);
+    guard_scalar(c, &ins->op[0], R9);
+    op_mem(c, 0, false, 0x8b, 0, RAX, RBX, VM_OFF(stack_len));
+    op_mem(c, 0, false, 0x3b, 0, RAX, RBX, VM_OFF(stack_cap));
+    jcc_slow(c, CC_E);
+    op_mem(c, 0, true, 0x8b, 0, RCX, RBX, VM_OFF(stack));
+    op_reg(c, true, 0x6b, RAX, RAX);                      // imul rax, rax, 24
+    emit8(c, VAL_SIZE);
+    op_reg(c, true, 0x01, RAX, RCX);                      // add rcx, rax
+    op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_TYPE);
+    op_mem(c, 0, true, 0x8b, 0, RDX, R9, VAL_DATA);
+    op_mem(c, 0, true, 0x89, 0, RAX, RCX, VAL_TYPE);
+    op_mem(c, 0, true, 0x89, 0, RDX, RCX, VAL_DATA);
+    add_mem32_imm8(c, RBX, VM_OFF(stack_len), 1);
+}
+
+/* Popped value (also string) is moved to the variable */
+static void emit_pops(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    var_addr(c, &ins->op[0], R8);
+    old_string(c);
+    op_mem(c, 0, false, 0x8b, 0, RAX, RBX, VM_OFF(stack_len));
+    op_reg(c, false, 0x85, RAX, RAX);                     // test eax, eax
+    jcc_slow(c, CC_E);
+    emit8(c, 0x83);                                       // sub eax, 1
+    emit8(c, 0xe8);
+    emit8(c, 1);
+    op_mem(c, 0, false, 0x89, 0, RAX, RBX, VM_OFF(stack_len));
+    op_mem(c, 0, true, 0x8b, 0, RCX, RBX, VM_OFF(stack));
+    op_reg(c, true, 0x6b, RAX, RAX);
+    emit8(c, VAL_SIZE);
+    op_reg(c, true, 0x01, RAX, RCX);
+
+    for (int32_t i = 0; i < VAL_SIZE; i += 8)
+    {
+        op_mem(c, 0, true, 0x8b, 0, RAX, RCX, i);
+        op_mem(c, 0, true, 0x89, 0, RAX, R8, i);
+    }
+
+    release_old(c);
+}
+
+/*
+ * Arithmetic of values in r9 and r10 stored to r8, integers when known or
+ * tested, floats otherwise. Operands are NULL for stack values.
+ */
+static void emit_arith(jit_ctx_t* c, int opcode, const vm_operand_t* a, const vm_operand_t* b)
+{
+    int ta = const_type(c, a);
+    int tb = const_type(c, b);
+    int known = ta >= 0 ? ta : tb;
+    bool ints = opcode != VM_DIV && opcode != VM_DIVS && (known < 0 || known == VM_T_INT);
+    bool floats = opcode != VM_IDIV && opcode != VM_IDIVS && (known < 0 || known == VM_T_FLOAT);
+    size_t to_float = 0;
+    size_t done = 0;
+
+    if (!ints && !floats)
+    {
+        jcc_slow(c, -1);
+        return;
+    }
+
+    if (ints)
+    {
+        if (floats)
+        {
+            cmp_mem32_imm8(c, R9, VAL_TYPE, VM_T_INT);
+            to_float = jcc_short(c, CC_NE);
+        }
+        else
+        {
+            guard_type(c, a, R9, VM_T_INT);
+        }
+
+        guard_type(c, b, R10, VM_T_INT);
+
+        switch (opcode)
+        {
+            case VM_ADD:
+            case VM_ADDS:
+                op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_DATA);
+                op_mem(c, 0, true, 0x03, 0, RAX, R10, VAL_DATA);
+                break;
+            case VM_SUB:
+            case VM_SUBS:
+                op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_DATA);
+                op_mem(c, 0, true, 0x2b, 0, RAX, R10, VAL_DATA);
+                break;
+            case VM_MUL:
+            case VM_MULS:
+                op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_DATA);
+                op_mem(c, 0, true, 0x0f, 0xaf, RAX, R10, VAL_DATA);
+                break;
+            default:
+                // zero and -1 (overflow of idiv) are divided by the interpreter
+                op_mem(c, 0, true, 0x8b, 0, RCX, R10, VAL_DATA);
+                op_reg(c, true, 0x85, RCX, RCX);
+                jcc_slow(c, CC_E);
+                op_reg(c, true, 0x83, 7, RCX);            // cmp rcx, -1
+                emit8(c, 0xff);
+                jcc_slow(c, CC_E);
+                op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_DATA);
+                emit8(c, 0x48);                           // cqo
+                emit8(c, 0x99);
+                op_reg(c, true, 0xf7, 7, RCX);            // idiv rcx
+                op_reg(c, true, 0x85, RDX, RDX);          // rounding towards negative infinity
+                size_t exact = jcc_short(c, CC_E);
+                op_reg(c, true, 0x31, RCX, RDX);          // xor rdx, rcx
+                size_t same = jcc_short(c, CC_NS);
+                op_reg(c, true, 0xff, 1, RAX);            // dec rax
+                patch_short(c, exact);
+                patch_short(c, same);
+                break;
+        }
+
+        store_type(c, R8, VM_T_INT);
+        op_mem(c, 0, true, 0x89, 0, RAX, R8, VAL_DATA);
+
+        if (!floats)
+        {
+            return;
+        }
+
+        done = jcc_short(c, -1);
+        patch_short(c, to_float);
+    }
+
+    guard_type(c, a, R9, VM_T_FLOAT);
+    guard_type(c, b, R10, VM_T_FLOAT);
+
+    uint8_t op = 0x5e;      // divsd
+
+    switch (opcode)
+    {
+        case VM_ADD:
+        case VM_ADDS:
+            op = 0x58;
+            break;
+        case VM_SUB:
+        case VM_SUBS:
+            op = 0x5c;
+            break;
+        case VM_MUL:
+        case VM_MULS:
+            op = 0x59;
+            break;
+        default:
+            op_mem(c, 0, true, 0x8b, 0, RAX, R10, VAL_DATA);
+            op_reg(c, true, 0x01, RAX, RAX);              // add rax, rax (zero of both signs)
+            jcc_slow(c, CC_E);
+            break;
+    }
+
+    op_mem(c, 0xf2, false, 0x0f, 0x10, 0, R9, VAL_DATA);  // movsd xmm0, [r9]
+    op_mem(c, 0xf2, false, 0x0f, op, 0, R10, VAL_DATA);
+    store_type(c, R8, VM_T_FLOAT);
+    op_mem(c, 0xf2, false, 0x0f, 0x11, 0, R8, VAL_DATA);  // movsd [r8], xmm0
+
+    if (ints)
+    {
+        patch_short(c, done);
+    }
+}
+
+/*
+ * Relation of values in r9 and r10 to flags, returns condition code of
+ * true relation or -1 (always slow path). Relations of other types than
+ * integers are compiled only against constants.
+ */
+static int emit_relation(jit_ctx_t* c, int opcode, const vm_operand_t* a, const vm_operand_t* b)
+{
+    int ta = const_type(c, a);
+    int tb = const_type(c, b);
+    bool eq = opcode != VM_LT && opcode != VM_LTS && opcode != VM_GT && opcode != VM_GTS;
+
+    if (ta >= 0 && tb >= 0)
+    {
+        jcc_slow(c, -1);
+        return -1;
+    }
+
+    if (eq && (ta == VM_T_NIL || tb == VM_T_NIL))
+    {
+        int reg = ta == VM_T_NIL ? R10 : R9;
+
+        cmp_mem32_imm8(c, reg, VAL_TYPE, VM_T_UNDEF);
+        jcc_slow(c, CC_E);
+        cmp_mem32_imm8(c, reg, VAL_TYPE, VM_T_NIL);
+        return CC_E;
+    }
+
+    if (eq && (ta == VM_T_BOOL || tb == VM_T_BOOL))
+    {
+        guard_type(c, a, R9, VM_T_BOOL);
+        guard_type(c, b, R10, VM_T_BOOL);
+        op_mem(c, 0, false, 0x0f, 0xb6, RAX, R9, VAL_DATA);  // movzx eax, byte [r9]
+        op_mem(c, 0, false, 0x3a, 0, RAX, R10, VAL_DATA);    // cmp al, [r10]
+        return CC_E;
+    }
+
+    // equality of stack values of the same type, integers or bools
+    if (eq && !a && !b)
+    {
+        op_mem(c, 0, false, 0x8b, 0, RAX, R9, VAL_TYPE);
+        op_mem(c, 0, false, 0x3b, 0, RAX, R10, VAL_TYPE);
+        jcc_slow(c, CC_NE);
+        emit8(c, 0x83);                                   // cmp eax, int
+        emit8(c, 0xf8);
+        emit8(c, VM_T_INT);
+        size_t ints = jcc_short(c, CC_E);
+        emit8(c, 0x83);                                   // cmp eax, bool
+        emit8(c, 0xf8);
+        emit8(c, VM_T_BOOL);
+        jcc_slow(c, CC_NE);
+        op_mem(c, 0, false, 0x0f, 0xb6, RAX, R9, VAL_DATA);
+        op_mem(c, 0, false, 0x3a, 0, RAX, R10, VAL_DATA);
+        size_t done = jcc_short(c, -1);
+        patch_short(c, ints);
+        op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_DATA);
+        op_mem(c, 0, true, 0x3b, 0, RAX, R10, VAL_DATA);
+        patch_short(c, done);
+        return CC_E;
+    }
+
+    if (ta == VM_T_FLOAT || tb == VM_T_FLOAT)
+    {
+        guard_type(c, a, R9, VM_T_FLOAT);
+        guard_type(c, b, R10, VM_T_FLOAT);
+
+        if (eq)
+        {
+            // unordered (NaN) is not equal
+            op_mem(c, 0xf2, false, 0x0f, 0x10, 0, R9, VAL_DATA);
+            op_mem(c, 0x66, false, 0x0f, 0x2e, 0, R10, VAL_DATA);   // ucomisd xmm0, [r10]
+            emit8(c, 0x0f);                               // setnp al
+            emit8(c, 0x9b);
+            emit8(c, 0xc0);
+            emit8(c, 0x0f);                               // sete cl
+            emit8(c, 0x94);
+            emit8(c, 0xc1);
+            emit8(c, 0x20);                               // and cl, al
+            emit8(c, 0xc1);
+            emit8(c, 0x84);                               // test cl, cl
+            emit8(c, 0xc9);
+            return CC_NE;
+        }
+
+        // above is false for unordered, a < b is tested as b > a
+        bool lt = opcode == VM_LT || opcode == VM_LTS;
+
+        op_mem(c, 0xf2, false, 0x0f, 0x10, 0, lt ? R10 : R9, VAL_DATA);
+        op_mem(c, 0x66, false, 0x0f, 0x2e, 0, lt ? R9 : R10, VAL_DATA);
+        return CC_A;
+    }
+
+    guard_type(c, a, R9, VM_T_INT);
+    guard_type(c, b, R10, VM_T_INT);
+    op_mem(c, 0, true, 0x8b, 0, RAX, R9, VAL_DATA);
+    op_mem(c, 0, true, 0x3b, 0, RAX, R10, VAL_DATA);
+
+    switch (opcode)
+    {
+        case VM_LT:
+        case VM_LTS:
+            return CC_L;
+        case VM_GT:
+        case VM_GTS:
+            return CC_G;
+        default:
+            return CC_E;
+    }
+}
+
+/* Bool of the condition to ecx */
+static void set_cond(jit_ctx_t* c, int cc)
+{
+    emit8(c, 0x0f);                                       // setcc cl
+    emit8(c, (uint8_t)(0x90 | cc));
+    emit8(c, 0xc1);
+    emit8(c, 0x0f);                                       // movzx ecx, cl
+    emit8(c, 0xb6);
+    emit8(c, 0xc9);
+}
+
+static void store_bool(jit_ctx_t* c, int reg)
+{
+    store_type(c, reg, VM_T_BOOL);
+    op_mem(c, 0, true, 0x89, 0, RCX, reg, VAL_DATA);
+}
+
+static void emit_compare(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    var_addr(c, &ins->op[0], R8);
+    symb_addr(c, &ins->op[1], R9);
+    symb_addr(c, &ins->op[2], R10);
+    old_string(c);
+
+    int cc = emit_relation(c, ins->opcode, &ins->op[1], &ins->op[2]);
+
+    if (cc >= 0)
+    {
+        set_cond(c, cc);
+        store_bool(c, R8);
+        release_old(c);
+    }
+}
+
+static void emit_logic(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    var_addr(c, &ins->op[0], R8);
+    symb_addr(c, &ins->op[1], R9);
+    old_string(c);
+    guard_type(c, &ins->op[1], R9, VM_T_BOOL);
+
+    if (ins->opcode != VM_NOT)
+    {
+        symb_addr(c, &ins->op[2], R10);
+        guard_type(c, &ins->op[2], R10, VM_T_BOOL);
+    }
+
+    op_mem(c, 0, false, 0x0f, 0xb6, RCX, R9, VAL_DATA);   // movzx ecx, byte [r9]
+
+    switch (ins->opcode)
+    {
+        case VM_AND:
+            op_mem(c, 0, false, 0x22, 0, RCX, R10, VAL_DATA);
+            break;
+        case VM_OR:
+            op_mem(c, 0, false, 0x0a, 0, RCX, R10, VAL_DATA);
+            break;
+        default:
+            op_reg(c, false, 0x83, 6, RCX);               // xor ecx, 1
+            emit8(c, 1);
+            break;
+    }
+
+    store_bool(c, R8);
+    release_old(c);
+}
+
+static void emit_stack(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    int cc;
+
+    stack_top2(c);
+
+    switch (ins->opcode)
+    {
+        case VM_LTS:
+        case VM_GTS:
+        case VM_EQS:
+            cc = emit_relation(c, ins->opcode, NULL, NULL);
+            set_cond(c, cc);
+            add_mem32_imm8(c, RBX, VM_OFF(stack_len), -1);
+            store_bool(c, R9);
+            break;
+
+        case VM_JUMPIFEQS:
+        case VM_JUMPIFNEQS:
+            cc = emit_relation(c, ins->opcode, NULL, NULL);
+            set_cond(c, cc);
+            add_mem32_imm8(c, RBX, VM_OFF(stack_len), -2);
+            op_reg(c, false, 0x85, RCX, RCX);             // test ecx, ecx
+            jcc_target(c, ins->opcode == VM_JUMPIFEQS ? CC_NE : CC_E, ins->op[0].index);
+            break;
+
+        default:
+            // result replaces the operand below, the stack is shortened after all checks
+            op_reg(c, true, 0x89, R9, R8);                // mov r8, r9
+            emit_arith(c, ins->opcode, NULL, NULL);
+            add_mem32_imm8(c, RBX, VM_OFF(stack_len), -1);
+            break;
+    }
+}
+
+/*
+ * Equality of two constants known at compile time (checks of division by
+ * a constant), returns -1 when it is left to the interpreter
+ */
+static int const_equal(jit_ctx_t* c, const vm_operand_t* a, const vm_operand_t* b)
+{
+    if (const_type(c, a) < 0 || const_type(c, b) < 0)
+    {
+        return -1;
+    }
+
+    const vm_value_t* x = &c->program->consts[a->index];
+    const vm_value_t* y = &c->program->consts[b->index];
+
+    if (x->type == VM_T_NIL || y->type == VM_T_NIL)
+    {
+        return x->type == y->type;
+    }
+
+    if (x->type != y->type)
+    {
+        return -1;
+    }
+
+    switch (x->type)
+    {
+        case VM_T_INT:
+            return x->i == y->i;
+        case VM_T_BOOL:
+            return x->b == y->b;
+        default:
+            return -1;
+    }
+}
+
+static void emit_jumpif(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    int equal = const_equal(c, &ins->op[1], &ins->op[2]);
+
+    if (equal >= 0)
+    {
+        if (equal == (ins->opcode == VM_JUMPIFEQ))
+        {
+            jcc_target(c, -1, ins->op[0].index);
+        }
+
+        return;
+    }
+
+    symb_addr(c, &ins->op[1], R9);
+    symb_addr(c, &ins->op[2], R10);
+
+    int cc = emit_relation(c, ins->opcode, &ins->op[1], &ins->op[2]);
+
+    if (cc >= 0)
+    {
+        jcc_target(c, ins->opcode == VM_JUMPIFEQ ? cc : cc ^ 1, ins->op[0].index);
+    }
+}
+
+static void emit_int2float(jit_ctx_t* c, const vm_instr_t* ins)
+{
+    if (ins->opcode == VM_INT2FLOAT)
+    {
+        var_addr(c, &ins->op[0], R8);
+        symb_addr(c, &ins->op[1], R9);
+        old_string(c);
+        guard_type(c, &ins->op[1], R9, VM_T_INT);
+    }
+    else
+    {
+        op_mem(c, 0, false, 0x8b, 0, RAX, RBX, VM_OFF(stack_len));
+        op_reg(c, false, 0x85, RAX, RAX);
+        jcc_slow(c, CC_E);
+        op_mem(c, 0, true, 0x8b, 0, R8, RBX, VM_OFF(stack));
+        op_reg(c, true, 0x6b, RAX, RAX);
+        emit8(c, VAL_SIZE);
+        op_reg(c, true, 0x01, RAX, R8);                   // add r8, rax
+        op_mem(c, 0, true, 0x8d, 0, R8, R8, -VAL_SIZE);
+        op_reg(c, true, 0x89, R8, R9);                    // mov r9, r8
+        guard_type(c, NULL, R9, VM_T_INT);
+    }
+
+    op_mem(c, 0xf2, true, 0x0f, 0x2a, 0, R9, VAL_DATA);   // cvtsi2sd xmm0, qword [r9]
+    store_type(c, R8, VM_T_FLOAT);
+    op_mem(c, 0xf2, false, 0x0f, 0x11, 0, R8, VAL_DATA);
+
+    if (ins->opcode == VM_INT2FLOAT)
+    {
+        release_old(c);
+    }
+}
+
+static void emit_instr(jit_ctx_t* c, uint32_t k)
+{
+    const vm_instr_t* ins = &c->program->code[k];
+
+    c->k = k;
+
+    switch (ins->opcode)
+    {
+        case VM_MOVE:
+            emit_move(c, ins);
+            break;
+        case VM_PUSHS:
+            emit_pushs(c, ins);
+            break;
+        case VM_POPS:
+            emit_pops(c, ins);
+            break;
+        case VM_ADD:
+        case VM_SUB:
+        case VM_MUL:
+        case VM_DIV:
+        case VM_IDIV:
+            var_addr(c, &ins->op[0], R8);
+            symb_addr(c, &ins->op[1], R9);
+            symb_addr(c, &ins->op[2], R10);
+            old_string(c);
+            emit_arith(c, ins->opcode, &ins->op[1], &ins->op[2]);
+            release_old(c);
+            break;
+        case VM_ADDS:
+        case VM_SUBS:
+        case VM_MULS:
+        case VM_DIVS:
+        case VM_IDIVS:
+        case VM_LTS:
+        case VM_GTS:
+        case VM_EQS:
+        case VM_JUMPIFEQS:
+        case VM_JUMPIFNEQS:
+            emit_stack(c, ins);
+            break;
+        case VM_LT:
+        case VM_GT:
+        case VM_EQ:
+            emit_compare(c, ins);
+            break;
+        case VM_AND:
+        case VM_OR:
+        case VM_NOT:
+            emit_logic(c, ins);
+            break;
+        case VM_INT2FLOAT:
+        case VM_INT2FLOATS:
+            emit_int2float(c, ins);
+            break;
+        case VM_JUMP:
+            jcc_target(c, -1, ins->op[0].index);
+            break;
+        case VM_JUMPIFEQ:
+        case VM_JUMPIFNEQ:
+            emit_jumpif(c, ins);
+            break;
+        case VM_EXIT:
+        case VM_BREAK:
+        case VM_DPRINT:
+            emit_interpret(c, k);
+            break;
+        default:
+            emit_step(c, k);
+            break;
+    }
+}
+
+/*
+ * End of region starting at hot target. Region follows the code up to
+ * the last jump, return or exit which is not skipped by a forward jump,
+ * or up to already compiled code.
+ */
+static uint32_t region_end(const vm_jit_t* jit, const vm_program_t* program, uint32_t start)
+{
+    uint32_t reach = start;
+    uint32_t i = start;
+
+    while (i < program->code_len && i - start < REGION_MAX_SIZE && (i == start || !jit->entries[i]))
+    {
+        const vm_instr_t* ins = &program->code[i++];
+
+        if (ins->op[0].kind == VM_OPND_LABEL && ins->op[0].index != VM_NO_TARGET && ins->op[0].index > reach &&
+            ins->opcode != VM_CALL)
+        {
+            reach = ins->op[0].index;
+        }
+
+        if ((ins->opcode == VM_JUMP || ins->opcode == VM_RETURN || ins->opcode == VM_EXIT) && i > reach)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* Offset of the code of fixup target, exits are emitted on demand */
+static size_t fixup_target(jit_ctx_t* c, const fixup_t* fix, size_t epilogue, uint32_t* exits, size_t* exit_offs,
+                           size_t* exits_len)
+{
+    switch (fix->kind)
+    {
+        case FIX_INSTR:
+            return c->offs[fix->value - c->start];
+        case FIX_SLOW:
+            return c->slows[fix->value - c->start];
+        case FIX_EPILOGUE:
+            return epilogue;
+        default:
+            break;
+    }
+
+    for (size_t i = 0; i < *exits_len; i++)
+    {
+        if (exits[i] == fix->value)
+        {
+            return exit_offs[i];
+        }
+    }
+
+    exits[*exits_len] = fix->value;
+    exit_offs[*exits_len] = c->len;
+    (*exits_len)++;
+
+    // already compiled target continues directly, others return to the interpreter
+    if (fix->value < c->program->code_len && c->jit->entries[fix->value])
+    {
+        mov_ptr(c, RAX, c->jit->entries[fix->value]);
+        emit8(c, 0xff);                                   // jmp rax
+        emit8(c, 0xe0);
+    }
+    else
+    {
+        emit8(c, 0xb8);                                   // mov eax, target | transfer
+        emit32(c, fix->value | VM_JIT_TRANSFER);
+        emit8(c, 0xe9);
+        emit32(c, (uint32_t)(epilogue - (c->len + 4)));
+    }
+
+    return exit_offs[*exits_len - 1];
+}
+
+static bool region_emit(jit_ctx_t* c)
+{
+    uint32_t size = c->end - c->start;
+
+    for (uint32_t k = c->start; k < c->end; k++)
+    {
+        c->offs[k - c->start] = c->len;
+        c->slows[k - c->start] = SIZE_MAX;
+        emit_instr(c, k);
+    }
+
+    c->k = c->end;
+    jmp_to(c, FIX_EXIT, c->end);
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (c->slows[i] != SIZE_MAX)
+        {
+            c->slows[i] = c->len;
+            emit_step(c, c->start + i);
+        }
+    }
+
+    size_t epilogue = c->len;
+
+    emit8(c, 0x5b);                                       // pop rbx
+    emit8(c, 0xc3);                                       // ret
+
+    uint32_t* exits = malloc((c->fixups_len + 1) * sizeof(uint32_t));
+    size_t* exit_offs = malloc((c->fixups_len + 1) * sizeof(size_t));
+    size_t exits_len = 0;
+
+    if (!exits || !exit_offs)
+    {
+        c->failed = true;
+    }
+
+    for (size_t i = 0; !c->failed && i < c->fixups_len; i++)
+    {
+        size_t target = fixup_target(c, &c->fixups[i], epilogue, exits, exit_offs, &exits_len);
+        uint32_t rel = (uint32_t)(target - (c->fixups[i].pos + 4));
+
+        if (!c->failed)
+        {
+            memcpy(&c->buf[c->fixups[i].pos], &rel, sizeof(rel));
+        }
+    }
+
+    free(exits);
+    free(exit_offs);
+
+    return !c->failed;
+}
+
+/* Executable copy of the code */
+static uint8_t* map_code(const uint8_t* code, size_t size)
+{
+    uint8_t* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    memcpy(mem, code, size);
+
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(mem, size);
+        return NULL;
+    }
+
+    return mem;
+}
+
+static bool jit_compile(vm_jit_t* jit, vm_t* vm, uint32_t start)
+{
+    jit_ctx_t c = { .jit = jit, .vm = vm, .program = vm->program, .start = start };
+    vm_jit_region_t* region = malloc(sizeof(vm_jit_region_t));
+
+    c.end = region_end(jit, vm->program, start);
+    c.offs = malloc((c.end - start) * sizeof(size_t));
+    c.slows = malloc((c.end - start) * sizeof(size_t));
+
+    bool ok = region && c.offs && c.slows && region_emit(&c);
+
+    if (ok)
+    {
+        region->code = map_code(c.buf, c.len);
+        region->size = c.len;
+        ok = region->code != NULL;
+    }
+
+    if (ok)
+    {
+        for (uint32_t k = start; k < c.end; k++)
+        {
+            jit->entries[k] = region->code + c.offs[k - start];
+        }
+
+        region->next = jit->regions;
+        jit->regions = region;
+    }
+    else
+    {
+        free(region);
+    }
+
+    free(c.buf);
+    free(c.offs);
+    free(c.slows);
+    free(c.fixups);
+
+    return ok;
+}
+
+bool vm_jit_init(vm_jit_t* jit, const vm_program_t* program, uint32_t threshold)
+{
+    // entry of generated code: push rbx; mov rbx, rdi; jmp rsi
+    static const uint8_t trampoline[] = { 0x53, 0x48, 0x89, 0xfb, 0xff, 0xe6 };
+
+    memset(jit, 0, sizeof(vm_jit_t));
+
+    if (program->code_len > VM_JIT_IP_MASK)
+    {
+        return false;
+    }
+
+    jit->threshold = threshold;
+    jit->counts = calloc(program->code_len + 1, sizeof(uint32_t));
+    jit->entries = calloc(program->code_len + 1, sizeof(uint8_t*));
+    jit->trampoline = map_code(trampoline, sizeof(trampoline));
+
+    if (!jit->counts || !jit->entries || !jit->trampoline)
+    {
+        vm_jit_free(jit);
+        return false;
+    }
+
+    return true;
+}
+
+void vm_jit_free(vm_jit_t* jit)
+{
+    while (jit->regions)
+    {
+        vm_jit_region_t* next = jit->regions->next;
+
+        munmap(jit->regions->code, jit->regions->size);
+        free(jit->regions);
+        jit->regions = next;
+    }
+
+    if (jit->trampoline)
+    {
+        munmap(jit->trampoline, 6);
+    }
+
+    free(jit->counts);
+    free(jit->entries);
+    memset(jit, 0, sizeof(vm_jit_t));
+}
+
+vm_error_t vm_jit_enter(vm_jit_t* jit, vm_t* vm, uint32_t* ip)
+{
+    jit_code_t run;
+
+    memcpy(&run, &jit->trampoline, sizeof(run));
+
+    while (*ip < vm->program->code_len)
+    {
+        uint32_t target = *ip;
+
+        if (!jit->entries[target])
+        {
+            if (++jit->counts[target] < jit->threshold)
+            {
+                return VM_OK;
+            }
+
+            // failed compilation is tried again after threshold executions
+            jit->counts[target] = 0;
+
+            if (!jit_compile(jit, vm, target))
+            {
+                return VM_OK;
+            }
+        }
+
+        uint32_t result = run(vm, jit->entries[target]);
+
+        *ip = result & VM_JIT_IP_MASK;
+
+        if (result & VM_JIT_ERROR)
+        {
+            return vm->error;
+        }
+
+        if (!(result & VM_JIT_TRANSFER))
+        {
+            return VM_OK;
+        }
+    }
+
+    return VM_OK;
+}
+
+#else
+
+bool vm_jit_init(vm_jit_t* jit, const vm_program_t* program, uint32_t threshold)
+{
+    (void)program;
+    (void)threshold;
+
+    memset(jit, 0, sizeof(vm_jit_t));
+
+    return false;
+}
+
+void vm_jit_free(vm_jit_t* jit)
+{
+    (void)jit;
+}
+
+vm_error_t vm_jit_enter(vm_jit_t* jit, vm_t* vm, uint32_t* ip)
+{
+    (void)jit;
+    (void)vm;
+    (void)ip;
+
+    return VM_OK;
+}
+
+#endif
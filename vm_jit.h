@@ -0,0 +1,141 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - state of the interpreter shared with the
+ *          template JIT compiler of hot regions (x86-64 Linux)
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_VM_JIT_H
+#define IFJ_BRATWURST2021_VM_JIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(VM_NO_JIT)
+#define VM_JIT
+#endif
+
+/**
+ * @struct Local or temporary frame. Variables are kept in definition order,
+ *         operands remember the slot where the variable was found last time.
+ */
+typedef struct vm_frame
+{
+    uint32_t* names;
+    vm_value_t* vals;
+    uint32_t len;
+    uint32_t cap;
+    struct vm_frame* next;
+} vm_frame_t;
+
+/**
+ * @struct State of the interpreter.
+ */
+typedef struct vm
+{
+    vm_program_t* program;
+    FILE* in;
+    FILE* out;
+
+    vm_value_t* globals;
+    bool* defined;        /// DEFVAR was executed for the global slot.
+
+    vm_frame_t* lf;       /// Top of the frame stack.
+    vm_frame_t* tf;
+    vm_frame_t* free_frames;
+
+    vm_value_t* stack;
+    uint32_t stack_len;
+    uint32_t stack_cap;
+
+    uint32_t* calls;
+    uint32_t calls_len;
+    uint32_t calls_cap;
+
+    char* chars[256];     /// Shared one character strings (created on use).
+    char* types[VM_T_STRING + 1];  /// Shared results of TYPE.
+
+    uint32_t ip;          /// Next instruction after a single step.
+    struct vm_profile* profile;  /// Counters of the profiling run or NULL.
+
+    vm_error_t error;
+    const char* message;
+} vm_t;
+
+/*
+ * Compiled code returns the instruction where the interpreter continues,
+ * with a flag when it was reached by a jump (the target may be compiled
+ * too) or when the instruction failed (error is set in the state).
+ * Without flags the instruction is interpreted.
+ */
+#define VM_JIT_TRANSFER 0x80000000u
+#define VM_JIT_ERROR    0x40000000u
+#define VM_JIT_IP_MASK  0x3fffffffu
+
+/**
+ * @struct Executable pages of one compiled region.
+ */
+typedef struct vm_jit_region
+{
+    uint8_t* code;
+    size_t size;
+    struct vm_jit_region* next;
+} vm_jit_region_t;
+
+/**
+ * @struct Compiled regions of the program. A region starts at a target of
+ *         backward jump, call or return executed threshold times and
+ *         covers the following instructions up to the end of the function.
+ */
+typedef struct vm_jit
+{
+    uint32_t threshold;
+    uint32_t* counts;           /// Executions of the target.
+    uint8_t** entries;          /// Compiled code of the instruction or NULL.
+    uint8_t* trampoline;        /// Entry from C: vm in rbx, jump to the code.
+    vm_jit_region_t* regions;
+} vm_jit_t;
+
+/**
+ * Initialization of the compiler for the program.
+ *
+ * @param jit Pointer to compiler.
+ * @param program Loaded program (with the final instruction).
+ * @param threshold Executions of a target before its region is compiled.
+ * @return False when JIT is not available (the program is interpreted).
+ */
+bool vm_jit_init(vm_jit_t* jit, const vm_program_t* program, uint32_t threshold);
+
+/**
+ * Release all compiled code.
+ *
+ * @param jit Pointer to compiler.
+ */
+void vm_jit_free(vm_jit_t* jit);
+
+/**
+ * Target of a jump, call or return is reached by the interpreter. Compiled
+ * code of the target (compiled now if it became hot) runs until it leaves
+ * the compiled regions.
+ *
+ * @param jit Pointer to compiler.
+ * @param vm State of the interpreter.
+ * @param ip Target, the next interpreted instruction on return.
+ * @return VM_OK or error of the instruction ip (message is set).
+ */
+vm_error_t vm_jit_enter(vm_jit_t* jit, vm_t* vm, uint32_t* ip);
+
+/**
+ * Slow path of compiled code, one instruction (not EXIT) is interpreted.
+ *
+ * @param vm State of the interpreter.
+ * @param ip Instruction.
+ * @return Next instruction with VM_JIT_TRANSFER or ip with VM_JIT_ERROR.
+ */
+uint32_t vm_jit_step(vm_t* vm, uint32_t ip);
+
+#endif //IFJ_BRATWURST2021_VM_JIT_H
@@ -0,0 +1,959 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - loader of the textual IFJcode21
+ *
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+#define MAX_TOKENS 5
+#define TABLE_INIT_SIZE 64
+#define STRING_MIN_CAP 16
+
+#define VM_OPCODE_NAME(op, name, operands) name,
+#define VM_OPCODE_SIGNATURE(op, name, operands) operands,
+
+static const char* opcode_names[VM_OPCODE_COUNT] = {
+    VM_OPCODES(VM_OPCODE_NAME)
+};
+
+static const char* opcode_operands[VM_OPCODE_COUNT] = {
+    VM_OPCODES(VM_OPCODE_SIGNATURE)
+};
+
+/**
+ * @struct Hash table mapping names to indexes (open addressing).
+ *         Keys are borrowed from the program.
+ */
+typedef struct name_table
+{
+    const char** keys;
+    uint32_t* ids;
+    uint32_t cap;
+    uint32_t len;
+} name_table_t;
+
+/**
+ * @struct State of the loader.
+ */
+typedef struct loader
+{
+    vm_program_t* program;
+    name_table_t names;
+    name_table_t labels;
+    uint32_t line;
+} loader_t;
+
+const char* vm_opcode_name(vm_opcode_t opcode)
+{
+    return opcode < VM_OPCODE_COUNT ? opcode_names[opcode] : "?";
+}
+
+const char* vm_opcode_operands(vm_opcode_t opcode)
+{
+    return opcode < VM_OPCODE_COUNT ? opcode_operands[opcode] : "";
+}
+
+char* vm_string_alloc(size_t cap)
+{
+    vm_strbuf_t* buf = malloc(sizeof(vm_strbuf_t) + cap);
+
+    if (!buf)
+    {
+        return NULL;
+    }
+
+    buf->refs = 1;
+    buf->used = 0;
+    buf->cap = cap;
+
+    return buf->data;
+}
+
+bool vm_string_new(vm_string_t* str, const char* data, size_t len)
+{
+    char* copy = vm_string_alloc(len);
+
+    if (!copy)
+    {
+        return false;
+    }
+
+    memcpy(copy, data, len);
+    VM_STRBUF(copy)->used = len;
+
+    str->data = copy;
+    str->len = len;
+
+    return true;
+}
+
+bool vm_string_concat(vm_string_t* res, const vm_string_t* a, const vm_string_t* b)
+{
+    vm_strbuf_t* buf = VM_STRBUF(a->data);
+    size_t len = a->len + b->len;
+
+    if (b->len == 0 || (a->len == buf->used && len <= buf->cap))
+    {
+        // strings sharing the buffer see only their prefix of the appended data
+        memcpy(buf->data + a->len, b->data, b->len);
+        buf->used = len > buf->used ? len : buf->used;
+        buf->refs++;
+
+        res->data = a->data;
+        res->len = len;
+
+        return true;
+    }
+
+    char* data = vm_string_alloc(len < STRING_MIN_CAP ? STRING_MIN_CAP : len * 2);
+
+    if (!data)
+    {
+        return false;
+    }
+
+    memcpy(data, a->data, a->len);
+    memcpy(data + a->len, b->data, b->len);
+    VM_STRBUF(data)->used = len;
+
+    res->data = data;
+    res->len = len;
+
+    return true;
+}
+
+bool vm_string_unique(vm_string_t* str)
+{
+    if (VM_STRBUF(str->data)->refs == 1)
+    {
+        return true;
+    }
+
+    vm_string_t copy;
+
+    if (!vm_string_new(&copy, str->data, str->len))
+    {
+        return false;
+    }
+
+    vm_string_release(str->data);
+    *str = copy;
+
+    return true;
+}
+
+void vm_string_release(char* data)
+{
+    vm_strbuf_t* buf = VM_STRBUF(data);
+
+    if (--buf->refs == 0)
+    {
+        free(buf);
+    }
+}
+
+void vm_program_init(vm_program_t* program)
+{
+    memset(program, 0, sizeof(vm_program_t));
+}
+
+void vm_program_free(vm_program_t* program)
+{
+    for (uint32_t i = 0; i < program->consts_len; i++)
+    {
+        if (program->consts[i].type == VM_T_STRING)
+        {
+            vm_string_release(program->consts[i].s.data);
+        }
+    }
+
+    for (uint32_t i = 0; i < program->names_len; i++)
+    {
+        free(program->names[i]);
+    }
+
+    for (uint32_t i = 0; i < program->labels_len; i++)
+    {
+        free(program->labels[i].name);
+    }
+
+    free(program->code);
+    free(program->consts);
+    free(program->names);
+    free(program->labels);
+    free(program->source_lines);
+
+    vm_program_init(program);
+}
+
+/*
+ * Grow array to hold at least one more element
+ */
+static bool grow(void** array, uint32_t* cap, uint32_t len, size_t item_size)
+{
+    if (len < *cap)
+    {
+        return true;
+    }
+
+    uint32_t new_cap = *cap == 0 ? TABLE_INIT_SIZE : *cap * 2;
+    void* tmp = realloc(*array, new_cap * item_size);
+
+    if (!tmp)
+    {
+        return false;
+    }
+
+    *array = tmp;
+    *cap = new_cap;
+
+    return true;
+}
+
+static uint32_t hash(const char* key)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *key; key++)
+    {
+        h = (h ^ (unsigned char)*key) * 16777619u;
+    }
+
+    return h;
+}
+
+static bool table_rehash(name_table_t* table)
+{
+    uint32_t new_cap = table->cap == 0 ? TABLE_INIT_SIZE : table->cap * 2;
+    const char** keys = calloc(new_cap, sizeof(char*));
+    uint32_t* ids = malloc(new_cap * sizeof(uint32_t));
+
+    if (!keys || !ids)
+    {
+        free(keys);
+        free(ids);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < table->cap; i++)
+    {
+        if (table->keys[i])
+        {
+            uint32_t pos = hash(table->keys[i]) & (new_cap - 1);
+
+            while (keys[pos])
+            {
+                pos = (pos + 1) & (new_cap - 1);
+            }
+
+            keys[pos] = table->keys[i];
+            ids[pos] = table->ids[i];
+        }
+    }
+
+    free(table->keys);
+    free(table->ids);
+
+    table->keys = keys;
+    table->ids = ids;
+    table->cap = new_cap;
+
+    return true;
+}
+
+/*
+ * Find the name, slot of the name (or empty slot for insert) is returned
+ */
+static uint32_t table_slot(name_table_t* table, const char* key)
+{
+    uint32_t pos = hash(key) & (table->cap - 1);
+
+    while (table->keys[pos] && strcmp(table->keys[pos], key) != 0)
+    {
+        pos = (pos + 1) & (table->cap - 1);
+    }
+
+    return pos;
+}
+
+static void table_free(name_table_t* table)
+{
+    free(table->keys);
+    free(table->ids);
+}
+
+/*
+ * Index of variable name, name is added to the program if it is new
+ */
+static bool intern_name(loader_t* loader, const char* name, uint32_t* id)
+{
+    vm_program_t* program = loader->program;
+    name_table_t* table = &loader->names;
+
+    if ((table->len + 1) * 2 > table->cap && !table_rehash(table))
+    {
+        return false;
+    }
+
+    uint32_t pos = table_slot(table, name);
+
+    if (!table->keys[pos])
+    {
+        if (!grow((void**)&program->names, &program->names_cap, program->names_len, sizeof(char*)))
+        {
+            return false;
+        }
+
+        char* copy = malloc(strlen(name) + 1);
+
+        if (!copy)
+        {
+            return false;
+        }
+
+        strcpy(copy, name);
+
+        program->names[program->names_len] = copy;
+        table->keys[pos] = copy;
+        table->ids[pos] = program->names_len++;
+        table->len++;
+    }
+
+    *id = table->ids[pos];
+
+    return true;
+}
+
+/*
+ * Index of label, label is added to the program without target if it is new
+ */
+static bool intern_label(loader_t* loader, const char* name, uint32_t* id)
+{
+    vm_program_t* program = loader->program;
+    name_table_t* table = &loader->labels;
+
+    if ((table->len + 1) * 2 > table->cap && !table_rehash(table))
+    {
+        return false;
+    }
+
+    uint32_t pos = table_slot(table, name);
+
+    if (!table->keys[pos])
+    {
+        if (!grow((void**)&program->labels, &program->labels_cap, program->labels_len, sizeof(vm_label_t)))
+        {
+            return false;
+        }
+
+        char* copy = malloc(strlen(name) + 1);
+
+        if (!copy)
+        {
+            return false;
+        }
+
+        strcpy(copy, name);
+
+        program->labels[program->labels_len].name = copy;
+        program->labels[program->labels_len].target = VM_NO_TARGET;
+        table->keys[pos] = copy;
+        table->ids[pos] = program->labels_len++;
+        table->len++;
+    }
+
+    *id = table->ids[pos];
+
+    return true;
+}
+
+static bool equal_nocase(const char* a, const char* b)
+{
+    for (; *a && *b; a++, b++)
+    {
+        if (tolower((unsigned char)*a) != tolower((unsigned char)*b))
+        {
+            return false;
+        }
+    }
+
+    return *a == *b;
+}
+
+static bool prefix_nocase(const char* token, const char* prefix)
+{
+    for (; *prefix; token++, prefix++)
+    {
+        if (tolower((unsigned char)*token) != tolower((unsigned char)*prefix))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool is_name_char(char c, bool first)
+{
+    return isalpha((unsigned char)c) || (!first && isdigit((unsigned char)c)) ||
+           (c != '\0' && strchr("_-$&%*!?", c) != NULL);
+}
+
+static bool is_identifier(const char* name)
+{
+    if (!is_name_char(*name, true))
+    {
+        return false;
+    }
+
+    for (name++; *name; name++)
+    {
+        if (!is_name_char(*name, false))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static vm_error_t add_const(loader_t* loader, vm_value_t value, uint32_t* index)
+{
+    vm_program_t* program = loader->program;
+
+    if (!grow((void**)&program->consts, &program->consts_cap, program->consts_len, sizeof(vm_value_t)))
+    {
+        return VM_E_INTERNAL;
+    }
+
+    program->consts[program->consts_len] = value;
+    *index = program->consts_len++;
+
+    return VM_OK;
+}
+
+/*
+ * Decode string literal with \ddd escape sequences
+ */
+static vm_error_t parse_string(const char* text, vm_value_t* value)
+{
+    size_t len = strlen(text);
+    char* data = vm_string_alloc(len);
+    size_t out = 0;
+
+    if (!data)
+    {
+        return VM_E_INTERNAL;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] != '\\')
+        {
+            data[out++] = text[i];
+            continue;
+        }
+
+        if (i + 3 >= len || !isdigit((unsigned char)text[i + 1]) ||
+            !isdigit((unsigned char)text[i + 2]) || !isdigit((unsigned char)text[i + 3]))
+        {
+            vm_string_release(data);
+            return VM_E_SYNTAX;
+        }
+
+        int code = (text[i + 1] - '0') * 100 + (text[i + 2] - '0') * 10 + (text[i + 3] - '0');
+
+        if (code > 255)
+        {
+            vm_string_release(data);
+            return VM_E_SYNTAX;
+        }
+
+        data[out++] = (char)code;
+        i += 3;
+    }
+
+    VM_STRBUF(data)->used = out;
+
+    value->type = VM_T_STRING;
+    value->s.data = data;
+    value->s.len = out;
+
+    return VM_OK;
+}
+
+static vm_error_t parse_constant(loader_t* loader, const char* token, vm_operand_t* operand)
+{
+    vm_value_t value;
+    const char* text = strchr(token, '@');
+    char* end;
+
+    if (!text)
+    {
+        return VM_E_SYNTAX;
+    }
+
+    text++;
+
+    if (prefix_nocase(token, "int@"))
+    {
+        value.type = VM_T_INT;
+        value.i = strtoll(text, &end, 10);
+
+        if (*end != '\0')
+        {
+            return VM_E_SYNTAX;
+        }
+    }
+    else if (prefix_nocase(token, "float@"))
+    {
+        const char* digits = (*text == '-' || *text == '+') ? text + 1 : text;
+
+        // only hexadecimal notation of floats is allowed
+        if (digits[0] != '0' || (digits[1] != 'x' && digits[1] != 'X'))
+        {
+            return VM_E_SYNTAX;
+        }
+
+        value.type = VM_T_FLOAT;
+        value.f = strtod(text, &end);
+
+        if (*end != '\0')
+        {
+            return VM_E_SYNTAX;
+        }
+    }
+    else if (prefix_nocase(token, "bool@"))
+    {
+        value.type = VM_T_BOOL;
+
+        if (equal_nocase(text, "true"))
+        {
+            value.b = true;
+        }
+        else if (equal_nocase(text, "false"))
+        {
+            value.b = false;
+        }
+        else
+        {
+            return VM_E_SYNTAX;
+        }
+    }
+    else if (prefix_nocase(token, "nil@"))
+    {
+        if (!equal_nocase(text, "nil"))
+        {
+            return VM_E_SYNTAX;
+        }
+
+        value.type = VM_T_NIL;
+    }
+    else if (prefix_nocase(token, "string@"))
+    {
+        vm_error_t result = parse_string(text, &value);
+
+        if (result != VM_OK)
+        {
+            return result;
+        }
+    }
+    else
+    {
+        return VM_E_SYNTAX;
+    }
+
+    operand->kind = VM_OPND_CONST;
+
+    vm_error_t result = add_const(loader, value, &operand->index);
+
+    if (result != VM_OK && value.type == VM_T_STRING)
+    {
+        vm_string_release(value.s.data);
+    }
+
+    return result;
+}
+
+static bool is_variable(const char* token)
+{
+    return prefix_nocase(token, "GF@") || prefix_nocase(token, "LF@") || prefix_nocase(token, "TF@");
+}
+
+static vm_error_t parse_variable(loader_t* loader, const char* token, vm_operand_t* operand)
+{
+    if (!is_variable(token) || !is_identifier(token + 3))
+    {
+        return VM_E_SYNTAX;
+    }
+
+    switch (toupper((unsigned char)token[0]))
+    {
+        case 'G':
+            operand->kind = VM_OPND_GF;
+            break;
+        case 'L':
+            operand->kind = VM_OPND_LF;
+            break;
+        default:
+            operand->kind = VM_OPND_TF;
+            break;
+    }
+
+    operand->hint = 0;
+
+    return intern_name(loader, token + 3, &operand->index) ? VM_OK : VM_E_INTERNAL;
+}
+
+static vm_error_t parse_type(const char* token, vm_operand_t* operand)
+{
+    static const struct
+    {
+        const char* name;
+        vm_type_t type;
+    } types[] = {
+        {"int",    VM_T_INT},
+        {"float",  VM_T_FLOAT},
+        {"string", VM_T_STRING},
+        {"bool",   VM_T_BOOL},
+        {"nil",    VM_T_NIL},
+    };
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        if (equal_nocase(token, types[i].name))
+        {
+            operand->kind = VM_OPND_TYPE;
+            operand->index = types[i].type;
+            return VM_OK;
+        }
+    }
+
+    return VM_E_SYNTAX;
+}
+
+static vm_error_t parse_operand(loader_t* loader, char kind, const char* token, vm_operand_t* operand)
+{
+    switch (kind)
+    {
+        case 'v':
+            return parse_variable(loader, token, operand);
+        case 's':
+            return is_variable(token) ? parse_variable(loader, token, operand)
+                                      : parse_constant(loader, token, operand);
+        case 'l':
+            operand->kind = VM_OPND_LABEL;
+            return intern_label(loader, token, &operand->index) ? VM_OK : VM_E_INTERNAL;
+        case 't':
+            return parse_type(token, operand);
+        default:
+            return VM_E_INTERNAL;
+    }
+}
+
+static vm_error_t parse_instruction(loader_t* loader, char** tokens, int count)
+{
+    vm_program_t* program = loader->program;
+
+    if (equal_nocase(tokens[0], "LABEL"))
+    {
+        uint32_t id;
+
+        if (count != 2)
+        {
+            return VM_E_SYNTAX;
+        }
+
+        if (!intern_label(loader, tokens[1], &id))
+        {
+            return VM_E_INTERNAL;
+        }
+
+        if (program->labels[id].target != VM_NO_TARGET)
+        {
+            fprintf(stderr, "Label %s already exists!\n", tokens[1]);
+            return VM_E_SEMANTIC;
+        }
+
+        program->labels[id].target = program->code_len;
+
+        return VM_OK;
+    }
+
+    for (int opcode = 0; opcode < VM_OPCODE_COUNT; opcode++)
+    {
+        if (!equal_nocase(tokens[0], opcode_names[opcode]))
+        {
+            continue;
+        }
+
+        const char* operands = opcode_operands[opcode];
+
+        if ((size_t)count != strlen(operands) + 1)
+        {
+            return VM_E_SYNTAX;
+        }
+
+        if (!grow((void**)&program->code, &program->code_cap, program->code_len, sizeof(vm_instr_t)))
+        {
+            return VM_E_INTERNAL;
+        }
+
+        vm_instr_t* instr = &program->code[program->code_len];
+
+        memset(instr, 0, sizeof(vm_instr_t));
+        instr->opcode = (uint8_t)opcode;
+        instr->line = loader->line;
+
+        for (int i = 0; operands[i]; i++)
+        {
+            vm_error_t result = parse_operand(loader, operands[i], tokens[i + 1], &instr->op[i]);
+
+            if (result != VM_OK)
+            {
+                return result;
+            }
+        }
+
+        program->code_len++;
+
+        return VM_OK;
+    }
+
+    return VM_E_SYNTAX;
+}
+
+/*
+ * Split line into whitespace separated tokens, comments are cut off
+ */
+static int tokenize(char* line, char** tokens)
+{
+    int count = 0;
+    char* comment = strchr(line, '#');
+
+    if (comment)
+    {
+        *comment = '\0';
+    }
+
+    for (char* token = strtok(line, " \t\r\v\f"); token; token = strtok(NULL, " \t\r\v\f"))
+    {
+        if (count == MAX_TOKENS)
+        {
+            return MAX_TOKENS + 1;
+        }
+
+        tokens[count++] = token;
+    }
+
+    return count;
+}
+
+static char* read_all(FILE* file, size_t* size)
+{
+    size_t cap = 4096;
+    size_t len = 0;
+    char* buffer = malloc(cap);
+
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    for (size_t n; (n = fread(buffer + len, 1, cap - len - 1, file)) > 0;)
+    {
+        len += n;
+
+        if (cap - len - 1 == 0)
+        {
+            char* tmp = realloc(buffer, cap * 2);
+
+            if (!tmp)
+            {
+                free(buffer);
+                return NULL;
+            }
+
+            buffer = tmp;
+            cap *= 2;
+        }
+    }
+
+    buffer[len] = '\0';
+    *size = len;
+
+    return buffer;
+}
+
+vm_error_t vm_load(FILE* file, vm_program_t* program)
+{
+    loader_t loader = {program, {NULL, NULL, 0, 0}, {NULL, NULL, 0, 0}, 0};
+    vm_error_t result = VM_OK;
+    bool header = false;
+    size_t size;
+    char* source = read_all(file, &size);
+
+    if (!source)
+    {
+        return VM_E_INTERNAL;
+    }
+
+    if (vm_is_object(source, size))
+    {
+        result = vm_object_parse(source, size, program);
+        free(source);
+        return result;
+    }
+
+    char* line = source;
+
+    while (line && result == VM_OK)
+    {
+        char* tokens[MAX_TOKENS + 1];
+        char* next = strchr(line, '\n');
+
+        if (next)
+        {
+            *next++ = '\0';
+        }
+
+        loader.line++;
+
+        int count = tokenize(line, tokens);
+
+        if (count > MAX_TOKENS)
+        {
+            result = VM_E_SYNTAX;
+        }
+        else if (count > 0 && !header)
+        {
+            header = count == 1 && equal_nocase(tokens[0], ".IFJcode21");
+            result = header ? VM_OK : VM_E_SYNTAX;
+        }
+        else if (count > 0)
+        {
+            result = parse_instruction(&loader, tokens, count);
+        }
+
+        line = next;
+    }
+
+    if (result == VM_OK && !header)
+    {
+        result = VM_E_SYNTAX;
+    }
+
+    if (result == VM_E_SYNTAX)
+    {
+        fprintf(stderr, "Syntax error at line %u!\n", loader.line);
+    }
+
+    // jumps refer directly to instructions
+    for (uint32_t i = 0; result == VM_OK && i < program->code_len; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            vm_operand_t* operand = &program->code[i].op[j];
+
+            if (operand->kind == VM_OPND_LABEL)
+            {
+                operand->hint = operand->index;
+                operand->index = program->labels[operand->hint].target;
+            }
+        }
+    }
+
+    table_free(&loader.names);
+    table_free(&loader.labels);
+    free(source);
+
+    return result;
+}
+
+vm_error_t vm_load_source_map(FILE* file, vm_program_t* program)
+{
+    uint32_t* runs = NULL;       // pairs of IFJcode21 line and IFJ21 line
+    uint32_t len = 0;
+    uint32_t cap = 0;
+    unsigned code_line, source_line;
+    int matched;
+
+    while ((matched = fscanf(file, "%u %u", &code_line, &source_line)) == 2)
+    {
+        // runs are in the order of IFJcode21 lines
+        if (len > 0 && code_line <= runs[2 * (len - 1)])
+        {
+            free(runs);
+            return VM_E_SYNTAX;
+        }
+
+        if (len == cap)
+        {
+            uint32_t new_cap = cap == 0 ? 64 : cap * 2;
+            uint32_t* tmp = realloc(runs, 2 * (size_t)new_cap * sizeof(uint32_t));
+
+            if (!tmp)
+            {
+                free(runs);
+                return VM_E_INTERNAL;
+            }
+
+            runs = tmp;
+            cap = new_cap;
+        }
+
+        runs[2 * len] = code_line;
+        runs[2 * len + 1] = source_line;
+        len++;
+    }
+
+    if (matched != EOF || ferror(file))
+    {
+        free(runs);
+        return VM_E_SYNTAX;
+    }
+
+    // the sentinel behind the last instruction has no line
+    uint32_t* lines = calloc(program->code_len + 1, sizeof(uint32_t));
+
+    if (!lines)
+    {
+        free(runs);
+        return VM_E_INTERNAL;
+    }
+
+    for (uint32_t i = 0; i < program->code_len; i++)
+    {
+        uint32_t low = 0;
+        uint32_t high = len;
+
+        // last run which starts at the line of the instruction or before
+        while (low < high)
+        {
+            uint32_t mid = low + (high - low) / 2;
+
+            if (runs[2 * mid] <= program->code[i].line)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        lines[i] = low > 0 ? runs[2 * (low - 1) + 1] : 0;
+    }
+
+    free(runs);
+    free(program->source_lines);
+    program->source_lines = lines;
+
+    return VM_OK;
+}
@@ -0,0 +1,254 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - command line interface
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+#include "vm_profile.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s [options] file\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -h --help           Display this information.\n");
+    fprintf(stderr, "  -d --disassemble    Print the program as textual IFJcode21.\n");
+    fprintf(stderr, "  -c --object         Print the program as binary object.\n");
+    fprintf(stderr, "  --no-jit            Interpret every instruction.\n");
+    fprintf(stderr, "  --jit-threshold=N   Compile code executed N times (default %d).\n", VM_JIT_THRESHOLD);
+    fprintf(stderr, "  --profile=FILE      Write profile report to FILE (- for stderr), disables JIT.\n");
+    fprintf(stderr, "  --folded=FILE       Write folded call stacks to FILE, disables JIT.\n");
+    fprintf(stderr, "  --profile-top=N     Rows of every table of the report (default %d).\n", VM_PROFILE_TOP);
+    fprintf(stderr, "  --source-map=FILE   Source map of the program (errors and profile show IFJ21 lines).\n");
+    fprintf(stderr, "File is either textual IFJcode21 or binary object.\n");
+}
+
+/*
+ * Write the report and folded stacks of the finished profile
+ */
+static bool write_profile(const vm_profile_t* profile, const char* report, const char* folded, unsigned top)
+{
+    bool success = true;
+
+    if (report && strcmp(report, "-") == 0)
+    {
+        vm_profile_report(profile, stderr, top);
+    }
+    else if (report)
+    {
+        FILE* file = fopen(report, "w");
+
+        if (file)
+        {
+            vm_profile_report(profile, file, top);
+            success = fclose(file) == 0;
+        }
+        else
+        {
+            success = false;
+        }
+    }
+
+    if (folded)
+    {
+        FILE* file = fopen(folded, "w");
+
+        if (file)
+        {
+            success = vm_profile_folded(profile, file) && success;
+            success = fclose(file) == 0 && success;
+        }
+        else
+        {
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+/**
+ * @enum What to do with the loaded program.
+ */
+typedef enum action
+{
+    ACTION_RUN,
+    ACTION_DISASSEMBLE,
+    ACTION_OBJECT
+} action_t;
+
+int main(int argc, char* argv[])
+{
+    static char output_buffer[OUTPUT_BUFFER_SIZE];
+    const char* path = NULL;
+    action_t action = ACTION_RUN;
+    uint32_t jit_threshold = VM_JIT_THRESHOLD;
+    const char* report = NULL;
+    const char* folded = NULL;
+    const char* source_map = NULL;
+    unsigned top = VM_PROFILE_TOP;
+    vm_program_t program;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+            return VM_OK;
+        }
+        else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--disassemble") == 0)
+        {
+            action = ACTION_DISASSEMBLE;
+            continue;
+        }
+        else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--object") == 0)
+        {
+            action = ACTION_OBJECT;
+            continue;
+        }
+        else if (strcmp(argv[i], "--no-jit") == 0)
+        {
+            jit_threshold = 0;
+            continue;
+        }
+        else if (strncmp(argv[i], "--jit-threshold=", 16) == 0 && argv[i][16] != '\0')
+        {
+            char* end;
+            unsigned long threshold = strtoul(argv[i] + 16, &end, 10);
+
+            if (*end != '\0' || threshold == 0 || threshold > UINT32_MAX)
+            {
+                usage(argv[0]);
+                return VM_E_PARAM;
+            }
+
+            jit_threshold = (uint32_t)threshold;
+            continue;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0 && argv[i][10] != '\0')
+        {
+            report = argv[i] + 10;
+            continue;
+        }
+        else if (strncmp(argv[i], "--folded=", 9) == 0 && argv[i][9] != '\0')
+        {
+            folded = argv[i] + 9;
+            continue;
+        }
+        else if (strncmp(argv[i], "--source-map=", 13) == 0 && argv[i][13] != '\0')
+        {
+            source_map = argv[i] + 13;
+            continue;
+        }
+        else if (strncmp(argv[i], "--profile-top=", 14) == 0 && argv[i][14] != '\0')
+        {
+            char* end;
+            unsigned long rows = strtoul(argv[i] + 14, &end, 10);
+
+            if (*end != '\0' || rows == 0 || rows > UINT32_MAX)
+            {
+                usage(argv[0]);
+                return VM_E_PARAM;
+            }
+
+            top = (unsigned)rows;
+            continue;
+        }
+        else if (argv[i][0] == '-' || path)
+        {
+            usage(argv[0]);
+            return VM_E_PARAM;
+        }
+
+        path = argv[i];
+    }
+
+    if (!path)
+    {
+        usage(argv[0]);
+        return VM_E_PARAM;
+    }
+
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+    {
+        fprintf(stderr, "Cannot open input file!\n");
+        return VM_E_FILE;
+    }
+
+    vm_program_init(&program);
+
+    int result = vm_load(file, &program);
+
+    fclose(file);
+
+    if (result == VM_OK && source_map)
+    {
+        FILE* map = fopen(source_map, "r");
+
+        if (!map)
+        {
+            fprintf(stderr, "Cannot open source map!\n");
+            result = VM_E_FILE;
+        }
+        else
+        {
+            result = vm_load_source_map(map, &program);
+            fclose(map);
+
+            if (result == VM_E_SYNTAX)
+            {
+                fprintf(stderr, "Malformed source map!\n");
+            }
+        }
+    }
+
+    if (result == VM_OK && action == ACTION_DISASSEMBLE)
+    {
+        vm_disassemble(stdout, &program);
+    }
+    else if (result == VM_OK && action == ACTION_OBJECT)
+    {
+        result = vm_object_write(stdout, &program) ? VM_OK : VM_E_INTERNAL;
+    }
+    else if (result == VM_OK && (report || folded))
+    {
+        vm_profile_t profile;
+
+        if (!vm_profile_init(&profile, &program))
+        {
+            fprintf(stderr, "Out of memory!\n");
+            result = VM_E_INTERNAL;
+        }
+        else
+        {
+            setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+            result = vm_run(&program, stdin, stdout, jit_threshold, &profile);
+
+            // exit code of the program is kept
+            if (!write_profile(&profile, report, folded, top))
+            {
+                fprintf(stderr, "Cannot write profile!\n");
+            }
+
+            vm_profile_free(&profile);
+        }
+    }
+    else if (result == VM_OK)
+    {
+        setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+        result = vm_run(&program, stdin, stdout, jit_threshold, NULL);
+    }
+
+    vm_program_free(&program);
+
+    return result;
+}
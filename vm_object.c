@@ -0,0 +1,602 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - binary object format and disassembler
+ *
+ * Format (all numbers are unsigned LEB128 unless stated otherwise):
+ *
+ *   magic "IFJ21OBJ", u8 version
+ *   names:  count, (length, bytes)*
+ *   labels: count, (length, bytes, target + 1 or 0 when undefined)*
+ *   code:   count, (u8 opcode, line, operand*)*
+ *
+ *   operand 'v': u8 kind, name
+ *           's': u8 kind, name or typed immediate (u8 type, value)
+ *           'l': label
+ *           't': u8 type
+ *
+ *   int immediates are zigzag encoded, floats are 8 bytes of IEEE 754
+ *   in little endian, strings are length and raw bytes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+#define OBJECT_MAGIC "IFJ21OBJ"
+#define OBJECT_MAGIC_LEN 8
+#define OBJECT_VERSION 1
+
+/**
+ * @struct Cursor of the object being parsed.
+ */
+typedef struct reader
+{
+    const unsigned char* data;
+    size_t len;
+    size_t pos;
+    bool error;
+} reader_t;
+
+/*
+ * Writing
+ */
+
+static void write_uint(FILE* file, uint64_t value)
+{
+    do
+    {
+        unsigned char byte = value & 0x7f;
+
+        value >>= 7;
+        putc(value ? byte | 0x80 : byte, file);
+    } while (value);
+}
+
+static void write_bytes(FILE* file, const char* data, size_t len)
+{
+    write_uint(file, len);
+    fwrite(data, 1, len, file);
+}
+
+static void write_const(FILE* file, const vm_value_t* value)
+{
+    uint64_t bits;
+
+    putc(value->type, file);
+
+    switch (value->type)
+    {
+        case VM_T_INT:
+            write_uint(file, ((uint64_t)value->i << 1) ^ (uint64_t)(value->i >> 63));
+            break;
+
+        case VM_T_FLOAT:
+            memcpy(&bits, &value->f, sizeof(bits));
+
+            for (int i = 0; i < 8; i++)
+            {
+                putc((bits >> (8 * i)) & 0xff, file);
+            }
+            break;
+
+        case VM_T_BOOL:
+            putc(value->b, file);
+            break;
+
+        case VM_T_STRING:
+            write_bytes(file, value->s.data, value->s.len);
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool vm_object_write(FILE* file, const vm_program_t* program)
+{
+    fwrite(OBJECT_MAGIC, 1, OBJECT_MAGIC_LEN, file);
+    putc(OBJECT_VERSION, file);
+
+    write_uint(file, program->names_len);
+
+    for (uint32_t i = 0; i < program->names_len; i++)
+    {
+        write_bytes(file, program->names[i], strlen(program->names[i]));
+    }
+
+    write_uint(file, program->labels_len);
+
+    for (uint32_t i = 0; i < program->labels_len; i++)
+    {
+        write_bytes(file, program->labels[i].name, strlen(program->labels[i].name));
+        write_uint(file, program->labels[i].target == VM_NO_TARGET ? 0 : (uint64_t)program->labels[i].target + 1);
+    }
+
+    write_uint(file, program->code_len);
+
+    for (uint32_t i = 0; i < program->code_len; i++)
+    {
+        const vm_instr_t* instr = &program->code[i];
+        const char* operands = vm_opcode_operands(instr->opcode);
+
+        putc(instr->opcode, file);
+        write_uint(file, instr->line);
+
+        for (int j = 0; operands[j]; j++)
+        {
+            const vm_operand_t* operand = &instr->op[j];
+
+            switch (operand->kind)
+            {
+                case VM_OPND_GF:
+                case VM_OPND_LF:
+                case VM_OPND_TF:
+                    putc(operand->kind, file);
+                    write_uint(file, operand->index);
+                    break;
+
+                case VM_OPND_CONST:
+                    putc(operand->kind, file);
+                    write_const(file, &program->consts[operand->index]);
+                    break;
+
+                case VM_OPND_LABEL:
+                    write_uint(file, operand->hint);
+                    break;
+
+                default:
+                    putc(operand->index, file);
+                    break;
+            }
+        }
+    }
+
+    return !ferror(file);
+}
+
+/*
+ * Reading
+ */
+
+static unsigned read_byte(reader_t* reader)
+{
+    if (reader->pos >= reader->len)
+    {
+        reader->error = true;
+        return 0;
+    }
+
+    return reader->data[reader->pos++];
+}
+
+static uint64_t read_uint(reader_t* reader)
+{
+    uint64_t value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        unsigned byte = read_byte(reader);
+
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+
+    reader->error = true;
+
+    return 0;
+}
+
+/*
+ * Index stored in the object, it must be lower than limit
+ */
+static uint32_t read_index(reader_t* reader, uint32_t limit)
+{
+    uint64_t value = read_uint(reader);
+
+    if (value >= limit)
+    {
+        reader->error = true;
+        return 0;
+    }
+
+    return (uint32_t)value;
+}
+
+static char* read_bytes(reader_t* reader, size_t* len)
+{
+    uint64_t size = read_uint(reader);
+
+    if (reader->error || size > reader->len - reader->pos)
+    {
+        reader->error = true;
+        return NULL;
+    }
+
+    char* data = malloc(size + 1);
+
+    if (!data)
+    {
+        reader->error = true;
+        return NULL;
+    }
+
+    memcpy(data, reader->data + reader->pos, size);
+    data[size] = '\0';
+    reader->pos += size;
+
+    if (len)
+    {
+        *len = size;
+    }
+
+    return data;
+}
+
+static bool read_const(reader_t* reader, vm_program_t* program, uint32_t* index)
+{
+    vm_value_t value;
+    uint64_t bits = 0;
+
+    value.type = (vm_type_t)read_byte(reader);
+
+    switch (value.type)
+    {
+        case VM_T_NIL:
+            break;
+
+        case VM_T_INT:
+            bits = read_uint(reader);
+            value.i = (int64_t)(bits >> 1) ^ -(int64_t)(bits & 1);
+            break;
+
+        case VM_T_FLOAT:
+            for (int i = 0; i < 8; i++)
+            {
+                bits |= (uint64_t)read_byte(reader) << (8 * i);
+            }
+
+            memcpy(&value.f, &bits, sizeof(bits));
+            break;
+
+        case VM_T_BOOL:
+            value.b = read_byte(reader) != 0;
+            break;
+
+        case VM_T_STRING:
+            value.s.len = read_uint(reader);
+
+            if (reader->error || value.s.len > reader->len - reader->pos ||
+                !vm_string_new(&value.s, (const char*)reader->data + reader->pos, value.s.len))
+            {
+                reader->error = true;
+                return false;
+            }
+
+            reader->pos += value.s.len;
+            break;
+
+        default:
+            return false;
+    }
+
+    if (program->consts_len == program->consts_cap)
+    {
+        uint32_t cap = program->consts_cap == 0 ? 64 : program->consts_cap * 2;
+        vm_value_t* consts = realloc(program->consts, cap * sizeof(vm_value_t));
+
+        if (!consts)
+        {
+            if (value.type == VM_T_STRING)
+            {
+                vm_string_release(value.s.data);
+            }
+
+            return false;
+        }
+
+        program->consts = consts;
+        program->consts_cap = cap;
+    }
+
+    program->consts[program->consts_len] = value;
+    *index = program->consts_len++;
+
+    return !reader->error;
+}
+
+static bool read_operand(reader_t* reader, vm_program_t* program, char signature, vm_operand_t* operand)
+{
+    switch (signature)
+    {
+        case 'l':
+            operand->kind = VM_OPND_LABEL;
+            operand->hint = read_index(reader, program->labels_len);
+            operand->index = reader->error ? VM_NO_TARGET : program->labels[operand->hint].target;
+            return !reader->error;
+
+        case 't':
+            operand->kind = VM_OPND_TYPE;
+            operand->index = read_byte(reader);
+            return !reader->error && operand->index >= VM_T_NIL && operand->index <= VM_T_STRING;
+
+        default:
+            operand->kind = read_byte(reader);
+            break;
+    }
+
+    switch (operand->kind)
+    {
+        case VM_OPND_GF:
+        case VM_OPND_LF:
+        case VM_OPND_TF:
+            operand->index = read_index(reader, program->names_len);
+            return !reader->error;
+
+        case VM_OPND_CONST:
+            return signature == 's' && read_const(reader, program, &operand->index);
+
+        default:
+            return false;
+    }
+}
+
+static bool read_program(reader_t* reader, vm_program_t* program)
+{
+    uint64_t count = read_uint(reader);
+
+    // every entry takes at least one byte
+    if (reader->error || count > reader->len)
+    {
+        return false;
+    }
+
+    program->names = calloc(count + 1, sizeof(char*));
+    program->names_cap = (uint32_t)count + 1;
+
+    for (; program->names && program->names_len < count; program->names_len++)
+    {
+        if (!(program->names[program->names_len] = read_bytes(reader, NULL)))
+        {
+            return false;
+        }
+    }
+
+    count = read_uint(reader);
+
+    if (!program->names || reader->error || count > reader->len)
+    {
+        return false;
+    }
+
+    program->labels = calloc(count + 1, sizeof(vm_label_t));
+    program->labels_cap = (uint32_t)count + 1;
+
+    for (; program->labels && program->labels_len < count; program->labels_len++)
+    {
+        vm_label_t* label = &program->labels[program->labels_len];
+
+        if (!(label->name = read_bytes(reader, NULL)))
+        {
+            return false;
+        }
+
+        uint64_t target = read_uint(reader);
+
+        label->target = target == 0 ? VM_NO_TARGET : (uint32_t)(target - 1);
+    }
+
+    count = read_uint(reader);
+
+    if (!program->labels || reader->error || count > reader->len)
+    {
+        return false;
+    }
+
+    program->code = calloc(count + 1, sizeof(vm_instr_t));
+    program->code_cap = (uint32_t)count + 1;
+
+    for (; program->code && program->code_len < count; program->code_len++)
+    {
+        vm_instr_t* instr = &program->code[program->code_len];
+
+        instr->opcode = read_byte(reader);
+        instr->line = (uint32_t)read_uint(reader);
+
+        if (reader->error || instr->opcode >= VM_OPCODE_COUNT)
+        {
+            return false;
+        }
+
+        const char* operands = vm_opcode_operands(instr->opcode);
+
+        for (int j = 0; operands[j]; j++)
+        {
+            if (!read_operand(reader, program, operands[j], &instr->op[j]))
+            {
+                return false;
+            }
+        }
+    }
+
+    if (!program->code)
+    {
+        return false;
+    }
+
+    // targets behind the end of program are invalid
+    for (uint32_t i = 0; i < program->labels_len; i++)
+    {
+        if (program->labels[i].target != VM_NO_TARGET && program->labels[i].target > program->code_len)
+        {
+            return false;
+        }
+    }
+
+    return reader->pos == reader->len;
+}
+
+bool vm_is_object(const char* data, size_t len)
+{
+    return len >= OBJECT_MAGIC_LEN && memcmp(data, OBJECT_MAGIC, OBJECT_MAGIC_LEN) == 0;
+}
+
+vm_error_t vm_object_parse(const char* data, size_t len, vm_program_t* program)
+{
+    reader_t reader = {(const unsigned char*)data, len, OBJECT_MAGIC_LEN, false};
+
+    if (!vm_is_object(data, len) || read_byte(&reader) != OBJECT_VERSION || !read_program(&reader, program))
+    {
+        fprintf(stderr, "Invalid IFJcode21 object!\n");
+        return VM_E_SYNTAX;
+    }
+
+    return VM_OK;
+}
+
+/*
+ * Disassembler
+ */
+
+static void print_string(FILE* file, const vm_string_t* string)
+{
+    for (size_t i = 0; i < string->len; i++)
+    {
+        unsigned char c = (unsigned char)string->data[i];
+
+        if (c <= ' ' || c == '#' || c == '\\')
+        {
+            fprintf(file, "\\%03u", c);
+        }
+        else
+        {
+            putc(c, file);
+        }
+    }
+}
+
+static void print_operand(FILE* file, const vm_program_t* program, const vm_operand_t* operand)
+{
+    static const char* frames[] = {"", "GF", "LF", "TF"};
+    static const char* types[] = {"", "nil", "int", "float", "bool", "string"};
+    const vm_value_t* value;
+
+    switch (operand->kind)
+    {
+        case VM_OPND_GF:
+        case VM_OPND_LF:
+        case VM_OPND_TF:
+            fprintf(file, " %s@%s", frames[operand->kind], program->names[operand->index]);
+            break;
+
+        case VM_OPND_LABEL:
+            fprintf(file, " %s", program->labels[operand->hint].name);
+            break;
+
+        case VM_OPND_TYPE:
+            fprintf(file, " %s", types[operand->index]);
+            break;
+
+        case VM_OPND_CONST:
+            value = &program->consts[operand->index];
+
+            switch (value->type)
+            {
+                case VM_T_INT:
+                    fprintf(file, " int@%lld", (long long)value->i);
+                    break;
+                case VM_T_FLOAT:
+                    fprintf(file, " float@%a", value->f);
+                    break;
+                case VM_T_BOOL:
+                    fprintf(file, " bool@%s", value->b ? "true" : "false");
+                    break;
+                case VM_T_STRING:
+                    fprintf(file, " string@");
+                    print_string(file, &value->s);
+                    break;
+                default:
+                    fprintf(file, " nil@nil");
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void vm_disassemble(FILE* file, const vm_program_t* program)
+{
+    // labels are printed in order of their definition, bucketed by target
+    uint32_t* first = malloc((program->code_len + 2) * sizeof(uint32_t));
+    uint32_t* order = malloc((program->labels_len + 1) * sizeof(uint32_t));
+
+    if (!first || !order)
+    {
+        free(first);
+        free(order);
+        return;
+    }
+
+    memset(first, 0, (program->code_len + 2) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < program->labels_len; i++)
+    {
+        if (program->labels[i].target != VM_NO_TARGET)
+        {
+            first[program->labels[i].target + 1]++;
+        }
+    }
+
+    for (uint32_t i = 1; i <= program->code_len + 1; i++)
+    {
+        first[i] += first[i - 1];
+    }
+
+    for (uint32_t i = 0; i < program->labels_len; i++)
+    {
+        if (program->labels[i].target != VM_NO_TARGET)
+        {
+            order[first[program->labels[i].target]++] = i;
+        }
+    }
+
+    fprintf(file, ".IFJcode21\n");
+
+    uint32_t next = 0;
+
+    for (uint32_t ip = 0; ip <= program->code_len; ip++)
+    {
+        // first[ip] now points behind the labels of instruction ip
+        for (; next < first[ip]; next++)
+        {
+            fprintf(file, "LABEL %s\n", program->labels[order[next]].name);
+        }
+
+        if (ip == program->code_len)
+        {
+            break;
+        }
+
+        const vm_instr_t* instr = &program->code[ip];
+        const char* operands = vm_opcode_operands(instr->opcode);
+
+        fprintf(file, "%s", vm_opcode_name(instr->opcode));
+
+        for (int j = 0; operands[j]; j++)
+        {
+            print_operand(file, program, &instr->op[j]);
+        }
+
+        fprintf(file, "\n");
+    }
+
+    free(first);
+    free(order);
+}
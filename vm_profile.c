@@ -0,0 +1,537 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - profiler of executed instructions and calls
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm_profile.h"
+
+#define NODES_INIT_SIZE 64
+
+/**
+ * @struct Row of a table of the report.
+ */
+typedef struct row
+{
+    uint64_t value;
+    uint32_t index;
+} row_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static const char* function_name(const vm_profile_t* profile, uint32_t function)
+{
+    return function == VM_PROFILE_PROGRAM ? "<program>" : profile->program->labels[function - 1].name;
+}
+
+bool vm_profile_init(vm_profile_t* profile, const vm_program_t* program)
+{
+    memset(profile, 0, sizeof(vm_profile_t));
+
+    profile->program = program;
+    // the sentinel behind the last instruction is executed too
+    profile->counts = calloc(program->code_len + 1, sizeof(uint64_t));
+    profile->functions = calloc(program->labels_len + 1, sizeof(vm_profile_function_t));
+    profile->nodes = calloc(NODES_INIT_SIZE, sizeof(vm_profile_node_t));
+    profile->stack = malloc(NODES_INIT_SIZE * sizeof(uint32_t));
+
+    if (!profile->counts || !profile->functions || !profile->nodes || !profile->stack)
+    {
+        vm_profile_free(profile);
+        return false;
+    }
+
+    profile->nodes_len = 1;
+    profile->nodes_cap = NODES_INIT_SIZE;
+    profile->stack[profile->stack_len++] = 0;
+    profile->stack_cap = NODES_INIT_SIZE;
+
+    profile->last_ns = now_ns();
+    profile->functions[VM_PROFILE_PROGRAM].calls = 1;
+    profile->functions[VM_PROFILE_PROGRAM].active = 1;
+    profile->functions[VM_PROFILE_PROGRAM].enter_ns = profile->last_ns;
+
+    return true;
+}
+
+/*
+ * Time and instructions since the last event belong to the running function
+ */
+static void account(vm_profile_t* profile, uint64_t now)
+{
+    vm_profile_node_t* node = &profile->nodes[profile->stack[profile->stack_len - 1]];
+    vm_profile_function_t* function = &profile->functions[node->function];
+    uint64_t ns = now - profile->last_ns;
+    uint64_t steps = profile->steps - profile->last_steps;
+
+    node->excl_ns += ns;
+    node->excl_steps += steps;
+    function->excl_ns += ns;
+    function->excl_steps += steps;
+
+    profile->last_ns = now;
+    profile->last_steps = profile->steps;
+}
+
+/*
+ * Node of the function called from the node, it is created on the first call
+ */
+static uint32_t callee(vm_profile_t* profile, uint32_t parent, uint32_t function)
+{
+    uint32_t index = profile->nodes[parent].child;
+
+    while (index != 0)
+    {
+        if (profile->nodes[index].function == function)
+        {
+            return index;
+        }
+
+        index = profile->nodes[index].sibling;
+    }
+
+    if (profile->nodes_len == profile->nodes_cap)
+    {
+        vm_profile_node_t* nodes = realloc(profile->nodes, profile->nodes_cap * 2 * sizeof(vm_profile_node_t));
+
+        if (!nodes)
+        {
+            return 0;
+        }
+
+        profile->nodes = nodes;
+        profile->nodes_cap *= 2;
+    }
+
+    index = profile->nodes_len++;
+
+    vm_profile_node_t* node = &profile->nodes[index];
+
+    memset(node, 0, sizeof(vm_profile_node_t));
+    node->function = function;
+    node->parent = parent;
+    node->sibling = profile->nodes[parent].child;
+    profile->nodes[parent].child = index;
+
+    return index;
+}
+
+void vm_profile_call(vm_profile_t* profile, uint32_t label)
+{
+    // without memory the time is left to the last known call
+    if (profile->incomplete)
+    {
+        return;
+    }
+
+    if (profile->stack_len == profile->stack_cap)
+    {
+        uint32_t* stack = realloc(profile->stack, profile->stack_cap * 2 * sizeof(uint32_t));
+
+        if (!stack)
+        {
+            profile->incomplete = true;
+            return;
+        }
+
+        profile->stack = stack;
+        profile->stack_cap *= 2;
+    }
+
+    uint32_t function = label + 1;
+    uint32_t node = callee(profile, profile->stack[profile->stack_len - 1], function);
+
+    if (node == 0)
+    {
+        profile->incomplete = true;
+        return;
+    }
+
+    uint64_t now = now_ns();
+    vm_profile_function_t* totals = &profile->functions[function];
+
+    account(profile, now);
+
+    totals->calls++;
+
+    if (totals->active++ == 0)
+    {
+        totals->enter_ns = now;
+        totals->enter_steps = profile->steps;
+    }
+
+    profile->nodes[node].calls++;
+    profile->stack[profile->stack_len++] = node;
+}
+
+/*
+ * Leave the top call, the outermost activation ends the inclusive time
+ */
+static void leave(vm_profile_t* profile, uint64_t now)
+{
+    vm_profile_node_t* node = &profile->nodes[profile->stack[--profile->stack_len]];
+    vm_profile_function_t* totals = &profile->functions[node->function];
+
+    if (--totals->active == 0)
+    {
+        totals->incl_ns += now - totals->enter_ns;
+        totals->incl_steps += profile->steps - totals->enter_steps;
+    }
+}
+
+void vm_profile_return(vm_profile_t* profile)
+{
+    // RETURN without CALL fails in the interpreter
+    if (profile->incomplete || profile->stack_len <= 1)
+    {
+        return;
+    }
+
+    uint64_t now = now_ns();
+
+    account(profile, now);
+    leave(profile, now);
+}
+
+void vm_profile_finish(vm_profile_t* profile)
+{
+    uint64_t now = now_ns();
+
+    account(profile, now);
+
+    while (profile->stack_len > 0)
+    {
+        leave(profile, now);
+    }
+}
+
+static int compare_rows(const void* a, const void* b)
+{
+    const row_t* x = a;
+    const row_t* y = b;
+
+    if (x->value != y->value)
+    {
+        return x->value < y->value ? 1 : -1;
+    }
+
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+static void report_functions(const vm_profile_t* profile, FILE* file, unsigned top, row_t* rows)
+{
+    const vm_profile_function_t* functions = profile->functions;
+    uint32_t len = 0;
+
+    for (uint32_t i = 0; i <= profile->program->labels_len; i++)
+    {
+        if (functions[i].calls > 0)
+        {
+            rows[len].value = functions[i].excl_ns;
+            rows[len++].index = i;
+        }
+    }
+
+    qsort(rows, len, sizeof(row_t), compare_rows);
+
+    fprintf(file, "\nFunctions by exclusive time:\n");
+    fprintf(file, "%10s %12s %12s %7s %14s %14s  %s\n",
+            "calls", "incl_ms", "excl_ms", "excl_%", "incl_instr", "excl_instr", "function");
+
+    for (uint32_t i = 0; i < len && i < top; i++)
+    {
+        const vm_profile_function_t* function = &functions[rows[i].index];
+
+        fprintf(file, "%10" PRIu64 " %12.3f %12.3f %6.2f%% %14" PRIu64 " %14" PRIu64 "  %s\n",
+                function->calls, function->incl_ns / 1e6, function->excl_ns / 1e6,
+                percent(function->excl_ns, functions[VM_PROFILE_PROGRAM].incl_ns),
+                function->incl_steps, function->excl_steps, function_name(profile, rows[i].index));
+    }
+}
+
+/*
+ * Label region is the code from the label to the next label
+ */
+static void report_labels(const vm_profile_t* profile, FILE* file, unsigned top, row_t* rows)
+{
+    const vm_program_t* program = profile->program;
+    uint32_t len = 0;
+
+    for (uint32_t i = 0; i < program->labels_len; i++)
+    {
+        if (program->labels[i].target != VM_NO_TARGET)
+        {
+            rows[len].value = program->labels[i].target;
+            rows[len++].index = i;
+        }
+    }
+
+    // ascending order of targets
+    qsort(rows, len, sizeof(row_t), compare_rows);
+
+    for (uint32_t i = 0; i < len / 2; i++)
+    {
+        row_t tmp = rows[i];
+
+        rows[i] = rows[len - 1 - i];
+        rows[len - 1 - i] = tmp;
+    }
+
+    // code in front of the first label is the region of the program
+    uint32_t start = 0;
+    uint32_t regions = 0;
+    uint32_t label = UINT32_MAX;
+
+    for (uint32_t i = 0; i <= len; i++)
+    {
+        uint32_t end = i < len ? (uint32_t)rows[i].value : program->code_len + 1;
+        uint32_t next = i < len ? rows[i].index : UINT32_MAX;
+        uint64_t count = 0;
+
+        for (uint32_t k = start; k < end; k++)
+        {
+            count += profile->counts[k];
+        }
+
+        if (count > 0)
+        {
+            rows[regions].value = count;
+            rows[regions++].index = label;
+        }
+
+        // rows of targets are overwritten by the regions behind them
+        start = end;
+        label = next;
+    }
+
+    qsort(rows, regions, sizeof(row_t), compare_rows);
+
+    fprintf(file, "\nLabel regions by executed instructions:\n");
+    fprintf(file, "%14s %7s  %s\n", "instructions", "%", "label");
+
+    for (uint32_t i = 0; i < regions && i < top; i++)
+    {
+        fprintf(file, "%14" PRIu64 " %6.2f%%  %s\n", rows[i].value, percent(rows[i].value, profile->steps),
+                rows[i].index == UINT32_MAX ? "<program>" : program->labels[rows[i].index].name);
+    }
+}
+
+static void report_opcodes(const vm_profile_t* profile, FILE* file, unsigned top, row_t* rows)
+{
+    const vm_program_t* program = profile->program;
+    uint32_t len = 0;
+
+    for (uint32_t op = 0; op < VM_OPCODE_COUNT; op++)
+    {
+        rows[op].value = 0;
+        rows[op].index = op;
+    }
+
+    for (uint32_t k = 0; k < program->code_len; k++)
+    {
+        rows[program->code[k].opcode].value += profile->counts[k];
+    }
+
+    qsort(rows, VM_OPCODE_COUNT, sizeof(row_t), compare_rows);
+
+    while (len < VM_OPCODE_COUNT && rows[len].value > 0)
+    {
+        len++;
+    }
+
+    fprintf(file, "\nOpcodes by executed instructions:\n");
+    fprintf(file, "%14s %7s  %s\n", "instructions", "%", "opcode");
+
+    for (uint32_t i = 0; i < len && i < top; i++)
+    {
+        fprintf(file, "%14" PRIu64 " %6.2f%%  %s\n", rows[i].value, percent(rows[i].value, profile->steps),
+                vm_opcode_name((vm_opcode_t)rows[i].index));
+    }
+}
+
+/*
+ * Lines of the IFJ21 source by the source map, line 0 is generated code
+ */
+static void report_source_lines(const vm_profile_t* profile, FILE* file, unsigned top)
+{
+    const vm_program_t* program = profile->program;
+    uint32_t last = 0;
+
+    for (uint32_t k = 0; k < program->code_len; k++)
+    {
+        if (program->source_lines[k] > last)
+        {
+            last = program->source_lines[k];
+        }
+    }
+
+    uint64_t* counts = calloc((size_t)last + 1, sizeof(uint64_t));
+    row_t* rows = malloc(((size_t)last + 1) * sizeof(row_t));
+    uint32_t len = 0;
+
+    if (!counts || !rows)
+    {
+        free(counts);
+        free(rows);
+        return;
+    }
+
+    // the sentinel is generated code
+    for (uint32_t k = 0; k <= program->code_len; k++)
+    {
+        counts[program->source_lines[k]] += profile->counts[k];
+    }
+
+    for (uint32_t line = 0; line <= last; line++)
+    {
+        if (counts[line] > 0)
+        {
+            rows[len].value = counts[line];
+            rows[len++].index = line;
+        }
+    }
+
+    qsort(rows, len, sizeof(row_t), compare_rows);
+
+    fprintf(file, "\nSource lines by executed instructions:\n");
+    fprintf(file, "%14s %7s  %s\n", "instructions", "%", "line");
+
+    for (uint32_t i = 0; i < len && i < top; i++)
+    {
+        if (rows[i].index == 0)
+        {
+            fprintf(file, "%14" PRIu64 " %6.2f%%  <generated>\n", rows[i].value, percent(rows[i].value, profile->steps));
+        }
+        else
+        {
+            fprintf(file, "%14" PRIu64 " %6.2f%%  %" PRIu32 "\n", rows[i].value, percent(rows[i].value, profile->steps),
+                    rows[i].index);
+        }
+    }
+
+    free(counts);
+    free(rows);
+}
+
+void vm_profile_report(const vm_profile_t* profile, FILE* file, unsigned top)
+{
+    const vm_program_t* program = profile->program;
+    uint32_t size = program->labels_len + 1;
+
+    if (size < VM_OPCODE_COUNT)
+    {
+        size = VM_OPCODE_COUNT;
+    }
+
+    row_t* rows = malloc(size * sizeof(row_t));
+    uint64_t calls = 0;
+
+    for (uint32_t i = 1; i <= program->labels_len; i++)
+    {
+        calls += profile->functions[i].calls;
+    }
+
+    fprintf(file, "Profile: %" PRIu64 " instructions, %" PRIu64 " calls, %.3f ms\n",
+            profile->steps, calls, profile->functions[VM_PROFILE_PROGRAM].incl_ns / 1e6);
+
+    if (!rows)
+    {
+        return;
+    }
+
+    report_functions(profile, file, top, rows);
+    report_labels(profile, file, top, rows);
+    report_opcodes(profile, file, top, rows);
+
+    if (program->source_lines)
+    {
+        report_source_lines(profile, file, top);
+    }
+
+    if (profile->incomplete)
+    {
+        fprintf(file, "\nCalling contexts are incomplete (out of memory).\n");
+    }
+
+    free(rows);
+}
+
+bool vm_profile_folded(const vm_profile_t* profile, FILE* file)
+{
+    uint32_t* path = malloc(profile->nodes_len * sizeof(uint32_t));
+    uint32_t depth = 0;
+    uint32_t node = 0;
+
+    if (!path)
+    {
+        return false;
+    }
+
+    // depth first walk of the calling context tree
+    for (;;)
+    {
+        path[depth++] = node;
+
+        if (profile->nodes[node].excl_ns > 0)
+        {
+            for (uint32_t i = 0; i < depth; i++)
+            {
+                fprintf(file, "%s%s", i > 0 ? ";" : "", function_name(profile, profile->nodes[path[i]].function));
+            }
+
+            fprintf(file, " %" PRIu64 "\n", profile->nodes[node].excl_ns);
+        }
+
+        if (profile->nodes[node].child != 0)
+        {
+            node = profile->nodes[node].child;
+            continue;
+        }
+
+        while (depth > 0 && profile->nodes[path[depth - 1]].sibling == 0)
+        {
+            depth--;
+        }
+
+        if (depth == 0)
+        {
+            break;
+        }
+
+        node = profile->nodes[path[--depth]].sibling;
+    }
+
+    free(path);
+
+    return !ferror(file);
+}
+
+void vm_profile_free(vm_profile_t* profile)
+{
+    free(profile->counts);
+    free(profile->functions);
+    free(profile->nodes);
+    free(profile->stack);
+
+    memset(profile, 0, sizeof(vm_profile_t));
+}
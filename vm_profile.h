@@ -0,0 +1,139 @@
+/**
+ * Project: IFJ21 imperative language compiler
+ *
+ * Brief:   IFJcode21 interpreter - profiler of executed instructions and calls
+ *
+ */
+
+#ifndef IFJ_BRATWURST2021_VM_PROFILE_H
+#define IFJ_BRATWURST2021_VM_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+/* Default count of rows of every table of the report */
+#define VM_PROFILE_TOP 20
+
+/*
+ * Functions are CALL targets, function i + 1 is label i of the program,
+ * function 0 is the code outside of any call
+ */
+#define VM_PROFILE_PROGRAM 0
+
+/**
+ * @struct Function in one calling context (node of the calling context tree).
+ */
+typedef struct vm_profile_node
+{
+    uint32_t function;
+    uint32_t parent;
+    uint32_t child;       /// First called function or 0.
+    uint32_t sibling;     /// Next function called by the parent or 0.
+    uint64_t calls;
+    uint64_t excl_ns;
+    uint64_t excl_steps;
+} vm_profile_node_t;
+
+/**
+ * @struct Totals of one function. Inclusive values are measured from the
+ *         outermost activation, recursive calls are not counted twice.
+ */
+typedef struct vm_profile_function
+{
+    uint64_t calls;
+    uint64_t incl_ns;
+    uint64_t excl_ns;
+    uint64_t incl_steps;
+    uint64_t excl_steps;
+    uint32_t active;      /// Activations on the call stack.
+    uint64_t enter_ns;
+    uint64_t enter_steps;
+} vm_profile_function_t;
+
+/**
+ * @struct Profile of one run. Instructions are counted by the interpreter,
+ *         calls and returns measure the time.
+ */
+typedef struct vm_profile
+{
+    const vm_program_t* program;
+    uint64_t* counts;     /// Executions of every instruction.
+    uint64_t steps;       /// All executed instructions.
+
+    vm_profile_function_t* functions;
+
+    vm_profile_node_t* nodes;
+    uint32_t nodes_len;
+    uint32_t nodes_cap;
+
+    uint32_t* stack;      /// Nodes of the active calls, the first is the program.
+    uint32_t stack_len;
+    uint32_t stack_cap;
+
+    uint64_t last_ns;     /// Time of the last call or return.
+    uint64_t last_steps;
+    bool incomplete;      /// Calling contexts were not recorded (out of memory).
+} vm_profile_t;
+
+/**
+ * Prepare empty profile of the program, time is measured from now.
+ *
+ * @param profile Profile to initialize.
+ * @param program Loaded program.
+ * @return True on success.
+ */
+bool vm_profile_init(vm_profile_t* profile, const vm_program_t* program);
+
+/**
+ * Enter the function called by CALL.
+ *
+ * @param profile Profile.
+ * @param label Label of the CALL target.
+ */
+void vm_profile_call(vm_profile_t* profile, uint32_t label);
+
+/**
+ * Leave the function by RETURN.
+ *
+ * @param profile Profile.
+ */
+void vm_profile_return(vm_profile_t* profile);
+
+/**
+ * Stop the time at the end of the run, active calls are left.
+ *
+ * @param profile Profile.
+ */
+void vm_profile_finish(vm_profile_t* profile);
+
+/**
+ * Plain text report, the hottest functions, label regions, opcodes and
+ * source lines (when the program has a source map).
+ *
+ * @param profile Finished profile.
+ * @param file Output stream.
+ * @param top Rows of every table.
+ */
+void vm_profile_report(const vm_profile_t* profile, FILE* file, unsigned top);
+
+/**
+ * Folded stacks for flame graph tools, one line per calling context
+ * with its exclusive time in nanoseconds.
+ *
+ * @param profile Finished profile.
+ * @param file Output stream.
+ * @return True on success.
+ */
+bool vm_profile_folded(const vm_profile_t* profile, FILE* file);
+
+/**
+ * Release all memory of the profile.
+ *
+ * @param profile Profile.
+ */
+void vm_profile_free(vm_profile_t* profile);
+
+#endif //IFJ_BRATWURST2021_VM_PROFILE_H